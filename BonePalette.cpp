@@ -0,0 +1,83 @@
+//--------------------------------------------------------------------------------------
+//	BonePalette.cpp
+//
+//	The node matrices of all the skinned models drawn in a frame, gathered into one
+//	constant buffer for the skinned vertex shaders. Uploaded once per frame, so both eyes
+//	share it
+//--------------------------------------------------------------------------------------
+
+#include "Defines.h"     // General definitions shared by all source files
+#include "BonePalette.h" // Declaration of this class
+#include "ResourceRegistry.h" // Counted in the buffer memory
+
+
+///////////////////////////////
+// Constructors / Destructors
+
+CBonePalette::CBonePalette()
+{
+	m_Buffer = NULL;
+}
+
+CBonePalette::~CBonePalette()
+{
+	ReleaseResources();
+}
+
+// Create the constant buffer. Returns true on success
+bool CBonePalette::Init()
+{
+	ReleaseResources();
+	m_Matrices.reserve( MaxMatrices );
+
+	// Rewritten every frame, so dynamic
+	D3D10_BUFFER_DESC bufferDesc;
+	bufferDesc.BindFlags = D3D10_BIND_CONSTANT_BUFFER;
+	bufferDesc.Usage = D3D10_USAGE_DYNAMIC;
+	bufferDesc.ByteWidth = MaxMatrices * sizeof(D3DXMATRIX);
+	bufferDesc.CPUAccessFlags = D3D10_CPU_ACCESS_WRITE;
+	bufferDesc.MiscFlags = 0;
+	return SUCCEEDED( g_Resources.CreateBuffer( ResourceBuffer, &bufferDesc, NULL, &m_Buffer ) );
+}
+
+// Release the constant buffer
+void CBonePalette::ReleaseResources()
+{
+	SAFE_RELEASE( m_Buffer );
+}
+
+
+/////////////////////////////
+// Palette building
+
+// Add the world matrices of a model's nodes to the palette and set the model's palette offset (see CModel::SetPaletteOffset), so its
+// skinned vertices can find them. Returns false, leaving the palette unchanged, if there isn't room for all the nodes
+bool CBonePalette::AddModel( CModel* model )
+{
+	// The mesh matrices take the model space vertices to world space as moved by each node. The vertices are stored in the default
+	// pose (see CMesh::Load), so that is the pose the skin weights are relative to
+	unsigned int numNodes = model->GetNumNodes();
+	if (m_Matrices.size() + numNodes > MaxMatrices)
+	{
+		return false;
+	}
+	model->SetPaletteOffset( static_cast<unsigned int>(m_Matrices.size()) );
+	for (unsigned int node = 0; node < numNodes; ++node)
+	{
+		m_Matrices.push_back( model->GetNodeMeshMatrix( node ) );
+	}
+	return true;
+}
+
+// Copy the matrices added since the last Clear to the constant buffer. The rest of the buffer is left undefined, no vertex uses it
+void CBonePalette::Upload()
+{
+	if (m_Matrices.empty()) return;
+
+	void* bufferData;
+	if (SUCCEEDED( m_Buffer->Map( D3D10_MAP_WRITE_DISCARD, 0, &bufferData ) ))
+	{
+		memcpy( bufferData, &m_Matrices[0], m_Matrices.size() * sizeof(D3DXMATRIX) );
+		m_Buffer->Unmap();
+	}
+}
@@ -0,0 +1,94 @@
+//--------------------------------------------------------------------------------------
+//	BonePalette.h
+//
+//	The node matrices of all the skinned models drawn in a frame, gathered into one
+//	constant buffer for the skinned vertex shaders. Uploaded once per frame, so both eyes
+//	share it
+//--------------------------------------------------------------------------------------
+
+#ifndef BONE_PALETTE_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define BONE_PALETTE_H_INCLUDED
+
+#include <vector>
+using namespace std;
+
+#include <d3d10.h>
+#include <d3dx10.h>
+#include "Model.h"
+
+
+class CBonePalette
+{
+/////////////////////////////
+// Public constants
+public:
+
+	// Most matrices in the palette, a 64KB constant buffer is the largest allowed. Must match MAX_BONE_MATRICES in Stereoscopic.fx
+	static const unsigned int MaxMatrices = 1024;
+
+
+/////////////////////////////
+// Private member variables
+private:
+
+	// CPU copy of the palette, built up as models are added then copied over in one go
+	vector<D3DXMATRIX> m_Matrices;
+
+	// Dynamic constant buffer bound to the BonePalette cbuffer in the shaders
+	ID3D10Buffer*      m_Buffer;
+
+
+/////////////////////////////
+// Public member functions
+public:
+
+	///////////////////////////////
+	// Constructors / Destructors
+
+	CBonePalette();
+	~CBonePalette();
+
+	// Create the constant buffer. Returns true on success
+	bool Init();
+
+	// Release the constant buffer
+	void ReleaseResources();
+
+
+	/////////////////////////////
+	// Palette building
+
+	// Empty the palette, ready for a new frame
+	void Clear()
+	{
+		m_Matrices.clear();
+	}
+
+	// Add the world matrices of a model's nodes to the palette and set the model's palette offset (see CModel::SetPaletteOffset), so
+	// its skinned vertices can find them. Returns false, leaving the palette unchanged, if there isn't room for all the nodes
+	bool AddModel( CModel* model );
+
+	// Copy the matrices added since the last Clear to the constant buffer
+	void Upload();
+
+	unsigned int GetNumMatrices()
+	{
+		return static_cast<unsigned int>(m_Matrices.size());
+	}
+	ID3D10Buffer* GetBuffer()
+	{
+		return m_Buffer;
+	}
+
+
+/////////////////////////////
+// Private member functions
+private:
+
+	// Disallow use of copy constructor and assignment operator (private and not defined)
+	CBonePalette( const CBonePalette& );
+	CBonePalette& operator=( const CBonePalette& );
+};
+
+
+#endif // End of header guard - see top of file
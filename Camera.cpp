@@ -6,6 +6,7 @@
 
 #include "Defines.h" // General definitions shared by all source files
 #include "Camera.h"  // Declaration of this class
+#include "CMatrix4x4.h" // Maths library matrix, used for its cheap rigid-transform inverse and direct matrix building
 
 ///////////////////////////////
 // Constructors / Destructors
@@ -15,7 +16,11 @@ CCamera::CCamera( D3DXVECTOR3 position, D3DXVECTOR3 rotation, float fov, float n
 {
 	m_Position = position;
 	m_Rotation = rotation;
-	m_Aspect = 1.333f; // Shouldn't be hard-coded (viewport width / viewport height)
+	m_UseQuaternion = false;
+	m_Orientation = gen::CQuaternion::kIdentity;
+	m_Aspect = (g_ViewportHeight > 0) ? static_cast<float>(g_ViewportWidth) / g_ViewportHeight : 1.333f; // Update with SetAspect if the viewport changes
+	m_Interocular = 0.65f;
+	m_ScreenDistance = 20.0f;
 
 	SetFOV( fov );
 	SetNearClip( nearClip );
@@ -30,111 +35,169 @@ CCamera::CCamera( D3DXVECTOR3 position, D3DXVECTOR3 rotation, float fov, float n
 
 // Update the matrices used for the camera in the rendering pipeline. Treat the camera like a model and create a world matrix for it. Then convert that into
 // the view matrix that the rendering pipeline actually uses. Also create the projection matrix
-//**** These matrices are created for a monoscopic camera, the getters below adjust for left/right eye
+//**|3D|** The matrices for the left and right eye are created here too, once per frame, so the getters only need to return them
 void CCamera::UpdateMatrices()
 {
-	// Make matrices for position and rotations, then multiply together to get a "camera world matrix"
-	D3DXMATRIXA16 matrixXRot, matrixYRot, matrixZRot, matrixTranslation;
-	D3DXMatrixRotationX( &matrixXRot, m_Rotation.x );
-	D3DXMatrixRotationY( &matrixYRot, m_Rotation.y );
-	D3DXMatrixRotationZ( &matrixZRot, m_Rotation.z );
-	D3DXMatrixTranslation( &matrixTranslation, m_Position.x, m_Position.y, m_Position.z);
-	m_WorldMatrix = matrixZRot * matrixXRot * matrixYRot * matrixTranslation;
-
-	// The rendering pipeline actually needs the inverse of the camera world matrix - called the view matrix. Creating an inverse is easy with DirectX:
-	D3DXMatrixInverse( &m_ViewMatrix, NULL, &m_WorldMatrix );
+	// Make a "camera world matrix" from the position and rotations: Z, X then Y rotation followed by the translation. The maths library
+	// builds it directly rather than multiplying separate matrices (the vector and matrix layouts are the same as D3DX). A quaternion
+	// orientation needs no sines or cosines at all
+	if (m_UseQuaternion)
+	{
+		gen::MatrixAffineQuaternion( reinterpret_cast<gen::CMatrix4x4*>(&m_WorldMatrix), reinterpret_cast<const gen::CVector3*>(&m_Position),
+		                             &m_Orientation, &gen::CVector3::kOne, 1 );
+	}
+	else
+	{
+		gen::MatrixAffineEulerZXY( reinterpret_cast<gen::CMatrix4x4*>(&m_WorldMatrix), reinterpret_cast<const gen::CVector3*>(&m_Position),
+		                           reinterpret_cast<const gen::CVector3*>(&m_Rotation), &gen::CVector3::kOne, 1 );
+	}
 
 	// Initialize the projection matrix. This determines viewing properties of the camera such as field of view (FOV) and near clip distance
 	// One other factor in the projection matrix is the aspect ratio of screen (width/height) - used to adjust FOV between horizontal and vertical
-	float aspect = (float)g_ViewportWidth / g_ViewportHeight; 
-	D3DXMatrixPerspectiveFovLH( &m_ProjMatrix, m_FOV, m_Aspect, m_NearClip, m_FarClip );
+	D3DXMATRIXA16 projMatrix;
+	D3DXMatrixPerspectiveFovLH( &projMatrix, m_FOV, m_Aspect, m_NearClip, m_FarClip );
 
-	// Combine the view and projection matrix into a single matrix - which can (optionally) be used in the vertex shaders to save one matrix multiply per vertex
-	m_ViewProjMatrix = m_ViewMatrix * m_ProjMatrix;
-}
+	for (int eye = 0; eye < NumEyes; ++eye)
+	{
+		SEyeMatrices& matrices = m_Eyes[eye];
+
+		//**|3D|** Offset camera by half interocular distance left or right as appropriate, along its local x-axis
+		float offset = 0.0f;
+		if (eye == StereoscopicLeft)  offset =  0.5f * m_Interocular;
+		if (eye == StereoscopicRight) offset = -0.5f * m_Interocular;
+
+		D3DXMATRIXA16 worldMatrix = m_WorldMatrix;
+		worldMatrix._41 += offset * worldMatrix._11;
+		worldMatrix._42 += offset * worldMatrix._12;
+		worldMatrix._43 += offset * worldMatrix._13;
+		matrices.Position = D3DXVECTOR3( worldMatrix._41, worldMatrix._42, worldMatrix._43 );
+
+		// The rendering pipeline actually needs the inverse of the camera world matrix - called the view matrix. The camera world matrix has
+		// only rotation and translation so the cheap inverse from the maths library can be used (the matrix layouts are the same)
+		matrices.ViewMatrix = worldMatrix;
+		reinterpret_cast<gen::CMatrix4x4*>(&matrices.ViewMatrix)->InvertRotTrans();
+
+		//**|3D|** Offset viewing frustum based on camera offset (as discussed in lecture)
+		matrices.ProjMatrix = projMatrix;
+		matrices.ProjMatrix._31 = (offset / m_ScreenDistance) / (m_Aspect * tanf(m_FOV/2));
+
+		// Combine the view and projection matrix into a single matrix - which can (optionally) be used in the vertex shaders to save one matrix multiply per vertex
+		matrices.ViewProjMatrix = matrices.ViewMatrix * matrices.ProjMatrix;
+		matrices.Frustum.ExtractFromMatrix( matrices.ViewProjMatrix );
+	}
 
+	UpdateStereoFrustum();
+}
 
-//**|3D|*********************************/
-// Camera matrix access / stereo offsets
 
-// Get position of the camera. If a left or right stereo view is selected, then adjust position returned accordingly
-D3DXVECTOR3 CCamera::GetPosition( EStereoscopic stereo, float interocular )
+//**|3D|** Update the frustum enclosing both eyes. The eyes are only offset along the camera's x-axis, so they share the near, far, top and
+// bottom planes of the monoscopic frustum. The side planes are worked out in camera space. An eye offset by o along x sees from x = -z*w + o*(1 - z/s)
+// to x = z*w + o*(1 - z/s) at depth z (w is the tangent of half the horizontal FOV, s the screen distance). The eye frustums cross at the screen,
+// so the outer edge of the pair bends there. The planes used go through the outer edge at the near and far clip distances instead, which
+// lie outside the bend and so enclose both frustums
+void CCamera::UpdateStereoFrustum()
 {
-	if (stereo == Monoscopic) return m_Position;
-
-	// Offset camera by half interocular distance left or right as appropriate
-	float offset = interocular * (stereo == StereoscopicLeft ? 0.5f : -0.5f);
-	
-	D3DXVECTOR3 position = m_Position;
-	position.x += m_WorldMatrix._11 * offset;
-	position.y += m_WorldMatrix._12 * offset;
-	position.z += m_WorldMatrix._13 * offset;
-
-	return position;
+	m_StereoFrustum = m_Eyes[Monoscopic].Frustum;
+
+	float halfWidth = m_Aspect * tanf(m_FOV/2);
+	float halfEyeOffset = 0.5f * m_Interocular;
+	float nearEdge = -m_NearClip * halfWidth - halfEyeOffset * fabsf(1.0f - m_NearClip / m_ScreenDistance);
+	float farEdge  = -m_FarClip  * halfWidth - halfEyeOffset * fabsf(1.0f - m_FarClip  / m_ScreenDistance);
+
+	// Left edge is the line x = edgeX + edgeSlope * z, the right edge is its mirror image. Make camera space planes facing inwards
+	float edgeSlope = (farEdge - nearEdge) / (m_FarClip - m_NearClip);
+	float edgeX = nearEdge - edgeSlope * m_NearClip;
+	D3DXPLANE cameraPlanes[2] = { D3DXPLANE(  1.0f, 0.0f, -edgeSlope, -edgeX ),
+	                              D3DXPLANE( -1.0f, 0.0f, -edgeSlope, -edgeX ) };
+
+	// Transform the planes to world space using the camera axes and position (the rows of the camera world matrix)
+	D3DXVECTOR3 xAxis( m_WorldMatrix._11, m_WorldMatrix._12, m_WorldMatrix._13 );
+	D3DXVECTOR3 zAxis( m_WorldMatrix._31, m_WorldMatrix._32, m_WorldMatrix._33 );
+	D3DXVECTOR3 position( m_WorldMatrix._41, m_WorldMatrix._42, m_WorldMatrix._43 );
+	for (int side = 0; side < 2; ++side)
+	{
+		D3DXVECTOR3 normal = cameraPlanes[side].a * xAxis + cameraPlanes[side].c * zAxis;
+		D3DXPLANE worldPlane( normal.x, normal.y, normal.z, cameraPlanes[side].d - D3DXVec3Dot( &normal, &position ) );
+		m_StereoFrustum.SetPlane( (side == 0) ? FrustumLeft : FrustumRight, worldPlane );
+	}
 }
 
-// Get view matrix of camera. If a left or right stereo view is selected, then adjust position in matrix accordingly
-D3DXMATRIXA16 CCamera::GetViewMatrix( EStereoscopic stereo, float interocular )
+
+//**|3D|** Horizontal distance in pixels between the left and right eye images of a point at the given distance from the camera, for a
+// viewport of the given height. The projection matrices shift each eye's image so the two meet at the screen distance, which leaves a
+// disparity of i*(1/s - 1/d) in camera space units at unit distance (i is the interocular distance, s the screen distance)
+float CCamera::GetDisparity( float distance, float viewportHeight )
 {
-	// Not stereoscopic
-	if (stereo == Monoscopic) return m_ViewMatrix;
-
-	// Offset camera by half interocular distance left or right as appropriate
-	float offset = interocular * (stereo == StereoscopicLeft ? 0.5f : -0.5f);
-
-	D3DXMATRIXA16 viewMatrix;
-	D3DXMATRIXA16 worldMatrix = m_WorldMatrix;
-	
-	worldMatrix._41 += offset * worldMatrix._11;
-	worldMatrix._42 += offset * worldMatrix._12;
-	worldMatrix._43 += offset * worldMatrix._13;
-	//** MISSING shift the x position in the camera's worldMatrix by the offset calculated above
-	// Needs to move in the local x-axis - the function above offers guidance
-
-	// Invert camera's adjusted "world matrix" to create view matrix
-	D3DXMatrixInverse( &viewMatrix, NULL, &worldMatrix );
-	return viewMatrix;
+	return m_Interocular * (1.0f / m_ScreenDistance - 1.0f / distance) * GetProjectionScale( viewportHeight );
 }
 
-// Get projection matrix of camera. If a left or right stereo view is selected, then adjust matrix as discussed in lecture
-D3DXMATRIXA16 CCamera::GetProjectionMatrix( EStereoscopic stereo, float interocular, float screenDistance )
-{
-	// Not stereoscopic
-	if (stereo == Monoscopic) return m_ProjMatrix;
 
-	// Offset camera by half interocular distance left or right as appropriate
-	float offset = interocular * (stereo == StereoscopicLeft ? 0.5f :- 0.5f);
+// Choose whether the camera orientation is held as a quaternion or Euler angles, converting the current orientation
+void CCamera::SetUseQuaternion( bool useQuaternion )
+{
+	if (useQuaternion == m_UseQuaternion)
+	{
+		return;
+	}
 
-	// Offset viewing frustum based on camera offset (as discussed in lecture)
-	D3DXMATRIXA16 projMatrix = m_ProjMatrix;
-	//** MISSING - set the single value in the projection matrix that is different for offset cameras - see the lecture notes
-	projMatrix._31 = (offset / screenDistance) / (m_Aspect * tanf(m_FOV/2));
-	return projMatrix;
+	// Convert through the rotation part of the current world matrix
+	gen::CMatrix4x4 rotation;
+	if (useQuaternion)
+	{
+		rotation = gen::MatrixRotation( *reinterpret_cast<gen::CVector3*>(&m_Rotation), gen::kZXY );
+		m_Orientation = gen::CQuaternion( rotation );
+		m_Orientation.Normalise();
+	}
+	else
+	{
+		rotation.MakeAffineQuaternion( m_Orientation );
+		rotation.DecomposeAffineEuler( NULL, reinterpret_cast<gen::CVector3*>(&m_Rotation), NULL, gen::kZXY );
+	}
+	m_UseQuaternion = useQuaternion;
 }
 
-//***************************************/
+
+// Turn the camera up / down around its own X axis and left / right around the world Y axis by the given angles in radians
+void CCamera::Turn( float turnX, float turnY )
+{
+	if (!m_UseQuaternion)
+	{
+		m_Rotation.x += turnX;
+		m_Rotation.y += turnY;
+	}
+	else if (turnX != 0.0f || turnY != 0.0f)
+	{
+		// Local rotations go before the orientation, world rotations after. Normalise to stop errors building up over many frames
+		m_Orientation = gen::QuaternionAxisAngle( gen::CVector3::kXAxis, turnX ) * m_Orientation *
+		                gen::QuaternionAxisAngle( gen::CVector3::kYAxis, turnY );
+		m_Orientation.Normalise();
+	}
+}
 
 
 // Control the camera's position and rotation using keys provided. Amount of motion performed depends on frame time
 void CCamera::Control( float frameTime, EKeyCode turnUp, EKeyCode turnDown, EKeyCode turnLeft, EKeyCode turnRight,  
                        EKeyCode moveForward, EKeyCode moveBackward, EKeyCode moveLeft, EKeyCode moveRight)
 {
+	// Turning up and down is around the camera's own X axis, turning left and right is around the world Y axis (as with the Euler angles)
+	float turnX = 0.0f, turnY = 0.0f;
 	if (KeyHeld( turnDown ))
 	{
-		m_Rotation.x += RotSpeed * frameTime;
+		turnX += RotSpeed * frameTime;
 	}
 	if (KeyHeld( turnUp ))
 	{
-		m_Rotation.x -= RotSpeed * frameTime;
+		turnX -= RotSpeed * frameTime;
 	}
 	if (KeyHeld( turnRight ))
 	{
-		m_Rotation.y += RotSpeed * frameTime;
+		turnY += RotSpeed * frameTime;
 	}
 	if (KeyHeld( turnLeft ))
 	{
-		m_Rotation.y -= RotSpeed * frameTime;
+		turnY -= RotSpeed * frameTime;
 	}
+	Turn( turnX, turnY );
 
 	// Local X movement - move in the direction of the X axis, get axis from camera's "world" matrix
 	if (KeyHeld( moveRight ))
@@ -8,6 +8,8 @@
 #define CAMERA_H_INCLUDED
 
 #include "Input.h"
+#include "Frustum.h"
+#include "CQuatTransform.h" // Maths library quaternion transform, an alternative to Euler angles for the camera orientation
 
 //-----------------------------------------------------------------------------
 // DirectX Camera Class Defintition
@@ -20,6 +22,17 @@ enum EStereoscopic
 	StereoscopicLeft,
 	StereoscopicRight
 };
+const int NumEyes = 3; // Number of EStereoscopic values - the camera keeps matrices for each
+
+// All the matrices for one eye, calculated once per frame in UpdateMatrices
+__declspec(align(16)) struct SEyeMatrices
+{
+	D3DXMATRIXA16 ViewMatrix;
+	D3DXMATRIXA16 ProjMatrix;
+	D3DXMATRIXA16 ViewProjMatrix;
+	D3DXVECTOR3   Position;
+	CFrustum      Frustum; // World space frustum extracted from the view-projection matrix
+};
 
 class CCamera
 {
@@ -31,17 +44,29 @@ private:
 	D3DXVECTOR3 m_Position;
 	D3DXVECTOR3 m_Rotation;
 
+	// The orientation can be a quaternion instead of the Euler angles above (see SetOrientation). The controls then rotate the
+	// quaternion a little each frame and the world matrix is built from it directly, with no trigonometry and no gimbal lock
+	bool             m_UseQuaternion;
+	gen::CQuaternion m_Orientation;
+
 	// Camera settings: field of view, aspect ratio, near and far clip plane distances. Note that the FOV angle is measured in radians (radians = degrees * PI/180)
 	float m_FOV;
 	float m_Aspect;
 	float m_NearClip;
 	float m_FarClip;
 
-	// Current view, projection and combined view-projection matrices (DirectX matrix type)
-	D3DXMATRIXA16 m_WorldMatrix;    // Easiest to treat the camera like a model and give it a "world" matrix...
-	D3DXMATRIXA16 m_ViewMatrix;     // ... the view matrix used in the pipeline is the inverse of its world matrix
-	D3DXMATRIXA16 m_ProjMatrix;     // Projection matrix to set field of view and near/far clip distances
-	D3DXMATRIXA16 m_ViewProjMatrix; // Combine (multiply) the view and projection matrices together - saves a matrix multiply in the shader (optional optimisation)
+	//**|3D|** Distance between the eyes and distance to the screen (zero parallax) for the stereo matrices
+	float m_Interocular;
+	float m_ScreenDistance;
+
+	// Easiest to treat the camera like a model and give it a "world" matrix. The view matrix used in the pipeline is the inverse of this
+	D3DXMATRIXA16 m_WorldMatrix;
+
+	// Current view, projection and combined view-projection matrices and position for each eye, indexed by EStereoscopic
+	SEyeMatrices m_Eyes[NumEyes];
+
+	//**|3D|** Frustum enclosing both eyes' frustums, used to cull models once for a stereo frame rather than once per eye
+	CFrustum     m_StereoFrustum;
 
 
 /////////////////////////////
@@ -63,22 +88,64 @@ public:
 	{
 		return m_Rotation;
 	}
+	bool UsesQuaternion()
+	{
+		return m_UseQuaternion;
+	}
+	const gen::CQuaternion& GetOrientation()
+	{
+		return m_Orientation;
+	}
 
-	//***|3D|********************************/
-	// Camera matrix access / stereo offsets
-	// See .cpp file
+	// Get the position and orientation as a quaternion transform (scale is 1). Only valid when the camera uses a quaternion
+	gen::CQuatTransform GetTransform()
+	{
+		return gen::CQuatTransform( m_Orientation, *reinterpret_cast<gen::CVector3*>(&m_Position), gen::CVector3::kOne );
+	}
 
-	D3DXVECTOR3 GetPosition( EStereoscopic stereo = Monoscopic, float interocular = 0.65f );
-	D3DXMATRIXA16 GetViewMatrix( EStereoscopic stereo = Monoscopic, float interocular = 0.65f );
-	D3DXMATRIXA16 GetProjectionMatrix( EStereoscopic stereo = Monoscopic, float interocular = 0.65f, float screenDistance = 20.0f );
+	//***|3D|********************************/
+	// Camera matrix access for each eye - calculated in UpdateMatrices, the left and right eyes are offset by the interocular distance
 
-	//***************************************/
+	const D3DXVECTOR3& GetPosition( EStereoscopic stereo = Monoscopic ) const
+	{
+		return m_Eyes[stereo].Position;
+	}
+	const D3DXMATRIXA16& GetViewMatrix( EStereoscopic stereo = Monoscopic ) const
+	{
+		return m_Eyes[stereo].ViewMatrix;
+	}
+	const D3DXMATRIXA16& GetProjectionMatrix( EStereoscopic stereo = Monoscopic ) const
+	{
+		return m_Eyes[stereo].ProjMatrix;
+	}
+	const D3DXMATRIXA16& GetViewProjectionMatrix( EStereoscopic stereo = Monoscopic ) const
+	{
+		return m_Eyes[stereo].ViewProjMatrix;
+	}
+	const CFrustum& GetFrustum( EStereoscopic stereo = Monoscopic ) const
+	{
+		return m_Eyes[stereo].Frustum;
+	}
+	const CFrustum& GetStereoFrustum() const
+	{
+		return m_StereoFrustum;
+	}
 
-	D3DXMATRIXA16 GetViewProjectionMatrix()
+	float GetInterocular()
 	{
-		return m_ViewProjMatrix;
+		return m_Interocular;
+	}
+	float GetScreenDistance()
+	{
+		return m_ScreenDistance;
 	}
 
+	// Horizontal distance in pixels between the left and right eye images of a point at the given distance from the camera, for a
+	// viewport of the given height. Zero at the screen distance, negative (crossed) for points in front of the screen
+	float GetDisparity( float distance, float viewportHeight );
+
+	//***************************************/
+
 	float GetFOV()
 	{
 		return m_FOV;
@@ -91,6 +158,17 @@ public:
 	{
 		return m_FarClip;
 	}
+	float GetAspect()
+	{
+		return m_Aspect;
+	}
+
+	// Height in pixels of an object of unit height at unit distance in front of the camera, for a viewport of the given height. Divide
+	// by the distance for the size of objects further away, e.g. to choose a level of detail
+	float GetProjectionScale( float viewportHeight )
+	{
+		return viewportHeight / (2.0f * tanf( m_FOV * 0.5f ));
+	}
 
 
 	// Setters
@@ -98,10 +176,26 @@ public:
 	{
 		m_Position = position;
 	}
-	void SetRotation( D3DXVECTOR3 rotation )
+	void SetRotation( D3DXVECTOR3 rotation ) // Switches the camera to Euler angles if it was using a quaternion
 	{
 		m_Rotation = rotation;
+		m_UseQuaternion = false;
+	}
+	void SetOrientation( const gen::CQuaternion& orientation ) // Switches the camera to a quaternion, must be normalised
+	{
+		m_Orientation = orientation;
+		m_UseQuaternion = true;
+	}
+
+	// Set the position and orientation from a quaternion transform (the scale is ignored), switches the camera to a quaternion
+	void SetTransform( const gen::CQuatTransform& transform )
+	{
+		m_Position = D3DXVECTOR3( transform.pos.x, transform.pos.y, transform.pos.z );
+		SetOrientation( transform.quat );
 	}
+
+	// Choose whether the camera orientation is held as a quaternion or Euler angles, converting the current orientation
+	void SetUseQuaternion( bool useQuaternion );
 	void SetFOV( float fov )
 	{
 		m_FOV = fov;
@@ -114,17 +208,40 @@ public:
 	{
 		m_FarClip = farClip;
 	}
+	void SetAspect( float aspect ) // Viewport width / viewport height
+	{
+		m_Aspect = aspect;
+	}
+	void SetInterocular( float interocular )
+	{
+		m_Interocular = interocular;
+	}
+	void SetScreenDistance( float screenDistance )
+	{
+		m_ScreenDistance = screenDistance;
+	}
 
 
 	/////////////////////////////
 	// Camera Usage
 
-	// Update the matrices used for the camera in the rendering pipeline
+	// Update the matrices used for the camera in the rendering pipeline, for the monoscopic camera and both eyes
 	void UpdateMatrices();
 
+	// Turn the camera up / down around its own X axis and left / right around the world Y axis by the given angles in radians
+	void Turn( float turnX, float turnY );
+
 	// Control the camera's position and rotation using keys provided
 	void Control( float frameTime, EKeyCode turnUp, EKeyCode turnDown, EKeyCode turnLeft, EKeyCode turnRight,  
 	              EKeyCode moveForward, EKeyCode moveBackward, EKeyCode moveLeft, EKeyCode moveRight);
+
+
+/////////////////////////////
+// Private member functions
+private:
+
+	//**|3D|** Update the frustum enclosing both eyes, from the monoscopic frustum. Called by UpdateMatrices
+	void UpdateStereoFrustum();
 };
 
 
@@ -0,0 +1,175 @@
+//--------------------------------------------------------------------------------------
+//	FileWatcher.cpp
+//
+//	Watches a directory on a background thread and collects the names of the files that
+//	change in it, so the app can reload its shaders and assets while it runs
+//--------------------------------------------------------------------------------------
+
+#include <cwctype>
+
+#include "Defines.h"     // General definitions shared by all source files
+#include "FileWatcher.h" // Declaration of this class
+
+// Size of the buffer the change notifications are written into. If more changes arrive between reads than fit, the notification
+// comes back empty and those changes are lost - only likely when many files are copied in at once
+const DWORD NotifyBufferSize = 16 * 1024;
+
+
+///////////////////////////////
+// Constructors / Destructors
+
+CFileWatcher::CFileWatcher()
+{
+	m_Directory = INVALID_HANDLE_VALUE;
+	m_Thread = NULL;
+	m_StopEvent = NULL;
+	InitializeCriticalSection( &m_Lock );
+}
+
+// Destructor - stops watching
+CFileWatcher::~CFileWatcher()
+{
+	Shutdown();
+	DeleteCriticalSection( &m_Lock );
+}
+
+
+// Start watching the given directory (not its subdirectories). Returns false if the directory could not be opened
+bool CFileWatcher::Init( const wstring& directory )
+{
+	// Overlapped so the thread can wait for a notification and the stop event together
+	m_Directory = CreateFileW( directory.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+	                           OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL );
+	if (m_Directory == INVALID_HANDLE_VALUE) return false;
+
+	m_StopEvent = CreateEvent( NULL, TRUE, FALSE, NULL );
+	if (!m_StopEvent)
+	{
+		Shutdown();
+		return false;
+	}
+	m_Thread = CreateThread( NULL, 0, ThreadProc, this, 0, NULL );
+	if (!m_Thread)
+	{
+		Shutdown();
+		return false;
+	}
+	return true;
+}
+
+// Stop the watching thread and close the directory
+void CFileWatcher::Shutdown()
+{
+	if (m_Thread)
+	{
+		SetEvent( m_StopEvent );
+		WaitForSingleObject( m_Thread, INFINITE );
+		CloseHandle( m_Thread );
+		m_Thread = NULL;
+	}
+	if (m_StopEvent)
+	{
+		CloseHandle( m_StopEvent );
+		m_StopEvent = NULL;
+	}
+	if (m_Directory != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle( m_Directory );
+		m_Directory = INVALID_HANDLE_VALUE;
+	}
+	m_Changes.clear();
+}
+
+
+/////////////////////////////
+// Changes
+
+// Get the names of the files (relative to the directory, in lower case) that have changed and then settled since the last call,
+// each reported once however many times it changed. Call from any one thread, e.g. once per frame
+void CFileWatcher::GetChangedFiles( vector<wstring>& fileNames )
+{
+	fileNames.clear();
+	DWORD now = GetTickCount();
+
+	EnterCriticalSection( &m_Lock );
+	TChangeMap::iterator change = m_Changes.begin();
+	while (change != m_Changes.end())
+	{
+		// Unsigned subtraction copes with the tick count wrapping
+		if (now - change->second >= SettleTime)
+		{
+			fileNames.push_back( change->first );
+			change = m_Changes.erase( change );
+		}
+		else
+		{
+			++change;
+		}
+	}
+	LeaveCriticalSection( &m_Lock );
+}
+
+
+/////////////////////////////
+// Private member functions
+
+// Thread loop, waits for change notifications and records the files until stopped
+void CFileWatcher::Run()
+{
+	// Notifications are DWORD aligned records, each with the length of the next and a file name (not null terminated)
+	vector<DWORD> buffer( NotifyBufferSize / sizeof(DWORD) );
+	OVERLAPPED overlapped = {0};
+	overlapped.hEvent = CreateEvent( NULL, TRUE, FALSE, NULL );
+	if (!overlapped.hEvent) return;
+
+	HANDLE events[] = { m_StopEvent, overlapped.hEvent };
+	for (;;)
+	{
+		ResetEvent( overlapped.hEvent );
+		if (!ReadDirectoryChangesW( m_Directory, &buffer[0], NotifyBufferSize, FALSE,
+		                            FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME, NULL, &overlapped, NULL ))
+		{
+			break;
+		}
+
+		// The read must be finished (or cancelled) before the buffer and overlapped structure go away
+		DWORD bytes = 0;
+		if (WaitForMultipleObjects( 2, events, FALSE, INFINITE ) != WAIT_OBJECT_0 + 1)
+		{
+			CancelIo( m_Directory );
+			GetOverlappedResult( m_Directory, &overlapped, &bytes, TRUE );
+			break;
+		}
+		if (!GetOverlappedResult( m_Directory, &overlapped, &bytes, FALSE ) || bytes == 0)
+		{
+			continue; // Buffer overflowed, the changes are lost
+		}
+
+		DWORD now = GetTickCount();
+		EnterCriticalSection( &m_Lock );
+		const BYTE* record = reinterpret_cast<const BYTE*>(&buffer[0]);
+		for (;;)
+		{
+			const FILE_NOTIFY_INFORMATION* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(record);
+			if (info->Action == FILE_ACTION_MODIFIED || info->Action == FILE_ACTION_ADDED || info->Action == FILE_ACTION_RENAMED_NEW_NAME)
+			{
+				wstring fileName( info->FileName, info->FileNameLength / sizeof(WCHAR) );
+				for (wstring::iterator c = fileName.begin(); c != fileName.end(); ++c)
+				{
+					*c = static_cast<wchar_t>(towlower( *c ));
+				}
+				m_Changes[fileName] = now;
+			}
+			if (info->NextEntryOffset == 0) break;
+			record += info->NextEntryOffset;
+		}
+		LeaveCriticalSection( &m_Lock );
+	}
+	CloseHandle( overlapped.hEvent );
+}
+
+DWORD WINAPI CFileWatcher::ThreadProc( LPVOID param )
+{
+	static_cast<CFileWatcher*>(param)->Run();
+	return 0;
+}
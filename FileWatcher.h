@@ -0,0 +1,85 @@
+//--------------------------------------------------------------------------------------
+//	FileWatcher.h
+//
+//	Watches a directory on a background thread and collects the names of the files that
+//	change in it, so the app can reload its shaders and assets while it runs
+//--------------------------------------------------------------------------------------
+
+#ifndef FILE_WATCHER_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define FILE_WATCHER_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <map>
+using namespace std;
+
+#include <windows.h>
+
+
+class CFileWatcher
+{
+/////////////////////////////
+// Public constants
+public:
+
+	// Time in milliseconds a file must go unchanged before it is reported. Editors often write a file in several steps (or write a
+	// temporary file and rename it), this waits for them to finish rather than reloading a half-written file
+	static const DWORD SettleTime = 250;
+
+
+/////////////////////////////
+// Private member variables
+private:
+
+	// Directory being watched (opened for change notification), the watching thread and the event that stops it
+	HANDLE           m_Directory;
+	HANDLE           m_Thread;
+	HANDLE           m_StopEvent;
+
+	// Files changed since they were last reported, in lower case, with the tick count of their latest change. Written by the watching
+	// thread, read by GetChangedFiles
+	typedef map<wstring, DWORD> TChangeMap;
+	CRITICAL_SECTION m_Lock;
+	TChangeMap       m_Changes;
+
+
+/////////////////////////////
+// Public member functions
+public:
+
+	///////////////////////////////
+	// Constructors / Destructors
+
+	CFileWatcher();
+	~CFileWatcher(); // Stops watching
+
+	// Start watching the given directory (not its subdirectories). Returns false if the directory could not be opened
+	bool Init( const wstring& directory );
+
+	// Stop the watching thread and close the directory
+	void Shutdown();
+
+
+	/////////////////////////////
+	// Changes
+
+	// Get the names of the files (relative to the directory, in lower case) that have changed and then settled since the last call,
+	// each reported once however many times it changed. Call from any one thread, e.g. once per frame
+	void GetChangedFiles( vector<wstring>& fileNames );
+
+
+/////////////////////////////
+// Private member functions
+private:
+
+	// Thread loop, waits for change notifications and records the files until stopped
+	void Run();
+	static DWORD WINAPI ThreadProc( LPVOID param );
+
+	// Disallow use of copy constructor and assignment operator (private and not defined)
+	CFileWatcher( const CFileWatcher& );
+	CFileWatcher& operator=( const CFileWatcher& );
+};
+
+
+#endif // End of header guard - see top of file
@@ -0,0 +1,361 @@
+//--------------------------------------------------------------------------------------
+//	FrameCapture.cpp
+//
+//	Records the rendered frames to disk without stalling the GPU. Each frame is copied into
+//	a ring of staging textures and read back a few frames later, once the GPU has long
+//	finished with it, then a background thread writes the pixels out as an image sequence
+//	or a raw video file
+//--------------------------------------------------------------------------------------
+
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+using namespace std;
+
+#include "Defines.h"      // General definitions shared by all source files
+#include "FrameCapture.h" // Declaration of this class
+#include "ResourceRegistry.h" // Staging textures are counted in the buffer memory
+
+
+///////////////////////////////
+// Constructors / Destructors
+
+CFrameCapture::CFrameCapture()
+{
+	for (unsigned int slot = 0; slot < RingSize; ++slot)
+	{
+		m_Ring[slot].texture = NULL;
+		m_Ring[slot].pending = false;
+	}
+	m_NextSlot = 0;
+	ZeroMemory( &m_StagingDesc, sizeof(m_StagingDesc) );
+	m_Recording = false;
+	m_Format = CaptureImages;
+	m_FramesCaptured = 0;
+	m_FramesWritten = 0;
+	m_WriteErrors = 0;
+	m_Thread = NULL;
+	m_FramesReady = NULL;
+	m_QueueSpace = NULL;
+	InitializeCriticalSection( &m_Lock );
+	m_RawFile = INVALID_HANDLE_VALUE;
+	m_RawWidth = 0;
+	m_RawHeight = 0;
+}
+
+// Destructor - stops any recording, writing the remaining frames
+CFrameCapture::~CFrameCapture()
+{
+	Stop();
+	for (unsigned int frame = 0; frame < m_FreeFrames.size(); ++frame)
+	{
+		delete m_FreeFrames[frame];
+	}
+	DeleteCriticalSection( &m_Lock );
+}
+
+
+/////////////////////////////
+// Recording
+
+// Start recording frames in the given format to files beginning with the given name. Returns false if the writer thread could not be
+// started
+bool CFrameCapture::Start( ECaptureFormat format, const wstring& baseName )
+{
+	Stop();
+	m_Format = format;
+	m_BaseName = baseName;
+	m_FramesCaptured = 0;
+	m_FramesWritten = 0;
+	m_WriteErrors = 0;
+
+	m_FramesReady = CreateSemaphore( NULL, 0, MaxQueuedFrames + 1, NULL );
+	m_QueueSpace  = CreateSemaphore( NULL, MaxQueuedFrames, MaxQueuedFrames, NULL );
+	if (!m_FramesReady || !m_QueueSpace)
+	{
+		Stop();
+		return false;
+	}
+	m_Thread = CreateThread( NULL, 0, ThreadProc, this, 0, NULL );
+	if (!m_Thread)
+	{
+		Stop();
+		return false;
+	}
+
+	// Writing is disk bound, let the render thread go first
+	SetThreadPriority( m_Thread, THREAD_PRIORITY_BELOW_NORMAL );
+	m_Recording = true;
+	return true;
+}
+
+// Read back the frames still in the ring, wait for the writer to finish them and release the staging textures
+void CFrameCapture::Stop()
+{
+	if (m_Recording)
+	{
+		FlushRing();
+		m_Recording = false;
+	}
+	ReleaseRing();
+
+	// An extra count with nothing queued tells the writer to stop, after the frames ahead of it
+	if (m_Thread)
+	{
+		ReleaseSemaphore( m_FramesReady, 1, NULL );
+		WaitForSingleObject( m_Thread, INFINITE );
+		CloseHandle( m_Thread );
+		m_Thread = NULL;
+	}
+	if (m_FramesReady)
+	{
+		CloseHandle( m_FramesReady );
+		m_FramesReady = NULL;
+	}
+	if (m_QueueSpace)
+	{
+		CloseHandle( m_QueueSpace );
+		m_QueueSpace = NULL;
+	}
+}
+
+// Copy this frame's pixels for recording: the top-left width x height of each slice of the given texture, which must not be
+// multisampled. The slices are placed side by side. Call once per frame after the texture has been rendered. Does nothing unless
+// recording
+void CFrameCapture::CaptureFrame( ID3D10Texture2D* source, UINT width, UINT height )
+{
+	if (!m_Recording) return;
+
+	// The ring matches the source exactly so it can be copied with CopyResource. If the source changes (e.g. the window is resized or
+	// the output mode changes) the frames still in the ring are read back first
+	D3D10_TEXTURE2D_DESC sourceDesc;
+	source->GetDesc( &sourceDesc );
+	if (!m_Ring[0].texture || sourceDesc.Width != m_StagingDesc.Width || sourceDesc.Height != m_StagingDesc.Height ||
+	    sourceDesc.ArraySize != m_StagingDesc.ArraySize || sourceDesc.Format != m_StagingDesc.Format)
+	{
+		FlushRing();
+		if (!CreateRing( sourceDesc ))
+		{
+			InterlockedIncrement( &m_WriteErrors );
+			return;
+		}
+	}
+
+	// The slot's last frame was copied RingSize frames ago, so reading it back now doesn't wait for the GPU
+	SRingSlot& slot = m_Ring[m_NextSlot];
+	if (slot.pending)
+	{
+		ReadSlot( slot );
+	}
+	g_pd3dDevice->CopyResource( slot.texture, source );
+	slot.pending = true;
+	slot.width  = min( width, sourceDesc.Width );
+	slot.height = min( height, sourceDesc.Height );
+	slot.frame  = m_FramesCaptured++;
+	m_NextSlot = (m_NextSlot + 1) % RingSize;
+}
+
+
+/////////////////////////////
+// Private member functions
+
+// Create the ring of staging textures to match the given source texture. Returns false on failure
+bool CFrameCapture::CreateRing( const D3D10_TEXTURE2D_DESC& sourceDesc )
+{
+	ReleaseRing();
+	m_StagingDesc = sourceDesc;
+	m_StagingDesc.MipLevels = 1;
+	m_StagingDesc.Usage = D3D10_USAGE_STAGING;
+	m_StagingDesc.BindFlags = 0;
+	m_StagingDesc.CPUAccessFlags = D3D10_CPU_ACCESS_READ;
+	m_StagingDesc.MiscFlags = 0;
+	for (unsigned int slot = 0; slot < RingSize; ++slot)
+	{
+		if (FAILED( g_Resources.CreateTexture2D( ResourceBuffer, &m_StagingDesc, NULL, &m_Ring[slot].texture ) ))
+		{
+			ReleaseRing();
+			return false;
+		}
+	}
+	return true;
+}
+
+void CFrameCapture::ReleaseRing()
+{
+	for (unsigned int slot = 0; slot < RingSize; ++slot)
+	{
+		SAFE_RELEASE( m_Ring[slot].texture );
+		m_Ring[slot].pending = false;
+	}
+	m_NextSlot = 0;
+}
+
+// Read back the frames in the ring, oldest first
+void CFrameCapture::FlushRing()
+{
+	for (unsigned int i = 0; i < RingSize; ++i)
+	{
+		SRingSlot& slot = m_Ring[(m_NextSlot + i) % RingSize];
+		if (slot.pending)
+		{
+			ReadSlot( slot );
+		}
+	}
+}
+
+// Map a ring slot's texture, copy its pixels into a frame and pass it to the writer thread
+void CFrameCapture::ReadSlot( SRingSlot& slot )
+{
+	slot.pending = false;
+
+	// Wait for room in the queue - slower than dropping the frame, but the recording must be complete
+	WaitForSingleObject( m_QueueSpace, INFINITE );
+	SFrame* frame = NULL;
+	EnterCriticalSection( &m_Lock );
+	if (!m_FreeFrames.empty())
+	{
+		frame = m_FreeFrames.back();
+		m_FreeFrames.pop_back();
+	}
+	LeaveCriticalSection( &m_Lock );
+	if (!frame)
+	{
+		frame = new SFrame;
+	}
+
+	// Each texture row can be padded, so copy a row at a time. The slices go side by side in each row of the frame
+	UINT slices = m_StagingDesc.ArraySize;
+	UINT sliceRowSize = slot.width * 4;
+	UINT frameRowSize = sliceRowSize * slices;
+	frame->width  = slot.width * slices;
+	frame->height = slot.height;
+	frame->number = slot.frame;
+	frame->pixels.resize( frameRowSize * slot.height );
+	for (UINT slice = 0; slice < slices; ++slice)
+	{
+		UINT subresource = D3D10CalcSubresource( 0, slice, 1 );
+		D3D10_MAPPED_TEXTURE2D mapped;
+		if (FAILED( slot.texture->Map( subresource, D3D10_MAP_READ, 0, &mapped ) ))
+		{
+			ZeroMemory( &frame->pixels[slice * sliceRowSize], sliceRowSize ); // Keep the frame, so the sequence has no gaps
+			InterlockedIncrement( &m_WriteErrors );
+			continue;
+		}
+		const BYTE* sourceRow = static_cast<const BYTE*>(mapped.pData);
+		BYTE* frameRow = &frame->pixels[slice * sliceRowSize];
+		for (UINT row = 0; row < slot.height; ++row)
+		{
+			memcpy( frameRow, sourceRow, sliceRowSize );
+			sourceRow += mapped.RowPitch;
+			frameRow += frameRowSize;
+		}
+		slot.texture->Unmap( subresource );
+	}
+
+	EnterCriticalSection( &m_Lock );
+	m_Queue.push_back( frame );
+	LeaveCriticalSection( &m_Lock );
+	ReleaseSemaphore( m_FramesReady, 1, NULL );
+}
+
+
+// Write a frame as a 32-bit BMP file named with the base name and the frame number. The frame's pixels are swizzled in place
+bool CFrameCapture::WriteImage( SFrame& frame )
+{
+	wostringstream fileName;
+	fileName << m_BaseName << L"_" << setw( 6 ) << setfill( L'0' ) << frame.number << L".bmp";
+	HANDLE file = CreateFileW( fileName.str().c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	// Top-down (negative height) so the rows are in the same order as in the frame. BMPs hold BGRA, the frame is RGBA
+	DWORD imageSize = frame.width * frame.height * 4;
+	BITMAPFILEHEADER fileHeader = {0};
+	fileHeader.bfType = 0x4D42; // "BM"
+	fileHeader.bfOffBits = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER);
+	fileHeader.bfSize = fileHeader.bfOffBits + imageSize;
+	BITMAPINFOHEADER infoHeader = {0};
+	infoHeader.biSize = sizeof(BITMAPINFOHEADER);
+	infoHeader.biWidth = frame.width;
+	infoHeader.biHeight = -static_cast<LONG>(frame.height);
+	infoHeader.biPlanes = 1;
+	infoHeader.biBitCount = 32;
+	infoHeader.biCompression = BI_RGB;
+	infoHeader.biSizeImage = imageSize;
+
+	for (DWORD i = 0; i < imageSize; i += 4)
+	{
+		swap( frame.pixels[i], frame.pixels[i + 2] );
+	}
+
+	DWORD written;
+	bool ok = WriteFile( file, &fileHeader, sizeof(fileHeader), &written, NULL ) &&
+	          WriteFile( file, &infoHeader, sizeof(infoHeader), &written, NULL ) &&
+	          WriteFile( file, &frame.pixels[0], imageSize, &written, NULL ) && written == imageSize;
+	CloseHandle( file );
+	return ok;
+}
+
+// Append a frame to the raw video file, named with the base name and the frame size. A frame of a new size starts a new file, named
+// with its first frame's number too
+bool CFrameCapture::WriteRawFrame( const SFrame& frame )
+{
+	if (m_RawFile == INVALID_HANDLE_VALUE || frame.width != m_RawWidth || frame.height != m_RawHeight)
+	{
+		if (m_RawFile != INVALID_HANDLE_VALUE) CloseHandle( m_RawFile );
+
+		wostringstream fileName;
+		fileName << m_BaseName;
+		if (frame.number > 0)
+		{
+			fileName << L"_" << setw( 6 ) << setfill( L'0' ) << frame.number;
+		}
+		fileName << L"_" << frame.width << L"x" << frame.height << L".rgba";
+		m_RawFile = CreateFileW( fileName.str().c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+		if (m_RawFile == INVALID_HANDLE_VALUE) return false;
+		m_RawWidth = frame.width;
+		m_RawHeight = frame.height;
+	}
+
+	DWORD size = static_cast<DWORD>(frame.pixels.size());
+	DWORD written;
+	return WriteFile( m_RawFile, &frame.pixels[0], size, &written, NULL ) && written == size;
+}
+
+
+// Writer thread loop, writes the queued frames in order until stopped
+void CFrameCapture::Run()
+{
+	for (;;)
+	{
+		WaitForSingleObject( m_FramesReady, INFINITE );
+		EnterCriticalSection( &m_Lock );
+		if (m_Queue.empty())
+		{
+			LeaveCriticalSection( &m_Lock );
+			break; // Stop signal, every frame queued before it has been written
+		}
+		SFrame* frame = m_Queue.front();
+		m_Queue.pop_front();
+		LeaveCriticalSection( &m_Lock );
+
+		bool ok = (m_Format == CaptureRawVideo) ? WriteRawFrame( *frame ) : WriteImage( *frame );
+		InterlockedIncrement( ok ? &m_FramesWritten : &m_WriteErrors );
+
+		EnterCriticalSection( &m_Lock );
+		m_FreeFrames.push_back( frame );
+		LeaveCriticalSection( &m_Lock );
+		ReleaseSemaphore( m_QueueSpace, 1, NULL );
+	}
+
+	if (m_RawFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle( m_RawFile );
+		m_RawFile = INVALID_HANDLE_VALUE;
+	}
+}
+
+DWORD WINAPI CFrameCapture::ThreadProc( LPVOID param )
+{
+	static_cast<CFrameCapture*>(param)->Run();
+	return 0;
+}
@@ -0,0 +1,167 @@
+//--------------------------------------------------------------------------------------
+//	FrameCapture.h
+//
+//	Records the rendered frames to disk without stalling the GPU. Each frame is copied into
+//	a ring of staging textures and read back a few frames later, once the GPU has long
+//	finished with it, then a background thread writes the pixels out as an image sequence
+//	or a raw video file
+//--------------------------------------------------------------------------------------
+
+#ifndef FRAME_CAPTURE_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define FRAME_CAPTURE_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <deque>
+using namespace std;
+
+#include <windows.h>
+#include <d3d10.h>
+
+
+// How the captured frames are written
+enum ECaptureFormat
+{
+	CaptureImages,   // A 32-bit BMP file for each frame
+	CaptureRawVideo, // All frames appended to one file of RGBA pixels, the frame size is in the file name
+};
+
+
+class CFrameCapture
+{
+/////////////////////////////
+// Public constants
+public:
+
+	// Staging textures in the ring. A frame is read back when its texture comes round again, this many frames after it was copied. The
+	// GPU runs at most 3 frames behind (the default frame latency), so by then the copy is complete and mapping it doesn't wait
+	static const unsigned int RingSize = 4;
+
+	// Frames read back but not yet written that are held in memory. If the writer falls this far behind, the render thread waits for
+	// it rather than drop frames - the disk must keep up with the frame rate on average
+	static const unsigned int MaxQueuedFrames = 16;
+
+
+/////////////////////////////
+// Private member variables
+private:
+
+	// A staging texture in the ring and the frame copied into it, if not yet read back. The width and height are the part of each slice
+	// captured
+	struct SRingSlot
+	{
+		ID3D10Texture2D* texture;
+		bool             pending;
+		UINT             width;
+		UINT             height;
+		unsigned int     frame;
+	};
+	SRingSlot            m_Ring[RingSize];
+	unsigned int         m_NextSlot;
+	D3D10_TEXTURE2D_DESC m_StagingDesc; // Description of the staging textures, they are recreated if the source changes
+
+	bool                 m_Recording;
+	ECaptureFormat       m_Format;
+	wstring              m_BaseName;      // File names start with this, followed by the frame number or size
+	unsigned int         m_FramesCaptured;
+	volatile LONG        m_FramesWritten;
+	volatile LONG        m_WriteErrors;
+
+	// A frame's pixels read back from the GPU, RGBA with the slices side by side
+	struct SFrame
+	{
+		vector<BYTE> pixels;
+		UINT         width;
+		UINT         height;
+		unsigned int number;
+	};
+
+	// Writer thread and the frames waiting for it. Frames are taken from the free list to avoid allocating every frame. The frames ready
+	// semaphore counts the queued frames (plus one to stop the thread), the space semaphore counts the frames that may still be queued
+	HANDLE               m_Thread;
+	HANDLE               m_FramesReady;
+	HANDLE               m_QueueSpace;
+	CRITICAL_SECTION     m_Lock;
+	deque<SFrame*>       m_Queue;
+	vector<SFrame*>      m_FreeFrames;
+
+	// Raw video file being written (writer thread only) and the frame size it holds
+	HANDLE               m_RawFile;
+	UINT                 m_RawWidth;
+	UINT                 m_RawHeight;
+
+
+/////////////////////////////
+// Public member functions
+public:
+
+	///////////////////////////////
+	// Constructors / Destructors
+
+	CFrameCapture();
+	~CFrameCapture(); // Stops any recording, writing the remaining frames
+
+
+	/////////////////////////////
+	// Recording
+
+	// Start recording frames in the given format to files beginning with the given name. Returns false if the writer thread could not be
+	// started
+	bool Start( ECaptureFormat format, const wstring& baseName );
+
+	// Read back the frames still in the ring, wait for the writer to finish them and release the staging textures
+	void Stop();
+
+	bool IsRecording()
+	{
+		return m_Recording;
+	}
+
+	// Copy this frame's pixels for recording: the top-left width x height of each slice of the given texture, which must not be
+	// multisampled. The slices are placed side by side. Call once per frame after the texture has been rendered. Does nothing unless
+	// recording
+	void CaptureFrame( ID3D10Texture2D* source, UINT width, UINT height );
+
+	unsigned int GetFramesCaptured()
+	{
+		return m_FramesCaptured;
+	}
+	unsigned int GetFramesWritten()
+	{
+		return static_cast<unsigned int>(m_FramesWritten);
+	}
+	unsigned int GetWriteErrors()
+	{
+		return static_cast<unsigned int>(m_WriteErrors);
+	}
+
+
+/////////////////////////////
+// Private member functions
+private:
+
+	// Create the ring of staging textures to match the given source texture. Returns false on failure
+	bool CreateRing( const D3D10_TEXTURE2D_DESC& sourceDesc );
+	void ReleaseRing();
+
+	// Read back the frames in the ring, oldest first
+	void FlushRing();
+
+	// Map a ring slot's texture, copy its pixels into a frame and pass it to the writer thread
+	void ReadSlot( SRingSlot& slot );
+
+	// Write a frame in the current format. Returns false if the file could not be written
+	bool WriteImage( SFrame& frame );
+	bool WriteRawFrame( const SFrame& frame );
+
+	// Writer thread loop, writes the queued frames in order until stopped
+	void Run();
+	static DWORD WINAPI ThreadProc( LPVOID param );
+
+	// Disallow use of copy constructor and assignment operator (private and not defined)
+	CFrameCapture( const CFrameCapture& );
+	CFrameCapture& operator=( const CFrameCapture& );
+};
+
+
+#endif // End of header guard - see top of file
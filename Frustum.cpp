@@ -0,0 +1,134 @@
+//--------------------------------------------------------------------------------------
+//	Frustum.cpp
+//
+//	A frustum is the six planes bounding what a camera can see. Used to cull models that
+//	are entirely outside the view so they are never sent to the GPU
+//--------------------------------------------------------------------------------------
+
+#include <xmmintrin.h> // SSE intrinsics
+
+#include "Defines.h" // General definitions shared by all source files
+#include "Frustum.h" // Declaration of this class
+
+
+///////////////////////////////
+// Constructors / Destructors
+
+// Constructor - creates a frustum that contains everything (all planes have zero normals)
+CFrustum::CFrustum()
+{
+	for (int plane = 0; plane < NumFrustumPlanes; ++plane)
+	{
+		m_Planes[plane] = D3DXPLANE( 0, 0, 0, 0 );
+	}
+}
+
+
+/////////////////////////////
+// Data access
+
+// Set a single plane, which is normalised
+void CFrustum::SetPlane( EFrustumPlane plane, const D3DXPLANE& value )
+{
+	D3DXPlaneNormalize( &m_Planes[plane], &value );
+}
+
+// Extract the planes from a combined view-projection matrix, giving a frustum in world space
+// A world point p is transformed to clip space by q = p * M, and is inside the frustum when -q.w <= q.x <= q.w, -q.w <= q.y <= q.w
+// and 0 <= q.z <= q.w. Each of these conditions is a plane made from the columns of M, e.g. q.w + q.x >= 0 is the left plane
+void CFrustum::ExtractFromMatrix( const D3DXMATRIX& m )
+{
+	SetPlane( FrustumLeft,   D3DXPLANE( m._14 + m._11, m._24 + m._21, m._34 + m._31, m._44 + m._41 ) );
+	SetPlane( FrustumRight,  D3DXPLANE( m._14 - m._11, m._24 - m._21, m._34 - m._31, m._44 - m._41 ) );
+	SetPlane( FrustumBottom, D3DXPLANE( m._14 + m._12, m._24 + m._22, m._34 + m._32, m._44 + m._42 ) );
+	SetPlane( FrustumTop,    D3DXPLANE( m._14 - m._12, m._24 - m._22, m._34 - m._32, m._44 - m._42 ) );
+	SetPlane( FrustumNear,   D3DXPLANE( m._13,         m._23,         m._33,         m._43 ) );
+	SetPlane( FrustumFar,    D3DXPLANE( m._14 - m._13, m._24 - m._23, m._34 - m._33, m._44 - m._43 ) );
+}
+
+
+/////////////////////////////
+// Culling
+
+// Test if a sphere is at least partly inside the frustum
+bool CFrustum::IsSphereVisible( const D3DXVECTOR3& centre, float radius ) const
+{
+	for (int plane = 0; plane < NumFrustumPlanes; ++plane)
+	{
+		// Outside if the whole sphere is behind any one plane
+		if (D3DXPlaneDotCoord( &m_Planes[plane], &centre ) < -radius)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Test if a sphere is entirely inside the frustum
+bool CFrustum::IsSphereInside( const D3DXVECTOR3& centre, float radius ) const
+{
+	for (int plane = 0; plane < NumFrustumPlanes; ++plane)
+	{
+		// Not inside if any part of the sphere is behind any one plane
+		if (D3DXPlaneDotCoord( &m_Planes[plane], &centre ) < radius)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Test a list of spheres against the frustum, four at a time using SSE. The sphere data is given as separate arrays of centre
+// x, y and z and radius (structure of arrays). Sets visible[i] to 1 if sphere i is at least partly inside the frustum, 0 otherwise
+// Returns the number of visible spheres
+unsigned int CFrustum::CullSpheres( const float* centreX, const float* centreY, const float* centreZ, const float* radius,
+                                    unsigned int numSpheres, unsigned char* visible ) const
+{
+	// Copy each plane component into all four lanes of an SSE register, done once for the whole list
+	__m128 planeA[NumFrustumPlanes], planeB[NumFrustumPlanes], planeC[NumFrustumPlanes], planeD[NumFrustumPlanes];
+	for (int plane = 0; plane < NumFrustumPlanes; ++plane)
+	{
+		planeA[plane] = _mm_set1_ps( m_Planes[plane].a );
+		planeB[plane] = _mm_set1_ps( m_Planes[plane].b );
+		planeC[plane] = _mm_set1_ps( m_Planes[plane].c );
+		planeD[plane] = _mm_set1_ps( m_Planes[plane].d );
+	}
+	const __m128 zero = _mm_setzero_ps();
+
+	// Each iteration tests four spheres against one plane at a time. A lane of the mask stays set while its sphere is in front of
+	// (or crossing) every plane so far. The arrays don't need to be aligned
+	unsigned int numVisible = 0;
+	unsigned int sphere = 0;
+	for (; sphere + 4 <= numSpheres; sphere += 4)
+	{
+		__m128 x = _mm_loadu_ps( centreX + sphere );
+		__m128 y = _mm_loadu_ps( centreY + sphere );
+		__m128 z = _mm_loadu_ps( centreZ + sphere );
+		__m128 negRadius = _mm_sub_ps( zero, _mm_loadu_ps( radius + sphere ) );
+
+		__m128 inside = _mm_cmpeq_ps( zero, zero ); // All bits set
+		for (int plane = 0; plane < NumFrustumPlanes; ++plane)
+		{
+			__m128 distance = _mm_add_ps( _mm_add_ps( _mm_mul_ps( planeA[plane], x ), _mm_mul_ps( planeB[plane], y ) ),
+			                              _mm_add_ps( _mm_mul_ps( planeC[plane], z ), planeD[plane] ) );
+			inside = _mm_and_ps( inside, _mm_cmpge_ps( distance, negRadius ) );
+		}
+
+		// One bit per sphere
+		int mask = _mm_movemask_ps( inside );
+		for (int lane = 0; lane < 4; ++lane)
+		{
+			visible[sphere + lane] = static_cast<unsigned char>((mask >> lane) & 1);
+			numVisible += visible[sphere + lane];
+		}
+	}
+
+	// Any spheres left over (less than four) are tested one at a time
+	for (; sphere < numSpheres; ++sphere)
+	{
+		visible[sphere] = IsSphereVisible( D3DXVECTOR3( centreX[sphere], centreY[sphere], centreZ[sphere] ), radius[sphere] ) ? 1 : 0;
+		numVisible += visible[sphere];
+	}
+
+	return numVisible;
+}
@@ -0,0 +1,81 @@
+//--------------------------------------------------------------------------------------
+//	Frustum.h
+//
+//	A frustum is the six planes bounding what a camera can see. Used to cull models that
+//	are entirely outside the view so they are never sent to the GPU
+//--------------------------------------------------------------------------------------
+
+#ifndef FRUSTUM_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define FRUSTUM_H_INCLUDED
+
+#include <d3d10.h>
+#include <d3dx10.h>
+
+
+// The planes of a frustum
+enum EFrustumPlane
+{
+	FrustumLeft,
+	FrustumRight,
+	FrustumBottom,
+	FrustumTop,
+	FrustumNear,
+	FrustumFar,
+	NumFrustumPlanes
+};
+
+
+class CFrustum
+{
+/////////////////////////////
+// Private member variables
+private:
+
+	// Planes with normalised normals pointing into the frustum, so a point p is inside a plane if a*p.x + b*p.y + c*p.z + d >= 0
+	D3DXPLANE m_Planes[NumFrustumPlanes];
+
+
+/////////////////////////////
+// Public member functions
+public:
+
+	///////////////////////////////
+	// Constructors / Destructors
+
+	// Constructor - creates a frustum that contains everything (all planes have zero normals)
+	CFrustum();
+
+
+	/////////////////////////////
+	// Data access
+
+	const D3DXPLANE& GetPlane( EFrustumPlane plane ) const
+	{
+		return m_Planes[plane];
+	}
+
+	// Set a single plane, which is normalised
+	void SetPlane( EFrustumPlane plane, const D3DXPLANE& value );
+
+	// Extract the planes from a combined view-projection matrix, giving a frustum in world space
+	void ExtractFromMatrix( const D3DXMATRIX& viewProjMatrix );
+
+
+	/////////////////////////////
+	// Culling
+
+	// Test if a sphere is at least partly inside the frustum
+	bool IsSphereVisible( const D3DXVECTOR3& centre, float radius ) const;
+
+	// Test if a sphere is entirely inside the frustum
+	bool IsSphereInside( const D3DXVECTOR3& centre, float radius ) const;
+
+	// Test a list of spheres against the frustum, four at a time using SSE. The sphere data is given as separate arrays of centre
+	// x, y and z and radius (structure of arrays). Sets visible[i] to 1 if sphere i is at least partly inside the frustum, 0 otherwise
+	// Returns the number of visible spheres
+	unsigned int CullSpheres( const float* centreX, const float* centreY, const float* centreZ, const float* radius,
+	                          unsigned int numSpheres, unsigned char* visible ) const;
+};
+
+
+#endif // End of header guard - see top of file
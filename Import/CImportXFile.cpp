@@ -13,6 +13,8 @@
 
 #include <algorithm>
 #include <numeric>
+#include <map>
+#include <set>
 using namespace std;
 
 #define INITGUID
@@ -78,9 +80,11 @@ EImportError CImportXFile::ImportFile
 {
 	GEN_GUARD;
 
-	// Wipe any existing data
+	// Wipe any existing data, including the arena - any sub-mesh data returned from the previous
+	// import is no longer valid
 	m_Frames.clear();
 	m_Meshes.clear();
+	m_Arena.Reset();
 	m_bImported = false;
 
 	// Ensure the file is an X-file
@@ -164,7 +168,10 @@ ERenderMethod CImportXFile::GetSubMeshRenderMethod( const TUInt32 iSubMesh ) con
 
 
 // Get the specification and data for given sub-mesh, returned through a pointer. May request
-// tangents to be calculated
+// tangents to be calculated, and may request the vertex data transformed into the space of the
+// root node rather than the submesh's own node (for users that don't keep the hierarchy)
+// The vertex and face data are allocated from the importer's arena, so remain valid until the
+// importer is destroyed or imports another file. The caller must not delete them
 // Possible return values:
 //		kSuccess:			...
 //		kOutOfSystemMemory:	...
@@ -172,27 +179,54 @@ EImportError CImportXFile::GetSubMesh
 (
 	const TUInt32 iSubMesh,
 	SSubMesh*     pOutSubMesh,
-	bool          bTangents /*= false*/
+	bool          bTangents /*= false*/,
+	bool          bRootSpace /*= false*/
 ) const
 {
 	GEN_GUARD;
 
-	// Set sub-mesh owner node
-	pOutSubMesh->node = m_Meshes[iSubMesh].iParentFrame;
-
-	// Calculate tangents if required
-	TXFileVectors tangents;
-	pOutSubMesh->hasTangents = bTangents;
-	if (pOutSubMesh->hasTangents)
+	// Size the sub-mesh, then fill in its data in space from the arena
+	GetSubMeshSpec( iSubMesh, pOutSubMesh, bTangents );
+	try
 	{
-		CalculateTangents( iSubMesh, &tangents );
+		pOutSubMesh->vertices =
+			m_Arena.AllocateArray<TUInt8>( pOutSubMesh->numVertices * pOutSubMesh->vertexSize );
+		pOutSubMesh->faces = m_Arena.AllocateArray<SMeshFace>( pOutSubMesh->numFaces );
 	}
+	catch (const bad_alloc&)
+	{
+		return kOutOfSystemMemory;
+	}
+	return GetSubMeshData( iSubMesh, pOutSubMesh, bRootSpace );
+
+	GEN_ENDGUARD;
+}
+
+
+// Get the specification of the given sub-mesh without its data: node, material, vertex
+// components and size, and the number of vertices and faces. The data pointers are not changed.
+// Tangents are only included if requested and the sub-mesh has the normals and texture coords
+// needed to calculate them. First half of a two-phase alternative to GetSubMesh, for callers
+// that want the data written to their own memory (see GetSubMeshData)
+void CImportXFile::GetSubMeshSpec
+(
+	const TUInt32 iSubMesh,
+	SSubMesh*     pOutSubMesh,
+	bool          bTangents /*= false*/
+) const
+{
+	GEN_GUARD;
+
+	// Set sub-mesh owner node and material (all faces in sub-mesh have the same material)
+	pOutSubMesh->node = m_Meshes[iSubMesh].iParentFrame;
+	pOutSubMesh->material = m_Meshes[iSubMesh].materialMap.front();
 
 	// Find what vertex data there is and calculate total vertex size
 	pOutSubMesh->hasSkinningData = (m_Meshes[iSubMesh].bones.size() > 0);
 	pOutSubMesh->hasNormals = (m_Meshes[iSubMesh].normals.size() > 0);
 	pOutSubMesh->hasTextureCoords = (m_Meshes[iSubMesh].textureCoords.size() > 0);
 	pOutSubMesh->hasVertexColours = (m_Meshes[iSubMesh].vertexColours.size() > 0);
+	pOutSubMesh->hasTangents = bTangents && pOutSubMesh->hasNormals && pOutSubMesh->hasTextureCoords;
 	pOutSubMesh->vertexSize = sizeof(CVector3) + 
 							  (pOutSubMesh->hasSkinningData ? 4 * sizeof(TFloat32) + sizeof(TUInt32) : 0) +
 	                          (pOutSubMesh->hasNormals ? sizeof(CVector3) : 0) +
@@ -201,12 +235,35 @@ EImportError CImportXFile::GetSubMesh
 	                          (pOutSubMesh->hasVertexColours ? sizeof(SXFileRGBAColour) : 0);
 	                          // Skinning data: assuming 4 float weights / 4 byte indices in TUInt32
 
-	// Set number of vertices and reserve space for vertex data
 	pOutSubMesh->numVertices = static_cast<TUInt32>(m_Meshes[iSubMesh].vertices.size());
-	pOutSubMesh->vertices = new TUInt8[pOutSubMesh->numVertices * pOutSubMesh->vertexSize];
-	if (!pOutSubMesh->vertices)
+	pOutSubMesh->numFaces = static_cast<TUInt32>(m_Meshes[iSubMesh].faces.size());
+
+	GEN_ENDGUARD;
+}
+
+
+// Write the vertex and face data of the given sub-mesh to the memory given in the sub-mesh, which
+// must first be filled in by GetSubMeshSpec. The vertices pointer must have space for numVertices
+// * vertexSize bytes and the faces pointer for numFaces faces, e.g. pointing into one larger
+// buffer holding several sub-meshes. May request the vertex data transformed into the space of
+// the root node rather than the submesh's own node (for users that don't keep the hierarchy)
+// Possible return values:
+//		kSuccess:			...
+EImportError CImportXFile::GetSubMeshData
+(
+	const TUInt32 iSubMesh,
+	SSubMesh*     pOutSubMesh,
+	bool          bRootSpace /*= false*/
+) const
+{
+	GEN_GUARD;
+
+	// Calculate tangents if required
+	CArenaAllocator<CVector3> vectorAllocator( &m_Arena );
+	TXFileVectors tangents( vectorAllocator );
+	if (pOutSubMesh->hasTangents)
 	{
-		return kOutOfSystemMemory;
+		CalculateTangents( iSubMesh, &tangents );
 	}
 
 	// Prefetch relevant vertex list info
@@ -259,6 +316,16 @@ EImportError CImportXFile::GetSubMesh
 		}
 	}
 
+	// Move vertex data from the sub-mesh's node into root space if required
+	if (bRootSpace)
+	{
+		CMatrix4x4 rootMatrix = GetRootMatrix( pOutSubMesh->node );
+		if (!rootMatrix.IsIdentity())
+		{
+			TransformSubMesh( pOutSubMesh, rootMatrix );
+		}
+	}
+
 	// Calculate bone influences if necessary
 	if (pOutSubMesh->hasSkinningData)
 	{
@@ -292,7 +359,7 @@ EImportError CImportXFile::GetSubMesh
 
 		// Normalise vertex bone weights (ensure they add up to 1)
 		TUInt8* pVert = pOutSubMesh->vertices;
-		for (TUInt32 vert = 0; vert < pOutSubMesh->vertexSize; ++vert)
+		for (TUInt32 vert = 0; vert < pOutSubMesh->numVertices; ++vert)
 		{
 			TFloat32* pVertBoneWeights = reinterpret_cast<TFloat32*>(pVert + boneWeightsOffset);
 			TUInt8* pVertBoneIndices = reinterpret_cast<TUInt8*>(pVert + boneIndicesOffset);
@@ -316,13 +383,6 @@ EImportError CImportXFile::GetSubMesh
 		}
 	}
 
-	// Pre-size face array
-	pOutSubMesh->numFaces = static_cast<TUInt32>(m_Meshes[iSubMesh].faces.size());
-	pOutSubMesh->faces = new SMeshFace[pOutSubMesh->numFaces];
-
-	// Get material from material map (all faces in sub-mesh have the same material at this point)
-	pOutSubMesh->material = m_Meshes[iSubMesh].materialMap.front();
-
 	// Loop through faces outputing to given sub-mesh
 	TXFileFaces::const_iterator itFace = m_Meshes[iSubMesh].faces.begin();
 	TXFileFaces::const_iterator itFaceEnd = m_Meshes[iSubMesh].faces.end();
@@ -430,6 +490,478 @@ void CImportXFile::GetMaterial
 }
 
 
+/////////////////////////////////////
+// Mesh simplification
+
+namespace
+{
+	// Number of steps a vertex position is quantised to across a grid cell when choosing a
+	// cluster's representative, so positions that differ only by rounding compare equal
+	const TFloat32 kfClusterSteps = 1024.0f;
+
+	// A cluster of vertices merged by SimplifyFaces
+	struct SVertexCluster
+	{
+		TUInt32 representative; // Vertex that replaces all the others
+		TUInt32 aiQuantised[3]; // Quantised position of the representative within the cell
+	};
+
+	// Whether quantised position a comes before b, comparing x, then y, then z
+	bool QuantisedLess( const TUInt32 a[3], const TUInt32 b[3] )
+	{
+		if (a[0] != b[0]) return a[0] < b[0];
+		if (a[1] != b[1]) return a[1] < b[1];
+		return a[2] < b[2];
+	}
+
+	// A face with its vertices rotated so the lowest index is first (keeps the winding order),
+	// used to find repeated faces
+	struct SFaceKey
+	{
+		TUInt32 i0, i1, i2;
+
+		SFaceKey( TUInt32 a, TUInt32 b, TUInt32 c )
+		{
+			if (a < b && a < c)  { i0 = a; i1 = b; i2 = c; }
+			else if (b < c)      { i0 = b; i1 = c; i2 = a; }
+			else                 { i0 = c; i1 = a; i2 = b; }
+		}
+
+		bool operator<( const SFaceKey& k ) const
+		{
+			if (i0 != k.i0) return i0 < k.i0;
+			if (i1 != k.i1) return i1 < k.i1;
+			return i2 < k.i2;
+		}
+	};
+}
+
+// Create a simplified list of faces for an output sub-mesh by vertex clustering. Space is
+// divided into a grid of cubes of the given size starting at the given origin, and all the
+// vertices in each cube are merged into the one with the lowest position in the cube (see
+// below). Collapsed and repeated faces are removed. The faces still use the sub-mesh's own
+// vertices, so a lower level of detail only needs a new index list. Use the same grid for all
+// sub-meshes of a mesh to avoid cracks between them. Returns the number of faces
+TUInt32 CImportXFile::SimplifyFaces
+(
+	const SSubMesh& subMesh,
+	const CVector3& gridOrigin,
+	const TFloat32  fCellSize,
+	TMeshFaces*     pFaces
+)
+{
+	GEN_GUARD;
+
+	pFaces->clear();
+	if (subMesh.numVertices == 0 || subMesh.numFaces == 0 || fCellSize <= 0.0f)
+	{
+		return 0;
+	}
+
+	// Find the grid cell of each vertex (position is the first element of a vertex). Cell
+	// coordinates are packed 21 bits each into a key
+	//
+	// The representative of each cluster depends only on the positions in the cell: the vertex
+	// with the lowest quantised position (x, then y, then z), the lowest index if several share
+	// it. Sub-meshes sharing the cell's lowest vertex, as along a seam, choose the same position
+	// whatever their other vertices are. Choosing by anything particular to the sub-mesh, such
+	// as the average of its vertices, gives each sub-mesh its own choice and cracks the seams
+	vector<SVertexCluster> clusters;
+	vector<TUInt32> vertexClusters( subMesh.numVertices );
+	map<TUInt64, TUInt32> cellClusters;
+	TFloat32 fInvCellSize = 1.0f / fCellSize;
+	for (TUInt32 vert = 0; vert < subMesh.numVertices; ++vert)
+	{
+		const CVector3& position =
+			*reinterpret_cast<const CVector3*>(subMesh.vertices + vert * subMesh.vertexSize);
+		CVector3 cell = (position - gridOrigin) * fInvCellSize;
+		TFloat32 afCell[3] = { Max( 0.0f, cell.x ), Max( 0.0f, cell.y ), Max( 0.0f, cell.z ) };
+		TUInt64 key = (static_cast<TUInt64>(afCell[0]) & 0x1fffff) |
+		              ((static_cast<TUInt64>(afCell[1]) & 0x1fffff) << 21) |
+		              ((static_cast<TUInt64>(afCell[2]) & 0x1fffff) << 42);
+
+		// Position within the cell in steps of 1/kfClusterSteps of the cell size
+		SVertexCluster candidate;
+		candidate.representative = vert;
+		for (TUInt32 axis = 0; axis < 3; ++axis)
+		{
+			TFloat32 fInCell = afCell[axis] - static_cast<TFloat32>(static_cast<TUInt64>(afCell[axis]));
+			candidate.aiQuantised[axis] = static_cast<TUInt32>(fInCell * kfClusterSteps);
+		}
+
+		map<TUInt64, TUInt32>::iterator itCell = cellClusters.find( key );
+		if (itCell == cellClusters.end())
+		{
+			itCell = cellClusters.insert( make_pair( key, static_cast<TUInt32>(clusters.size()) ) ).first;
+			clusters.push_back( candidate );
+		}
+		else if (QuantisedLess( candidate.aiQuantised, clusters[itCell->second].aiQuantised ))
+		{
+			clusters[itCell->second] = candidate; // Vertices are visited in index order so ties keep the lowest
+		}
+		vertexClusters[vert] = itCell->second;
+	}
+
+	// Replace each face's vertices with their representatives, keeping faces that still have
+	// three different vertices and haven't been seen already
+	set<SFaceKey> faceKeys;
+	for (TUInt32 face = 0; face < subMesh.numFaces; ++face)
+	{
+		SMeshFace newFace;
+		for (TUInt32 corner = 0; corner < 3; ++corner)
+		{
+			TUInt32 vert = subMesh.faces[face].aiVertex[corner];
+			newFace.aiVertex[corner] = clusters[vertexClusters[vert]].representative;
+		}
+		if (newFace.aiVertex[0] == newFace.aiVertex[1] || newFace.aiVertex[1] == newFace.aiVertex[2] ||
+		    newFace.aiVertex[2] == newFace.aiVertex[0])
+		{
+			continue;
+		}
+		if (faceKeys.insert( SFaceKey( newFace.aiVertex[0], newFace.aiVertex[1], newFace.aiVertex[2] ) ).second)
+		{
+			pFaces->push_back( newFace );
+		}
+	}
+
+	return static_cast<TUInt32>(pFaces->size());
+
+	GEN_ENDGUARD;
+}
+
+
+/////////////////////////////////////
+// Mesh optimisation
+
+namespace
+{
+	// Vertex scoring constants for OptimiseFaceOrder, the values suggested by Forsyth
+	const TFloat32 kfCacheDecayPower   = 1.5f;
+	const TFloat32 kfLastFaceScore     = 0.75f;
+	const TFloat32 kfValenceBoostScale = 2.0f;
+	const TFloat32 kfValenceBoostPower = 0.5f;
+
+	// Score a vertex given its position in the simulated cache (-1 if not in it) and the number
+	// of faces still to be output that use it
+	TFloat32 VertexCacheScore
+	(
+		const TInt32  cachePosition,
+		const TUInt32 numActiveFaces,
+		const TUInt32 cacheSize
+	)
+	{
+		if (numActiveFaces == 0)
+		{
+			return -1.0f; // Vertex is finished with, never choose faces because of it
+		}
+
+		TFloat32 score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			if (cachePosition < 3)
+			{
+				// Used by the face just output. Fixed score so there is no preference for which
+				// direction to continue in
+				score = kfLastFaceScore;
+			}
+			else
+			{
+				// Higher the more recently the vertex was used
+				TFloat32 scale = 1.0f / static_cast<TFloat32>(cacheSize - 3);
+				score = Pow( 1.0f - static_cast<TFloat32>(cachePosition - 3) * scale, kfCacheDecayPower );
+			}
+		}
+
+		// Boost vertices with few faces left, so they are finished off rather than leaving
+		// isolated faces to be drawn later with no cache use
+		score += kfValenceBoostScale * Pow( static_cast<TFloat32>(numActiveFaces), -kfValenceBoostPower );
+		return score;
+	}
+}
+
+// Reorder the faces of a list for vertex cache locality, using Tom Forsyth's linear-speed
+// vertex cache optimisation. Each vertex is scored from its position in a simulated cache
+// and the number of faces still using it, and the face with the best vertices is output
+// next. The order suits any cache size up to kiVertexCacheSize
+void CImportXFile::OptimiseFaceOrder
+(
+	SMeshFace*    pFaces,
+	const TUInt32 numFaces,
+	const TUInt32 numVertices
+)
+{
+	GEN_GUARD;
+
+	if (numFaces == 0 || numVertices == 0)
+	{
+		return;
+	}
+	const TUInt32 kiNoFace = 0xffffffff;
+
+	// List the faces using each vertex, all in one array with a start index for each vertex.
+	// The faces still to be output are kept at the front of each vertex's range
+	vector<TUInt32> vertexFaceStart( numVertices + 1, 0 );
+	for (TUInt32 face = 0; face < numFaces; ++face)
+	{
+		for (TUInt32 corner = 0; corner < 3; ++corner)
+		{
+			++vertexFaceStart[pFaces[face].aiVertex[corner] + 1];
+		}
+	}
+	for (TUInt32 vert = 0; vert < numVertices; ++vert)
+	{
+		vertexFaceStart[vert + 1] += vertexFaceStart[vert];
+	}
+	vector<TUInt32> vertexFaces( numFaces * 3 );
+	vector<TUInt32> numActiveFaces( numVertices, 0 );
+	for (TUInt32 face = 0; face < numFaces; ++face)
+	{
+		for (TUInt32 corner = 0; corner < 3; ++corner)
+		{
+			TUInt32 vert = pFaces[face].aiVertex[corner];
+			vertexFaces[vertexFaceStart[vert] + numActiveFaces[vert]++] = face;
+		}
+	}
+
+	// Initial scores, nothing is in the cache
+	vector<TInt32> cachePositions( numVertices, -1 );
+	vector<TFloat32> vertexScores( numVertices );
+	for (TUInt32 vert = 0; vert < numVertices; ++vert)
+	{
+		vertexScores[vert] = VertexCacheScore( -1, numActiveFaces[vert], kiVertexCacheSize );
+	}
+	vector<TFloat32> faceScores( numFaces );
+	vector<bool> faceAdded( numFaces, false );
+	for (TUInt32 face = 0; face < numFaces; ++face)
+	{
+		const SMeshFace& meshFace = pFaces[face];
+		faceScores[face] = vertexScores[meshFace.aiVertex[0]] + vertexScores[meshFace.aiVertex[1]] +
+		                   vertexScores[meshFace.aiVertex[2]];
+	}
+
+	// The cache holds up to three extra vertices while a face is added, the oldest then drop out
+	vector<TUInt32> cache, newCache;
+	cache.reserve( kiVertexCacheSize + 3 );
+	newCache.reserve( kiVertexCacheSize + 3 );
+	TMeshFaces outFaces;
+	outFaces.reserve( numFaces );
+
+	TUInt32 bestFace = kiNoFace;
+	TUInt32 firstUnadded = 0; // All faces before this have been output
+	while (outFaces.size() < numFaces)
+	{
+		// Normally the best face is found among those using the cached vertices. When there is
+		// none (at the start, or when a region is finished) search all the remaining faces
+		if (bestFace == kiNoFace)
+		{
+			while (faceAdded[firstUnadded])
+			{
+				++firstUnadded;
+			}
+			bestFace = firstUnadded;
+			for (TUInt32 face = firstUnadded + 1; face < numFaces; ++face)
+			{
+				if (!faceAdded[face] && faceScores[face] > faceScores[bestFace])
+				{
+					bestFace = face;
+				}
+			}
+		}
+
+		const SMeshFace& meshFace = pFaces[bestFace];
+		outFaces.push_back( meshFace );
+		faceAdded[bestFace] = true;
+
+		// Take the face out of the active part of its vertices' face lists
+		for (TUInt32 corner = 0; corner < 3; ++corner)
+		{
+			TUInt32 vert = meshFace.aiVertex[corner];
+			TUInt32* faces = &vertexFaces[vertexFaceStart[vert]];
+			for (TUInt32 activeFace = 0; activeFace < numActiveFaces[vert]; ++activeFace)
+			{
+				if (faces[activeFace] == bestFace)
+				{
+					swap( faces[activeFace], faces[numActiveFaces[vert] - 1] );
+					--numActiveFaces[vert];
+					break;
+				}
+			}
+		}
+
+		// The face's vertices move to the front of the cache (LRU), followed by the rest of the
+		// old cache in order
+		newCache.clear();
+		for (TUInt32 corner = 0; corner < 3; ++corner)
+		{
+			TUInt32 vert = meshFace.aiVertex[corner];
+			if (find( newCache.begin(), newCache.end(), vert ) == newCache.end())
+			{
+				newCache.push_back( vert );
+			}
+		}
+		TUInt32 numFaceVertices = static_cast<TUInt32>(newCache.size());
+		for (TUInt32 entry = 0; entry < cache.size(); ++entry)
+		{
+			if (find( newCache.begin(), newCache.begin() + numFaceVertices, cache[entry] ) ==
+			    newCache.begin() + numFaceVertices)
+			{
+				newCache.push_back( cache[entry] );
+			}
+		}
+
+		// Rescore the vertices whose cache state changed, including any that have just dropped
+		// out, then rescore their remaining faces and choose the best of those for the next face
+		for (TUInt32 entry = 0; entry < newCache.size(); ++entry)
+		{
+			TUInt32 vert = newCache[entry];
+			cachePositions[vert] = (entry < kiVertexCacheSize) ? static_cast<TInt32>(entry) : -1;
+			vertexScores[vert] = VertexCacheScore( cachePositions[vert], numActiveFaces[vert], kiVertexCacheSize );
+		}
+		bestFace = kiNoFace;
+		TFloat32 bestScore = -1.0f;
+		for (TUInt32 entry = 0; entry < newCache.size(); ++entry)
+		{
+			TUInt32 vert = newCache[entry];
+			const TUInt32* faces = &vertexFaces[vertexFaceStart[vert]];
+			for (TUInt32 activeFace = 0; activeFace < numActiveFaces[vert]; ++activeFace)
+			{
+				TUInt32 face = faces[activeFace];
+				const SMeshFace& scoreFace = pFaces[face];
+				faceScores[face] = vertexScores[scoreFace.aiVertex[0]] + vertexScores[scoreFace.aiVertex[1]] +
+				                   vertexScores[scoreFace.aiVertex[2]];
+				if (faceScores[face] > bestScore)
+				{
+					bestFace = face;
+					bestScore = faceScores[face];
+				}
+			}
+		}
+
+		if (newCache.size() > kiVertexCacheSize)
+		{
+			newCache.resize( kiVertexCacheSize );
+		}
+		cache.swap( newCache );
+	}
+
+	copy( outFaces.begin(), outFaces.end(), pFaces );
+
+	GEN_ENDGUARD;
+}
+
+// Reorder the vertices of an output sub-mesh into the order the faces first use them, so
+// vertex fetches move steadily through memory. Vertices used by no face go at the end
+void CImportXFile::OptimiseVertexOrder( SSubMesh* pSubMesh )
+{
+	GEN_GUARD;
+
+	if (pSubMesh->numVertices == 0)
+	{
+		return;
+	}
+	const TUInt32 kiUnused = 0xffffffff;
+
+	// Number the vertices in order of first use, renumbering the faces as we go
+	vector<TUInt32> newIndices( pSubMesh->numVertices, kiUnused );
+	TUInt32 nextIndex = 0;
+	for (TUInt32 face = 0; face < pSubMesh->numFaces; ++face)
+	{
+		for (TUInt32 corner = 0; corner < 3; ++corner)
+		{
+			TUInt32& vert = pSubMesh->faces[face].aiVertex[corner];
+			if (newIndices[vert] == kiUnused)
+			{
+				newIndices[vert] = nextIndex++;
+			}
+			vert = newIndices[vert];
+		}
+	}
+	for (TUInt32 vert = 0; vert < pSubMesh->numVertices; ++vert)
+	{
+		if (newIndices[vert] == kiUnused)
+		{
+			newIndices[vert] = nextIndex++;
+		}
+	}
+
+	// Move the raw vertex data, which takes all components (including skinning data) with it
+	TUInt32 vertexSize = pSubMesh->vertexSize;
+	vector<TUInt8> oldVertices( pSubMesh->vertices, pSubMesh->vertices + pSubMesh->numVertices * vertexSize );
+	for (TUInt32 vert = 0; vert < pSubMesh->numVertices; ++vert)
+	{
+		memcpy( pSubMesh->vertices + newIndices[vert] * vertexSize, &oldVertices[vert * vertexSize], vertexSize );
+	}
+
+	GEN_ENDGUARD;
+}
+
+// Optimise an output sub-mesh for the GPU: reorder the faces for the vertex cache then
+// reorder the vertices to match. Optionally returns the average cache miss ratio (ACMR,
+// see CalculateACMR) before and after
+void CImportXFile::OptimiseSubMesh
+(
+	SSubMesh* pSubMesh,
+	TFloat32* pACMRBefore /*= 0*/,
+	TFloat32* pACMRAfter /*= 0*/
+)
+{
+	GEN_GUARD;
+
+	if (pACMRBefore)
+	{
+		*pACMRBefore = CalculateACMR( pSubMesh->faces, pSubMesh->numFaces, pSubMesh->numVertices );
+	}
+
+	OptimiseFaceOrder( pSubMesh->faces, pSubMesh->numFaces, pSubMesh->numVertices );
+	OptimiseVertexOrder( pSubMesh );
+
+	if (pACMRAfter)
+	{
+		*pACMRAfter = CalculateACMR( pSubMesh->faces, pSubMesh->numFaces, pSubMesh->numVertices );
+	}
+
+	GEN_ENDGUARD;
+}
+
+// Return the average cache miss ratio of a face list: the number of vertices that miss a
+// FIFO post-transform cache of the given size per face. 3 is the worst possible, 0.5 is
+// about the best for a regular grid
+TFloat32 CImportXFile::CalculateACMR
+(
+	const SMeshFace* pFaces,
+	const TUInt32    numFaces,
+	const TUInt32    numVertices,
+	const TUInt32    cacheSize /*= 16*/
+)
+{
+	GEN_GUARD;
+
+	if (numFaces == 0)
+	{
+		return 0.0f;
+	}
+
+	// Each vertex records the miss count when it entered the cache (0 if never). A FIFO cache
+	// holds the vertices of the most recent cacheSize misses
+	vector<TUInt32> missTimes( numVertices, 0 );
+	TUInt32 numMisses = 0;
+	for (TUInt32 face = 0; face < numFaces; ++face)
+	{
+		for (TUInt32 corner = 0; corner < 3; ++corner)
+		{
+			TUInt32 vert = pFaces[face].aiVertex[corner];
+			if (missTimes[vert] == 0 || missTimes[vert] + cacheSize <= numMisses)
+			{
+				missTimes[vert] = ++numMisses;
+			}
+		}
+	}
+	return static_cast<TFloat32>(numMisses) / static_cast<TFloat32>(numFaces);
+
+	GEN_ENDGUARD;
+}
+
+
 /*-----------------------------------------------------------------------------------------
 	X-File API support
 -----------------------------------------------------------------------------------------*/
@@ -746,7 +1278,7 @@ EImportError CImportXFile::ParseXFileMesh
 
 	// Create new mesh
 	TUInt32 iCurrMesh = static_cast<TUInt32>(m_Meshes.size());
-	m_Meshes.push_back( SXFileMesh() );
+	m_Meshes.push_back( SXFileMesh( &m_Arena ) );
 
 	// Set owner frame
 	m_Meshes[iCurrMesh].iParentFrame = iCurrFrame;
@@ -900,6 +1432,21 @@ EImportError CImportXFile::ReadMeshData
 	TUInt32 iNumFaces;
 	ReadXFileLockedUInt( pMeshData, &iNumFaces );
 	m_Meshes[iMesh].origFaceEdges.resize( iNumFaces ); // See below
+
+	// Count the triangles first so the face list is allocated once - the list's memory is from
+	// the arena, so each time it grows the old memory is not reused
+	const TUInt8* pMeshDataEnd = pMeshDataStart + iMeshDataSize;
+	const TUInt8* pFaceData = pMeshData;
+	TUInt32 iNumTriangles = 0;
+	for (TUInt32 iFace = 0; iFace < iNumFaces && pFaceData < pMeshDataEnd; ++iFace)
+	{
+		TUInt32 iNumEdges;
+		ReadXFileLockedUInt( pFaceData, &iNumEdges );
+		iNumTriangles += (iNumEdges > 2) ? iNumEdges - 2 : 0;
+		pFaceData += iNumEdges * sizeof(TUInt32);
+	}
+	m_Meshes[iMesh].faces.reserve( iNumTriangles );
+
 	for (TUInt32 iFace = 0; iFace < iNumFaces; ++iFace)
 	{
 		TUInt32 iNumEdges;
@@ -978,7 +1525,9 @@ EImportError CImportXFile::ReadNormalData
 		return kInvalidData;
 	}
 
-	// Read normal faces - they can be general polygons - convert them all to triangles
+	// Read normal faces - they can be general polygons - convert them all to triangles. The
+	// edge counts match the original faces, so there will be as many triangles as in the face list
+	m_Meshes[iMesh].normalFaces.reserve( m_Meshes[iMesh].faces.size() );
 	for (TUInt32 iFace = 0; iFace < iNumNormalFaces; ++iFace)
 	{
 		TUInt32 iNumEdges;
@@ -1613,15 +2162,11 @@ EImportError CImportXFile::GetXFileDataName
 	}
 	else
 	{
-		char* szName = new char[iDataSize];
-		if (!szName)
-		{
-			return kOutOfSystemMemory;
-		}
+		// Temporary buffer from the arena, freed with the rest of the import data
+		char* szName = m_Arena.AllocateArray<char>( iDataSize );
 		xFileError = pXFileData->GetName( szName, &iDataSize );
 		GEN_ASSERT( xFileError == S_OK, "Failure getting X-File name" );
 		sName = szName;
-		delete[] szName;
 	}
 
 	return kSuccess;
@@ -1788,11 +2333,12 @@ void CImportXFile::MatchFaceLists
 		                                   mesh.origFaceEdges.end(), 0 );
 
 		// Create empty vertex and normal maps - use max vertex value as unused marker
-		TXFileInts vertexMap( iMaxVertices, iMaxVertices );
-		TXFileInts normalMap( iMaxVertices, iMaxVertices );
+		CArenaAllocator<TUInt32> intAllocator( &m_Arena );
+		TXFileInts vertexMap( iMaxVertices, iMaxVertices, intAllocator );
+		TXFileInts normalMap( iMaxVertices, iMaxVertices, intAllocator );
 
 		// Table of vertex duplicates created by this process, each entry is next copy of vertex
-		TXFileInts vertexDup( iMaxVertices, iMaxVertices );
+		TXFileInts vertexDup( iMaxVertices, iMaxVertices, intAllocator );
 
 		// May need to duplicate vertices, count from original number of vertices
 		TUInt32 iNewNumVertices = static_cast<TUInt32>(mesh.vertices.size()); 
@@ -1851,6 +2397,21 @@ void CImportXFile::MatchFaceLists
 		TUInt32 iOldNumVertices = static_cast<TUInt32>(mesh.vertices.size());
 		if (iNewNumVertices > iOldNumVertices)
 		{
+			// Grow each list once rather than as the vertices are added
+			mesh.vertices.reserve( iNewNumVertices );
+			if (!mesh.textureCoords.empty())
+			{
+				mesh.textureCoords.reserve( iNewNumVertices );
+			}
+			if (!mesh.vertexColours.empty())
+			{
+				mesh.vertexColours.reserve( iNewNumVertices );
+			}
+			if (!mesh.duplicateIndices.empty())
+			{
+				mesh.duplicateIndices.reserve( iNewNumVertices );
+			}
+
 			// For every added vertex...
 			for (TUInt32 iVertex = iOldNumVertices; iVertex < iNewNumVertices; ++iVertex)
 			{
@@ -1872,7 +2433,8 @@ void CImportXFile::MatchFaceLists
 		}
 
 		// Build full updated normal list and replace original normals
-		TXFileVectors newNormals( iNewNumVertices );
+		TXFileVectors newNormals( iNewNumVertices, CVector3::kOrigin,
+		                          CArenaAllocator<CVector3>( &m_Arena ) );
 		for (TUInt32 iNormal = 0; iNormal < iNewNumVertices; ++iNormal)
 		{
 			newNormals[iNormal] = mesh.normals[normalMap[iNormal]];
@@ -2019,44 +2581,83 @@ void CImportXFile::SplitMeshes()
 {
 	GEN_GUARD;
 
-	TUInt32 iNumOrigMeshes = static_cast<TUInt32>(m_Meshes.size());
-	for (TUInt32 iMesh = 0; iMesh < iNumOrigMeshes; ++iMesh)
+	// Build the split meshes in a new list, which is sized up front and its meshes filled in
+	// place, so no mesh (and its data) is copied
+	TUInt32 iNumNewMeshes = 0;
+	for (TUInt32 iMesh = 0; iMesh < m_Meshes.size(); ++iMesh)
+	{
+		iNumNewMeshes += static_cast<TUInt32>(m_Meshes[iMesh].materials.size());
+	}
+	TXFileMeshes newMeshes;
+	newMeshes.reserve( iNumNewMeshes );
+
+	for (TUInt32 iMesh = 0; iMesh < m_Meshes.size(); ++iMesh)
 	{
-		TUInt32 iMaxVertices = static_cast<TUInt32>(m_Meshes[iMesh].vertices.size());
+		const SXFileMesh& mesh = m_Meshes[iMesh];
+		TUInt32 iMaxVertices = static_cast<TUInt32>(mesh.vertices.size());
+		CArenaAllocator<TUInt32> intAllocator( &m_Arena );
+		TXFileInts vertexMap( intAllocator );
 
-		for (TUInt32 iMaterial = 0; iMaterial < m_Meshes[iMesh].materials.size(); ++iMaterial)
+		for (TUInt32 iMaterial = 0; iMaterial < mesh.materials.size(); ++iMaterial)
 		{
-			SXFileMesh newMesh;
-			newMesh.iParentFrame = m_Meshes[iMesh].iParentFrame;
-			newMesh.materials.push_back( m_Meshes[iMesh].materials[iMaterial] );
-			newMesh.materialMap.push_back( m_Meshes[iMesh].materialMap[iMaterial] );
+			// Count the faces using this material to size the new mesh's lists
+			TUInt32 iNumFaces = static_cast<TUInt32>(
+				count( mesh.faceMaterials.begin(), mesh.faceMaterials.end(), iMaterial ) );
+			if (iNumFaces == 0)
+			{
+				continue;
+			}
+			TUInt32 iNumVertices = min( 3 * iNumFaces, iMaxVertices );
+
+			newMeshes.push_back( SXFileMesh( &m_Arena ) );
+			SXFileMesh& newMesh = newMeshes.back();
+			newMesh.iParentFrame = mesh.iParentFrame;
+			newMesh.iMaxBonesPerVertex = mesh.iMaxBonesPerVertex;
+			newMesh.iMaxBonesPerFace = mesh.iMaxBonesPerFace;
+			newMesh.materials.push_back( mesh.materials[iMaterial] );
+			newMesh.materialMap.push_back( mesh.materialMap[iMaterial] );
+			newMesh.faces.reserve( iNumFaces );
+			newMesh.faceMaterials.assign( iNumFaces, 0 );
+			newMesh.vertices.reserve( iNumVertices );
+			if (mesh.normals.size() > 0)
+			{
+				newMesh.normals.reserve( iNumVertices );
+			}
+			if (mesh.textureCoords.size() > 0)
+			{
+				newMesh.textureCoords.reserve( iNumVertices );
+			}
+			if (mesh.vertexColours.size() > 0)
+			{
+				newMesh.vertexColours.reserve( iNumVertices );
+			}
 
-			TXFileInts vertexMap( iMaxVertices, iMaxVertices );
+			// Reuses the same memory for each material
+			vertexMap.assign( iMaxVertices, iMaxVertices );
 
-			for (TUInt32 iFace = 0; iFace < m_Meshes[iMesh].faceMaterials.size(); ++iFace)
+			for (TUInt32 iFace = 0; iFace < mesh.faceMaterials.size(); ++iFace)
 			{
-				if (m_Meshes[iMesh].faceMaterials[iFace] == iMaterial)
+				if (mesh.faceMaterials[iFace] == iMaterial)
 				{
-					newMesh.faceMaterials.push_back( 0 );
 					SXFileFace newFace;
 					for (TUInt32 iIndex = 0; iIndex < 3; ++iIndex)
 					{
-						TUInt32 iVert = m_Meshes[iMesh].faces[iFace].aiVertex[iIndex];
+						TUInt32 iVert = mesh.faces[iFace].aiVertex[iIndex];
 						if (vertexMap[iVert] == iMaxVertices)
 						{
 							vertexMap[iVert] = static_cast<TUInt32>(newMesh.vertices.size());
-							newMesh.vertices.push_back( m_Meshes[iMesh].vertices[iVert] );
-							if (m_Meshes[iMesh].normals.size() > 0)
+							newMesh.vertices.push_back( mesh.vertices[iVert] );
+							if (mesh.normals.size() > 0)
 							{
-								newMesh.normals.push_back( m_Meshes[iMesh].normals[iVert] );
+								newMesh.normals.push_back( mesh.normals[iVert] );
 							}
-							if (m_Meshes[iMesh].textureCoords.size() > 0)
+							if (mesh.textureCoords.size() > 0)
 							{
-								newMesh.textureCoords.push_back( m_Meshes[iMesh].textureCoords[iVert] );
+								newMesh.textureCoords.push_back( mesh.textureCoords[iVert] );
 							}
-							if (m_Meshes[iMesh].vertexColours.size() > 0)
+							if (mesh.vertexColours.size() > 0)
 							{
-								newMesh.vertexColours.push_back( m_Meshes[iMesh].vertexColours[iVert] );
+								newMesh.vertexColours.push_back( mesh.vertexColours[iVert] );
 							}
 						}
 						newFace.aiVertex[iIndex] = vertexMap[iVert];
@@ -2064,18 +2665,93 @@ void CImportXFile::SplitMeshes()
 					newMesh.faces.push_back( newFace );
 				}
 			}
-			if (newMesh.vertices.size() > 0)
+
+			// Each bone keeps the weights of the vertices used by this material, renumbered to
+			// the new mesh. Bones are kept even with no weights left so the count matches the
+			// skinning header
+			for (TUInt32 iBone = 0; iBone < mesh.bones.size(); ++iBone)
 			{
-				m_Meshes.push_back( newMesh );
+				const SXFileBone& bone = mesh.bones[iBone];
+				newMesh.bones.push_back( SXFileBone() );
+				SXFileBone& newBone = newMesh.bones.back();
+				newBone.sFrameName = bone.sFrameName;
+				newBone.iFrame = bone.iFrame;
+				newBone.offsetMatrix = bone.offsetMatrix;
+				for (TUInt32 iWeight = 0; iWeight < bone.weights.size(); ++iWeight)
+				{
+					TUInt32 iVert = bone.weights[iWeight].iVertexIndex;
+					if (iVert < iMaxVertices && vertexMap[iVert] != iMaxVertices)
+					{
+						SXFileBoneWeight newWeight = { vertexMap[iVert], bone.weights[iWeight].fWeight };
+						newBone.weights.push_back( newWeight );
+					}
+				}
 			}
 		}
 	}
-	m_Meshes.erase( m_Meshes.begin(), m_Meshes.begin() + iNumOrigMeshes );
+	m_Meshes.swap( newMeshes );
 
 	GEN_ENDGUARD;
 }
 
 
+// Return the matrix that transforms from the space of the given frame to the space of the root
+// frame, i.e. the frame's default matrix combined with those of all its ancestors
+CMatrix4x4 CImportXFile::GetRootMatrix( TUInt32 iFrame ) const
+{
+	CMatrix4x4 rootMatrix = m_Frames[iFrame].defaultMatrix;
+	while (iFrame != 0)
+	{
+		iFrame = m_Frames[iFrame].iParentIndex;
+		rootMatrix.MultiplyAffine( m_Frames[iFrame].defaultMatrix );
+	}
+	return rootMatrix;
+}
+
+// Transform the vertex data of an output sub-mesh by the given matrix, positions as points
+// and normals and tangents as vectors, which are renormalised. Normals use the inverse
+// transpose of the matrix, tangents the matrix itself
+void CImportXFile::TransformSubMesh
+(
+	SSubMesh*         pSubMesh,
+	const CMatrix4x4& matrix
+)
+{
+	if (pSubMesh->numVertices == 0)
+	{
+		return;
+	}
+
+	// Positions are the first element of each vertex
+	TUInt8* pVertices = pSubMesh->vertices;
+	TUInt32 vertexSize = pSubMesh->vertexSize;
+	matrix.TransformPoints( pVertices, vertexSize, pVertices, vertexSize, pSubMesh->numVertices );
+
+	// Normals and tangents follow the position and bone data, normal first. Normals are
+	// transformed by the inverse transpose so they stay perpendicular to the surface under
+	// non-uniform scaling. Tangents lie in the surface, so they are transformed like the
+	// surface itself, by the matrix
+	TUInt32 offset = sizeof(CVector3) + (pSubMesh->hasSkinningData ? 4 * sizeof(TFloat32) + sizeof(TUInt32) : 0);
+	TUInt32 numVectors = (pSubMesh->hasNormals ? 1 : 0) + (pSubMesh->hasTangents ? 1 : 0);
+	if (numVectors == 0)
+	{
+		return;
+	}
+	CMatrix4x4 normalMatrix = Transpose( InverseAffine( matrix ) );
+	for (TUInt32 vector = 0; vector < numVectors; ++vector)
+	{
+		TUInt8* pVectors = pVertices + offset + vector * sizeof(CVector3);
+		bool bNormal = pSubMesh->hasNormals && vector == 0;
+		const CMatrix4x4& vectorMatrix = bNormal ? normalMatrix : matrix;
+		vectorMatrix.TransformVectors( pVectors, vertexSize, pVectors, vertexSize, pSubMesh->numVertices );
+		for (TUInt32 vert = 0; vert < pSubMesh->numVertices; ++vert)
+		{
+			reinterpret_cast<CVector3*>(pVectors + vert * vertexSize)->Normalise();
+		}
+	}
+}
+
+
 // Create a list of tangent vectors for the given mesh. The tangent vector is the direction of
 // a vertex's texture U axis in model-space. Returns true on success
 bool CImportXFile::CalculateTangents
@@ -22,6 +22,7 @@ using namespace std;
 #include "CVector3.h"
 #include "CMatrix4x4.h"
 #include "MeshData.h"
+#include "CArena.h"
 
 namespace gen
 {
@@ -84,6 +85,14 @@ public:
 	);
 
 
+	// Get the memory held for the imported file's data (the importer's arena), in bytes. It is
+	// freed when the importer is destroyed or imports another file
+	size_t GetMemoryUsed() const
+	{
+		return m_Arena.GetTotalSize();
+	}
+
+
 	/////////////////////////////////////
 	// Data access
 
@@ -111,17 +120,47 @@ public:
 	ERenderMethod GetSubMeshRenderMethod( const TUInt32 iSubMesh ) const;
 		
 	// Get the specification and data for given submesh, returned through a pointer. May request
-	// tangents to be calculated
+	// tangents to be calculated, and may request the vertex data transformed into the space of the
+	// root node rather than the submesh's own node (for users that don't keep the hierarchy)
+	// The vertex and face data are allocated from the importer's arena, so remain valid until the
+	// importer is destroyed or imports another file. The caller must not delete them
 	// Possible return values:
 	//		kSuccess:			...
 	//		kOutOfSystemMemory:	...
 	EImportError CImportXFile::GetSubMesh
+	(
+		const TUInt32 iSubMesh,
+		SSubMesh*     pSubMesh,
+		bool          bTangents = false,
+		bool          bRootSpace = false
+	) const;
+
+	// Get the specification of the given sub-mesh without its data: node, material, vertex
+	// components and size, and the number of vertices and faces. The data pointers are not
+	// changed. Tangents are only included if requested and the sub-mesh has the normals and
+	// texture coords needed to calculate them. First half of a two-phase alternative to
+	// GetSubMesh, for callers that want the data written to their own memory (see GetSubMeshData)
+	void GetSubMeshSpec
 	(
 		const TUInt32 iSubMesh,
 		SSubMesh*     pSubMesh,
 		bool          bTangents = false
 	) const;
 
+	// Write the vertex and face data of the given sub-mesh to the memory given in the sub-mesh,
+	// which must first be filled in by GetSubMeshSpec. The vertices pointer must have space for
+	// numVertices * vertexSize bytes and the faces pointer for numFaces faces, e.g. pointing into
+	// one larger buffer holding several sub-meshes. May request the vertex data transformed into
+	// the space of the root node rather than the submesh's own node
+	// Possible return values:
+	//		kSuccess:			...
+	EImportError GetSubMeshData
+	(
+		const TUInt32 iSubMesh,
+		SSubMesh*     pSubMesh,
+		bool          bRootSpace = false
+	) const;
+
 
 	// Get the number of materials used in the mesh (across all submeshes - i.e. in all meshes
 	// in an X-File)
@@ -167,6 +206,61 @@ public:
 		const string& sXName
 	);
 
+	// Create a simplified list of faces for an output sub-mesh by vertex clustering. Space is
+	// divided into a grid of cubes of the given size starting at the given origin, and all the
+	// vertices in each cube are merged into the one with the lowest position in the cube, which
+	// depends only on the positions so sub-meshes sharing that vertex agree. Collapsed and
+	// repeated faces are removed. The faces still use the sub-mesh's own vertices, so a lower
+	// level of detail only needs a new index list. Use the same grid for all sub-meshes of a
+	// mesh to avoid cracks between them. Returns the number of faces
+	static TUInt32 SimplifyFaces
+	(
+		const SSubMesh& subMesh,
+		const CVector3& gridOrigin,
+		const TFloat32  fCellSize,
+		TMeshFaces*     pFaces
+	);
+
+
+	// Reorder the faces of a list for vertex cache locality, using Tom Forsyth's linear-speed
+	// vertex cache optimisation. Each vertex is scored from its position in a simulated cache
+	// and the number of faces still using it, and the face with the best vertices is output
+	// next. The order suits any cache size up to kiVertexCacheSize
+	static void OptimiseFaceOrder
+	(
+		SMeshFace*    pFaces,
+		const TUInt32 numFaces,
+		const TUInt32 numVertices
+	);
+
+	// Reorder the vertices of an output sub-mesh into the order the faces first use them, so
+	// vertex fetches move steadily through memory. Vertices used by no face go at the end
+	static void OptimiseVertexOrder( SSubMesh* pSubMesh );
+
+	// Optimise an output sub-mesh for the GPU: reorder the faces for the vertex cache then
+	// reorder the vertices to match. Optionally returns the average cache miss ratio (ACMR,
+	// see CalculateACMR) before and after
+	static void OptimiseSubMesh
+	(
+		SSubMesh* pSubMesh,
+		TFloat32* pACMRBefore = 0,
+		TFloat32* pACMRAfter = 0
+	);
+
+	// Return the average cache miss ratio of a face list: the number of vertices that miss a
+	// FIFO post-transform cache of the given size per face. 3 is the worst possible, 0.5 is
+	// about the best for a regular grid
+	static TFloat32 CalculateACMR
+	(
+		const SMeshFace* pFaces,
+		const TUInt32    numFaces,
+		const TUInt32    numVertices,
+		const TUInt32    cacheSize = 16
+	);
+
+	// Size of the vertex cache simulated by OptimiseFaceOrder
+	static const TUInt32 kiVertexCacheSize = 32;
+
 
 /*-----------------------------------------------------------------------------------------
 	Private interface
@@ -176,16 +270,19 @@ private:
 	/////////////////////////////////////
 	// X-File types
 
-	// Container types used
-	typedef vector<TUInt32>  TXFileInts;
-	typedef vector<CVector3> TXFileVectors;
+	// Container types used. The bulk vertex and face data is only needed during the import, so
+	// these lists take their memory from the importer's arena (m_Arena) - every list holding mesh
+	// data must be constructed with an allocator for the arena, see SXFileMesh. Lists from
+	// different arenas (or the heap) cannot be swapped
+	typedef vector<TUInt32, CArenaAllocator<TUInt32> >   TXFileInts;
+	typedef vector<CVector3, CArenaAllocator<CVector3> > TXFileVectors;
 
 	// Single face in an X-file - three vertex indices (will convert all faces to triangles)
 	struct SXFileFace
 	{
 		TUInt32 aiVertex[3];
 	};
-	typedef vector<SXFileFace> TXFileFaces;
+	typedef vector<SXFileFace, CArenaAllocator<SXFileFace> > TXFileFaces;
 
 
 	// 2D texture coordinate in an X-file
@@ -194,7 +291,7 @@ private:
 		TFloat32 fU;
 		TFloat32 fV;
 	};
-	typedef vector<SXFileUV> TXFileUVs;
+	typedef vector<SXFileUV, CArenaAllocator<SXFileUV> > TXFileUVs;
 
 
 	// RGB colour used in structures below
@@ -213,7 +310,7 @@ private:
 		TFloat32 fBlue;
 		TFloat32 fAlpha;
 	};
-	typedef vector<SXFileRGBAColour> TXFileRGBAColours;
+	typedef vector<SXFileRGBAColour, CArenaAllocator<SXFileRGBAColour> > TXFileRGBAColours;
 
 
 	// Material used in an X-file, material name, diffuse, specular and emmisive colours and a
@@ -276,6 +373,24 @@ private:
 	// A single mesh in an X-File
 	struct SXFileMesh
 	{
+		// Constructor takes the arena for the mesh's data lists
+		SXFileMesh
+		(
+			CArena* pArena
+		) : vertices( CArenaAllocator<CVector3>( pArena ) ),
+		    normals( CArenaAllocator<CVector3>( pArena ) ),
+		    textureCoords( CArenaAllocator<SXFileUV>( pArena ) ),
+		    vertexColours( CArenaAllocator<SXFileRGBAColour>( pArena ) ),
+		    faces( CArenaAllocator<SXFileFace>( pArena ) ),
+		    faceMaterials( CArenaAllocator<TUInt32>( pArena ) ),
+		    origFaceEdges( CArenaAllocator<TUInt32>( pArena ) ),
+		    normalFaces( CArenaAllocator<SXFileFace>( pArena ) ),
+		    materialMap( CArenaAllocator<TUInt32>( pArena ) ),
+		    adjacencyIndices( CArenaAllocator<TUInt32>( pArena ) ),
+		    duplicateIndices( CArenaAllocator<TUInt32>( pArena ) )
+		{
+		}
+
 		// Index of frame that holds this mesh
 		TUInt32           iParentFrame;
 
@@ -576,6 +691,18 @@ private:
 	// Split each mesh into a set of meshes - each of which contains only a single material
 	void SplitMeshes();
 
+	// Return the matrix that transforms from the space of the given frame to the space of the root
+	// frame, i.e. the frame's default matrix combined with those of all its ancestors
+	CMatrix4x4 GetRootMatrix( TUInt32 iFrame ) const;
+
+	// Transform the vertex data of an output sub-mesh by the given matrix, positions as points
+	// and normals and tangents as vectors, which are renormalised
+	static void TransformSubMesh
+	(
+		SSubMesh*         pSubMesh,
+		const CMatrix4x4& matrix
+	);
+
 	// Create a list of tangent vectors for the given mesh. The tangent vector is the direction of
 	// a vertex's texture U axis in model-space. Returns true on success
 	bool CalculateTangents
@@ -600,6 +727,11 @@ private:
 
 	// Global list of materials used by all the meshes
 	TXFileMaterials m_Materials;
+
+	// Arena holding the mesh data lists above, the sub-mesh data returned by GetSubMesh and other
+	// temporary data. It is all freed at once when the importer is destroyed. Mutable as the
+	// const data access functions allocate from it too
+	mutable CArena  m_Arena;
 };
 
 
@@ -0,0 +1,68 @@
+/**************************************************************************************************
+	Module:       CArena.cpp
+
+	Implementation of the CArena class, a linear memory arena
+
+	Change history:
+		V1.0    Created for the X-file importer's intermediate data
+**************************************************************************************************/
+
+#include <cstdlib>
+
+#include "CArena.h"
+
+namespace gen
+{
+
+// Return memory for the given number of bytes at the given alignment (a power of 2). Throws
+// std::bad_alloc if the system is out of memory, like operator new
+void* CArena::Allocate
+(
+	const size_t iSize,
+	const size_t iAlign /*= sizeof(double)*/
+)
+{
+	// Align the current pointer, use it if the request fits in what is left of the block
+	size_t iAlignMask = iAlign - 1;
+	TUInt8* pAligned = reinterpret_cast<TUInt8*>(
+		(reinterpret_cast<size_t>(m_pCurrent) + iAlignMask) & ~iAlignMask );
+	if (m_pCurrent && pAligned + iSize <= m_pEnd)
+	{
+		m_pCurrent = pAligned + iSize;
+		return pAligned;
+	}
+
+	// Otherwise start a new block. A request bigger than the block size gets a block of its own,
+	// which becomes the current block - the rest of the old block is wasted, but large requests
+	// come from growing vectors which will soon request more
+	size_t iBlockSize = iSize + iAlignMask > m_iBlockSize ? iSize + iAlignMask : m_iBlockSize;
+	TUInt8* pBlock = static_cast<TUInt8*>(malloc( iBlockSize ));
+	if (!pBlock)
+	{
+		throw bad_alloc();
+	}
+	m_Blocks.push_back( pBlock );
+	m_iTotalSize += iBlockSize;
+
+	pAligned = reinterpret_cast<TUInt8*>(
+		(reinterpret_cast<size_t>(pBlock) + iAlignMask) & ~iAlignMask );
+	m_pCurrent = pAligned + iSize;
+	m_pEnd = pBlock + iBlockSize;
+	return pAligned;
+}
+
+// Free all the memory allocated by the arena. Any pointers into it become invalid
+void CArena::Reset()
+{
+	for (TUInt32 iBlock = 0; iBlock < m_Blocks.size(); ++iBlock)
+	{
+		free( m_Blocks[iBlock] );
+	}
+	m_Blocks.clear();
+	m_pCurrent = 0;
+	m_pEnd = 0;
+	m_iTotalSize = 0;
+}
+
+
+} // namespace gen
@@ -0,0 +1,214 @@
+/**************************************************************************************************
+	Module:       CArena.h
+
+	Definition of the CArena class, a linear memory arena, and an STL allocator that takes memory
+	from one. Used for short-lived data built up and freed together, e.g. during a file import
+
+	Change history:
+		V1.0    Created for the X-file importer's intermediate data
+**************************************************************************************************/
+
+#ifndef GEN_C_ARENA_H_INCLUDED
+#define GEN_C_ARENA_H_INCLUDED
+
+#include <cstddef>
+#include <new>
+#include <vector>
+using namespace std;
+
+#include "GenDefines.h"
+
+namespace gen
+{
+
+// Linear memory arena - hands out memory from large blocks by moving a pointer along, and frees
+// all of it at once. Individual allocations cannot be freed. Suits temporary data that is built
+// up and thrown away together, e.g. everything made while importing a file. Not thread-safe,
+// use one arena per thread
+class CArena
+{
+	GEN_CLASS( CArena );
+
+public:
+	// Constructor takes the size of each block. Requests larger than this get a block to themselves
+	CArena
+	(
+		const TUInt32 iBlockSize = 64 * 1024
+	) : m_iBlockSize( iBlockSize ), m_pCurrent( 0 ), m_pEnd( 0 ), m_iTotalSize( 0 )
+	{
+	}
+
+	// Destructor frees all the blocks
+	~CArena()
+	{
+		Reset();
+	}
+
+private:
+	// Disallow use of copy constructor and assignment operator (private and not defined)
+	CArena( const CArena& );
+	CArena& operator=( const CArena& );
+
+
+public:
+	// Return memory for the given number of bytes at the given alignment (a power of 2). Throws
+	// std::bad_alloc if the system is out of memory, like operator new
+	void* Allocate
+	(
+		const size_t iSize,
+		const size_t iAlign = sizeof(double)
+	);
+
+	// Allocate an uninitialised array of a POD type
+	template <class T>
+	T* AllocateArray
+	(
+		const size_t iNum
+	)
+	{
+		return static_cast<T*>(Allocate( iNum * sizeof(T), __alignof(T) ));
+	}
+
+	// Free all the memory allocated by the arena. Any pointers into it become invalid
+	void Reset();
+
+	// Return the total bytes in the blocks the arena has taken from the system
+	size_t GetTotalSize() const
+	{
+		return m_iTotalSize;
+	}
+
+private:
+	const TUInt32 m_iBlockSize; // Size of normal blocks
+	TUInt8*       m_pCurrent;   // Next free byte in the current block
+	TUInt8*       m_pEnd;       // End of the current block
+	size_t        m_iTotalSize; // Total size of all blocks
+	vector<void*> m_Blocks;     // All blocks taken from the system, freed by Reset
+};
+
+
+// STL allocator that takes memory from an arena. Deallocation does nothing, the memory is freed
+// with the arena. Constructed with no arena the allocator uses the normal heap, so containers
+// using it can still be default constructed. Containers can only swap or move their contents if
+// the allocators compare equal (i.e. use the same arena)
+template <class T>
+class CArenaAllocator
+{
+public:
+	typedef T              value_type;
+	typedef T*             pointer;
+	typedef const T*       const_pointer;
+	typedef T&             reference;
+	typedef const T&       const_reference;
+	typedef size_t         size_type;
+	typedef ptrdiff_t      difference_type;
+
+	template <class U>
+	struct rebind
+	{
+		typedef CArenaAllocator<U> other;
+	};
+
+	// Constructors
+	CArenaAllocator
+	(
+		CArena* pArena = 0
+	) : m_pArena( pArena )
+	{
+	}
+
+	template <class U>
+	CArenaAllocator
+	(
+		const CArenaAllocator<U>& other
+	) : m_pArena( other.GetArena() )
+	{
+	}
+
+	CArena* GetArena() const
+	{
+		return m_pArena;
+	}
+
+	pointer allocate
+	(
+		size_type   n,
+		const void* = 0
+	)
+	{
+		if (m_pArena)
+		{
+			return static_cast<pointer>(m_pArena->Allocate( n * sizeof(T), __alignof(T) ));
+		}
+		return static_cast<pointer>(::operator new( n * sizeof(T) ));
+	}
+
+	void deallocate
+	(
+		pointer   p,
+		size_type
+	)
+	{
+		if (!m_pArena)
+		{
+			::operator delete( p );
+		}
+	}
+
+	void construct
+	(
+		pointer  p,
+		const T& value
+	)
+	{
+		::new (static_cast<void*>(p)) T( value );
+	}
+
+	void destroy( pointer p )
+	{
+		GEN_UNREFERENCED_PARAMETER( p ); // Not seen as used when T has a trivial destructor
+		p->~T();
+	}
+
+	pointer address( reference x ) const
+	{
+		return &x;
+	}
+	const_pointer address( const_reference x ) const
+	{
+		return &x;
+	}
+
+	size_type max_size() const
+	{
+		return static_cast<size_type>(-1) / sizeof(T);
+	}
+
+private:
+	CArena* m_pArena;
+};
+
+template <class T, class U>
+inline bool operator==
+(
+	const CArenaAllocator<T>& a1,
+	const CArenaAllocator<U>& a2
+)
+{
+	return a1.GetArena() == a2.GetArena();
+}
+
+template <class T, class U>
+inline bool operator!=
+(
+	const CArenaAllocator<T>& a1,
+	const CArenaAllocator<U>& a2
+)
+{
+	return a1.GetArena() != a2.GetArena();
+}
+
+
+} // namespace gen
+
+#endif // GEN_C_ARENA_H_INCLUDED
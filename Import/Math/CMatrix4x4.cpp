@@ -23,6 +23,7 @@
 #include "CMatrix2x2.h"
 #include "CMatrix3x3.h"
 #include "CQuaternion.h"
+#include "MatrixKernels.h" // Scalar and SSE versions of multiplication, transformation and inverse
 
 namespace gen
 {
@@ -1656,31 +1657,7 @@ CMatrix4x4 Orthogonalise3x3
 // This is also the (most efficient) inverse for a rotation matrix
 void CMatrix4x4::Transpose()
 {
-	TFloat32 t;
-
-	t   = e01;
-	e01 = e10;
-	e10 = t;
-
-	t   = e02;
-	e02 = e20;
-	e20 = t;
-
-	t   = e12;
-	e12 = e21;
-	e21 = t;
-
-	t   = e03;
-	e03 = e30;
-	e30 = t;
-
-	t   = e13;
-	e13 = e31;
-	e31 = t;
-
-	t   = e23;
-	e23 = e32;
-	e32 = t;
+	kernels::Transpose( *this, *this );
 }
     
 // Return the transpose of given matrix (matrix reflected through its diagonal)
@@ -1688,27 +1665,7 @@ void CMatrix4x4::Transpose()
 CMatrix4x4 Transpose( const CMatrix4x4& m )
 {
 	CMatrix4x4 transMat;
-
-	transMat.e00 = m.e00;
-	transMat.e01 = m.e10;
-	transMat.e02 = m.e20;
-	transMat.e03 = m.e30;
-
-	transMat.e10 = m.e01;
-	transMat.e11 = m.e11;
-	transMat.e12 = m.e21;
-	transMat.e13 = m.e31;
-
-	transMat.e20 = m.e02;
-	transMat.e21 = m.e12;
-	transMat.e22 = m.e22;
-	transMat.e23 = m.e32;
-
-	transMat.e30 = m.e03;
-	transMat.e31 = m.e13;
-	transMat.e32 = m.e23;
-	transMat.e33 = m.e33;
-
+	kernels::Transpose( transMat, m );
 	return transMat;
 }
 
@@ -1964,7 +1921,12 @@ TFloat32 Cofactor
 // Suitable for non-affine matrices (e.g. a perspective projection matrix)
 void CMatrix4x4::Invert()
 {
-	*this = Inverse( *this ); // TODO: Just use non-member version
+	GEN_GUARD;
+
+	TFloat32 det = kernels::Inverse( *this, *this );
+	GEN_ASSERT( !IsZero(det), "Singular matrix" );
+
+	GEN_ENDGUARD;
 }
 
 // Return the inverse of given matrix. Most general, least efficient inverse function
@@ -1974,22 +1936,8 @@ CMatrix4x4 Inverse( const CMatrix4x4& m )
 	GEN_GUARD;
 
 	CMatrix4x4 mOut;
-
-	// Calculate determinant
-	TFloat32 det = m.e00 * Cofactor( m, 0, 0 ) + m.e01 * Cofactor( m, 0, 1 ) + 
-	               m.e02 * Cofactor( m, 0, 2 ) + m.e03 * Cofactor( m, 0, 3 ); 
+	TFloat32 det = kernels::Inverse( mOut, m );
 	GEN_ASSERT( !IsZero(det), "Singular matrix" );
-
-	// Inverse is (1/determinant)*adjoint matrix. Adjoint matrix is transposed matrix of cofactors
-	TFloat32 invDet = 1.0f / det;
-	for (TUInt32 i = 0; i < 4; ++i)
-	{
-		for (TUInt32 j = 0; j < 4; ++j)
-		{
-			mOut[i][j] = invDet * Cofactor( m, j, i );
-		}
-	}
-
 	return mOut;
 
 	GEN_ENDGUARD;
@@ -2767,6 +2715,78 @@ CMatrix4x4 MatrixScaling( const TFloat32 fScale )
 }
 
 
+// Build an array of affine transformation matrices from arrays of positions, Euler angles and
+// scalings, all of the given length. Rotations are applied in kZXY order and each matrix is
+// written directly from the sines and cosines of its angles, with no intermediate matrices.
+// Gives the same result as MakeAffineEuler( position, angles, kZXY, scale ) for each element.
+// Matrices are built in this order: M = Scale*Rotation*Translation
+void MatrixAffineEulerZXY
+(
+	CMatrix4x4*     pMatrices,
+	const CVector3* pPositions,
+	const CVector3* pAngles,
+	const CVector3* pScales,
+	const TUInt32   numMatrices
+)
+{
+	for (TUInt32 i = 0; i < numMatrices; ++i)
+	{
+		CMatrix4x4&     m = pMatrices[i];
+		const CVector3& angles = pAngles[i];
+		const CVector3& scale = pScales[i];
+
+		TFloat32 sX, cX, sY, cY, sZ, cZ;
+		SinCos( angles.x, &sX, &cX );
+		SinCos( angles.y, &sY, &cY );
+		SinCos( angles.z, &sZ, &cZ );
+
+		// Rotation rows as in MakeRotation (kZXY), each scaled by its scale component
+		TFloat32 sXsY = sX * sY;
+		TFloat32 sXcY = sX * cY;
+		m.e00 = scale.x * (cZ * cY + sZ * sXsY);
+		m.e01 = scale.x * (sZ * cX);
+		m.e02 = scale.x * (-cZ * sY + sZ * sXcY);
+		m.e03 = 0.0f;
+
+		m.e10 = scale.y * (-sZ * cY + cZ * sXsY);
+		m.e11 = scale.y * (cZ * cX);
+		m.e12 = scale.y * (sZ * sY + cZ * sXcY);
+		m.e13 = 0.0f;
+
+		m.e20 = scale.z * (cX * sY);
+		m.e21 = scale.z * (-sX);
+		m.e22 = scale.z * (cX * cY);
+		m.e23 = 0.0f;
+
+		// Put position (translation) in bottom row
+		m.e30 = pPositions[i].x;
+		m.e31 = pPositions[i].y;
+		m.e32 = pPositions[i].z;
+		m.e33 = 1.0f;
+	}
+}
+
+// Build an array of affine transformation matrices from arrays of positions, quaternions and
+// scalings, all of the given length. No trigonometric functions are needed, so this is cheaper
+// than MatrixAffineEulerZXY. Gives the same result as MakeAffineQuaternion( quat, position,
+// scale ) for each element. Quaternions must be normalised
+// Matrices are built in this order: M = Scale*Rotation*Translation
+void MatrixAffineQuaternion
+(
+	CMatrix4x4*        pMatrices,
+	const CVector3*    pPositions,
+	const CQuaternion* pQuats,
+	const CVector3*    pScales,
+	const TUInt32      numMatrices
+)
+{
+	for (TUInt32 i = 0; i < numMatrices; ++i)
+	{
+		pMatrices[i].MakeAffineQuaternion( pQuats[i], pPositions[i], pScales[i] );
+	}
+}
+
+
 /*-----------------------------------------------------------------------------------------
 	Facing Matrices
 -----------------------------------------------------------------------------------------*/
@@ -3116,11 +3136,7 @@ CVector4 operator*
 )
 {
     CVector4 vOut;
-    vOut.x = v.x*m.e00 + v.y*m.e10 + v.z*m.e20 + v.w*m.e30;
-    vOut.y = v.x*m.e01 + v.y*m.e11 + v.z*m.e21 + v.w*m.e31;
-    vOut.z = v.x*m.e02 + v.y*m.e12 + v.z*m.e22 + v.w*m.e32;
-    vOut.w = v.x*m.e03 + v.y*m.e13 + v.z*m.e23 + v.w*m.e33;
-
+    kernels::Transform( vOut, v, m );
     return vOut;
 }
 
@@ -3146,11 +3162,7 @@ CVector4 operator*
 CVector4 CMatrix4x4::Transform(	const CVector4& v ) const
 {
 	CVector4 vOut;
-	vOut.x = v.x*e00 + v.y*e10 + v.z*e20 + v.w*e30;
-	vOut.y = v.x*e01 + v.y*e11 + v.z*e21 + v.w*e31;
-	vOut.z = v.x*e02 + v.y*e12 + v.z*e22 + v.w*e32;
-	vOut.w = v.x*e03 + v.y*e13 + v.z*e23 + v.w*e33;
-
+	kernels::Transform( vOut, v, *this );
 	return vOut;
 }
 
@@ -3159,10 +3171,7 @@ CVector4 CMatrix4x4::Transform(	const CVector4& v ) const
 CVector3 CMatrix4x4::TransformVector( const CVector3& v ) const
 {
 	CVector3 vOut;
-	vOut.x = v.x*e00 + v.y*e10 + v.z*e20;
-	vOut.y = v.x*e01 + v.y*e11 + v.z*e21;
-	vOut.z = v.x*e02 + v.y*e12 + v.z*e22;
-
+	kernels::TransformVector( vOut, v, *this );
 	return vOut;
 }
 
@@ -3171,13 +3180,52 @@ CVector3 CMatrix4x4::TransformVector( const CVector3& v ) const
 CVector3 CMatrix4x4::TransformPoint( const CVector3& p ) const
 {
 	CVector3 pOut;
-	pOut.x = p.x*e00 + p.y*e10 + p.z*e20 + e30;
-	pOut.y = p.x*e01 + p.y*e11 + p.z*e21 + e31;
-	pOut.z = p.x*e02 + p.y*e12 + p.z*e22 + e32;
-
+	kernels::TransformPoint( pOut, p, *this );
 	return pOut;
 }
 
+// Transform an array of points by this matrix (V' = V*M, assuming 4th element is 1). Each point
+// is the first three floats of an element of the given stride in bytes, so the points can be the
+// positions in an interleaved vertex buffer. Only these three floats are written in each
+// destination element. Source and destination may be the same
+void CMatrix4x4::TransformPoints
+(
+	const void* pSource,
+	TUInt32     sourceStride,
+	void*       pDest,
+	TUInt32     destStride,
+	TUInt32     numPoints
+) const
+{
+	GEN_GUARD_OPT;
+	GEN_ASSERT_OPT( sourceStride >= sizeof(CVector3) && destStride >= sizeof(CVector3), "Invalid parameter" );
+
+	kernels::TransformPoints( *this, static_cast<const TUInt8*>(pSource), sourceStride,
+	                          static_cast<TUInt8*>(pDest), destStride, numPoints );
+
+	GEN_ENDGUARD_OPT;
+}
+
+// Transform an array of vectors by this matrix (V' = V*M, assuming 4th element is 0), e.g. the
+// normals in an interleaved vertex buffer. Data layout as TransformPoints above
+void CMatrix4x4::TransformVectors
+(
+	const void* pSource,
+	TUInt32     sourceStride,
+	void*       pDest,
+	TUInt32     destStride,
+	TUInt32     numVectors
+) const
+{
+	GEN_GUARD_OPT;
+	GEN_ASSERT_OPT( sourceStride >= sizeof(CVector3) && destStride >= sizeof(CVector3), "Invalid parameter" );
+
+	kernels::TransformVectors( *this, static_cast<const TUInt8*>(pSource), sourceStride,
+	                           static_cast<TUInt8*>(pDest), destStride, numVectors );
+
+	GEN_ENDGUARD_OPT;
+}
+
 
 ///////////////////////////////
 // Matrix multiplication
@@ -3185,47 +3233,8 @@ CVector3 CMatrix4x4::TransformPoint( const CVector3& p ) const
 // Post-multiply this matrix by the given one
 CMatrix4x4& CMatrix4x4::operator*=( const CMatrix4x4& m )
 {
-	if ( this == &m )
-	{
-		// Special case of multiplying by self - no copy optimisations so use binary version
-		*this = m * m;
-	}
-	else
-	{
-		TFloat32 t0, t1, t2;
-
-		t0  = e00*m.e00 + e01*m.e10 + e02*m.e20 + e03*m.e30;
-		t1  = e00*m.e01 + e01*m.e11 + e02*m.e21 + e03*m.e31;
-		t2  = e00*m.e02 + e01*m.e12 + e02*m.e22 + e03*m.e32;
-		e03 = e00*m.e03 + e01*m.e13 + e02*m.e23 + e03*m.e33;
-		e00 = t0;
-		e01 = t1;
-		e02 = t2;
-
-		t0  = e10*m.e00 + e11*m.e10 + e12*m.e20 + e13*m.e30;
-		t1  = e10*m.e01 + e11*m.e11 + e12*m.e21 + e13*m.e31;
-		t2  = e10*m.e02 + e11*m.e12 + e12*m.e22 + e13*m.e32;
-		e13 = e10*m.e03 + e11*m.e13 + e12*m.e23 + e13*m.e33;
-		e10 = t0;
-		e11 = t1;
-		e12 = t2;
-
-		t0  = e20*m.e00 + e21*m.e10 + e22*m.e20 + e23*m.e30;
-		t1  = e20*m.e01 + e21*m.e11 + e22*m.e21 + e23*m.e31;
-		t2  = e20*m.e02 + e21*m.e12 + e22*m.e22 + e23*m.e32;
-		e23 = e20*m.e03 + e21*m.e13 + e22*m.e23 + e23*m.e33;
-		e20 = t0;
-		e21 = t1;
-		e22 = t2;
-
-		t0  = e30*m.e00 + e31*m.e10 + e32*m.e20 + e33*m.e30;
-		t1  = e30*m.e01 + e31*m.e11 + e32*m.e21 + e33*m.e31;
-		t2  = e30*m.e02 + e31*m.e12 + e32*m.e22 + e33*m.e32;
-		e33 = e30*m.e03 + e31*m.e13 + e32*m.e23 + e33*m.e33;
-		e30 = t0;
-		e31 = t1;
-		e32 = t2;
-	}
+	// Kernel allows output to be one of the inputs, which includes multiplying by self
+	kernels::Multiply( *this, *this, m );
 	return *this;
 }
 
@@ -3238,27 +3247,7 @@ CMatrix4x4 operator*
 )
 {
 	CMatrix4x4 mOut;
-
-	mOut.e00 = m1.e00*m2.e00 + m1.e01*m2.e10 + m1.e02*m2.e20 + m1.e03*m2.e30;
-	mOut.e01 = m1.e00*m2.e01 + m1.e01*m2.e11 + m1.e02*m2.e21 + m1.e03*m2.e31;
-	mOut.e02 = m1.e00*m2.e02 + m1.e01*m2.e12 + m1.e02*m2.e22 + m1.e03*m2.e32;
-	mOut.e03 = m1.e00*m2.e03 + m1.e01*m2.e13 + m1.e02*m2.e23 + m1.e03*m2.e33;
-
-	mOut.e10 = m1.e10*m2.e00 + m1.e11*m2.e10 + m1.e12*m2.e20 + m1.e13*m2.e30;
-	mOut.e11 = m1.e10*m2.e01 + m1.e11*m2.e11 + m1.e12*m2.e21 + m1.e13*m2.e31;
-	mOut.e12 = m1.e10*m2.e02 + m1.e11*m2.e12 + m1.e12*m2.e22 + m1.e13*m2.e32;
-	mOut.e13 = m1.e10*m2.e03 + m1.e11*m2.e13 + m1.e12*m2.e23 + m1.e13*m2.e33;
-
-	mOut.e20 = m1.e20*m2.e00 + m1.e21*m2.e10 + m1.e22*m2.e20 + m1.e23*m2.e30;
-	mOut.e21 = m1.e20*m2.e01 + m1.e21*m2.e11 + m1.e22*m2.e21 + m1.e23*m2.e31;
-	mOut.e22 = m1.e20*m2.e02 + m1.e21*m2.e12 + m1.e22*m2.e22 + m1.e23*m2.e32;
-	mOut.e23 = m1.e20*m2.e03 + m1.e21*m2.e13 + m1.e22*m2.e23 + m1.e23*m2.e33;
-
-	mOut.e30 = m1.e30*m2.e00 + m1.e31*m2.e10 + m1.e32*m2.e20 + m1.e33*m2.e30;
-	mOut.e31 = m1.e30*m2.e01 + m1.e31*m2.e11 + m1.e32*m2.e21 + m1.e33*m2.e31;
-	mOut.e32 = m1.e30*m2.e02 + m1.e31*m2.e12 + m1.e32*m2.e22 + m1.e33*m2.e32;
-	mOut.e33 = m1.e30*m2.e03 + m1.e31*m2.e13 + m1.e32*m2.e23 + m1.e33*m2.e33;
-
+	kernels::Multiply( mOut, m1, m2 );
 	return mOut;
 }
 
@@ -3266,40 +3255,8 @@ CMatrix4x4 operator*
 // Post-multiply this matrix by the given one assuming they are both affine
 CMatrix4x4& CMatrix4x4::MultiplyAffine( const CMatrix4x4& m )
 {
-	if ( this == &m )
-	{
-		// Special case of multiplying by self - no copy optimisations so use binary version
-		*this = gen::MultiplyAffine( m, m );
-	}
-	else
-	{
-		TFloat32 t0, t1;
-
-		t0  = e00*m.e00 + e01*m.e10 + e02*m.e20;
-		t1  = e00*m.e01 + e01*m.e11 + e02*m.e21;
-		e02 = e00*m.e02 + e01*m.e12 + e02*m.e22;
-		e00 = t0;
-		e01 = t1;
-
-		t0  = e10*m.e00 + e11*m.e10 + e12*m.e20;
-		t1  = e10*m.e01 + e11*m.e11 + e12*m.e21;
-		e12 = e10*m.e02 + e11*m.e12 + e12*m.e22;
-		e10 = t0;
-		e11 = t1;
-
-		t0  = e20*m.e00 + e21*m.e10 + e22*m.e20;
-		t1  = e20*m.e01 + e21*m.e11 + e22*m.e21;
-		e22 = e20*m.e02 + e21*m.e12 + e22*m.e22;
-		e20 = t0;
-		e21 = t1;
-
-		t0  = e30*m.e00 + e31*m.e10 + e32*m.e20 + m.e30;
-		t1  = e30*m.e01 + e31*m.e11 + e32*m.e21 + m.e31;
-		e32 = e30*m.e02 + e31*m.e12 + e32*m.e22 + m.e32;
-		e30 = t0;
-		e31 = t1;
-	}
-
+	// Kernel allows output to be one of the inputs, which includes multiplying by self
+	kernels::MultiplyAffine( *this, *this, m );
 	return *this;
 }
 
@@ -3311,27 +3268,7 @@ CMatrix4x4 MultiplyAffine
 )
 {
 	CMatrix4x4 mOut;
-
-	mOut.e00 = m1.e00*m2.e00 + m1.e01*m2.e10 + m1.e02*m2.e20;
-	mOut.e01 = m1.e00*m2.e01 + m1.e01*m2.e11 + m1.e02*m2.e21;
-	mOut.e02 = m1.e00*m2.e02 + m1.e01*m2.e12 + m1.e02*m2.e22;
-	mOut.e03 = 0.0f;
-
-	mOut.e10 = m1.e10*m2.e00 + m1.e11*m2.e10 + m1.e12*m2.e20;
-	mOut.e11 = m1.e10*m2.e01 + m1.e11*m2.e11 + m1.e12*m2.e21;
-	mOut.e12 = m1.e10*m2.e02 + m1.e11*m2.e12 + m1.e12*m2.e22;
-	mOut.e13 = 0.0f;
-
-	mOut.e20 = m1.e20*m2.e00 + m1.e21*m2.e10 + m1.e22*m2.e20;
-	mOut.e21 = m1.e20*m2.e01 + m1.e21*m2.e11 + m1.e22*m2.e21;
-	mOut.e22 = m1.e20*m2.e02 + m1.e21*m2.e12 + m1.e22*m2.e22;
-	mOut.e23 = 0.0f;
-
-	mOut.e30 = m1.e30*m2.e00 + m1.e31*m2.e10 + m1.e32*m2.e20 + m2.e30;
-	mOut.e31 = m1.e30*m2.e01 + m1.e31*m2.e11 + m1.e32*m2.e21 + m2.e31;
-	mOut.e32 = m1.e30*m2.e02 + m1.e31*m2.e12 + m1.e32*m2.e22 + m2.e32;
-	mOut.e33 = 1.0f;
-
+	kernels::MultiplyAffine( mOut, m1, m2 );
 	return mOut;
 }
 
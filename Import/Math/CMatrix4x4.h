@@ -1185,6 +1185,30 @@ public:
 	// Assuming it is a point rather then a vector, i.e. assume the vector's 4th element is 1
     CVector3 TransformPoint( const CVector3& p ) const;
 
+	// Transform an array of points by this matrix (V' = V*M, assuming 4th element is 1). Each point
+	// is the first three floats of an element of the given stride in bytes, so the points can be the
+	// positions in an interleaved vertex buffer. Only these three floats are written in each
+	// destination element. Source and destination may be the same
+    void TransformPoints
+	(
+		const void* pSource,
+		TUInt32     sourceStride,
+		void*       pDest,
+		TUInt32     destStride,
+		TUInt32     numPoints
+	) const;
+
+	// Transform an array of vectors by this matrix (V' = V*M, assuming 4th element is 0), e.g. the
+	// normals in an interleaved vertex buffer. Data layout as TransformPoints above
+    void TransformVectors
+	(
+		const void* pSource,
+		TUInt32     sourceStride,
+		void*       pDest,
+		TUInt32     destStride,
+		TUInt32     numVectors
+	) const;
+
 
 	///////////////////////////////
 	// Matrix multiplication
@@ -1395,6 +1419,35 @@ CMatrix4x4 MatrixScaling( const CVector3& scale );
 CMatrix4x4 MatrixScaling( const TFloat32 fScale );
 
 
+// Build an array of affine transformation matrices from arrays of positions, Euler angles and
+// scalings, all of the given length. Rotations are applied in kZXY order and each matrix is
+// written directly from the sines and cosines of its angles, with no intermediate matrices.
+// Gives the same result as MakeAffineEuler( position, angles, kZXY, scale ) for each element.
+// Matrices are built in this order: M = Scale*Rotation*Translation
+void MatrixAffineEulerZXY
+(
+	CMatrix4x4*     pMatrices,
+	const CVector3* pPositions,
+	const CVector3* pAngles,
+	const CVector3* pScales,
+	const TUInt32   numMatrices
+);
+
+// Build an array of affine transformation matrices from arrays of positions, quaternions and
+// scalings, all of the given length. No trigonometric functions are needed, so this is cheaper
+// than MatrixAffineEulerZXY. Gives the same result as MakeAffineQuaternion( quat, position,
+// scale ) for each element. Quaternions must be normalised
+// Matrices are built in this order: M = Scale*Rotation*Translation
+void MatrixAffineQuaternion
+(
+	CMatrix4x4*        pMatrices,
+	const CVector3*    pPositions,
+	const CQuaternion* pQuats,
+	const CVector3*    pScales,
+	const TUInt32      numMatrices
+);
+
+
 /*-----------------------------------------------------------------------------------------
 	Facing Matrices
 -----------------------------------------------------------------------------------------*/
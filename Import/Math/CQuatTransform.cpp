@@ -116,6 +116,36 @@ void Slerp
 	Slerp( q0.quat, q1.quat, t, qt.quat );
 }
 
+// Spherical linear interpolation of arrays of quaternion-transforms, each pair of pQT0[i] and
+// pQT1[i] with parameter pT[i], results in pQTOut[i], all arrays of the given length. Output
+// may be one of the input arrays. Uses the polynomial SlerpEstimate from CQuaternion.h for the
+// quaternions, so has no trigonometric functions. Quaternions must be normalised
+// Non-member function
+void Slerp
+(
+	const CQuatTransform* pQT0,
+	const CQuatTransform* pQT1,
+	const TFloat32*       pT,
+	CQuatTransform*       pQTOut,
+	const TUInt32         numTransforms
+)
+{
+	for (TUInt32 i = 0; i < numTransforms; ++i)
+	{
+		const CQuatTransform& q0 = pQT0[i];
+		const CQuatTransform& q1 = pQT1[i];
+		CQuatTransform& qt = pQTOut[i];
+		TFloat32 t = pT[i];
+
+		// Quaternion first as it reads both inputs, output may be an input
+		CQuaternion quat;
+		SlerpEstimate( q0.quat, q1.quat, t, quat );
+		qt.pos = q0.pos*(1.0f-t) + q1.pos*t;
+		qt.scale = q0.scale*(1.0f-t) + q1.scale*t;
+		qt.quat = quat;
+	}
+}
+
 
 } // namespace gen
 
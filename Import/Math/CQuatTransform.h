@@ -96,12 +96,9 @@ public:
 		CMatrix4x4& mat
 	) const
 	{
-		// Create initial matrix from quaternion
-		mat = CMatrix4x4( quat );
-
-		// Add scale and position to matrix
-		mat.SetScale( scale );
-		mat.SetPosition( pos );
+		// Build the matrix directly from the quaternion, scale and position. Assumes the
+		// quaternion is normalised
+		mat.MakeAffineQuaternion( quat, pos, scale );
 	}
 
 
@@ -249,6 +246,20 @@ public:
 		CQuatTransform&       qt
 	);
 
+	// Spherical linear interpolation of arrays of quaternion-transforms, each pair of pQT0[i] and
+	// pQT1[i] with parameter pT[i], results in pQTOut[i], all arrays of the given length. Output
+	// may be one of the input arrays. Uses the polynomial SlerpEstimate from CQuaternion.h for the
+	// quaternions, so has no trigonometric functions. Quaternions must be normalised
+	// Non-member function
+	friend void Slerp
+	(
+		const CQuatTransform* pQT0,
+		const CQuatTransform* pQT1,
+		const TFloat32*       pT,
+		CQuatTransform*       pQTOut,
+		const TUInt32         numTransforms
+	);
+
 
 	/*---------------------------------------------------------------------------------------------
 		Data
@@ -564,6 +564,24 @@ CQuaternion Normalise
 );
 
 
+/*---------------------------------------------------------------------------------------------
+	Rotation quaternions
+---------------------------------------------------------------------------------------------*/
+
+// Return a quaternion that is a rotation around the given (normalised) axis of the given angle
+// (radians)
+inline CQuaternion QuaternionAxisAngle
+(
+	const CVector3& axis,
+	const TFloat32  fAngle
+)
+{
+	TFloat32 s, c;
+	SinCos( 0.5f * fAngle, &s, &c );
+	return CQuaternion( c, axis.x * s, axis.y * s, axis.z * s );
+}
+
+
 /*---------------------------------------------------------------------------------------------
 	Interpolation
 ---------------------------------------------------------------------------------------------*/
@@ -597,6 +615,55 @@ void Slerp
 	CQuaternion&       qt
 );
 
+// Approximate spherical linear interpolation of two unit quaternions q0 and q1, with parameter t,
+// result in qt. The slerp weights sin((1-t)*theta)/sin(theta) and sin(t*theta)/sin(theta) are
+// found from a polynomial in cos(theta) and t instead of with ACos and Sin, as described in
+// "A Fast and Accurate Algorithm for Computing SLERP" (Eberly). The weights are within 2e-5 of
+// the exact ones. Takes the short route round the circle like Slerp. Defined inline so loops
+// over many quaternions have no call overhead or branches other than the route selection
+inline void SlerpEstimate
+(
+	const CQuaternion& q0,
+	const CQuaternion& q1,
+	const TFloat32     t,
+	CQuaternion&       qt
+)
+{
+	// Coefficients of the polynomial, the last pair are adjusted to correct for the truncation
+	const TFloat32 kMu = 1.85298109240830f;
+	static const TFloat32 u[8] = { 1.0f/(1*3), 1.0f/(2*5), 1.0f/(3*7), 1.0f/(4*9),
+	                               1.0f/(5*11), 1.0f/(6*13), 1.0f/(7*15), kMu/(8*17) };
+	static const TFloat32 v[8] = { 1.0f/3, 2.0f/5, 3.0f/7, 4.0f/9,
+	                               5.0f/11, 6.0f/13, 7.0f/15, kMu*8/17 };
+
+	TFloat32 cosTheta = Dot( q0, q1 );
+	TFloat32 sign = 1.0f;
+	if (cosTheta < 0.0f)
+	{
+		cosTheta = -cosTheta;
+		sign = -1.0f;
+	}
+
+	TFloat32 cosThetaM1 = cosTheta - 1.0f;
+	TFloat32 d = 1.0f - t;
+	TFloat32 sqrT = t * t;
+	TFloat32 sqrD = d * d;
+	TFloat32 weight0 = 1.0f;
+	TFloat32 weight1 = 1.0f;
+	for (int i = 7; i >= 0; --i)
+	{
+		weight0 = 1.0f + (u[i] * sqrD - v[i]) * cosThetaM1 * weight0;
+		weight1 = 1.0f + (u[i] * sqrT - v[i]) * cosThetaM1 * weight1;
+	}
+	weight0 *= d;
+	weight1 *= sign * t;
+
+	qt.w = q0.w * weight0 + q1.w * weight1;
+	qt.x = q0.x * weight0 + q1.x * weight1;
+	qt.y = q0.y * weight0 + q1.y * weight1;
+	qt.z = q0.z * weight0 + q1.z * weight1;
+}
+
 
 } // namespace gen
 
@@ -0,0 +1,485 @@
+/**************************************************************************************************
+	Module:       MatrixKernels.cpp
+
+	Low-level implementations of the performance critical CMatrix4x4 operations: multiplication,
+	vector transformation, transpose and general inverse. Each operation has a scalar version and
+	an SSE version, CMatrix4x4 uses the version selected by the compile-time switch in the header
+
+	Change history:
+		V1.0    Created from the scalar code in CMatrix4x4.cpp
+**************************************************************************************************/
+
+#include <xmmintrin.h> // SSE intrinsics
+
+#include "MatrixKernels.h"
+
+namespace gen
+{
+
+/*-----------------------------------------------------------------------------------------
+	Scalar versions
+-----------------------------------------------------------------------------------------*/
+
+namespace scalar
+{
+
+// General 4x4 matrix multiplication: mOut = m1*m2
+void Multiply( CMatrix4x4& mOut, const CMatrix4x4& m1, const CMatrix4x4& m2 )
+{
+	CMatrix4x4 m; // Output may be one of the inputs
+
+	m.e00 = m1.e00*m2.e00 + m1.e01*m2.e10 + m1.e02*m2.e20 + m1.e03*m2.e30;
+	m.e01 = m1.e00*m2.e01 + m1.e01*m2.e11 + m1.e02*m2.e21 + m1.e03*m2.e31;
+	m.e02 = m1.e00*m2.e02 + m1.e01*m2.e12 + m1.e02*m2.e22 + m1.e03*m2.e32;
+	m.e03 = m1.e00*m2.e03 + m1.e01*m2.e13 + m1.e02*m2.e23 + m1.e03*m2.e33;
+
+	m.e10 = m1.e10*m2.e00 + m1.e11*m2.e10 + m1.e12*m2.e20 + m1.e13*m2.e30;
+	m.e11 = m1.e10*m2.e01 + m1.e11*m2.e11 + m1.e12*m2.e21 + m1.e13*m2.e31;
+	m.e12 = m1.e10*m2.e02 + m1.e11*m2.e12 + m1.e12*m2.e22 + m1.e13*m2.e32;
+	m.e13 = m1.e10*m2.e03 + m1.e11*m2.e13 + m1.e12*m2.e23 + m1.e13*m2.e33;
+
+	m.e20 = m1.e20*m2.e00 + m1.e21*m2.e10 + m1.e22*m2.e20 + m1.e23*m2.e30;
+	m.e21 = m1.e20*m2.e01 + m1.e21*m2.e11 + m1.e22*m2.e21 + m1.e23*m2.e31;
+	m.e22 = m1.e20*m2.e02 + m1.e21*m2.e12 + m1.e22*m2.e22 + m1.e23*m2.e32;
+	m.e23 = m1.e20*m2.e03 + m1.e21*m2.e13 + m1.e22*m2.e23 + m1.e23*m2.e33;
+
+	m.e30 = m1.e30*m2.e00 + m1.e31*m2.e10 + m1.e32*m2.e20 + m1.e33*m2.e30;
+	m.e31 = m1.e30*m2.e01 + m1.e31*m2.e11 + m1.e32*m2.e21 + m1.e33*m2.e31;
+	m.e32 = m1.e30*m2.e02 + m1.e31*m2.e12 + m1.e32*m2.e22 + m1.e33*m2.e32;
+	m.e33 = m1.e30*m2.e03 + m1.e31*m2.e13 + m1.e32*m2.e23 + m1.e33*m2.e33;
+
+	mOut = m;
+}
+
+// Matrix multiplication assuming both matrices are affine: mOut = m1*m2
+void MultiplyAffine( CMatrix4x4& mOut, const CMatrix4x4& m1, const CMatrix4x4& m2 )
+{
+	CMatrix4x4 m; // Output may be one of the inputs
+
+	m.e00 = m1.e00*m2.e00 + m1.e01*m2.e10 + m1.e02*m2.e20;
+	m.e01 = m1.e00*m2.e01 + m1.e01*m2.e11 + m1.e02*m2.e21;
+	m.e02 = m1.e00*m2.e02 + m1.e01*m2.e12 + m1.e02*m2.e22;
+	m.e03 = 0.0f;
+
+	m.e10 = m1.e10*m2.e00 + m1.e11*m2.e10 + m1.e12*m2.e20;
+	m.e11 = m1.e10*m2.e01 + m1.e11*m2.e11 + m1.e12*m2.e21;
+	m.e12 = m1.e10*m2.e02 + m1.e11*m2.e12 + m1.e12*m2.e22;
+	m.e13 = 0.0f;
+
+	m.e20 = m1.e20*m2.e00 + m1.e21*m2.e10 + m1.e22*m2.e20;
+	m.e21 = m1.e20*m2.e01 + m1.e21*m2.e11 + m1.e22*m2.e21;
+	m.e22 = m1.e20*m2.e02 + m1.e21*m2.e12 + m1.e22*m2.e22;
+	m.e23 = 0.0f;
+
+	m.e30 = m1.e30*m2.e00 + m1.e31*m2.e10 + m1.e32*m2.e20 + m2.e30;
+	m.e31 = m1.e30*m2.e01 + m1.e31*m2.e11 + m1.e32*m2.e21 + m2.e31;
+	m.e32 = m1.e30*m2.e02 + m1.e31*m2.e12 + m1.e32*m2.e22 + m2.e32;
+	m.e33 = 1.0f;
+
+	mOut = m;
+}
+
+// Vector-matrix multiplication: vOut = v*m
+void Transform( CVector4& vOut, const CVector4& v, const CMatrix4x4& m )
+{
+	TFloat32 x = v.x*m.e00 + v.y*m.e10 + v.z*m.e20 + v.w*m.e30;
+	TFloat32 y = v.x*m.e01 + v.y*m.e11 + v.z*m.e21 + v.w*m.e31;
+	TFloat32 z = v.x*m.e02 + v.y*m.e12 + v.z*m.e22 + v.w*m.e32;
+	vOut.w     = v.x*m.e03 + v.y*m.e13 + v.z*m.e23 + v.w*m.e33;
+	vOut.x = x;
+	vOut.y = y;
+	vOut.z = z;
+}
+
+// Vector-matrix multiplication assuming p is a point (4th element is 1): pOut = p*m
+void TransformPoint( CVector3& pOut, const CVector3& p, const CMatrix4x4& m )
+{
+	TFloat32 x = p.x*m.e00 + p.y*m.e10 + p.z*m.e20 + m.e30;
+	TFloat32 y = p.x*m.e01 + p.y*m.e11 + p.z*m.e21 + m.e31;
+	pOut.z     = p.x*m.e02 + p.y*m.e12 + p.z*m.e22 + m.e32;
+	pOut.x = x;
+	pOut.y = y;
+}
+
+// Vector-matrix multiplication assuming v is a vector (4th element is 0): vOut = v*m
+void TransformVector( CVector3& vOut, const CVector3& v, const CMatrix4x4& m )
+{
+	TFloat32 x = v.x*m.e00 + v.y*m.e10 + v.z*m.e20;
+	TFloat32 y = v.x*m.e01 + v.y*m.e11 + v.z*m.e21;
+	vOut.z     = v.x*m.e02 + v.y*m.e12 + v.z*m.e22;
+	vOut.x = x;
+	vOut.y = y;
+}
+
+// Transform an array of points (4th element 1) by a matrix. Each point is three floats at the
+// start of an element of the given stride in bytes. Source and destination may be the same array
+void TransformPoints( const CMatrix4x4& m, const TUInt8* pSource, TUInt32 sourceStride,
+                      TUInt8* pDest, TUInt32 destStride, TUInt32 numPoints )
+{
+	for (TUInt32 point = 0; point < numPoints; ++point)
+	{
+		TransformPoint( *reinterpret_cast<CVector3*>(pDest), *reinterpret_cast<const CVector3*>(pSource), m );
+		pSource += sourceStride;
+		pDest += destStride;
+	}
+}
+
+// Transform an array of vectors (4th element 0) by a matrix, data layout as TransformPoints
+void TransformVectors( const CMatrix4x4& m, const TUInt8* pSource, TUInt32 sourceStride,
+                       TUInt8* pDest, TUInt32 destStride, TUInt32 numVectors )
+{
+	for (TUInt32 vector = 0; vector < numVectors; ++vector)
+	{
+		TransformVector( *reinterpret_cast<CVector3*>(pDest), *reinterpret_cast<const CVector3*>(pSource), m );
+		pSource += sourceStride;
+		pDest += destStride;
+	}
+}
+
+// Transpose of a matrix
+void Transpose( CMatrix4x4& mOut, const CMatrix4x4& m )
+{
+	CMatrix4x4 t; // Output may be the input
+
+	t.e00 = m.e00;
+	t.e01 = m.e10;
+	t.e02 = m.e20;
+	t.e03 = m.e30;
+
+	t.e10 = m.e01;
+	t.e11 = m.e11;
+	t.e12 = m.e21;
+	t.e13 = m.e31;
+
+	t.e20 = m.e02;
+	t.e21 = m.e12;
+	t.e22 = m.e22;
+	t.e23 = m.e32;
+
+	t.e30 = m.e03;
+	t.e31 = m.e13;
+	t.e32 = m.e23;
+	t.e33 = m.e33;
+
+	mOut = t;
+}
+
+// General inverse of a matrix, returns the determinant. If the determinant is zero then the
+// matrix is singular and the output is not valid
+TFloat32 Inverse( CMatrix4x4& mOut, const CMatrix4x4& m )
+{
+	// Calculate determinant
+	TFloat32 det = m.e00 * Cofactor( m, 0, 0 ) + m.e01 * Cofactor( m, 0, 1 ) +
+	               m.e02 * Cofactor( m, 0, 2 ) + m.e03 * Cofactor( m, 0, 3 );
+	if (det == 0.0f)
+	{
+		return det;
+	}
+
+	// Inverse is (1/determinant)*adjoint matrix. Adjoint matrix is transposed matrix of cofactors
+	CMatrix4x4 inv; // Output may be the input
+	TFloat32 invDet = 1.0f / det;
+	for (TUInt32 i = 0; i < 4; ++i)
+	{
+		for (TUInt32 j = 0; j < 4; ++j)
+		{
+			inv[i][j] = invDet * Cofactor( m, j, i );
+		}
+	}
+	mOut = inv;
+
+	return det;
+}
+
+} // namespace scalar
+
+
+/*-----------------------------------------------------------------------------------------
+	SSE versions
+-----------------------------------------------------------------------------------------*/
+
+namespace sse
+{
+
+// Helpers to load and store a matrix as four rows
+inline void LoadRows( const CMatrix4x4& m, __m128& row0, __m128& row1, __m128& row2, __m128& row3 )
+{
+	row0 = _mm_loadu_ps( &m.e00 );
+	row1 = _mm_loadu_ps( &m.e10 );
+	row2 = _mm_loadu_ps( &m.e20 );
+	row3 = _mm_loadu_ps( &m.e30 );
+}
+inline void StoreRows( CMatrix4x4& m, const __m128& row0, const __m128& row1, const __m128& row2, const __m128& row3 )
+{
+	_mm_storeu_ps( &m.e00, row0 );
+	_mm_storeu_ps( &m.e10, row1 );
+	_mm_storeu_ps( &m.e20, row2 );
+	_mm_storeu_ps( &m.e30, row3 );
+}
+
+// Row vector times matrix given as rows: x*row0 + y*row1 + z*row2 + w*row3
+inline __m128 MultiplyRow( const __m128& v, const __m128& row0, const __m128& row1, const __m128& row2, const __m128& row3 )
+{
+	__m128 xy = _mm_add_ps( _mm_mul_ps( _mm_shuffle_ps( v, v, _MM_SHUFFLE(0,0,0,0) ), row0 ),
+	                        _mm_mul_ps( _mm_shuffle_ps( v, v, _MM_SHUFFLE(1,1,1,1) ), row1 ) );
+	__m128 zw = _mm_add_ps( _mm_mul_ps( _mm_shuffle_ps( v, v, _MM_SHUFFLE(2,2,2,2) ), row2 ),
+	                        _mm_mul_ps( _mm_shuffle_ps( v, v, _MM_SHUFFLE(3,3,3,3) ), row3 ) );
+	return _mm_add_ps( xy, zw );
+}
+
+// Store the first three elements of a register to a vector
+inline void StoreVector3( CVector3& vOut, const __m128& v )
+{
+	TFloat32 elts[4];
+	_mm_storeu_ps( elts, v );
+	vOut.x = elts[0];
+	vOut.y = elts[1];
+	vOut.z = elts[2];
+}
+
+
+// Load three floats into the x, y and z of a register (w is 0) without reading past them
+inline __m128 LoadVector3( const TUInt8* pData )
+{
+	__m128 xy = _mm_loadl_pi( _mm_setzero_ps(), reinterpret_cast<const __m64*>(pData) );
+	__m128 z  = _mm_load_ss( reinterpret_cast<const TFloat32*>(pData) + 2 );
+	return _mm_movelh_ps( xy, z );
+}
+
+// Store the x, y and z of a register to three floats without writing past them
+inline void StoreVector3( TUInt8* pData, const __m128& v )
+{
+	_mm_storel_pi( reinterpret_cast<__m64*>(pData), v );
+	_mm_store_ss( reinterpret_cast<TFloat32*>(pData) + 2, _mm_movehl_ps( v, v ) );
+}
+
+// Shared code of TransformPoints and TransformVectors. Four elements are loaded and transposed so
+// a register holds the x (or y or z) of all four, then each output component for all four is found
+// with three multiplies and adds using the matrix elements copied into every lane. The results are
+// transposed back to store. Any elements left over at the end are done one at a time
+template <bool Points>
+inline void TransformVector3s( const CMatrix4x4& m, const TUInt8* pSource, TUInt32 sourceStride,
+                               TUInt8* pDest, TUInt32 destStride, TUInt32 numElements )
+{
+	const __m128 m00 = _mm_set1_ps( m.e00 ), m01 = _mm_set1_ps( m.e01 ), m02 = _mm_set1_ps( m.e02 );
+	const __m128 m10 = _mm_set1_ps( m.e10 ), m11 = _mm_set1_ps( m.e11 ), m12 = _mm_set1_ps( m.e12 );
+	const __m128 m20 = _mm_set1_ps( m.e20 ), m21 = _mm_set1_ps( m.e21 ), m22 = _mm_set1_ps( m.e22 );
+	const __m128 m30 = _mm_set1_ps( Points ? m.e30 : 0.0f );
+	const __m128 m31 = _mm_set1_ps( Points ? m.e31 : 0.0f );
+	const __m128 m32 = _mm_set1_ps( Points ? m.e32 : 0.0f );
+
+	TUInt32 element = 0;
+	for (; element + 4 <= numElements; element += 4)
+	{
+		__m128 x = LoadVector3( pSource );
+		__m128 y = LoadVector3( pSource + sourceStride );
+		__m128 z = LoadVector3( pSource + 2 * sourceStride );
+		__m128 w = LoadVector3( pSource + 3 * sourceStride );
+		_MM_TRANSPOSE4_PS( x, y, z, w );
+
+		__m128 outX = _mm_add_ps( _mm_add_ps( _mm_mul_ps( x, m00 ), _mm_mul_ps( y, m10 ) ),
+		                          _mm_add_ps( _mm_mul_ps( z, m20 ), m30 ) );
+		__m128 outY = _mm_add_ps( _mm_add_ps( _mm_mul_ps( x, m01 ), _mm_mul_ps( y, m11 ) ),
+		                          _mm_add_ps( _mm_mul_ps( z, m21 ), m31 ) );
+		__m128 outZ = _mm_add_ps( _mm_add_ps( _mm_mul_ps( x, m02 ), _mm_mul_ps( y, m12 ) ),
+		                          _mm_add_ps( _mm_mul_ps( z, m22 ), m32 ) );
+		w = _mm_setzero_ps();
+		_MM_TRANSPOSE4_PS( outX, outY, outZ, w );
+
+		// All four sources are loaded before any are stored, so in-place transforms are safe
+		StoreVector3( pDest, outX );
+		StoreVector3( pDest + destStride, outY );
+		StoreVector3( pDest + 2 * destStride, outZ );
+		StoreVector3( pDest + 3 * destStride, w );
+		pSource += 4 * sourceStride;
+		pDest += 4 * destStride;
+	}
+
+	for (; element < numElements; ++element)
+	{
+		__m128 v = LoadVector3( pSource );
+		__m128 out = _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_shuffle_ps( v, v, _MM_SHUFFLE(0,0,0,0) ), _mm_loadu_ps( &m.e00 ) ),
+		                                     _mm_mul_ps( _mm_shuffle_ps( v, v, _MM_SHUFFLE(1,1,1,1) ), _mm_loadu_ps( &m.e10 ) ) ),
+		                         _mm_mul_ps( _mm_shuffle_ps( v, v, _MM_SHUFFLE(2,2,2,2) ), _mm_loadu_ps( &m.e20 ) ) );
+		if (Points)
+		{
+			out = _mm_add_ps( out, _mm_loadu_ps( &m.e30 ) );
+		}
+		StoreVector3( pDest, out );
+		pSource += sourceStride;
+		pDest += destStride;
+	}
+}
+
+// General 4x4 matrix multiplication: mOut = m1*m2
+// Each row of the output is a row of m1 multiplied by m2
+void Multiply( CMatrix4x4& mOut, const CMatrix4x4& m1, const CMatrix4x4& m2 )
+{
+	__m128 row0, row1, row2, row3;
+	LoadRows( m2, row0, row1, row2, row3 );
+
+	// All of m1 is loaded before anything is stored, so the output may be either input
+	__m128 out0 = MultiplyRow( _mm_loadu_ps( &m1.e00 ), row0, row1, row2, row3 );
+	__m128 out1 = MultiplyRow( _mm_loadu_ps( &m1.e10 ), row0, row1, row2, row3 );
+	__m128 out2 = MultiplyRow( _mm_loadu_ps( &m1.e20 ), row0, row1, row2, row3 );
+	__m128 out3 = MultiplyRow( _mm_loadu_ps( &m1.e30 ), row0, row1, row2, row3 );
+	StoreRows( mOut, out0, out1, out2, out3 );
+}
+
+// Matrix multiplication assuming both matrices are affine: mOut = m1*m2
+// A full multiply costs no more than the affine one with SSE. The 4th column is set exactly
+void MultiplyAffine( CMatrix4x4& mOut, const CMatrix4x4& m1, const CMatrix4x4& m2 )
+{
+	Multiply( mOut, m1, m2 );
+	mOut.e03 = 0.0f;
+	mOut.e13 = 0.0f;
+	mOut.e23 = 0.0f;
+	mOut.e33 = 1.0f;
+}
+
+// Vector-matrix multiplication: vOut = v*m
+void Transform( CVector4& vOut, const CVector4& v, const CMatrix4x4& m )
+{
+	__m128 row0, row1, row2, row3;
+	LoadRows( m, row0, row1, row2, row3 );
+	_mm_storeu_ps( &vOut.x, MultiplyRow( _mm_loadu_ps( &v.x ), row0, row1, row2, row3 ) );
+}
+
+// Vector-matrix multiplication assuming p is a point (4th element is 1): pOut = p*m
+void TransformPoint( CVector3& pOut, const CVector3& p, const CMatrix4x4& m )
+{
+	// Vector only has three elements so can't load four, set each element separately
+	__m128 out = _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( p.x ), _mm_loadu_ps( &m.e00 ) ),
+	                                     _mm_mul_ps( _mm_set1_ps( p.y ), _mm_loadu_ps( &m.e10 ) ) ),
+	                         _mm_add_ps( _mm_mul_ps( _mm_set1_ps( p.z ), _mm_loadu_ps( &m.e20 ) ),
+	                                     _mm_loadu_ps( &m.e30 ) ) );
+	StoreVector3( pOut, out );
+}
+
+// Vector-matrix multiplication assuming v is a vector (4th element is 0): vOut = v*m
+void TransformVector( CVector3& vOut, const CVector3& v, const CMatrix4x4& m )
+{
+	__m128 out = _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( v.x ), _mm_loadu_ps( &m.e00 ) ),
+	                                     _mm_mul_ps( _mm_set1_ps( v.y ), _mm_loadu_ps( &m.e10 ) ) ),
+	                         _mm_mul_ps( _mm_set1_ps( v.z ), _mm_loadu_ps( &m.e20 ) ) );
+	StoreVector3( vOut, out );
+}
+
+// Transform an array of points (4th element 1) by a matrix. Each point is three floats at the
+// start of an element of the given stride in bytes. Source and destination may be the same array
+void TransformPoints( const CMatrix4x4& m, const TUInt8* pSource, TUInt32 sourceStride,
+                      TUInt8* pDest, TUInt32 destStride, TUInt32 numPoints )
+{
+	TransformVector3s<true>( m, pSource, sourceStride, pDest, destStride, numPoints );
+}
+
+// Transform an array of vectors (4th element 0) by a matrix, data layout as TransformPoints
+void TransformVectors( const CMatrix4x4& m, const TUInt8* pSource, TUInt32 sourceStride,
+                       TUInt8* pDest, TUInt32 destStride, TUInt32 numVectors )
+{
+	TransformVector3s<false>( m, pSource, sourceStride, pDest, destStride, numVectors );
+}
+
+// Transpose of a matrix
+void Transpose( CMatrix4x4& mOut, const CMatrix4x4& m )
+{
+	__m128 row0, row1, row2, row3;
+	LoadRows( m, row0, row1, row2, row3 );
+	_MM_TRANSPOSE4_PS( row0, row1, row2, row3 );
+	StoreRows( mOut, row0, row1, row2, row3 );
+}
+
+// General inverse of a matrix, returns the determinant. If the determinant is zero then the
+// matrix is singular and the output is not valid
+// Uses Cramer's rule as described in Intel's "Streaming SIMD Extensions - Inverse of 4x4 Matrix"
+// (AP-928). The matrix is transposed on loading, then the cofactors are found for four elements
+// at a time from products of pairs of rows
+TFloat32 Inverse( CMatrix4x4& mOut, const CMatrix4x4& m )
+{
+	__m128 row0, row1, row2, row3;
+	LoadRows( m, row0, row1, row2, row3 );
+	_MM_TRANSPOSE4_PS( row0, row1, row2, row3 );
+
+	// The algorithm works on rows 1 and 3 swapped in their halves
+	row1 = _mm_shuffle_ps( row1, row1, _MM_SHUFFLE(1,0,3,2) );
+	row3 = _mm_shuffle_ps( row3, row3, _MM_SHUFFLE(1,0,3,2) );
+
+	__m128 minor0, minor1, minor2, minor3, tmp;
+
+	tmp    = _mm_mul_ps( row2, row3 );
+	tmp    = _mm_shuffle_ps( tmp, tmp, 0xB1 );
+	minor0 = _mm_mul_ps( row1, tmp );
+	minor1 = _mm_mul_ps( row0, tmp );
+	tmp    = _mm_shuffle_ps( tmp, tmp, 0x4E );
+	minor0 = _mm_sub_ps( _mm_mul_ps( row1, tmp ), minor0 );
+	minor1 = _mm_sub_ps( _mm_mul_ps( row0, tmp ), minor1 );
+	minor1 = _mm_shuffle_ps( minor1, minor1, 0x4E );
+
+	tmp    = _mm_mul_ps( row1, row2 );
+	tmp    = _mm_shuffle_ps( tmp, tmp, 0xB1 );
+	minor0 = _mm_add_ps( _mm_mul_ps( row3, tmp ), minor0 );
+	minor3 = _mm_mul_ps( row0, tmp );
+	tmp    = _mm_shuffle_ps( tmp, tmp, 0x4E );
+	minor0 = _mm_sub_ps( minor0, _mm_mul_ps( row3, tmp ) );
+	minor3 = _mm_sub_ps( _mm_mul_ps( row0, tmp ), minor3 );
+	minor3 = _mm_shuffle_ps( minor3, minor3, 0x4E );
+
+	tmp    = _mm_mul_ps( _mm_shuffle_ps( row1, row1, 0x4E ), row3 );
+	tmp    = _mm_shuffle_ps( tmp, tmp, 0xB1 );
+	row2   = _mm_shuffle_ps( row2, row2, 0x4E );
+	minor0 = _mm_add_ps( _mm_mul_ps( row2, tmp ), minor0 );
+	minor2 = _mm_mul_ps( row0, tmp );
+	tmp    = _mm_shuffle_ps( tmp, tmp, 0x4E );
+	minor0 = _mm_sub_ps( minor0, _mm_mul_ps( row2, tmp ) );
+	minor2 = _mm_sub_ps( _mm_mul_ps( row0, tmp ), minor2 );
+	minor2 = _mm_shuffle_ps( minor2, minor2, 0x4E );
+
+	tmp    = _mm_mul_ps( row0, row1 );
+	tmp    = _mm_shuffle_ps( tmp, tmp, 0xB1 );
+	minor2 = _mm_add_ps( _mm_mul_ps( row3, tmp ), minor2 );
+	minor3 = _mm_sub_ps( _mm_mul_ps( row2, tmp ), minor3 );
+	tmp    = _mm_shuffle_ps( tmp, tmp, 0x4E );
+	minor2 = _mm_sub_ps( _mm_mul_ps( row3, tmp ), minor2 );
+	minor3 = _mm_sub_ps( minor3, _mm_mul_ps( row2, tmp ) );
+
+	tmp    = _mm_mul_ps( row0, row3 );
+	tmp    = _mm_shuffle_ps( tmp, tmp, 0xB1 );
+	minor1 = _mm_sub_ps( minor1, _mm_mul_ps( row2, tmp ) );
+	minor2 = _mm_add_ps( _mm_mul_ps( row1, tmp ), minor2 );
+	tmp    = _mm_shuffle_ps( tmp, tmp, 0x4E );
+	minor1 = _mm_add_ps( _mm_mul_ps( row2, tmp ), minor1 );
+	minor2 = _mm_sub_ps( minor2, _mm_mul_ps( row1, tmp ) );
+
+	tmp    = _mm_mul_ps( row0, row2 );
+	tmp    = _mm_shuffle_ps( tmp, tmp, 0xB1 );
+	minor1 = _mm_add_ps( _mm_mul_ps( row3, tmp ), minor1 );
+	minor3 = _mm_sub_ps( minor3, _mm_mul_ps( row1, tmp ) );
+	tmp    = _mm_shuffle_ps( tmp, tmp, 0x4E );
+	minor1 = _mm_sub_ps( minor1, _mm_mul_ps( row3, tmp ) );
+	minor3 = _mm_add_ps( _mm_mul_ps( row1, tmp ), minor3 );
+
+	// Determinant is the dot product of the first row with its cofactors, summed across the register
+	__m128 det = _mm_mul_ps( row0, minor0 );
+	det = _mm_add_ps( _mm_shuffle_ps( det, det, 0x4E ), det );
+	det = _mm_add_ss( _mm_shuffle_ps( det, det, 0xB1 ), det );
+	TFloat32 determinant;
+	_mm_store_ss( &determinant, det );
+	if (determinant == 0.0f)
+	{
+		return determinant;
+	}
+
+	// Inverse is the cofactors divided by the determinant. Full precision divide rather than the
+	// approximate reciprocal instruction
+	det = _mm_div_ss( _mm_set_ss( 1.0f ), det );
+	det = _mm_shuffle_ps( det, det, 0x00 );
+	StoreRows( mOut, _mm_mul_ps( det, minor0 ), _mm_mul_ps( det, minor1 ),
+	                 _mm_mul_ps( det, minor2 ), _mm_mul_ps( det, minor3 ) );
+
+	return determinant;
+}
+
+} // namespace sse
+
+
+} // namespace gen
@@ -0,0 +1,131 @@
+/**************************************************************************************************
+	Module:       MatrixKernels.h
+
+	Low-level implementations of the performance critical CMatrix4x4 operations: multiplication,
+	vector transformation, transpose and general inverse. Each operation has a scalar version and
+	an SSE version, CMatrix4x4 uses the version selected by the compile-time switch below. Both
+	versions are always available so they can be compared (see the -mathbenchmark option)
+
+	Change history:
+		V1.0    Created from the scalar code in CMatrix4x4.cpp
+**************************************************************************************************/
+
+// The SSE versions use unaligned loads and stores, so the matrices and vectors do not need to be
+// 16-byte aligned. This allows them to work on D3DX matrices and vectors, and on data in standard
+// containers, both of which are used in place of the maths types in this project. On current CPUs
+// unaligned loads of data that happens to be aligned are as fast as aligned loads
+//
+// There are no SSE4.1 versions. The matrices are row-major and vectors are multiplied on the
+// left (v*m), so each output is a sum of matrix rows scaled by one vector element - broadcast
+// then multiply-add, which SSE1 does directly. The SSE4.1 dot product instruction would need
+// the matrix transposed first, and is slower than the multiply and add it replaces on the CPUs
+// this runs on. The only horizontal sum, the determinant in Inverse, is done once per inverse
+// so gains nothing measurable. SSE4.1 would also stop the importer running on older CPUs
+
+#ifndef GEN_MATRIX_KERNELS_H_INCLUDED
+#define GEN_MATRIX_KERNELS_H_INCLUDED
+
+#include "GenDefines.h"
+#include "CVector3.h"
+#include "CVector4.h"
+#include "CMatrix4x4.h"
+
+// Define GEN_MATH_NO_SSE (e.g. in the project settings) to use the scalar versions throughout
+#if !defined(GEN_MATH_NO_SSE)
+	#define GEN_MATH_SSE
+#endif
+
+namespace gen
+{
+
+/*-----------------------------------------------------------------------------------------
+	Kernel declarations
+-----------------------------------------------------------------------------------------*/
+// The same functions are declared in each namespace. In all of them the output may be the same
+// object as any of the inputs
+
+// Element-by-element versions
+namespace scalar
+{
+	// General 4x4 matrix multiplication: mOut = m1*m2
+	void Multiply( CMatrix4x4& mOut, const CMatrix4x4& m1, const CMatrix4x4& m2 );
+
+	// Matrix multiplication assuming both matrices are affine: mOut = m1*m2
+	void MultiplyAffine( CMatrix4x4& mOut, const CMatrix4x4& m1, const CMatrix4x4& m2 );
+
+	// Vector-matrix multiplication: vOut = v*m
+	void Transform( CVector4& vOut, const CVector4& v, const CMatrix4x4& m );
+
+	// Vector-matrix multiplication assuming p is a point (4th element is 1): pOut = p*m
+	void TransformPoint( CVector3& pOut, const CVector3& p, const CMatrix4x4& m );
+
+	// Vector-matrix multiplication assuming v is a vector (4th element is 0): vOut = v*m
+	void TransformVector( CVector3& vOut, const CVector3& v, const CMatrix4x4& m );
+
+	// Transform an array of points (4th element 1) by a matrix. Each point is three floats at the
+	// start of an element of the given stride in bytes, so the points can be part of a larger vertex.
+	// Only the three floats of each destination element are written, source and destination may be
+	// the same array
+	void TransformPoints( const CMatrix4x4& m, const TUInt8* pSource, TUInt32 sourceStride,
+	                      TUInt8* pDest, TUInt32 destStride, TUInt32 numPoints );
+
+	// Transform an array of vectors (4th element 0) by a matrix, data layout as TransformPoints
+	void TransformVectors( const CMatrix4x4& m, const TUInt8* pSource, TUInt32 sourceStride,
+	                       TUInt8* pDest, TUInt32 destStride, TUInt32 numVectors );
+
+	// Transpose of a matrix
+	void Transpose( CMatrix4x4& mOut, const CMatrix4x4& m );
+
+	// General inverse of a matrix, returns the determinant. If the determinant is zero then the
+	// matrix is singular and the output is not valid
+	TFloat32 Inverse( CMatrix4x4& mOut, const CMatrix4x4& m );
+}
+
+// SSE versions, working on a whole row at a time
+namespace sse
+{
+	// General 4x4 matrix multiplication: mOut = m1*m2
+	void Multiply( CMatrix4x4& mOut, const CMatrix4x4& m1, const CMatrix4x4& m2 );
+
+	// Matrix multiplication assuming both matrices are affine: mOut = m1*m2
+	void MultiplyAffine( CMatrix4x4& mOut, const CMatrix4x4& m1, const CMatrix4x4& m2 );
+
+	// Vector-matrix multiplication: vOut = v*m
+	void Transform( CVector4& vOut, const CVector4& v, const CMatrix4x4& m );
+
+	// Vector-matrix multiplication assuming p is a point (4th element is 1): pOut = p*m
+	void TransformPoint( CVector3& pOut, const CVector3& p, const CMatrix4x4& m );
+
+	// Vector-matrix multiplication assuming v is a vector (4th element is 0): vOut = v*m
+	void TransformVector( CVector3& vOut, const CVector3& v, const CMatrix4x4& m );
+
+	// Transform an array of points (4th element 1) by a matrix. Each point is three floats at the
+	// start of an element of the given stride in bytes, so the points can be part of a larger vertex.
+	// Only the three floats of each destination element are written, source and destination may be
+	// the same array
+	void TransformPoints( const CMatrix4x4& m, const TUInt8* pSource, TUInt32 sourceStride,
+	                      TUInt8* pDest, TUInt32 destStride, TUInt32 numPoints );
+
+	// Transform an array of vectors (4th element 0) by a matrix, data layout as TransformPoints
+	void TransformVectors( const CMatrix4x4& m, const TUInt8* pSource, TUInt32 sourceStride,
+	                       TUInt8* pDest, TUInt32 destStride, TUInt32 numVectors );
+
+	// Transpose of a matrix
+	void Transpose( CMatrix4x4& mOut, const CMatrix4x4& m );
+
+	// General inverse of a matrix, returns the determinant. If the determinant is zero then the
+	// matrix is singular and the output is not valid
+	TFloat32 Inverse( CMatrix4x4& mOut, const CMatrix4x4& m );
+}
+
+// The versions used by CMatrix4x4
+#if defined(GEN_MATH_SSE)
+	namespace kernels = sse;
+#else
+	namespace kernels = scalar;
+#endif
+
+
+} // namespace gen
+
+#endif // GEN_MATRIX_KERNELS_H_INCLUDED
@@ -56,7 +56,7 @@ struct SMeshNode
 // A single face in a mesh - all faces are triangles
 struct SMeshFace
 {
-	TUInt16 aiVertex[3];
+	TUInt32 aiVertex[3];
 };
 typedef vector<SMeshFace> TMeshFaces;
 
@@ -6,13 +6,23 @@
 // Gamers: Used in the same way as the TL-Engine
 //--------------------------------------------------------------------------------------
 
+#include <windows.h>
 #include "Input.h"
 
 
 //////////////////////////////////
 // Globals
 
-EKeyState  g_aiKeyStates[kMaxKeyCodes];
+// Written by the window messages and read by KeyHit and KeyHeld, which may be on another thread (e.g. the update thread). The
+// input functions only ever change a state from pressed to held, with an interlocked exchange, so they never undo a key release
+volatile LONG g_aiKeyStates[kMaxKeyCodes];
+
+// Total raw mouse movement in counts, added to by the window thread with interlocked adds
+volatile LONG g_iMouseTotalX = 0;
+volatile LONG g_iMouseTotalY = 0;
+
+// Raw input devices are registered
+bool g_bRawInput = false;
 
 
 //////////////////////////////////
@@ -25,6 +35,31 @@ void InitInput()
 	{
 		g_aiKeyStates[i] = kNotPressed;
 	}
+	g_iMouseTotalX = 0;
+	g_iMouseTotalY = 0;
+}
+
+// Register the keyboard and mouse for raw input to the given window. Returns false on failure
+bool InitRawInput( HWND hWnd )
+{
+	// Generic desktop usage page (1): mouse (2) and keyboard (6). No flags so other windows and the system keys work as normal
+	RAWINPUTDEVICE devices[2];
+	devices[0].usUsagePage = 0x01;
+	devices[0].usUsage = 0x02;
+	devices[0].dwFlags = 0;
+	devices[0].hwndTarget = hWnd;
+	devices[1].usUsagePage = 0x01;
+	devices[1].usUsage = 0x06;
+	devices[1].dwFlags = 0;
+	devices[1].hwndTarget = hWnd;
+
+	g_bRawInput = (RegisterRawInputDevices( devices, 2, sizeof(RAWINPUTDEVICE) ) != FALSE);
+	return g_bRawInput;
+}
+
+bool UsingRawInput()
+{
+	return g_bRawInput;
 }
 
 
@@ -34,14 +69,9 @@ void InitInput()
 // Event called to indicate that a key has been pressed down
 void KeyDownEvent( EKeyState Key )
 {
-	if (g_aiKeyStates[Key] == kNotPressed)
-	{
-		g_aiKeyStates[Key] = kPressed;
-	}
-	else
-	{
-		g_aiKeyStates[Key] = kHeld;
-	}
+	// Only a new press changes the state. Auto-repeat sends more key downs while the key is held, these must not turn a press into
+	// held before KeyHit has seen it (e.g. when the update thread is between ticks)
+	InterlockedCompareExchange( &g_aiKeyStates[Key], kPressed, kNotPressed );
 }
 
 // Event called to indicate that a key has been lifted up
@@ -50,6 +80,56 @@ void KeyUpEvent( EKeyState Key )
 	g_aiKeyStates[Key] = kNotPressed;
 }
 
+// Event called for a WM_INPUT message. Updates the key states and mouse totals as soon as the input arrives rather than waiting for
+// translated messages
+void RawInputEvent( LPARAM lParam )
+{
+	RAWINPUT input;
+	UINT size = sizeof(input);
+	if (GetRawInputData( reinterpret_cast<HRAWINPUT>(lParam), RID_INPUT, &input, &size, sizeof(RAWINPUTHEADER) ) == static_cast<UINT>(-1))
+	{
+		return;
+	}
+
+	if (input.header.dwType == RIM_TYPEKEYBOARD)
+	{
+		// Key code 0xFF is sent as part of some escaped key sequences, it isn't a key
+		USHORT key = input.data.keyboard.VKey;
+		if (key == 0 || key >= 0xFF) return;
+		if (input.data.keyboard.Flags & RI_KEY_BREAK)
+		{
+			KeyUpEvent( static_cast<EKeyState>(key) );
+		}
+		else
+		{
+			KeyDownEvent( static_cast<EKeyState>(key) );
+		}
+	}
+	else if (input.header.dwType == RIM_TYPEMOUSE)
+	{
+		const RAWMOUSE& mouse = input.data.mouse;
+
+		// Absolute devices (e.g. tablets or remote desktop) don't give a movement in counts, only their buttons are used
+		if (!(mouse.usFlags & MOUSE_MOVE_ABSOLUTE))
+		{
+			if (mouse.lLastX) InterlockedExchangeAdd( &g_iMouseTotalX, mouse.lLastX );
+			if (mouse.lLastY) InterlockedExchangeAdd( &g_iMouseTotalY, mouse.lLastY );
+		}
+
+		// Button transitions, several can come in one event
+		const USHORT downFlags[] = { RI_MOUSE_LEFT_BUTTON_DOWN, RI_MOUSE_RIGHT_BUTTON_DOWN, RI_MOUSE_MIDDLE_BUTTON_DOWN,
+		                             RI_MOUSE_BUTTON_4_DOWN, RI_MOUSE_BUTTON_5_DOWN };
+		const USHORT upFlags[] = { RI_MOUSE_LEFT_BUTTON_UP, RI_MOUSE_RIGHT_BUTTON_UP, RI_MOUSE_MIDDLE_BUTTON_UP,
+		                           RI_MOUSE_BUTTON_4_UP, RI_MOUSE_BUTTON_5_UP };
+		const EKeyCode buttons[] = { Mouse_LButton, Mouse_RButton, Mouse_MButton, Mouse_XButton1, Mouse_XButton2 };
+		for (int button = 0; button < 5; ++button)
+		{
+			if (mouse.usButtonFlags & downFlags[button]) KeyDownEvent( static_cast<EKeyState>(buttons[button]) );
+			if (mouse.usButtonFlags & upFlags[button]) KeyUpEvent( static_cast<EKeyState>(buttons[button]) );
+		}
+	}
+}
+
 
 //////////////////////////////////
 // Input functions
@@ -59,12 +139,7 @@ void KeyUpEvent( EKeyState Key )
 // Mouse_LButton, see input.h for a full list.
 bool KeyHit( EKeyCode eKeyCode )
 {
-	if (g_aiKeyStates[eKeyCode] == kPressed)
-	{
-		g_aiKeyStates[eKeyCode] = kHeld;
-		return true;
-	}
-	return false;
+	return InterlockedCompareExchange( &g_aiKeyStates[eKeyCode], kHeld, kPressed ) == kPressed;
 }
 
 // Returns true as long as a given key or button is held down. Use for
@@ -72,12 +147,15 @@ bool KeyHit( EKeyCode eKeyCode )
 // Mouse_LButton, see input.h for a full list.
 bool KeyHeld( EKeyCode eKeyCode )
 {
-	if (g_aiKeyStates[eKeyCode] == kNotPressed)
-	{
-		return false;
-	}
-	g_aiKeyStates[eKeyCode] = kHeld;
-	return true;
+	return InterlockedCompareExchange( &g_aiKeyStates[eKeyCode], kHeld, kPressed ) != kNotPressed;
+}
+
+// Gets the total raw mouse movement in counts since input started (x
+// right, y down), zero without raw input.
+void GetMouseTotal( LONG& x, LONG& y )
+{
+	x = g_iMouseTotalX;
+	y = g_iMouseTotalY;
 }
 
 		
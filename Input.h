@@ -8,6 +8,8 @@
 
 #pragma once
 
+#include <windows.h>
+
 //////////////////////////////////
 // Constants
 
@@ -168,6 +170,18 @@ enum EKeyCode
 // Initialise the input system
 void InitInput();
 
+// Take keyboard and mouse input from Raw Input (WM_INPUT messages) for
+// the given window instead of WM_KEYDOWN / WM_KEYUP. Raw input skips
+// the legacy message translation and gives the mouse movement in
+// counts, unaffected by pointer acceleration or the screen edges.
+// Returns false if the devices could not be registered, in which case
+// the window messages are used as before.
+bool InitRawInput( HWND hWnd );
+
+// Returns true if raw input is in use. The window still receives
+// WM_KEYDOWN / WM_KEYUP, which should then be ignored.
+bool UsingRawInput();
+
 
 //////////////////////////////////
 // Events
@@ -178,6 +192,9 @@ void KeyDownEvent( EKeyState Key );
 // Event called to indicate that a key has been lifted up
 void KeyUpEvent( EKeyState Key );
 
+// Event called for a WM_INPUT message, pass its lParam
+void RawInputEvent( LPARAM lParam );
+
 
 //////////////////////////////////
 // Input functions
@@ -191,3 +208,9 @@ bool KeyHit( EKeyCode eKeyCode );
 // continuous action or motion. Example key codes: Key_A or
 // Mouse_LButton, see input.h for a full list.
 bool KeyHeld( EKeyCode eKeyCode );
+
+// Gets the total raw mouse movement in counts since input started (x
+// right, y down), zero without raw input. Find the movement since you
+// last looked from the change in the totals, so any number of users,
+// on any thread, can each keep track of their own.
+void GetMouseTotal( LONG& x, LONG& y );
@@ -0,0 +1,243 @@
+//--------------------------------------------------------------------------------------
+//	InstancedModel.cpp
+//
+//	An instanced model draws many copies of the same geometry in a single call. Each copy
+//	(instance) has its own world matrix and tint colour, held in a second vertex buffer
+//--------------------------------------------------------------------------------------
+
+#include "Defines.h"        // General definitions shared by all source files
+#include "InstancedModel.h" // Declaration of this class
+#include "ResourceRegistry.h" // Counted in the buffer memory
+#include "CMatrix4x4.h"     // Maths library matrix, used to build the instance world matrices
+
+
+///////////////////////////////
+// Constructors / Destructors
+
+CInstancedModel::CInstancedModel()
+{
+	m_Mesh = NULL;
+	m_MaxInstances = 0;
+	m_InstanceBuffer = NULL;
+	m_InstancesChanged = false;
+	m_InstanceLayout = NULL;
+	m_StereoInstanceLayout = NULL;
+}
+
+CInstancedModel::~CInstancedModel()
+{
+	ReleaseResources();
+}
+
+// Release resources used by model
+void CInstancedModel::ReleaseResources()
+{
+	SAFE_RELEASE( m_StereoInstanceLayout );
+	SAFE_RELEASE( m_InstanceLayout );
+	SAFE_RELEASE( m_InstanceBuffer );
+	CMeshCache::ReleaseMesh( m_Mesh );
+	m_Mesh = NULL;
+	m_MaxInstances = 0;
+}
+
+
+/////////////////////////////
+// Model Loading
+
+// Load the model geometry from a file (see CModel::Load) and create an instance buffer for up to the given number of instances.
+// The layouts are built against the two example techniques, which must be instanced techniques: one monoscopic, one single-pass stereo
+// Returns true if the load was successful
+bool CInstancedModel::Load( const string& fileName, ID3D10EffectTechnique* exampleTechnique, ID3D10EffectTechnique* exampleStereoTechnique,
+                            unsigned int maxInstances, bool tangents /*= false*/, bool compressed /*= false*/ )
+{
+	ReleaseResources();
+
+	// The mesh's own layout isn't used (no technique passed), the instanced layouts below combine its vertex elements with the instance data
+	m_Mesh = CMeshCache::GetMesh( fileName, NULL, tangents, compressed );
+	if (!m_Mesh)
+	{
+		return false;
+	}
+
+	if (!CreateLayout( exampleTechnique, 1, &m_InstanceLayout ) ||
+	    !CreateLayout( exampleStereoTechnique, 2, &m_StereoInstanceLayout ))
+	{
+		return false;
+	}
+
+	// Dynamic buffer, rewritten by the CPU whenever the instances change
+	m_MaxInstances = maxInstances;
+	D3D10_BUFFER_DESC bufferDesc;
+	bufferDesc.BindFlags = D3D10_BIND_VERTEX_BUFFER;
+	bufferDesc.Usage = D3D10_USAGE_DYNAMIC;
+	bufferDesc.ByteWidth = m_MaxInstances * sizeof(SInstanceData);
+	bufferDesc.CPUAccessFlags = D3D10_CPU_ACCESS_WRITE;
+	bufferDesc.MiscFlags = 0;
+	if (FAILED( g_Resources.CreateBuffer( ResourceBuffer, &bufferDesc, NULL, &m_InstanceBuffer ) ))
+	{
+		return false;
+	}
+	m_InstancesChanged = true;
+
+	return true;
+}
+
+
+/////////////////////////////
+// Instances
+
+// Add an instance with the given position, rotation, scaling and tint. Returns the new instance's index, or -1 if the instance
+// buffer is full
+int CInstancedModel::AddInstance( D3DXVECTOR3 position, D3DXVECTOR3 rotation /*= D3DXVECTOR3(0,0,0)*/, float scale /*= 1.0f*/,
+                                  D3DXVECTOR3 tint /*= D3DXVECTOR3(1,1,1)*/ )
+{
+	if (m_Instances.size() >= m_MaxInstances)
+	{
+		return -1;
+	}
+
+	// World matrix built in the same way as the scene's model matrices (see CScene::BuildMatrices)
+	SInstanceData instance;
+	D3DXVECTOR3 scaling( scale, scale, scale );
+	gen::MatrixAffineEulerZXY( reinterpret_cast<gen::CMatrix4x4*>(&instance.WorldMatrix), reinterpret_cast<const gen::CVector3*>(&position),
+	                           reinterpret_cast<const gen::CVector3*>(&rotation), reinterpret_cast<const gen::CVector3*>(&scaling), 1 );
+	instance.TintColour = tint;
+	m_Instances.push_back( instance );
+	m_InstancesChanged = true;
+
+	return static_cast<int>(m_Instances.size() - 1);
+}
+
+// Change an existing instance
+void CInstancedModel::SetInstanceMatrix( unsigned int index, const D3DXMATRIX& worldMatrix )
+{
+	m_Instances[index].WorldMatrix = worldMatrix;
+	m_InstancesChanged = true;
+}
+
+// Get the world space bounding sphere of an instance (see CModel::GetBoundingSphere)
+void CInstancedModel::GetInstanceBoundingSphere( unsigned int index, D3DXVECTOR3& centre, float& radius )
+{
+	const D3DXMATRIX& m = m_Instances[index].WorldMatrix;
+	if (!m_Mesh)
+	{
+		centre = D3DXVECTOR3( m._41, m._42, m._43 );
+		radius = 0.0f;
+		return;
+	}
+
+	// Largest scale of the matrix rows, in case it isn't uniform
+	float scaleSquared = max( m._11*m._11 + m._12*m._12 + m._13*m._13,
+	                          max( m._21*m._21 + m._22*m._22 + m._23*m._23, m._31*m._31 + m._32*m._32 + m._33*m._33 ) );
+	D3DXVec3TransformCoord( &centre, &m_Mesh->GetBoundingCentre(), &m );
+	radius = m_Mesh->GetBoundingRadius() * sqrtf( scaleSquared );
+}
+
+void CInstancedModel::SetInstanceTint( unsigned int index, const D3DXVECTOR3& tint )
+{
+	m_Instances[index].TintColour = tint;
+	m_InstancesChanged = true;
+}
+
+// Remove all instances
+void CInstancedModel::ClearInstances()
+{
+	m_Instances.clear();
+	m_InstancesChanged = true;
+}
+
+
+/////////////////////////////
+// Model Usage
+
+// Render all instances with the given instanced technique in a single draw call. Assumes any shader variables for the technique have
+// already been set up (e.g. camera matrices and textures). Pass stereo as true for single-pass stereo techniques
+void CInstancedModel::Render( ID3D10EffectTechnique* technique, bool stereo /*= false*/ )
+{
+	if (!m_Mesh || m_Instances.empty()) return;
+
+	UpdateInstanceBuffer();
+
+	// Mesh vertices in slot 0, instance data in slot 1
+	ID3D10Buffer* buffers[2] = { m_Mesh->GetVertexBuffer(), m_InstanceBuffer };
+	UINT strides[2] = { m_Mesh->GetVertexSize(), sizeof(SInstanceData) };
+	UINT offsets[2] = { 0, 0 };
+	g_pd3dDevice->IASetVertexBuffers( 0, 2, buffers, strides, offsets );
+	g_pd3dDevice->IASetInputLayout( stereo ? m_StereoInstanceLayout : m_InstanceLayout );
+	g_pd3dDevice->IASetIndexBuffer( m_Mesh->GetIndexBuffer(), m_Mesh->GetIndexFormat(), 0 );
+	g_pd3dDevice->IASetPrimitiveTopology( D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
+
+	// Single-pass stereo draws every instance once for each eye
+	unsigned int numInstances = GetNumInstances() * (stereo ? 2 : 1);
+
+	D3D10_TECHNIQUE_DESC techDesc;
+	technique->GetDesc( &techDesc );
+	for (UINT p = 0; p < techDesc.Passes; ++p)
+	{
+		technique->GetPassByIndex( p )->Apply( 0 );
+		m_Mesh->Draw( numInstances );
+	}
+}
+
+
+/////////////////////////////
+// Private member functions
+
+// Create a vertex layout of the mesh's vertex elements plus the instance elements, stepping the instance data at the given rate
+bool CInstancedModel::CreateLayout( ID3D10EffectTechnique* exampleTechnique, UINT instanceStepRate, ID3D10InputLayout** layout )
+{
+	// Copy the mesh's elements, then add the world matrix (one element per row) and tint from slot 1
+	const unsigned int MaxElts = 64;
+	D3D10_INPUT_ELEMENT_DESC vertexElts[MaxElts];
+	unsigned int numElts = m_Mesh->GetNumVertexElts();
+	if (numElts + 5 > MaxElts)
+	{
+		return false;
+	}
+	for (unsigned int elt = 0; elt < numElts; ++elt)
+	{
+		vertexElts[elt] = m_Mesh->GetVertexElts()[elt];
+	}
+
+	unsigned int offset = 0;
+	for (unsigned int row = 0; row < 4; ++row)
+	{
+		vertexElts[numElts].SemanticName = "INSTANCE_WORLD";
+		vertexElts[numElts].SemanticIndex = row;
+		vertexElts[numElts].Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+		vertexElts[numElts].AlignedByteOffset = offset;
+		vertexElts[numElts].InputSlot = 1;
+		vertexElts[numElts].InputSlotClass = D3D10_INPUT_PER_INSTANCE_DATA; // Data advances per instance rather than per vertex
+		vertexElts[numElts].InstanceDataStepRate = instanceStepRate;        // Number of instances drawn with each element of data
+		offset += 16;
+		++numElts;
+	}
+	vertexElts[numElts].SemanticName = "INSTANCE_TINT";
+	vertexElts[numElts].SemanticIndex = 0;
+	vertexElts[numElts].Format = DXGI_FORMAT_R32G32B32_FLOAT;
+	vertexElts[numElts].AlignedByteOffset = offset;
+	vertexElts[numElts].InputSlot = 1;
+	vertexElts[numElts].InputSlotClass = D3D10_INPUT_PER_INSTANCE_DATA;
+	vertexElts[numElts].InstanceDataStepRate = instanceStepRate;
+	++numElts;
+
+	D3D10_PASS_DESC PassDesc;
+	exampleTechnique->GetPassByIndex( 0 )->GetDesc( &PassDesc );
+	return SUCCEEDED( g_pd3dDevice->CreateInputLayout( vertexElts, numElts, PassDesc.pIAInputSignature,
+	                                                   PassDesc.IAInputSignatureSize, layout ) );
+}
+
+// Copy the instance data to the instance buffer if it has changed
+void CInstancedModel::UpdateInstanceBuffer()
+{
+	if (!m_InstancesChanged) return;
+
+	// Discard the old contents so the GPU doesn't need to finish with them before we write
+	void* data;
+	if (SUCCEEDED( m_InstanceBuffer->Map( D3D10_MAP_WRITE_DISCARD, 0, &data ) ))
+	{
+		memcpy( data, &m_Instances[0], m_Instances.size() * sizeof(SInstanceData) );
+		m_InstanceBuffer->Unmap();
+		m_InstancesChanged = false;
+	}
+}
@@ -0,0 +1,132 @@
+//--------------------------------------------------------------------------------------
+//	InstancedModel.h
+//
+//	An instanced model draws many copies of the same geometry in a single call. Each copy
+//	(instance) has its own world matrix and tint colour, held in a second vertex buffer
+//--------------------------------------------------------------------------------------
+
+#ifndef INSTANCED_MODEL_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define INSTANCED_MODEL_H_INCLUDED
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <d3d10.h>
+#include <d3dx10.h>
+#include "Mesh.h"
+
+
+// Data for a single instance, as stored in the instance buffer. Must match the INSTANCE_ elements in VS_INSTANCED_INPUT (Stereoscopic.fx)
+struct SInstanceData
+{
+	D3DXMATRIX  WorldMatrix;
+	D3DXVECTOR3 TintColour;
+};
+
+
+class CInstancedModel
+{
+/////////////////////////////
+// Private member variables
+private:
+
+	// Geometry for the model, shared with any other models using the same file (see CMeshCache). NULL if no geometry
+	CMesh*                    m_Mesh;
+
+	// Instance data kept on the CPU, copied to the dynamic instance buffer when it changes
+	vector<SInstanceData>     m_Instances;
+	unsigned int              m_MaxInstances;
+	ID3D10Buffer*             m_InstanceBuffer;
+	bool                      m_InstancesChanged;
+
+	// Vertex layouts combining the mesh's vertex elements (slot 0) with the instance data (slot 1). The stereo layout steps the
+	// instance data every second instance, as single-pass stereo draws each instance twice (once per eye)
+	ID3D10InputLayout*        m_InstanceLayout;
+	ID3D10InputLayout*        m_StereoInstanceLayout;
+
+
+/////////////////////////////
+// Public member functions
+public:
+
+	///////////////////////////////
+	// Constructors / Destructors
+
+	CInstancedModel();
+	~CInstancedModel();
+
+	// Release resources used by model
+	void ReleaseResources();
+
+
+	/////////////////////////////
+	// Model Loading
+
+	// Load the model geometry from a file (see CModel::Load) and create an instance buffer for up to the given number of instances.
+	// The layouts are built against the two example techniques, which must be instanced techniques: one monoscopic, one single-pass stereo
+	// Returns true if the load was successful
+	bool Load( const string& fileName, ID3D10EffectTechnique* exampleTechnique, ID3D10EffectTechnique* exampleStereoTechnique,
+	           unsigned int maxInstances, bool tangents = false, bool compressed = false );
+
+
+	/////////////////////////////
+	// Instances
+
+	// Add an instance with the given position, rotation, scaling and tint. Returns the new instance's index, or -1 if the instance
+	// buffer is full
+	int AddInstance( D3DXVECTOR3 position, D3DXVECTOR3 rotation = D3DXVECTOR3(0,0,0), float scale = 1.0f,
+	                 D3DXVECTOR3 tint = D3DXVECTOR3(1,1,1) );
+
+	// Change an existing instance
+	void SetInstanceMatrix( unsigned int index, const D3DXMATRIX& worldMatrix );
+	void SetInstanceTint( unsigned int index, const D3DXVECTOR3& tint );
+
+	// Remove all instances
+	void ClearInstances();
+
+	unsigned int GetNumInstances()
+	{
+		return static_cast<unsigned int>(m_Instances.size());
+	}
+	// A copy, as adding instances moves the list
+	SInstanceData GetInstance( unsigned int index )
+	{
+		return m_Instances[index];
+	}
+
+	// Get the world space bounding sphere of an instance (see CModel::GetBoundingSphere)
+	void GetInstanceBoundingSphere( unsigned int index, D3DXVECTOR3& centre, float& radius );
+
+	// Geometry shared by all the instances, NULL if not loaded
+	CMesh* GetMesh()
+	{
+		return m_Mesh;
+	}
+
+
+	/////////////////////////////
+	// Model Usage
+
+	// Render all instances with the given instanced technique in a single draw call. Assumes any shader variables for the technique have
+	// already been set up (e.g. camera matrices and textures). Pass stereo as true for single-pass stereo techniques
+	void Render( ID3D10EffectTechnique* technique, bool stereo = false );
+
+
+/////////////////////////////
+// Private member functions
+private:
+
+	// Create a vertex layout of the mesh's vertex elements plus the instance elements, stepping the instance data at the given rate
+	bool CreateLayout( ID3D10EffectTechnique* exampleTechnique, UINT instanceStepRate, ID3D10InputLayout** layout );
+
+	// Copy the instance data to the instance buffer if it has changed
+	void UpdateInstanceBuffer();
+
+	// Disallow use of copy constructor and assignment operator (private and not defined)
+	CInstancedModel( const CInstancedModel& );
+	CInstancedModel& operator=( const CInstancedModel& );
+};
+
+
+#endif // End of header guard - see top of file
@@ -0,0 +1,209 @@
+//--------------------------------------------------------------------------------------
+//	JobSystem.cpp
+//
+//	A small pool of worker threads that run jobs (a function and its data). Each worker
+//	has its own queue and takes work from the other queues when its own is empty, so the
+//	load evens out whatever the length of each job
+//--------------------------------------------------------------------------------------
+
+#include "Defines.h"   // General definitions shared by all source files
+#include "JobSystem.h" // Declaration of this class
+
+
+///////////////////////////////
+// Constructors / Destructors
+
+CJobSystem::CJobSystem()
+{
+	m_JobsReady = NULL;
+	m_Stop = 0;
+	m_NextQueue = 0;
+}
+
+// Destructor - stops the workers, jobs not yet started are not run
+CJobSystem::~CJobSystem()
+{
+	Shutdown();
+}
+
+
+// Start the worker threads. Defaults (0) to one less than the number of processors, as the thread waiting for jobs runs them too
+bool CJobSystem::Init( unsigned int numThreads /*= 0*/ )
+{
+	if (numThreads == 0)
+	{
+		SYSTEM_INFO systemInfo;
+		GetSystemInfo( &systemInfo );
+		numThreads = max( systemInfo.dwNumberOfProcessors, 2ul ) - 1;
+	}
+
+	m_JobsReady = CreateSemaphore( NULL, 0, MAXLONG, NULL );
+	if (!m_JobsReady) return false;
+
+	// All the queues exist before any thread starts, as a worker may steal from any of them
+	m_Stop = 0;
+	for (unsigned int worker = 0; worker < numThreads; ++worker)
+	{
+		SWorkerQueue* queue = new SWorkerQueue;
+		InitializeCriticalSection( &queue->lock );
+		queue->system = this;
+		queue->worker = worker;
+		m_Queues.push_back( queue );
+	}
+	for (unsigned int worker = 0; worker < numThreads; ++worker)
+	{
+		HANDLE thread = CreateThread( NULL, 0, ThreadProc, m_Queues[worker], 0, NULL );
+		if (!thread)
+		{
+			Shutdown();
+			return false;
+		}
+		m_Threads.push_back( thread );
+	}
+	return true;
+}
+
+// Stop the worker threads, waits for the jobs they are running. Jobs not yet started are not run
+void CJobSystem::Shutdown()
+{
+	if (!m_JobsReady) return;
+
+	// Wake every worker to see the stop flag
+	InterlockedExchange( &m_Stop, 1 );
+	ReleaseSemaphore( m_JobsReady, static_cast<LONG>(m_Queues.size()), NULL );
+	for (unsigned int thread = 0; thread < m_Threads.size(); ++thread)
+	{
+		WaitForSingleObject( m_Threads[thread], INFINITE );
+		CloseHandle( m_Threads[thread] );
+	}
+	m_Threads.clear();
+
+	for (unsigned int queue = 0; queue < m_Queues.size(); ++queue)
+	{
+		DeleteCriticalSection( &m_Queues[queue]->lock );
+		delete m_Queues[queue];
+	}
+	m_Queues.clear();
+
+	CloseHandle( m_JobsReady );
+	m_JobsReady = NULL;
+}
+
+
+/////////////////////////////
+// Jobs
+
+// Queue a job, which will run on one of the workers. The counter (optional) is increased now and decreased when the job finishes.
+// With no worker threads the job is run straight away
+void CJobSystem::Add( TJobFunction function, void* data, SJobCounter* counter /*= NULL*/ )
+{
+	SJob job = { function, data, counter };
+	if (counter)
+	{
+		InterlockedIncrement( &counter->numPending );
+	}
+	if (m_Queues.empty())
+	{
+		RunJob( job );
+		return;
+	}
+
+	SWorkerQueue* queue = m_Queues[static_cast<unsigned long>(InterlockedIncrement( &m_NextQueue )) % m_Queues.size()];
+	EnterCriticalSection( &queue->lock );
+	queue->jobs.push_back( job );
+	LeaveCriticalSection( &queue->lock );
+	ReleaseSemaphore( m_JobsReady, 1, NULL );
+}
+
+// Wait until all the jobs added with the counter have finished. The calling thread runs queued jobs while it waits
+void CJobSystem::Wait( SJobCounter& counter )
+{
+	// The caller has no queue of its own, so it steals from all of them. Once the queues are empty the remaining jobs are already
+	// running on the workers, just give up the time slice until they are done
+	unsigned int noQueue = static_cast<unsigned int>(m_Queues.size());
+	while (counter.numPending > 0)
+	{
+		SJob job;
+		if (TakeJob( noQueue, job ))
+		{
+			RunJob( job );
+		}
+		else
+		{
+			SwitchToThread();
+		}
+	}
+}
+
+
+/////////////////////////////
+// Private member functions
+
+// Take a job from the given worker's own queue, or from any other queue if that is empty. Returns false if there are no jobs
+bool CJobSystem::TakeJob( unsigned int worker, SJob& job )
+{
+	unsigned int numQueues = static_cast<unsigned int>(m_Queues.size());
+	if (worker < numQueues)
+	{
+		SWorkerQueue* queue = m_Queues[worker];
+		EnterCriticalSection( &queue->lock );
+		bool found = !queue->jobs.empty();
+		if (found)
+		{
+			job = queue->jobs.back();
+			queue->jobs.pop_back();
+		}
+		LeaveCriticalSection( &queue->lock );
+		if (found) return true;
+	}
+
+	// Steal the oldest job from the other queues, starting with the next one along so the workers don't all pick on the same queue
+	for (unsigned int i = 1; i <= numQueues; ++i)
+	{
+		SWorkerQueue* queue = m_Queues[(worker + i) % numQueues];
+		EnterCriticalSection( &queue->lock );
+		bool found = !queue->jobs.empty();
+		if (found)
+		{
+			job = queue->jobs.front();
+			queue->jobs.pop_front();
+		}
+		LeaveCriticalSection( &queue->lock );
+		if (found) return true;
+	}
+	return false;
+}
+
+// Run a job and count it off
+void CJobSystem::RunJob( const SJob& job )
+{
+	job.function( job.data );
+	if (job.counter)
+	{
+		InterlockedDecrement( &job.counter->numPending );
+	}
+}
+
+// Worker thread loop. The semaphore is released once per job added, but a job may be taken by another worker (or a waiting thread)
+// first, so finding nothing after waking is normal
+void CJobSystem::Run( unsigned int worker )
+{
+	for (;;)
+	{
+		WaitForSingleObject( m_JobsReady, INFINITE );
+		if (m_Stop) return;
+
+		SJob job;
+		while (!m_Stop && TakeJob( worker, job ))
+		{
+			RunJob( job );
+		}
+	}
+}
+
+DWORD WINAPI CJobSystem::ThreadProc( LPVOID param )
+{
+	SWorkerQueue* queue = static_cast<SWorkerQueue*>(param);
+	queue->system->Run( queue->worker );
+	return 0;
+}
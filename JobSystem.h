@@ -0,0 +1,122 @@
+//--------------------------------------------------------------------------------------
+//	JobSystem.h
+//
+//	A small pool of worker threads that run jobs (a function and its data). Each worker
+//	has its own queue and takes work from the other queues when its own is empty, so the
+//	load evens out whatever the length of each job
+//--------------------------------------------------------------------------------------
+
+#ifndef JOB_SYSTEM_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define JOB_SYSTEM_H_INCLUDED
+
+#include <deque>
+#include <vector>
+using namespace std;
+
+#include <windows.h>
+
+
+// Function run by a job, given the data pointer added with it
+typedef void (*TJobFunction)( void* data );
+
+// Counts the jobs added with it that haven't finished yet, wait for them with CJobSystem::Wait. Must stay in place (not be copied)
+// until the jobs are done
+struct SJobCounter
+{
+	volatile LONG numPending;
+
+	SJobCounter()
+	{
+		numPending = 0;
+	}
+};
+
+
+class CJobSystem
+{
+/////////////////////////////
+// Private member variables
+private:
+
+	struct SJob
+	{
+		TJobFunction function;
+		void*        data;
+		SJobCounter* counter;
+	};
+
+	// A worker's queue. The owner takes its newest job (likely to still be in its cache), others steal the oldest
+	struct SWorkerQueue
+	{
+		CRITICAL_SECTION lock;
+		deque<SJob>      jobs;
+		CJobSystem*      system; // Passed to the worker's thread with its queue
+		unsigned int     worker;
+	};
+
+	vector<HANDLE>        m_Threads;
+	vector<SWorkerQueue*> m_Queues;     // One per worker
+	HANDLE                m_JobsReady;  // Semaphore counting queued jobs, idle workers sleep on it
+	volatile LONG         m_Stop;
+	volatile LONG         m_NextQueue;  // Queue for the next job added, spreads the jobs around
+
+
+/////////////////////////////
+// Public member functions
+public:
+
+	///////////////////////////////
+	// Constructors / Destructors
+
+	CJobSystem();
+
+	// Destructor - stops the workers, jobs not yet started are not run
+	~CJobSystem();
+
+private:
+	// Disallow use of copy constructor and assignment operator (private and not defined)
+	CJobSystem( const CJobSystem& );
+	CJobSystem& operator=( const CJobSystem& );
+
+public:
+
+	// Start the worker threads. Defaults (0) to one less than the number of processors, as the thread waiting for jobs runs them too
+	bool Init( unsigned int numThreads = 0 );
+
+	// Stop the worker threads, waits for the jobs they are running. Jobs not yet started are not run
+	void Shutdown();
+
+	unsigned int GetNumThreads()
+	{
+		return static_cast<unsigned int>(m_Threads.size());
+	}
+
+
+	/////////////////////////////
+	// Jobs
+
+	// Queue a job, which will run on one of the workers. The counter (optional) is increased now and decreased when the job finishes.
+	// With no worker threads the job is run straight away
+	void Add( TJobFunction function, void* data, SJobCounter* counter = NULL );
+
+	// Wait until all the jobs added with the counter have finished. The calling thread runs queued jobs while it waits
+	void Wait( SJobCounter& counter );
+
+
+/////////////////////////////
+// Private member functions
+private:
+
+	// Take a job from the given worker's own queue, or from any other queue if that is empty. Returns false if there are no jobs
+	bool TakeJob( unsigned int worker, SJob& job );
+
+	// Run a job and count it off
+	void RunJob( const SJob& job );
+
+	// Worker thread loop
+	void Run( unsigned int worker );
+	static DWORD WINAPI ThreadProc( LPVOID param );
+};
+
+
+#endif // End of header guard - see top of file
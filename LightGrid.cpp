@@ -0,0 +1,282 @@
+//--------------------------------------------------------------------------------------
+//	LightGrid.cpp
+//
+//	A list of point lights binned into screen-space tiles once per frame, so each pixel
+//	only loops over the lights that can reach its tile. The tiles cover the union of both
+//	eyes' views, so one grid is shared by the left and right renders
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+#include "Defines.h"   // General definitions shared by all source files
+#include "LightGrid.h" // Declaration of this class
+#include "ResourceRegistry.h" // Counted in the buffer memory
+
+
+// Light intensity below which a light is treated as having no effect - a little over 1/10 of the scene's ambient light
+const float CLightGrid::LightCutoff = 0.05f;
+
+
+///////////////////////////////
+// Constructors / Destructors
+
+CLightGrid::CLightGrid()
+{
+	m_MaxLights = 0;
+	m_TilesX = 0;
+	m_TilesY = 0;
+	m_LightBuffer = NULL;
+	m_LightView = NULL;
+	m_TileBuffer = NULL;
+	m_TileView = NULL;
+	m_MaxTiles = 0;
+	m_IndexBuffer = NULL;
+	m_IndexView = NULL;
+	m_MaxIndices = 0;
+}
+
+CLightGrid::~CLightGrid()
+{
+	ReleaseResources();
+}
+
+// Create the light buffer for up to the given number of lights. Returns true on success
+bool CLightGrid::Init( unsigned int maxLights )
+{
+	ReleaseResources();
+
+	m_MaxLights = maxLights;
+	m_Lights.reserve( m_MaxLights );
+	m_LightData.resize( m_MaxLights * 2 );
+	m_LightTiles.resize( m_MaxLights );
+	return CreateBuffer( m_MaxLights * 2, sizeof(D3DXVECTOR4), DXGI_FORMAT_R32G32B32A32_FLOAT, &m_LightBuffer, &m_LightView );
+}
+
+// Release the GPU buffers
+void CLightGrid::ReleaseResources()
+{
+	SAFE_RELEASE( m_IndexView );
+	SAFE_RELEASE( m_IndexBuffer );
+	SAFE_RELEASE( m_TileView );
+	SAFE_RELEASE( m_TileBuffer );
+	SAFE_RELEASE( m_LightView );
+	SAFE_RELEASE( m_LightBuffer );
+	m_MaxTiles = 0;
+	m_MaxIndices = 0;
+}
+
+
+/////////////////////////////
+// Lights
+
+// Add a light, a range of 0 selects the range from the colour's intensity (see GetDefaultRange). Returns the new light's index,
+// or -1 if the grid already has its maximum number of lights
+int CLightGrid::AddLight( const D3DXVECTOR3& position, const D3DXVECTOR3& colour, float range /*= 0.0f*/ )
+{
+	if (m_Lights.size() >= m_MaxLights) return -1;
+
+	SPointLight light;
+	light.position = position;
+	light.colour = colour;
+	light.range = (range > 0.0f) ? range : GetDefaultRange( colour );
+	m_Lights.push_back( light );
+	return static_cast<int>(m_Lights.size()) - 1;
+}
+
+// Change an existing light
+void CLightGrid::SetLightPosition( unsigned int index, const D3DXVECTOR3& position )
+{
+	m_Lights[index].position = position;
+}
+
+void CLightGrid::SetLightColour( unsigned int index, const D3DXVECTOR3& colour )
+{
+	m_Lights[index].colour = colour;
+}
+
+// Distance at which a light of the given colour falls below the cutoff intensity. Lights fall off with 1 / distance, so this is
+// the largest colour component / cutoff
+float CLightGrid::GetDefaultRange( const D3DXVECTOR3& colour )
+{
+	return max( colour.x, max( colour.y, colour.z ) ) / LightCutoff;
+}
+
+
+/////////////////////////////
+// Binning
+
+// Bin the lights into the tiles of the given eye viewports (the grid uses the larger size of the two), using the left and right eye
+// matrices of the camera. Each light goes in the tiles covered by its sphere in either eye. Copies the lights, tiles and indices to
+// the GPU buffers. Returns false if the buffers could not be created
+bool CLightGrid::Build( CCamera* camera, const D3D10_VIEWPORT eyeViewports[2] )
+{
+	// The eye viewports are the same size other than rounding (side-by-side), tiles are counted from the top-left of each
+	UINT width  = max( eyeViewports[0].Width,  eyeViewports[1].Width );
+	UINT height = max( eyeViewports[0].Height, eyeViewports[1].Height );
+	m_TilesX = (width  + TileSize - 1) / TileSize;
+	m_TilesY = (height + TileSize - 1) / TileSize;
+	unsigned int numTiles = m_TilesX * m_TilesY;
+
+	// Grow the tile and index buffers if the viewport is larger than they were made for
+	if (numTiles > m_MaxTiles)
+	{
+		SAFE_RELEASE( m_IndexView );
+		SAFE_RELEASE( m_IndexBuffer );
+		SAFE_RELEASE( m_TileView );
+		SAFE_RELEASE( m_TileBuffer );
+		m_MaxTiles = m_MaxIndices = 0;
+		if (!CreateBuffer( numTiles, 2 * sizeof(UINT), DXGI_FORMAT_R32G32_UINT, &m_TileBuffer, &m_TileView ) ||
+		    !CreateBuffer( numTiles * AverageLightsPerTile, sizeof(UINT), DXGI_FORMAT_R32_UINT, &m_IndexBuffer, &m_IndexView ))
+		{
+			return false;
+		}
+		m_MaxTiles = numTiles;
+		m_MaxIndices = numTiles * AverageLightsPerTile;
+		m_TileData.resize( m_MaxTiles * 2 );
+		m_Indices.resize( m_MaxIndices );
+	}
+
+	// Find the tiles each light covers in either eye and count the lights in each tile. The eyes' tile rectangles mostly overlap, so
+	// using their union adds few tiles but means both eyes share one grid
+	unsigned int numLights = GetNumLights();
+	float nearClip = camera->GetNearClip();
+	fill( m_TileData.begin(), m_TileData.begin() + numTiles * 2, 0 );
+	for (unsigned int light = 0; light < numLights; ++light)
+	{
+		RECT leftTiles, rightTiles;
+		bool inLeft  = GetTileRect( m_Lights[light], camera->GetViewMatrix( StereoscopicLeft ), camera->GetProjectionMatrix( StereoscopicLeft ),
+		                            eyeViewports[0], nearClip, leftTiles );
+		bool inRight = GetTileRect( m_Lights[light], camera->GetViewMatrix( StereoscopicRight ), camera->GetProjectionMatrix( StereoscopicRight ),
+		                            eyeViewports[1], nearClip, rightTiles );
+		RECT& tiles = m_LightTiles[light];
+		if      (inLeft && inRight) UnionRect( &tiles, &leftTiles, &rightTiles );
+		else if (inLeft)            tiles = leftTiles;
+		else if (inRight)           tiles = rightTiles;
+		else                        SetRectEmpty( &tiles );
+
+		for (LONG y = tiles.top; y < tiles.bottom; ++y)
+		{
+			for (LONG x = tiles.left; x < tiles.right; ++x)
+			{
+				++m_TileData[(y * m_TilesX + x) * 2 + 1];
+			}
+		}
+	}
+
+	// Each tile's lights follow on from the previous tile's in the index buffer. The counts are then rebuilt as the indices are added
+	UINT numIndices = 0;
+	for (unsigned int tile = 0; tile < numTiles; ++tile)
+	{
+		m_TileData[tile * 2] = numIndices;
+		numIndices += m_TileData[tile * 2 + 1];
+		m_TileData[tile * 2 + 1] = 0;
+	}
+
+	// Fill in the indices. The tile ranges don't overlap, so the only overflow is off the end of the buffer - tiles there lose their
+	// last lights (or all of them)
+	for (unsigned int light = 0; light < numLights; ++light)
+	{
+		const RECT& tiles = m_LightTiles[light];
+		for (LONG y = tiles.top; y < tiles.bottom; ++y)
+		{
+			for (LONG x = tiles.left; x < tiles.right; ++x)
+			{
+				unsigned int tile = y * m_TilesX + x;
+				UINT index = m_TileData[tile * 2] + m_TileData[tile * 2 + 1];
+				if (index < m_MaxIndices)
+				{
+					m_Indices[index] = light;
+					++m_TileData[tile * 2 + 1];
+				}
+			}
+		}
+
+		m_LightData[light * 2]     = D3DXVECTOR4( m_Lights[light].position, m_Lights[light].range );
+		m_LightData[light * 2 + 1] = D3DXVECTOR4( m_Lights[light].colour, 0.0f );
+	}
+
+	UpdateBuffer( m_LightBuffer, numLights > 0 ? &m_LightData[0] : NULL, numLights * 2 * sizeof(D3DXVECTOR4) );
+	UpdateBuffer( m_TileBuffer, &m_TileData[0], numTiles * 2 * sizeof(UINT) );
+	UpdateBuffer( m_IndexBuffer, &m_Indices[0], min( numIndices, m_MaxIndices ) * sizeof(UINT) );
+	return true;
+}
+
+
+/////////////////////////////
+// Private member functions
+
+// Get the rectangle of tiles covered by a light's sphere in the view of one eye (right and bottom are one past the last tile). Returns
+// false if the sphere is behind the camera or outside the viewport
+bool CLightGrid::GetTileRect( const SPointLight& light, const D3DXMATRIXA16& viewMatrix, const D3DXMATRIXA16& projMatrix,
+                              const D3D10_VIEWPORT& viewport, float nearClip, RECT& tiles )
+{
+	D3DXVECTOR3 viewPos;
+	D3DXVec3TransformCoord( &viewPos, &light.position, &viewMatrix );
+	float range = light.range;
+	if (viewPos.z + range <= nearClip) return false;
+
+	// A sphere crossing the near clip plane can cover any part of the screen
+	if (viewPos.z - range <= nearClip)
+	{
+		SetRect( &tiles, 0, 0, m_TilesX, m_TilesY );
+		return true;
+	}
+
+	// Project the corners of the sphere's view space bounding box, which encloses the sphere's projection. The box is in front of the
+	// camera, so x/z is smallest at the smallest x and one of the two z extremes (similarly for the other bounds). The projection maps
+	// x/z to x * _11 + _31 (the stereo projections are off-axis, so _31 is not 0)
+	float nearZ = viewPos.z - range;
+	float farZ  = viewPos.z + range;
+	float left   = min( (viewPos.x - range) / nearZ, (viewPos.x - range) / farZ ) * projMatrix._11 + projMatrix._31;
+	float right  = max( (viewPos.x + range) / nearZ, (viewPos.x + range) / farZ ) * projMatrix._11 + projMatrix._31;
+	float bottom = min( (viewPos.y - range) / nearZ, (viewPos.y - range) / farZ ) * projMatrix._22 + projMatrix._32;
+	float top    = max( (viewPos.y + range) / nearZ, (viewPos.y + range) / farZ ) * projMatrix._22 + projMatrix._32;
+	if (left >= 1.0f || right <= -1.0f || bottom >= 1.0f || top <= -1.0f) return false;
+
+	// Convert from -1->1 (y up) to tiles (y down)
+	float tilesPerUnitX = 0.5f * viewport.Width  / TileSize;
+	float tilesPerUnitY = 0.5f * viewport.Height / TileSize;
+	tiles.left   = max( static_cast<LONG>(floorf( (left + 1.0f) * tilesPerUnitX )), 0L );
+	tiles.right  = min( static_cast<LONG>(floorf( (right + 1.0f) * tilesPerUnitX )) + 1, static_cast<LONG>(m_TilesX) );
+	tiles.top    = max( static_cast<LONG>(floorf( (1.0f - top) * tilesPerUnitY )), 0L );
+	tiles.bottom = min( static_cast<LONG>(floorf( (1.0f - bottom) * tilesPerUnitY )) + 1, static_cast<LONG>(m_TilesY) );
+	return true;
+}
+
+// Create a dynamic buffer of the given number of elements and a shader resource view of it with the given element format
+bool CLightGrid::CreateBuffer( unsigned int numElements, UINT elementSize, DXGI_FORMAT format,
+                               ID3D10Buffer** buffer, ID3D10ShaderResourceView** view )
+{
+	D3D10_BUFFER_DESC bufferDesc;
+	bufferDesc.BindFlags = D3D10_BIND_SHADER_RESOURCE;
+	bufferDesc.Usage = D3D10_USAGE_DYNAMIC;
+	bufferDesc.ByteWidth = max( numElements, 1u ) * elementSize;
+	bufferDesc.CPUAccessFlags = D3D10_CPU_ACCESS_WRITE;
+	bufferDesc.MiscFlags = 0;
+	if (FAILED( g_Resources.CreateBuffer( ResourceBuffer, &bufferDesc, NULL, buffer ) ))
+	{
+		return false;
+	}
+
+	D3D10_SHADER_RESOURCE_VIEW_DESC viewDesc;
+	viewDesc.Format = format;
+	viewDesc.ViewDimension = D3D10_SRV_DIMENSION_BUFFER;
+	viewDesc.Buffer.ElementOffset = 0;
+	viewDesc.Buffer.ElementWidth = max( numElements, 1u );
+	return SUCCEEDED( g_Resources.CreateShaderResourceView( ResourceBuffer, *buffer, &viewDesc, view ) );
+}
+
+// Copy data to a dynamic buffer, replacing its contents
+void CLightGrid::UpdateBuffer( ID3D10Buffer* buffer, const void* data, UINT size )
+{
+	if (size == 0) return;
+
+	void* bufferData;
+	if (SUCCEEDED( buffer->Map( D3D10_MAP_WRITE_DISCARD, 0, &bufferData ) ))
+	{
+		memcpy( bufferData, data, size );
+		buffer->Unmap();
+	}
+}
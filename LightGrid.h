@@ -0,0 +1,172 @@
+//--------------------------------------------------------------------------------------
+//	LightGrid.h
+//
+//	A list of point lights binned into screen-space tiles once per frame, so each pixel
+//	only loops over the lights that can reach its tile. The tiles cover the union of both
+//	eyes' views, so one grid is shared by the left and right renders
+//--------------------------------------------------------------------------------------
+
+#ifndef LIGHT_GRID_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define LIGHT_GRID_H_INCLUDED
+
+#include <vector>
+using namespace std;
+
+#include <d3d10.h>
+#include <d3dx10.h>
+#include "Camera.h"
+
+
+// A point light. The light falls off with distance and reaches zero at its range
+struct SPointLight
+{
+	D3DXVECTOR3 position;
+	D3DXVECTOR3 colour;
+	float       range;
+};
+
+
+class CLightGrid
+{
+/////////////////////////////
+// Public constants
+public:
+
+	// Size of each tile in pixels. Smaller tiles cull more lights per pixel, but cost more to bin and take more index memory
+	static const unsigned int TileSize = 32;
+
+	// Average number of lights per tile the index buffer is sized for. If a frame needs more, the lights binned last are dropped from
+	// the tiles that overflow
+	static const unsigned int AverageLightsPerTile = 16;
+
+	// Light intensity (largest colour component / distance) below which a light is treated as having no effect, gives the default range
+	static const float LightCutoff;
+
+
+/////////////////////////////
+// Private member variables
+private:
+
+	vector<SPointLight>       m_Lights;
+	unsigned int              m_MaxLights;
+
+	// Tiles across and down the eye viewport in the last build
+	unsigned int              m_TilesX;
+	unsigned int              m_TilesY;
+
+	// CPU copies of the buffers below, built each frame then copied over in one go. Each light's tile rectangle is kept between the
+	// passes of the build
+	vector<D3DXVECTOR4>       m_LightData;
+	vector<UINT>              m_TileData;
+	vector<UINT>              m_Indices;
+	vector<RECT>              m_LightTiles;
+
+	// Dynamic GPU buffers read by the pixel shaders: two float4s per light (position & range, colour), a uint2 per tile (offset of its
+	// first light in the index buffer, number of lights) and the light indices for all tiles. The tile and index buffers are recreated
+	// when the viewport grows past their size
+	ID3D10Buffer*             m_LightBuffer;
+	ID3D10ShaderResourceView* m_LightView;
+	ID3D10Buffer*             m_TileBuffer;
+	ID3D10ShaderResourceView* m_TileView;
+	unsigned int              m_MaxTiles;
+	ID3D10Buffer*             m_IndexBuffer;
+	ID3D10ShaderResourceView* m_IndexView;
+	unsigned int              m_MaxIndices;
+
+
+/////////////////////////////
+// Public member functions
+public:
+
+	///////////////////////////////
+	// Constructors / Destructors
+
+	CLightGrid();
+	~CLightGrid();
+
+	// Create the light buffer for up to the given number of lights. Returns true on success
+	bool Init( unsigned int maxLights );
+
+	// Release the GPU buffers
+	void ReleaseResources();
+
+
+	/////////////////////////////
+	// Lights
+
+	// Add a light, a range of 0 selects the range from the colour's intensity (see GetDefaultRange). Returns the new light's index,
+	// or -1 if the grid already has its maximum number of lights
+	int AddLight( const D3DXVECTOR3& position, const D3DXVECTOR3& colour, float range = 0.0f );
+
+	// Change an existing light
+	void SetLightPosition( unsigned int index, const D3DXVECTOR3& position );
+	void SetLightColour( unsigned int index, const D3DXVECTOR3& colour );
+
+	unsigned int GetNumLights()
+	{
+		return static_cast<unsigned int>(m_Lights.size());
+	}
+	const SPointLight& GetLight( unsigned int index )
+	{
+		return m_Lights[index];
+	}
+
+	// Distance at which a light of the given colour falls below the cutoff intensity. Lights fall off with 1 / distance, so this is
+	// the largest colour component / cutoff
+	static float GetDefaultRange( const D3DXVECTOR3& colour );
+
+
+	/////////////////////////////
+	// Binning
+
+	// Bin the lights into the tiles of the given eye viewports (the grid uses the larger size of the two), using the left and right eye
+	// matrices of the camera. Each light goes in the tiles covered by its sphere in either eye. Copies the lights, tiles and indices to
+	// the GPU buffers. Returns false if the buffers could not be created
+	bool Build( CCamera* camera, const D3D10_VIEWPORT eyeViewports[2] );
+
+	unsigned int GetTilesX()
+	{
+		return m_TilesX;
+	}
+	unsigned int GetTilesY()
+	{
+		return m_TilesY;
+	}
+
+	// Views of the GPU buffers for the shaders (see LightData, LightTiles and LightIndices in Stereoscopic.fx)
+	ID3D10ShaderResourceView* GetLightView()
+	{
+		return m_LightView;
+	}
+	ID3D10ShaderResourceView* GetTileView()
+	{
+		return m_TileView;
+	}
+	ID3D10ShaderResourceView* GetIndexView()
+	{
+		return m_IndexView;
+	}
+
+
+/////////////////////////////
+// Private member functions
+private:
+
+	// Get the rectangle of tiles covered by a light's sphere in the view of one eye. Returns false if the sphere is behind the camera
+	bool GetTileRect( const SPointLight& light, const D3DXMATRIXA16& viewMatrix, const D3DXMATRIXA16& projMatrix,
+	                  const D3D10_VIEWPORT& viewport, float nearClip, RECT& tiles );
+
+	// Create a dynamic buffer of the given number of elements and a shader resource view of it with the given element format
+	bool CreateBuffer( unsigned int numElements, UINT elementSize, DXGI_FORMAT format,
+	                   ID3D10Buffer** buffer, ID3D10ShaderResourceView** view );
+
+	// Copy data to a dynamic buffer, replacing its contents
+	void UpdateBuffer( ID3D10Buffer* buffer, const void* data, UINT size );
+
+	// Disallow use of copy constructor and assignment operator (private and not defined)
+	CLightGrid( const CLightGrid& );
+	CLightGrid& operator=( const CLightGrid& );
+};
+
+
+#endif // End of header guard - see top of file
@@ -0,0 +1,283 @@
+//--------------------------------------------------------------------------------------
+//	MathBenchmark.cpp
+//
+//	Times the scalar and SSE versions of the maths library's matrix operations (see
+//	MatrixKernels.h) and writes the results to a CSV file. Run with -mathbenchmark
+//--------------------------------------------------------------------------------------
+
+#include <vector>
+#include <fstream>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+using namespace std;
+
+#include "MathBenchmark.h" // Declaration of this module
+#include "MatrixKernels.h" // The scalar (gen::scalar) and SSE (gen::sse) versions of the operations
+#include "CTimer.h"        // Timer class - not DirectX
+using namespace gen;
+
+
+//--------------------------------------------------------------------------------------
+// Benchmark Data
+//--------------------------------------------------------------------------------------
+
+// Operations work through arrays of this many matrices and vectors, small enough to stay in the cache so the arithmetic is measured
+// rather than memory. Each array is processed this many times
+const unsigned int NumMathElements = 1024;
+const unsigned int NumMathRepeats = 2000;
+
+// Largest difference allowed between the scalar and SSE results. They differ slightly as the additions are done in a different order
+const float MathTolerance = 1e-3f;
+
+// The batch transforms work on vertices like those of an imported mesh: position, normal then UV, with this many floats per vertex
+const unsigned int MathVertexFloats = 8;
+const unsigned int MathVertexStride = MathVertexFloats * sizeof(float);
+const unsigned int MathNormalOffset = 3 * sizeof(float);
+
+// Random matrices and vectors used as the inputs, and the outputs of each version
+vector<CMatrix4x4> MathMatrices1;
+vector<CMatrix4x4> MathMatrices2;
+vector<CVector4>   MathVectors4;
+vector<CVector3>   MathVectors3;
+vector<float>      MathVertices;
+
+vector<CMatrix4x4> ScalarMatrices;
+vector<CMatrix4x4> SSEMatrices;
+vector<CVector4>   ScalarVectors4;
+vector<CVector4>   SSEVectors4;
+vector<CVector3>   ScalarVectors3;
+vector<CVector3>   SSEVectors3;
+vector<float>      ScalarVertices;
+vector<float>      SSEVertices;
+
+// Results of the inverses are summed here so the compiler can't remove them
+volatile float MathSink;
+
+
+//--------------------------------------------------------------------------------------
+// Helper functions
+//--------------------------------------------------------------------------------------
+
+float RandomFloat()
+{
+	return static_cast<float>(rand()) / RAND_MAX * 2.0f - 1.0f;
+}
+
+// Random affine matrix, with the identity added to the upper 3x3 so that it is well away from singular
+CMatrix4x4 RandomAffineMatrix()
+{
+	return CMatrix4x4( 2.0f + RandomFloat(), RandomFloat(), RandomFloat(), 0.0f,
+	                   RandomFloat(), 2.0f + RandomFloat(), RandomFloat(), 0.0f,
+	                   RandomFloat(), RandomFloat(), 2.0f + RandomFloat(), 0.0f,
+	                   RandomFloat() * 100.0f, RandomFloat() * 100.0f, RandomFloat() * 100.0f, 1.0f );
+}
+
+// Largest difference between elements of two arrays of floats
+float MaxDifference( const float* values1, const float* values2, unsigned int numValues )
+{
+	float maxDiff = 0.0f;
+	for (unsigned int i = 0; i < numValues; ++i)
+	{
+		maxDiff = max( maxDiff, fabs( values1[i] - values2[i] ) );
+	}
+	return maxDiff;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Timed loops, one for each operation. The kernel namespace is chosen by the template
+// parameter, so both versions run exactly the same loop
+//--------------------------------------------------------------------------------------
+
+struct SScalarKernels
+{
+	static void Multiply( CMatrix4x4& mOut, const CMatrix4x4& m1, const CMatrix4x4& m2 )       { scalar::Multiply( mOut, m1, m2 ); }
+	static void MultiplyAffine( CMatrix4x4& mOut, const CMatrix4x4& m1, const CMatrix4x4& m2 ) { scalar::MultiplyAffine( mOut, m1, m2 ); }
+	static void Transform( CVector4& vOut, const CVector4& v, const CMatrix4x4& m )            { scalar::Transform( vOut, v, m ); }
+	static void TransformPoint( CVector3& pOut, const CVector3& p, const CMatrix4x4& m )       { scalar::TransformPoint( pOut, p, m ); }
+	static void TransformVector( CVector3& vOut, const CVector3& v, const CMatrix4x4& m )      { scalar::TransformVector( vOut, v, m ); }
+	static void TransformPoints( const CMatrix4x4& m, const TUInt8* pSource, TUInt32 sourceStride, TUInt8* pDest, TUInt32 destStride,
+	                             TUInt32 numPoints )  { scalar::TransformPoints( m, pSource, sourceStride, pDest, destStride, numPoints ); }
+	static void TransformVectors( const CMatrix4x4& m, const TUInt8* pSource, TUInt32 sourceStride, TUInt8* pDest, TUInt32 destStride,
+	                              TUInt32 numVectors ) { scalar::TransformVectors( m, pSource, sourceStride, pDest, destStride, numVectors ); }
+	static void Transpose( CMatrix4x4& mOut, const CMatrix4x4& m )                             { scalar::Transpose( mOut, m ); }
+	static TFloat32 Inverse( CMatrix4x4& mOut, const CMatrix4x4& m )                           { return scalar::Inverse( mOut, m ); }
+};
+struct SSSEKernels
+{
+	static void Multiply( CMatrix4x4& mOut, const CMatrix4x4& m1, const CMatrix4x4& m2 )       { sse::Multiply( mOut, m1, m2 ); }
+	static void MultiplyAffine( CMatrix4x4& mOut, const CMatrix4x4& m1, const CMatrix4x4& m2 ) { sse::MultiplyAffine( mOut, m1, m2 ); }
+	static void Transform( CVector4& vOut, const CVector4& v, const CMatrix4x4& m )            { sse::Transform( vOut, v, m ); }
+	static void TransformPoint( CVector3& pOut, const CVector3& p, const CMatrix4x4& m )       { sse::TransformPoint( pOut, p, m ); }
+	static void TransformVector( CVector3& vOut, const CVector3& v, const CMatrix4x4& m )      { sse::TransformVector( vOut, v, m ); }
+	static void TransformPoints( const CMatrix4x4& m, const TUInt8* pSource, TUInt32 sourceStride, TUInt8* pDest, TUInt32 destStride,
+	                             TUInt32 numPoints )  { sse::TransformPoints( m, pSource, sourceStride, pDest, destStride, numPoints ); }
+	static void TransformVectors( const CMatrix4x4& m, const TUInt8* pSource, TUInt32 sourceStride, TUInt8* pDest, TUInt32 destStride,
+	                              TUInt32 numVectors ) { sse::TransformVectors( m, pSource, sourceStride, pDest, destStride, numVectors ); }
+	static void Transpose( CMatrix4x4& mOut, const CMatrix4x4& m )                             { sse::Transpose( mOut, m ); }
+	static TFloat32 Inverse( CMatrix4x4& mOut, const CMatrix4x4& m )                           { return sse::Inverse( mOut, m ); }
+};
+
+// The operations that are timed
+enum EMathOperation
+{
+	MathMultiply,
+	MathMultiplyAffine,
+	MathTransform,
+	MathTransformPoint,
+	MathTransformVector,
+	MathTransformPoints,  // Batches of vertex positions with a vertex stride, as the importer transforms sub-meshes
+	MathTransformVectors, // Batches of vertex normals
+	MathTranspose,
+	MathInverse,
+	NumMathOperations
+};
+const char* MathOperationNames[NumMathOperations] =
+{
+	"Multiply", "MultiplyAffine", "Transform", "TransformPoint", "TransformVector", "TransformPoints", "TransformVectors", "Transpose",
+	"Inverse"
+};
+
+// Run one operation over all the elements the given number of times, writing to the given outputs. Returns the time in seconds. The
+// batch transforms process all the vertices in one call, with a different matrix each repeat
+template <class Kernels>
+float TimeOperation( EMathOperation operation, unsigned int numRepeats, vector<CMatrix4x4>& matrices,
+                     vector<CVector4>& vectors4, vector<CVector3>& vectors3, vector<float>& vertices )
+{
+	const TUInt8* pSource = reinterpret_cast<const TUInt8*>(&MathVertices[0]);
+	TUInt8* pDest = reinterpret_cast<TUInt8*>(&vertices[0]);
+	CTimer timer;
+	timer.Reset();
+	float sum = 0.0f;
+	for (unsigned int repeat = 0; repeat < numRepeats; ++repeat)
+	{
+		switch (operation)
+		{
+		case MathMultiply:
+			for (unsigned int i = 0; i < NumMathElements; ++i)
+				Kernels::Multiply( matrices[i], MathMatrices1[i], MathMatrices2[i] );
+			break;
+		case MathMultiplyAffine:
+			for (unsigned int i = 0; i < NumMathElements; ++i)
+				Kernels::MultiplyAffine( matrices[i], MathMatrices1[i], MathMatrices2[i] );
+			break;
+		case MathTransform:
+			for (unsigned int i = 0; i < NumMathElements; ++i)
+				Kernels::Transform( vectors4[i], MathVectors4[i], MathMatrices1[i] );
+			break;
+		case MathTransformPoint:
+			for (unsigned int i = 0; i < NumMathElements; ++i)
+				Kernels::TransformPoint( vectors3[i], MathVectors3[i], MathMatrices1[i] );
+			break;
+		case MathTransformVector:
+			for (unsigned int i = 0; i < NumMathElements; ++i)
+				Kernels::TransformVector( vectors3[i], MathVectors3[i], MathMatrices1[i] );
+			break;
+		case MathTransformPoints:
+			Kernels::TransformPoints( MathMatrices1[repeat % NumMathElements], pSource, MathVertexStride, pDest, MathVertexStride,
+			                          NumMathElements );
+			break;
+		case MathTransformVectors:
+			Kernels::TransformVectors( MathMatrices1[repeat % NumMathElements], pSource + MathNormalOffset, MathVertexStride,
+			                           pDest + MathNormalOffset, MathVertexStride, NumMathElements );
+			break;
+		case MathTranspose:
+			for (unsigned int i = 0; i < NumMathElements; ++i)
+				Kernels::Transpose( matrices[i], MathMatrices1[i] );
+			break;
+		case MathInverse:
+			for (unsigned int i = 0; i < NumMathElements; ++i)
+				sum += Kernels::Inverse( matrices[i], MathMatrices1[i] );
+			break;
+		}
+	}
+	float time = timer.GetTime();
+	MathSink = sum;
+	return time;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Benchmark
+//--------------------------------------------------------------------------------------
+
+// Time each matrix operation with both the scalar and SSE versions, writing the time per operation and the speed-up to the given
+// CSV file. Also checks that both versions give the same results. Returns false if the file could not be written or the results differ
+bool RunMathBenchmark( const wstring& fileName )
+{
+	ofstream file( fileName.c_str() );
+	if (!file)
+	{
+		return false;
+	}
+	file << "Operation,Scalar ns,SSE ns,Speed-up,Max difference\n";
+
+	// Same inputs every run
+	srand( 1 );
+	MathMatrices1.resize( NumMathElements );
+	MathMatrices2.resize( NumMathElements );
+	MathVectors4.resize( NumMathElements );
+	MathVectors3.resize( NumMathElements );
+	MathVertices.resize( NumMathElements * MathVertexFloats );
+	for (unsigned int i = 0; i < NumMathElements * MathVertexFloats; ++i)
+	{
+		MathVertices[i] = RandomFloat();
+	}
+	for (unsigned int i = 0; i < NumMathElements; ++i)
+	{
+		MathMatrices1[i] = RandomAffineMatrix();
+		MathMatrices2[i] = RandomAffineMatrix();
+		MathVectors4[i] = CVector4( RandomFloat(), RandomFloat(), RandomFloat(), 1.0f );
+		MathVectors3[i] = CVector3( RandomFloat(), RandomFloat(), RandomFloat() );
+	}
+	ScalarMatrices.resize( NumMathElements );
+	SSEMatrices.resize( NumMathElements );
+	ScalarVectors4.resize( NumMathElements );
+	SSEVectors4.resize( NumMathElements );
+	ScalarVectors3.resize( NumMathElements );
+	SSEVectors3.resize( NumMathElements );
+	ScalarVertices = MathVertices; // The batch transforms only write part of each vertex, the rest must match too
+	SSEVertices = MathVertices;
+
+	bool resultsMatch = true;
+	for (int operation = 0; operation < NumMathOperations; ++operation)
+	{
+		EMathOperation op = static_cast<EMathOperation>(operation);
+
+		// One untimed pass of each to warm the cache, then the timed runs
+		TimeOperation<SScalarKernels>( op, 1, ScalarMatrices, ScalarVectors4, ScalarVectors3, ScalarVertices );
+		TimeOperation<SSSEKernels>( op, 1, SSEMatrices, SSEVectors4, SSEVectors3, SSEVertices );
+		float scalarTime = TimeOperation<SScalarKernels>( op, NumMathRepeats, ScalarMatrices, ScalarVectors4, ScalarVectors3,
+		                                                  ScalarVertices );
+		float sseTime    = TimeOperation<SSSEKernels>( op, NumMathRepeats, SSEMatrices, SSEVectors4, SSEVectors3, SSEVertices );
+
+		// Compare the outputs of the last run
+		float maxDiff;
+		if (op == MathTransform)
+		{
+			maxDiff = MaxDifference( &ScalarVectors4[0].x, &SSEVectors4[0].x, NumMathElements * 4 );
+		}
+		else if (op == MathTransformPoints || op == MathTransformVectors)
+		{
+			maxDiff = MaxDifference( &ScalarVertices[0], &SSEVertices[0], NumMathElements * MathVertexFloats );
+		}
+		else if (op == MathTransformPoint || op == MathTransformVector)
+		{
+			maxDiff = MaxDifference( &ScalarVectors3[0].x, &SSEVectors3[0].x, NumMathElements * 3 );
+		}
+		else
+		{
+			maxDiff = MaxDifference( &ScalarMatrices[0].e00, &SSEMatrices[0].e00, NumMathElements * 16 );
+		}
+		resultsMatch = resultsMatch && maxDiff <= MathTolerance;
+
+		float numOperations = static_cast<float>(NumMathElements) * NumMathRepeats;
+		float scalarNs = scalarTime * 1e9f / numOperations;
+		float sseNs    = sseTime * 1e9f / numOperations;
+		file << MathOperationNames[operation] << "," << scalarNs << "," << sseNs << "," << (sseNs > 0.0f ? scalarNs / sseNs : 0.0f)
+		     << "," << maxDiff << "\n";
+	}
+
+	return file.good() && resultsMatch;
+}
@@ -0,0 +1,20 @@
+//--------------------------------------------------------------------------------------
+//	MathBenchmark.h
+//
+//	Times the scalar and SSE versions of the maths library's matrix operations (see
+//	MatrixKernels.h) and writes the results to a CSV file. Run with -mathbenchmark
+//--------------------------------------------------------------------------------------
+
+#ifndef MATH_BENCHMARK_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define MATH_BENCHMARK_H_INCLUDED
+
+#include <string>
+using namespace std;
+
+
+// Time each matrix operation with both the scalar and SSE versions, writing the time per operation and the speed-up to the given
+// CSV file. Also checks that both versions give the same results. Returns false if the file could not be written or the results differ
+bool RunMathBenchmark( const wstring& fileName );
+
+
+#endif // End of header guard - see top of file
@@ -0,0 +1,1265 @@
+//--------------------------------------------------------------------------------------
+//	Mesh.cpp
+//
+//	The mesh class holds the GPU geometry loaded from a file (vertex and index buffers and
+//	vertex layout). Meshes are shared between models through the mesh cache, so a file used
+//	by several models is only imported and uploaded once
+//--------------------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <algorithm>
+#include "Defines.h" // General definitions shared by all source files
+#include "Mesh.h"    // Declaration of this class
+#include "ResourceRegistry.h" // Counted in the mesh memory, with a budget
+#include "JobSystem.h" // Meshes can be loaded in parallel on worker threads (see CMeshCache::LoadMeshes)
+
+#include "CImportXFile.h"    // Class to load meshes (taken from a full graphics engine)
+
+///////////////////////////////
+// Constructors / Destructors
+
+// Constructor - creates an empty mesh with a reference count of one
+CMesh::CMesh()
+{
+	m_RefCount = 1;
+
+	m_VertexBuffer = NULL;
+	m_NumVertices = 0;
+	m_VertexSize = 0;
+	m_NumVertexElts = 0;
+	m_VertexLayout = NULL;
+
+	m_IndexBuffer = NULL;
+	m_NumIndices = 0;
+	m_IndexFormat = DXGI_FORMAT_R16_UINT;
+	m_NumSubMeshes = 0;
+	m_NumLods = 1;
+	m_LodErrors[0] = 0.0f;
+
+	m_PendingVertices = NULL;
+	m_PendingIndices = NULL;
+	m_ImportBytes = 0;
+	m_CacheFile = INVALID_HANDLE_VALUE;
+	m_CacheMapping = NULL;
+	m_CacheView = NULL;
+
+	m_BoundingCentre = D3DXVECTOR3( 0, 0, 0 );
+	m_BoundingRadius = 0.0f;
+
+	m_Compressed = false;
+	m_Skinned = false;
+	m_PositionScale = D3DXVECTOR3( 1, 1, 1 );
+	m_PositionOffset = D3DXVECTOR3( 0, 0, 0 );
+}
+
+// Mesh destructor - release the GPU resources
+CMesh::~CMesh()
+{
+	SAFE_RELEASE( m_IndexBuffer );  // Using a DirectX helper macro to simplify code here - look it up in Defines.h
+	SAFE_RELEASE( m_VertexBuffer );
+	SAFE_RELEASE( m_VertexLayout );
+	ReleaseData();
+}
+
+
+// Reference counting. Release deletes the mesh when no longer used and returns the remaining count
+void CMesh::AddRef()
+{
+	++m_RefCount;
+}
+
+unsigned int CMesh::Release()
+{
+	unsigned int refCount = --m_RefCount;
+	if (refCount == 0)
+	{
+		delete this;
+	}
+	return refCount;
+}
+
+
+/////////////////////////////
+// Mesh Loading
+
+// The loading and parsing of ".X" files is supported using a class taken from another application. We will not look at the process (more to do with parsing than graphics). Ultimately
+// we end up with arrays of data exactly as we have previously manually typed in
+
+// Load the mesh geometry from a file. All the sub-meshes in the file (one for each material) are loaded into a single vertex and index
+// buffer, with a draw range for each. May optionally request for tangents to be created for the model (for normal or parallax mapping)
+// We need to pass an example technique that the mesh will use to help DirectX understand how to connect this data with the vertex shaders
+// The example technique may be NULL, in which case no vertex layout is created (see CreateVertexLayout)
+// Compressed vertices are less than half the size, with quantised positions, 8-bit normals and tangents and 16-bit float UVs
+// Returns true if the load was successful
+bool CMesh::Load( const string& fileName, ID3D10EffectTechnique* exampleTechnique, bool tangents /*= false*/, bool compressed /*= false*/ ) // The commented out bit is the default parameter (can't write it here, only in the declaration)
+{
+	return LoadData( fileName, tangents, compressed ) && CreateDeviceObjects( exampleTechnique );
+}
+
+// First part of Load - read the cache file, or import the file and build the buffer data. Uses no device so can run on any thread
+bool CMesh::LoadData( const string& fileName, bool tangents /*= false*/, bool compressed /*= false*/ )
+{
+	// Over the mesh budget, further meshes use compressed vertices whatever was asked for. The lower levels of detail share the full
+	// detail vertices, so leaving them out would save little
+	if (!compressed && g_Resources.IsOverBudget( ResourceMesh ))
+	{
+		compressed = true;
+	}
+
+	// Use the mesh cache file if it is up to date - it holds the finished buffer data, so needs no parsing
+	string cacheFileName = CacheFileName( fileName, tangents, compressed );
+	if (LoadCacheFile( cacheFileName, fileName ))
+	{
+		return true;
+	}
+
+	// Use CImportXFile class (from another application) to load the given file. The import code is wrapped in the namespace 'gen'
+	gen::CImportXFile mesh;
+	if (mesh.ImportFile( fileName.c_str() ) != gen::kSuccess)
+	{
+		return false;
+	}
+
+	// Keep the file's node hierarchy so models can pose the nodes
+	CreateNodes( mesh );
+
+	// Get all the sub-meshes from the loaded file. An unposed mesh is drawn with a single world matrix, so the import class moves each
+	// sub-mesh from its own frame in the file's hierarchy into the space of the root frame. A posed model takes each sub-mesh back to
+	// its node's space with the node's inverse root matrix
+	unsigned int numSubMeshes = mesh.GetNumSubMeshes();
+	if (numSubMeshes == 0)
+	{
+		return false;
+	}
+
+	// The import class writes the vertices of every sub-mesh straight into the vertex buffer data, one sub-mesh after another, so get
+	// the size of each sub-mesh first. All sub-meshes share one vertex buffer, so they must all have the same vertex data. The import
+	// class gives every sub-mesh in a file the same components unless the file is unusual, so just reject those files
+	// Each sub-mesh's render method comes from its material, so the models can choose a technique for each
+	vector<gen::SSubMesh> subMeshes( numSubMeshes );
+	vector<gen::ERenderMethod> renderMethods( numSubMeshes );
+	unsigned int numVertices = 0;
+	unsigned int numFaces = 0;
+	for (unsigned int i = 0; i < numSubMeshes; ++i)
+	{
+		mesh.GetSubMeshSpec( i, &subMeshes[i], tangents );
+		renderMethods[i] = mesh.GetSubMeshRenderMethod( i );
+		if (subMeshes[i].vertexSize       != subMeshes[0].vertexSize ||
+		    subMeshes[i].hasSkinningData  != subMeshes[0].hasSkinningData ||
+		    subMeshes[i].hasNormals       != subMeshes[0].hasNormals ||
+		    subMeshes[i].hasTangents      != subMeshes[0].hasTangents ||
+		    subMeshes[i].hasTextureCoords != subMeshes[0].hasTextureCoords ||
+		    subMeshes[i].hasVertexColours != subMeshes[0].hasVertexColours)
+		{
+			return false;
+		}
+		numVertices += subMeshes[i].numVertices;
+		numFaces += subMeshes[i].numFaces;
+	}
+	if (numVertices == 0 || numFaces == 0)
+	{
+		return false;
+	}
+
+	// The faces still need converting to the index format, so they go in a temporary list
+	unsigned int vertexSize = subMeshes[0].vertexSize;
+	m_ImportVertices.resize( numVertices * vertexSize );
+	vector<gen::SMeshFace> faces( numFaces );
+	unsigned int baseVertex = 0;
+	unsigned int baseFace = 0;
+	bool success = true;
+	for (unsigned int i = 0; i < numSubMeshes && success; ++i)
+	{
+		subMeshes[i].vertices = &m_ImportVertices[0] + baseVertex * vertexSize;
+		subMeshes[i].faces = &faces[0] + baseFace;
+		baseVertex += subMeshes[i].numVertices;
+		baseFace += subMeshes[i].numFaces;
+		success = (mesh.GetSubMeshData( i, &subMeshes[i], true ) == gen::kSuccess);
+		if (success)
+		{
+			// Reorder the faces for the GPU's post-transform vertex cache and the vertices to match. The result is saved in the cache
+			// file, so this is only done when the .X file is imported. The average cache miss ratio (vertices transformed per face)
+			// is reported to the debugger
+			float acmrBefore, acmrAfter;
+			gen::CImportXFile::OptimiseSubMesh( &subMeshes[i], &acmrBefore, &acmrAfter );
+			char text[256];
+			sprintf_s( text, "Mesh %s sub-mesh %u: ACMR %.3f -> %.3f\n", fileName.c_str(), i, acmrBefore, acmrAfter );
+			OutputDebugStringA( text );
+		}
+	}
+	// The importer's data and the faces are at their largest now, and are freed when this function returns
+	size_t importerBytes = mesh.GetMemoryUsed() + faces.size() * sizeof(gen::SMeshFace);
+	g_Resources.AddCPU( ResourceImport, importerBytes );
+	if (success)
+	{
+		success = BuildBuffers( subMeshes, renderMethods, compressed, cacheFileName );
+	}
+	g_Resources.RemoveCPU( ResourceImport, importerBytes );
+	if (!success)
+	{
+		ReleaseData();
+	}
+	return success;
+}
+
+// Second part of Load - create the vertex and index buffers from the data loaded by LoadData, and the vertex layout if an example
+// technique is given. Must be on the render thread
+bool CMesh::CreateDeviceObjects( ID3D10EffectTechnique* exampleTechnique )
+{
+	if (!m_PendingVertices || !m_PendingIndices)
+	{
+		return false;
+	}
+	bool success = CreateGPUBuffers( m_PendingVertices, m_PendingIndices );
+	ReleaseData();
+
+	// Given the vertex element list, pass it to DirectX to create a vertex layout. We also need to pass an example of a technique that will
+	// render this model. We will only be able to render this model with techniques that have the same vertex input as the example we use here
+	// Users that build their own layouts from the element list (e.g. instanced models) pass no technique
+	if (success && exampleTechnique)
+	{
+		CreateVertexLayout( exampleTechnique );
+	}
+	return success;
+}
+
+
+// Copy the node hierarchy from the import class
+void CMesh::CreateNodes( const gen::CImportXFile& mesh )
+{
+	unsigned int numNodes = mesh.GetNumNodes();
+	m_Nodes.resize( numNodes );
+	m_NodeNames.resize( numNodes );
+
+	// The matrix of each node in model space is its default matrix combined with its parent's model space matrix. Parents are
+	// always earlier in the list so their matrix is already known
+	vector<gen::CMatrix4x4> rootMatrices( numNodes );
+	for (unsigned int n = 0; n < numNodes; ++n)
+	{
+		gen::SMeshNode node;
+		mesh.GetNode( n, &node );
+		m_Nodes[n].parent = node.parent;
+		m_Nodes[n].defaultMatrix = *reinterpret_cast<D3DXMATRIX*>(&node.positionMatrix); // Maths library and D3DX matrices have the same layout
+		m_NodeNames[n] = node.name;
+
+		rootMatrices[n] = node.positionMatrix;
+		if (node.parent != n)
+		{
+			rootMatrices[n].MultiplyAffine( rootMatrices[node.parent] );
+		}
+		gen::CMatrix4x4 invRootMatrix = gen::InverseAffine( rootMatrices[n] );
+		m_Nodes[n].invRootMatrix = *reinterpret_cast<D3DXMATRIX*>(&invRootMatrix);
+	}
+}
+
+
+// Build the index data and draw ranges from the sub-meshes imported by LoadData (with the render method of each), ready for
+// CreateDeviceObjects, then write the buffers (and the nodes) to the given mesh cache file. The sub-meshes all have the same vertex
+// data, which LoadData has already written one sub-mesh after another into m_ImportVertices
+bool CMesh::BuildBuffers( const vector<gen::SSubMesh>& subMeshes, const vector<gen::ERenderMethod>& renderMethods, bool compressed,
+                          const string& cacheFileName )
+{
+	const gen::SSubMesh& firstSubMesh = subMeshes[0];
+
+	// Vertex element list for the data the import class loaded
+	unsigned int components = (firstSubMesh.hasNormals       ? VertexNormals  : 0) |
+	                          (firstSubMesh.hasTangents      ? VertexTangents : 0) |
+	                          (firstSubMesh.hasTextureCoords ? VertexUVs      : 0) |
+	                          (firstSubMesh.hasVertexColours ? VertexColours  : 0) |
+	                          (firstSubMesh.hasSkinningData  ? VertexSkinned  : 0);
+	BuildVertexElements( components );
+	if (m_VertexSize != firstSubMesh.vertexSize)
+	{
+		return false; // Vertex data the element list doesn't describe
+	}
+	if (m_Skinned && m_Nodes.size() > MaxSkinNodes)
+	{
+		return false; // Node indices in the vertices are only 8-bit
+	}
+	if (compressed)
+	{
+		components |= VertexCompressed;
+		BuildVertexElements( components );
+	}
+
+
+	// Sub-meshes are placed one after another in the vertex and index buffers. Each sub-mesh's indices stay relative to its own first
+	// vertex (the base vertex is given when drawing), so 16-bit indices can be used unless a single sub-mesh has more than 65535 vertices.
+	// 32-bit indices are only used when needed as they double the size of the index data
+	unsigned int numSubMeshes = static_cast<unsigned int>(subMeshes.size());
+	m_NumSubMeshes = numSubMeshes;
+	m_NumVertices = 0;
+	m_IndexFormat = DXGI_FORMAT_R16_UINT;
+	m_SubMeshes.resize( numSubMeshes );
+	vector<const gen::SMeshFace*> rangeFaces( numSubMeshes ); // Faces for each range, in the same order as the ranges
+	for (unsigned int i = 0; i < numSubMeshes; ++i)
+	{
+		m_SubMeshes[i].numIndices = subMeshes[i].numFaces * 3;
+		m_SubMeshes[i].baseVertex = m_NumVertices;
+		m_SubMeshes[i].material   = subMeshes[i].material;
+		m_SubMeshes[i].node       = subMeshes[i].node;
+		m_SubMeshes[i].renderMethod = renderMethods[i];
+		rangeFaces[i] = subMeshes[i].faces;
+		m_NumVertices += subMeshes[i].numVertices;
+		if (subMeshes[i].numVertices > 0xffff)
+		{
+			m_IndexFormat = DXGI_FORMAT_R32_UINT;
+		}
+	}
+	if (m_NumVertices == 0)
+	{
+		return false;
+	}
+
+	// The lower levels of detail add more ranges, which use the same vertices
+	vector<gen::TMeshFaces> lodFaces;
+	CreateLods( subMeshes, lodFaces );
+	for (unsigned int i = 0; i < lodFaces.size(); ++i)
+	{
+		rangeFaces.push_back( lodFaces[i].empty() ? NULL : &lodFaces[i][0] );
+	}
+
+	// The ranges are placed one after another in the index buffer
+	m_NumIndices = 0;
+	for (unsigned int r = 0; r < m_SubMeshes.size(); ++r)
+	{
+		m_SubMeshes[r].startIndex = m_NumIndices;
+		m_NumIndices += m_SubMeshes[r].numIndices;
+	}
+	if (m_NumIndices == 0)
+	{
+		return false;
+	}
+	unsigned int indexSize = GetIndexSize();
+
+	// The vertex data for all sub-meshes is already in place, in the uncompressed layout. Gather the index data for all ranges
+	vector<unsigned char>& vertices = m_ImportVertices;
+	if (compressed)
+	{
+		vector<unsigned char> compressedVertices;
+		CompressVertices( vertices, components & ~VertexCompressed, compressedVertices );
+		vertices.swap( compressedVertices );
+	}
+	vector<unsigned char>& indices = m_ImportIndices;
+	indices.resize( m_NumIndices * indexSize );
+	for (unsigned int r = 0; r < m_SubMeshes.size(); ++r)
+	{
+		if (m_SubMeshes[r].numIndices == 0) continue;
+
+		const gen::TUInt32* faceIndices = &rangeFaces[r][0].aiVertex[0]; // Faces are just three indices each
+		if (m_IndexFormat == DXGI_FORMAT_R32_UINT)
+		{
+			DWORD* index = reinterpret_cast<DWORD*>(&indices[m_SubMeshes[r].startIndex * indexSize]);
+			for (unsigned int n = 0; n < m_SubMeshes[r].numIndices; ++n)
+			{
+				index[n] = faceIndices[n];
+			}
+		}
+		else
+		{
+			WORD* index = reinterpret_cast<WORD*>(&indices[m_SubMeshes[r].startIndex * indexSize]);
+			for (unsigned int n = 0; n < m_SubMeshes[r].numIndices; ++n)
+			{
+				index[n] = static_cast<WORD>(faceIndices[n]);
+			}
+		}
+	}
+
+	// The buffers are created from this data by CreateDeviceObjects, the bounds are found while the CPU has the positions
+	m_PendingVertices = &vertices[0];
+	m_PendingIndices = &indices[0];
+	m_ImportBytes = vertices.size() + indices.size();
+	g_Resources.AddCPU( ResourceImport, m_ImportBytes );
+	CalculateBounds( m_PendingVertices );
+
+	// Save the finished buffers so the next load can skip the import entirely. Not an error if this fails
+	SaveCacheFile( cacheFileName, components, &vertices[0], &indices[0] );
+
+	return true;
+}
+
+
+// Create the lower levels of detail by simplifying the faces of the imported sub-meshes. Adds a range for each sub-mesh in each new
+// LOD to the sub-mesh list, with the faces for each range added to the given list. Sets the number of LODs and their errors
+// Vertices are merged on a grid, which is coarser for each LOD (see CImportXFile::SimplifyFaces). A grid that doesn't remove at least
+// a quarter of the faces of the previous LOD is skipped, so small meshes like cubes keep a single LOD
+void CMesh::CreateLods( const vector<gen::SSubMesh>& subMeshes, vector<gen::TMeshFaces>& lodFaces )
+{
+	// Number of grid cells across the largest side of the mesh's bounding box for each LOD after the first
+	const float LodGridCells[MaxMeshLods - 1] = { 64.0f, 32.0f, 16.0f };
+
+	m_NumLods = 1;
+	m_LodErrors[0] = 0.0f;
+	lodFaces.clear();
+
+	// All sub-meshes are simplified on the same grid, and each cell's vertices merge into the one chosen from its position alone, so
+	// sub-meshes sharing it still meet after simplification. The grid covers the mesh's bounding box
+	unsigned int numSubMeshes = static_cast<unsigned int>(subMeshes.size());
+	unsigned int numFaces = 0;
+	bool empty = true;
+	D3DXVECTOR3 boxMin, boxMax;
+	for (unsigned int i = 0; i < numSubMeshes; ++i)
+	{
+		numFaces += subMeshes[i].numFaces;
+		for (unsigned int v = 0; v < subMeshes[i].numVertices; ++v)
+		{
+			// Position is the first element of a vertex
+			const D3DXVECTOR3* position = reinterpret_cast<const D3DXVECTOR3*>(subMeshes[i].vertices + v * subMeshes[i].vertexSize);
+			if (empty)
+			{
+				boxMin = boxMax = *position;
+				empty = false;
+			}
+			D3DXVec3Minimize( &boxMin, &boxMin, position );
+			D3DXVec3Maximize( &boxMax, &boxMax, position );
+		}
+	}
+	D3DXVECTOR3 boxSize = boxMax - boxMin;
+	float size = max( boxSize.x, max( boxSize.y, boxSize.z ) );
+	if (empty || size <= 0.0f)
+	{
+		return;
+	}
+
+	for (unsigned int level = 0; level < MaxMeshLods - 1; ++level)
+	{
+		float cellSize = size / LodGridCells[level];
+		vector<gen::TMeshFaces> levelFaces( numSubMeshes );
+		unsigned int numLevelFaces = 0;
+		for (unsigned int i = 0; i < numSubMeshes; ++i)
+		{
+			numLevelFaces += gen::CImportXFile::SimplifyFaces( subMeshes[i], *reinterpret_cast<gen::CVector3*>(&boxMin), cellSize,
+			                                                   &levelFaces[i] );
+		}
+		if (numLevelFaces == 0)
+		{
+			break; // Coarser grids won't leave anything either
+		}
+		if (numLevelFaces > numFaces * 3 / 4)
+		{
+			continue;
+		}
+
+		// Same sub-meshes as the full detail ranges, with the new faces
+		for (unsigned int i = 0; i < numSubMeshes; ++i)
+		{
+			if (!levelFaces[i].empty())
+			{
+				// The simplified faces are in grid order, reorder them for the vertex cache too. The vertex order is shared with the
+				// full detail faces so it stays as it is
+				gen::CImportXFile::OptimiseFaceOrder( &levelFaces[i][0], static_cast<unsigned int>(levelFaces[i].size()),
+				                                      subMeshes[i].numVertices );
+			}
+			SSubMeshRange range = m_SubMeshes[i];
+			range.numIndices = static_cast<unsigned int>(levelFaces[i].size()) * 3;
+			m_SubMeshes.push_back( range );
+			lodFaces.push_back( gen::TMeshFaces() );
+			lodFaces.back().swap( levelFaces[i] );
+		}
+
+		// A merged vertex can have moved anywhere within its cell
+		m_LodErrors[m_NumLods] = cellSize * sqrtf( 3.0f );
+		++m_NumLods;
+		numFaces = numLevelFaces;
+	}
+}
+
+
+// Build the vertex element list for a vertex with the given components (EVertexComponents flags), sets the vertex size
+void CMesh::BuildVertexElements( unsigned int components )
+{
+	// We need a vertex layout to say what data we have per vertex in this model (e.g. position, normal, uv, etc.)
+	// In previous projects the element list was a manually typed in array as we knew what data we would provide. However, as we can load models with
+	// different vertex data this time we need flexible code. The array is built up one element at a time: ask if the mesh has normals, 
+	// if so then add a normal line to the array, then ask if it has UVS...etc
+	// Compressed vertices use smaller formats that the GPU expands to floats as the vertices are read, so the shaders see the same
+	// inputs. Positions are 16-bit 0->1 values across the bounding box (the shaders decode them, see m_PositionScale), normals and
+	// tangents are 8-bit -1->1 values and UVs are 16-bit floats
+	bool compressed = (components & VertexCompressed) != 0;
+	unsigned int numElts = 0;
+	unsigned int offset = 0;
+	// Position is always required
+	m_VertexElts[numElts].SemanticName = "POSITION";   // Semantic in HLSL (what is this data for)
+	m_VertexElts[numElts].SemanticIndex = 0;           // Index to add to semantic (a count for this kind of data, when using multiple of the same type, e.g. TEXCOORD0, TEXCOORD1)
+	m_VertexElts[numElts].Format = compressed ? DXGI_FORMAT_R16G16B16A16_UNORM : DXGI_FORMAT_R32G32B32_FLOAT; // Type of data - this one will be a float3 in the shader. Most data communicated as though it were colours
+	m_VertexElts[numElts].AlignedByteOffset = offset;  // Offset of element from start of vertex data (e.g. if we have position (float3), uv (float2) then normal, the normal's offset is 5 floats = 5*4 = 20)
+	m_VertexElts[numElts].InputSlot = 0;               // For when using multiple vertex buffers (e.g. instancing - an advanced topic)
+	m_VertexElts[numElts].InputSlotClass = D3D10_INPUT_PER_VERTEX_DATA; // Use this value for most cases (only changed for instancing)
+	m_VertexElts[numElts].InstanceDataStepRate = 0;                     // --"--
+	offset += compressed ? 8 : 12;
+	++numElts;
+	// Repeat for each kind of vertex data. Skinning data comes first as that is where the import class puts it: four weights (8-bit
+	// 0->1 values when compressed) and four node indices
+	if (components & VertexSkinned)
+	{
+		m_VertexElts[numElts].SemanticName = "BLENDWEIGHT";
+		m_VertexElts[numElts].SemanticIndex = 0;
+		m_VertexElts[numElts].Format = compressed ? DXGI_FORMAT_R8G8B8A8_UNORM : DXGI_FORMAT_R32G32B32A32_FLOAT;
+		m_VertexElts[numElts].AlignedByteOffset = offset;
+		m_VertexElts[numElts].InputSlot = 0;
+		m_VertexElts[numElts].InputSlotClass = D3D10_INPUT_PER_VERTEX_DATA;
+		m_VertexElts[numElts].InstanceDataStepRate = 0;
+		offset += compressed ? 4 : 16;
+		++numElts;
+
+		m_VertexElts[numElts].SemanticName = "BLENDINDICES";
+		m_VertexElts[numElts].SemanticIndex = 0;
+		m_VertexElts[numElts].Format = DXGI_FORMAT_R8G8B8A8_UINT;
+		m_VertexElts[numElts].AlignedByteOffset = offset;
+		m_VertexElts[numElts].InputSlot = 0;
+		m_VertexElts[numElts].InputSlotClass = D3D10_INPUT_PER_VERTEX_DATA;
+		m_VertexElts[numElts].InstanceDataStepRate = 0;
+		offset += 4;
+		++numElts;
+	}
+	if (components & VertexNormals)
+	{
+		m_VertexElts[numElts].SemanticName = "NORMAL";
+		m_VertexElts[numElts].SemanticIndex = 0;
+		m_VertexElts[numElts].Format = compressed ? DXGI_FORMAT_R8G8B8A8_SNORM : DXGI_FORMAT_R32G32B32_FLOAT;
+		m_VertexElts[numElts].AlignedByteOffset = offset;
+		m_VertexElts[numElts].InputSlot = 0;
+		m_VertexElts[numElts].InputSlotClass = D3D10_INPUT_PER_VERTEX_DATA;
+		m_VertexElts[numElts].InstanceDataStepRate = 0;
+		offset += compressed ? 4 : 12;
+		++numElts;
+	}
+	if (components & VertexTangents)
+	{
+		m_VertexElts[numElts].SemanticName = "TANGENT";
+		m_VertexElts[numElts].SemanticIndex = 0;
+		m_VertexElts[numElts].Format = compressed ? DXGI_FORMAT_R8G8B8A8_SNORM : DXGI_FORMAT_R32G32B32_FLOAT;
+		m_VertexElts[numElts].AlignedByteOffset = offset;
+		m_VertexElts[numElts].InputSlot = 0;
+		m_VertexElts[numElts].InputSlotClass = D3D10_INPUT_PER_VERTEX_DATA;
+		m_VertexElts[numElts].InstanceDataStepRate = 0;
+		offset += compressed ? 4 : 12;
+		++numElts;
+	}
+	if (components & VertexUVs)
+	{
+		m_VertexElts[numElts].SemanticName = "TEXCOORD";
+		m_VertexElts[numElts].SemanticIndex = 0;
+		m_VertexElts[numElts].Format = compressed ? DXGI_FORMAT_R16G16_FLOAT : DXGI_FORMAT_R32G32_FLOAT;
+		m_VertexElts[numElts].AlignedByteOffset = offset;
+		m_VertexElts[numElts].InputSlot = 0;
+		m_VertexElts[numElts].InputSlotClass = D3D10_INPUT_PER_VERTEX_DATA;
+		m_VertexElts[numElts].InstanceDataStepRate = 0;
+		offset += compressed ? 4 : 8;
+		++numElts;
+	}
+	if (components & VertexColours)
+	{
+		m_VertexElts[numElts].SemanticName = "COLOR";
+		m_VertexElts[numElts].SemanticIndex = 0;
+		m_VertexElts[numElts].Format = DXGI_FORMAT_R8G8B8A8_UNORM; // A RGBA colour with 1 byte (0-255) per component
+		m_VertexElts[numElts].AlignedByteOffset = offset;
+		m_VertexElts[numElts].InputSlot = 0;
+		m_VertexElts[numElts].InputSlotClass = D3D10_INPUT_PER_VERTEX_DATA;
+		m_VertexElts[numElts].InstanceDataStepRate = 0;
+		offset += 4;
+		++numElts;
+	}
+	m_VertexSize = offset;
+	m_NumVertexElts = numElts;
+	m_Compressed = compressed;
+	m_Skinned = (components & VertexSkinned) != 0;
+}
+
+
+// Convert a float in the range -1->1 to an 8-bit signed normalised value
+static char PackSNorm8( float value )
+{
+	value = max( -1.0f, min( 1.0f, value ) );
+	return static_cast<char>(floorf( value * 127.0f + 0.5f ));
+}
+
+// Convert uncompressed vertex data (in the layout for the given components without VertexCompressed) to the compressed layout,
+// which must already be built. Sets the position decode from the bounding box of the vertices
+void CMesh::CompressVertices( const vector<unsigned char>& vertices, unsigned int components, vector<unsigned char>& compressedVertices )
+{
+	// Uncompressed vertex layout, in the same order as BuildVertexElements
+	unsigned int vertexSize = static_cast<unsigned int>(vertices.size()) / m_NumVertices;
+	compressedVertices.resize( m_NumVertices * m_VertexSize );
+
+	// Positions are quantised across the bounding box. An axis with no size gets a scale of 1 so there is no divide by zero
+	D3DXVECTOR3 boxMin = *reinterpret_cast<const D3DXVECTOR3*>(&vertices[0]);
+	D3DXVECTOR3 boxMax = boxMin;
+	for (unsigned int v = 1; v < m_NumVertices; ++v)
+	{
+		const D3DXVECTOR3* position = reinterpret_cast<const D3DXVECTOR3*>(&vertices[v * vertexSize]);
+		D3DXVec3Minimize( &boxMin, &boxMin, position );
+		D3DXVec3Maximize( &boxMax, &boxMax, position );
+	}
+	m_PositionOffset = boxMin;
+	m_PositionScale = boxMax - boxMin;
+	if (m_PositionScale.x <= 0.0f) m_PositionScale.x = 1.0f;
+	if (m_PositionScale.y <= 0.0f) m_PositionScale.y = 1.0f;
+	if (m_PositionScale.z <= 0.0f) m_PositionScale.z = 1.0f;
+
+	for (unsigned int v = 0; v < m_NumVertices; ++v)
+	{
+		const float* source = reinterpret_cast<const float*>(&vertices[v * vertexSize]);
+		unsigned char* dest = &compressedVertices[v * m_VertexSize];
+
+		// Position (the unused fourth value is 1)
+		unsigned short* position = reinterpret_cast<unsigned short*>(dest);
+		for (int i = 0; i < 3; ++i)
+		{
+			float value = (source[i] - m_PositionOffset[i]) / m_PositionScale[i];
+			position[i] = static_cast<unsigned short>(floorf( max( 0.0f, min( 1.0f, value ) ) * 65535.0f + 0.5f ));
+		}
+		position[3] = 0xffff;
+		source += 3;
+		dest += 8;
+
+		// Skin weights to 8-bit, with the largest (always the first) taking up the rounding so they still add up to 1. The indices
+		// are already 8-bit
+		if (components & VertexSkinned)
+		{
+			unsigned char* weights = dest;
+			int total = 0;
+			for (int i = 1; i < 4; ++i)
+			{
+				weights[i] = static_cast<unsigned char>(floorf( max( 0.0f, min( 1.0f, source[i] ) ) * 255.0f + 0.5f ));
+				total += weights[i];
+			}
+			weights[0] = static_cast<unsigned char>(max( 0, 255 - total ));
+			memcpy( dest + 4, source + 4, 4 );
+			source += 5;
+			dest += 8;
+		}
+
+		// Normal and tangent, the unused fourth value is 0. Normalised again as the lighting expects unit length
+		for (unsigned int component = VertexNormals; component <= VertexTangents; component <<= 1)
+		{
+			if (!(components & component)) continue;
+			D3DXVECTOR3 vector;
+			D3DXVec3Normalize( &vector, reinterpret_cast<const D3DXVECTOR3*>(source) );
+			char* packed = reinterpret_cast<char*>(dest);
+			packed[0] = PackSNorm8( vector.x );
+			packed[1] = PackSNorm8( vector.y );
+			packed[2] = PackSNorm8( vector.z );
+			packed[3] = 0;
+			source += 3;
+			dest += 4;
+		}
+
+		// UVs as half floats
+		if (components & VertexUVs)
+		{
+			D3DXFloat32To16Array( reinterpret_cast<D3DXFLOAT16*>(dest), source, 2 );
+			source += 2;
+			dest += 4;
+		}
+
+		// Colours are already 8-bit
+		if (components & VertexColours)
+		{
+			memcpy( dest, source, 4 );
+		}
+	}
+}
+
+// Get the model space position of a vertex in the given vertex data, decoding it if compressed
+D3DXVECTOR3 CMesh::GetVertexPosition( const void* vertices, unsigned int vertex )
+{
+	// Position is always the first element in the vertex (see BuildVertexElements)
+	const unsigned char* vertexData = static_cast<const unsigned char*>(vertices) + vertex * m_VertexSize;
+	if (!m_Compressed)
+	{
+		return *reinterpret_cast<const D3DXVECTOR3*>(vertexData);
+	}
+	const unsigned short* position = reinterpret_cast<const unsigned short*>(vertexData);
+	return D3DXVECTOR3( position[0] * m_PositionScale.x / 65535.0f + m_PositionOffset.x,
+	                    position[1] * m_PositionScale.y / 65535.0f + m_PositionOffset.y,
+	                    position[2] * m_PositionScale.z / 65535.0f + m_PositionOffset.z );
+}
+
+
+// Create the vertex and index buffers from the given data, which must match the vertex size, counts and index format already set
+bool CMesh::CreateGPUBuffers( const void* vertices, const void* indices )
+{
+	// Create the vertex buffer and fill it with the loaded vertex data
+	D3D10_BUFFER_DESC bufferDesc;
+	bufferDesc.BindFlags = D3D10_BIND_VERTEX_BUFFER;
+	bufferDesc.Usage = D3D10_USAGE_DEFAULT; // Not a dynamic buffer
+	bufferDesc.ByteWidth = m_NumVertices * m_VertexSize; // Buffer size
+	bufferDesc.CPUAccessFlags = 0;   // Indicates that CPU won't access this buffer at all after creation
+	bufferDesc.MiscFlags = 0;
+	D3D10_SUBRESOURCE_DATA initData; // Initial data
+	initData.pSysMem = vertices;
+	if (FAILED( g_Resources.CreateBuffer( ResourceMesh, &bufferDesc, &initData, &m_VertexBuffer )))
+	{
+		return false;
+	}
+
+
+	// Create the index buffer - 2 or 4 byte indices
+	bufferDesc.BindFlags = D3D10_BIND_INDEX_BUFFER;
+	bufferDesc.Usage = D3D10_USAGE_DEFAULT;
+	bufferDesc.ByteWidth = m_NumIndices * GetIndexSize();
+	bufferDesc.CPUAccessFlags = 0;
+	bufferDesc.MiscFlags = 0;
+	initData.pSysMem = indices;
+	if (FAILED( g_Resources.CreateBuffer( ResourceMesh, &bufferDesc, &initData, &m_IndexBuffer )))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+
+// Calculate the bounding sphere from the given vertex data, which must match the vertex size and count already set
+// The sphere is centred on the middle of the bounding box, which is simple and usually close to the smallest sphere
+void CMesh::CalculateBounds( const void* vertices )
+{
+	m_BoundingCentre = D3DXVECTOR3( 0, 0, 0 );
+	m_BoundingRadius = 0.0f;
+	if (m_NumVertices == 0)
+	{
+		return;
+	}
+
+	D3DXVECTOR3 boxMin = GetVertexPosition( vertices, 0 );
+	D3DXVECTOR3 boxMax = boxMin;
+	for (unsigned int v = 1; v < m_NumVertices; ++v)
+	{
+		D3DXVECTOR3 position = GetVertexPosition( vertices, v );
+		D3DXVec3Minimize( &boxMin, &boxMin, &position );
+		D3DXVec3Maximize( &boxMax, &boxMax, &position );
+	}
+	m_BoundingCentre = 0.5f * (boxMin + boxMax);
+
+	// Radius is the distance to the furthest vertex from the centre
+	float radiusSquared = 0.0f;
+	for (unsigned int v = 0; v < m_NumVertices; ++v)
+	{
+		D3DXVECTOR3 offset = GetVertexPosition( vertices, v ) - m_BoundingCentre;
+		radiusSquared = max( radiusSquared, D3DXVec3LengthSq( &offset ) );
+	}
+	m_BoundingRadius = sqrtf( radiusSquared );
+}
+
+
+// Free the buffer data held for CreateDeviceObjects, unmapping the cache file if it was used
+void CMesh::ReleaseData()
+{
+	m_PendingVertices = NULL;
+	m_PendingIndices = NULL;
+	vector<unsigned char>().swap( m_ImportVertices );
+	vector<unsigned char>().swap( m_ImportIndices );
+	if (m_ImportBytes > 0)
+	{
+		g_Resources.RemoveCPU( ResourceImport, m_ImportBytes );
+		m_ImportBytes = 0;
+	}
+
+	if (m_CacheView)    UnmapViewOfFile( m_CacheView );
+	if (m_CacheMapping) CloseHandle( m_CacheMapping );
+	if (m_CacheFile != INVALID_HANDLE_VALUE) CloseHandle( m_CacheFile );
+	m_CacheView = NULL;
+	m_CacheMapping = NULL;
+	m_CacheFile = INVALID_HANDLE_VALUE;
+}
+
+
+//-----------------------------------------------------------------------------
+// Mesh cache files
+//-----------------------------------------------------------------------------
+
+// Importing a .X file is slow (the file is parsed, vertices de-duplicated and split by material). So the finished buffer data is saved
+// in a binary cache file next to the .X file, and later loads map that file into memory and pass it straight to DirectX. The file is:
+//   SMeshFileHeader
+//   SSubMeshRange[numSubMeshes * numLods]
+//   SMeshNodeInfo[numNodes]
+//   Vertex data (numVertices * vertexSize bytes)
+//   Index data  (numIndices * indexSize bytes)
+//   Node names  (nodeNamesSize bytes, each name followed by a zero)
+// The cache is rebuilt when the .X file is newer, or when the version below changes
+
+const char         MeshFileID[4] = { 'S', 'M', 'S', 'H' };
+const unsigned int MeshFileVersion = 7;
+
+struct SMeshFileHeader
+{
+	char         id[4];
+	unsigned int version;
+	unsigned int components;   // EVertexComponents flags, used to rebuild the vertex element list
+	unsigned int vertexSize;
+	unsigned int numVertices;
+	unsigned int indexSize;    // 2 or 4 bytes
+	unsigned int numIndices;
+	unsigned int numSubMeshes; // In each level of detail
+	unsigned int numLods;
+	float        lodErrors[MaxMeshLods];
+	unsigned int numNodes;
+	unsigned int nodeNamesSize;
+	D3DXVECTOR3  positionScale;  // Position decode for compressed vertices (see CMesh::m_PositionScale)
+	D3DXVECTOR3  positionOffset;
+};
+
+// Name of the cache file for a mesh file - the tangent and compression flags give different vertex data so need their own files
+string CMesh::CacheFileName( const string& fileName, bool tangents, bool compressed )
+{
+	return fileName + (tangents ? ".tangents" : "") + (compressed ? ".compressed" : "") + ".mesh";
+}
+
+
+// Load the mesh from a cache file if it exists and is newer than the source file (if the source file is missing the cache is still used).
+// The file is memory-mapped and stays mapped until CreateDeviceObjects passes it directly to DirectX. Returns false if the cache can't be used
+bool CMesh::LoadCacheFile( const string& cacheFileName, const string& sourceFileName )
+{
+	// Compare modification times
+	WIN32_FILE_ATTRIBUTE_DATA cacheAttributes, sourceAttributes;
+	if (!GetFileAttributesExA( cacheFileName.c_str(), GetFileExInfoStandard, &cacheAttributes ))
+	{
+		return false;
+	}
+	if (GetFileAttributesExA( sourceFileName.c_str(), GetFileExInfoStandard, &sourceAttributes ) &&
+	    CompareFileTime( &cacheAttributes.ftLastWriteTime, &sourceAttributes.ftLastWriteTime ) < 0)
+	{
+		return false;
+	}
+
+	// Map the file into memory
+	HANDLE file = CreateFileA( cacheFileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	DWORD fileSizeHigh = 0;
+	DWORD fileSizeLow = GetFileSize( file, &fileSizeHigh );
+	UINT64 fileSize = (static_cast<UINT64>(fileSizeHigh) << 32) | fileSizeLow;
+	HANDLE mapping = CreateFileMapping( file, NULL, PAGE_READONLY, 0, 0, NULL );
+	const unsigned char* data = NULL;
+	if (mapping)
+	{
+		data = static_cast<const unsigned char*>(MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ));
+	}
+
+	// Check the header and that the file is as big as the header says, then create the buffers directly from the mapped data
+	bool success = false;
+	const SMeshFileHeader* header = reinterpret_cast<const SMeshFileHeader*>(data);
+	if (data && fileSize >= sizeof(SMeshFileHeader) &&
+	    memcmp( header->id, MeshFileID, sizeof(MeshFileID) ) == 0 && header->version == MeshFileVersion &&
+	    (header->indexSize == 2 || header->indexSize == 4) &&
+	    header->numVertices > 0 && header->numIndices > 0 && header->numSubMeshes > 0 && header->numNodes > 0 &&
+	    header->numLods > 0 && header->numLods <= MaxMeshLods)
+	{
+		// Sizes are worked out in 64 bits so a corrupt header can't overflow them into a size that matches the file
+		UINT64 numRanges = static_cast<UINT64>(header->numSubMeshes) * header->numLods;
+		UINT64 expectedSize = sizeof(SMeshFileHeader) + numRanges * sizeof(SSubMeshRange) +
+		                      static_cast<UINT64>(header->numNodes) * sizeof(SMeshNodeInfo) +
+		                      static_cast<UINT64>(header->numVertices) * header->vertexSize +
+		                      static_cast<UINT64>(header->numIndices) * header->indexSize + header->nodeNamesSize;
+		BuildVertexElements( header->components );
+		if (fileSize == expectedSize && m_VertexSize == header->vertexSize)
+		{
+			m_PositionScale = header->positionScale;
+			m_PositionOffset = header->positionOffset;
+			const SSubMeshRange* ranges = reinterpret_cast<const SSubMeshRange*>(header + 1);
+			const SMeshNodeInfo* nodes = reinterpret_cast<const SMeshNodeInfo*>(ranges + numRanges);
+			const unsigned char* vertices = reinterpret_cast<const unsigned char*>(nodes + header->numNodes);
+			const unsigned char* indices = vertices + header->numVertices * header->vertexSize;
+			const char* names = reinterpret_cast<const char*>(indices + header->numIndices * header->indexSize);
+			const char* namesEnd = names + header->nodeNamesSize;
+
+			m_SubMeshes.assign( ranges, ranges + static_cast<size_t>(numRanges) );
+			m_NumSubMeshes = header->numSubMeshes;
+			m_NumLods = header->numLods;
+			memcpy( m_LodErrors, header->lodErrors, sizeof(m_LodErrors) );
+			m_Nodes.assign( nodes, nodes + header->numNodes );
+			m_NodeNames.clear();
+			while (names < namesEnd && m_NodeNames.size() < header->numNodes)
+			{
+				const char* nameEnd = static_cast<const char*>(memchr( names, 0, namesEnd - names ));
+				if (!nameEnd) break;
+				m_NodeNames.push_back( string( names, nameEnd ) );
+				names = nameEnd + 1;
+			}
+			m_NumVertices = header->numVertices;
+			m_NumIndices  = header->numIndices;
+			m_IndexFormat = (header->indexSize == 4) ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
+			// Parents must come before their children (see SMeshNodeInfo) and every sub-mesh needs a node
+			bool valid = (names == namesEnd && m_NodeNames.size() == header->numNodes);
+			for (unsigned int n = 0; n < header->numNodes && valid; ++n)
+			{
+				valid = (nodes[n].parent <= n);
+			}
+			// Each sub-mesh's indices and first vertex must be inside the buffers
+			for (unsigned int i = 0; i < numRanges && valid; ++i)
+			{
+				valid = (ranges[i].node < header->numNodes) && ranges[i].baseVertex < header->numVertices &&
+				        static_cast<UINT64>(ranges[i].startIndex) + ranges[i].numIndices <= header->numIndices;
+			}
+			success = valid;
+			if (success)
+			{
+				m_PendingVertices = vertices;
+				m_PendingIndices = indices;
+				CalculateBounds( vertices );
+			}
+		}
+	}
+
+	// Keep the mapping for CreateDeviceObjects
+	if (success)
+	{
+		m_CacheFile = file;
+		m_CacheMapping = mapping;
+		m_CacheView = data;
+		m_ImportBytes = static_cast<size_t>(fileSize);
+		g_Resources.AddCPU( ResourceImport, m_ImportBytes );
+		return true;
+	}
+
+	if (data)    UnmapViewOfFile( data );
+	if (mapping) CloseHandle( mapping );
+	CloseHandle( file );
+
+	// Leave the mesh clean for a normal import
+	m_PendingVertices = NULL;
+	m_PendingIndices = NULL;
+	m_SubMeshes.clear();
+	m_NumSubMeshes = 0;
+	m_NumLods = 1;
+	m_Nodes.clear();
+	m_NodeNames.clear();
+	m_PositionScale = D3DXVECTOR3( 1, 1, 1 );
+	m_PositionOffset = D3DXVECTOR3( 0, 0, 0 );
+	return false;
+}
+
+
+// Write the mesh's buffer data to a cache file. Returns true on success
+bool CMesh::SaveCacheFile( const string& cacheFileName, unsigned int components, const void* vertices, const void* indices )
+{
+	SMeshFileHeader header;
+	memcpy( header.id, MeshFileID, sizeof(MeshFileID) );
+	header.version      = MeshFileVersion;
+	header.components   = components;
+	header.vertexSize   = m_VertexSize;
+	header.numVertices  = m_NumVertices;
+	header.indexSize    = GetIndexSize();
+	header.numIndices   = m_NumIndices;
+	header.numSubMeshes = m_NumSubMeshes;
+	header.numLods      = m_NumLods;
+	memcpy( header.lodErrors, m_LodErrors, sizeof(header.lodErrors) );
+	header.numNodes     = static_cast<unsigned int>(m_Nodes.size());
+	header.positionScale  = m_PositionScale;
+	header.positionOffset = m_PositionOffset;
+
+	// Node names are written one after another, each with its terminating zero
+	string names;
+	for (unsigned int n = 0; n < m_NodeNames.size(); ++n)
+	{
+		names.append( m_NodeNames[n].c_str(), m_NodeNames[n].length() + 1 );
+	}
+	header.nodeNamesSize = static_cast<unsigned int>(names.length());
+
+	// Write to a temporary name then rename, so a partially written file is never picked up
+	string tempFileName = cacheFileName + ".tmp";
+	HANDLE file = CreateFileA( tempFileName.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	DWORD written;
+	bool success = WriteFile( file, &header, sizeof(header), &written, NULL ) &&
+	               WriteFile( file, &m_SubMeshes[0], static_cast<DWORD>(m_SubMeshes.size() * sizeof(SSubMeshRange)), &written, NULL ) &&
+	               WriteFile( file, &m_Nodes[0], header.numNodes * sizeof(SMeshNodeInfo), &written, NULL ) &&
+	               WriteFile( file, vertices, m_NumVertices * m_VertexSize, &written, NULL ) &&
+	               WriteFile( file, indices, m_NumIndices * header.indexSize, &written, NULL ) &&
+	               WriteFile( file, names.data(), header.nodeNamesSize, &written, NULL );
+	CloseHandle( file );
+
+	if (!success || !MoveFileExA( tempFileName.c_str(), cacheFileName.c_str(), MOVEFILE_REPLACE_EXISTING ))
+	{
+		DeleteFileA( tempFileName.c_str() );
+		return false;
+	}
+	return true;
+}
+
+
+// Create the vertex layout for the mesh from its element list, if not already created - see comment in CreateBuffers. Returns true on success
+bool CMesh::CreateVertexLayout( ID3D10EffectTechnique* exampleTechnique )
+{
+	if (m_VertexLayout) return true;
+
+	D3D10_PASS_DESC PassDesc;
+	exampleTechnique->GetPassByIndex( 0 )->GetDesc( &PassDesc );
+	return SUCCEEDED( g_pd3dDevice->CreateInputLayout( m_VertexElts, m_NumVertexElts, PassDesc.pIAInputSignature,
+	                                                   PassDesc.IAInputSignatureSize, &m_VertexLayout ) );
+}
+
+
+// Load the mesh again from its file (e.g. after it was edited), replacing the geometry in place so the models using it see the
+// change. The vertex layout is kept, so the new geometry must have the same vertex elements, and the same number of nodes. The node
+// hierarchy and matrices are replaced, so the models using the mesh must take a new copy of them (see CScene::SetNodes). Returns
+// false, leaving the mesh unchanged, if the file fails to load or doesn't match. Must be on the render thread, which waits for the import
+bool CMesh::Reload( const string& fileName, bool tangents /*= false*/ )
+{
+	// Load into a separate mesh first, so a bad file leaves this one as it was
+	CMesh* newMesh = new CMesh;
+	bool compatible = newMesh->LoadData( fileName, tangents, m_Compressed ) && newMesh->CreateDeviceObjects( NULL ) &&
+	                  newMesh->m_VertexSize == m_VertexSize && newMesh->m_NumVertexElts == m_NumVertexElts &&
+	                  newMesh->m_Nodes.size() == m_Nodes.size();
+	for (unsigned int elt = 0; compatible && elt < m_NumVertexElts; ++elt)
+	{
+		compatible = newMesh->m_VertexElts[elt].Format == m_VertexElts[elt].Format &&
+		             newMesh->m_VertexElts[elt].AlignedByteOffset == m_VertexElts[elt].AlignedByteOffset;
+	}
+
+	// Swap the geometry over, the old geometry is released with the new mesh object
+	if (compatible)
+	{
+		swap( m_VertexBuffer, newMesh->m_VertexBuffer );
+		swap( m_NumVertices,  newMesh->m_NumVertices );
+		swap( m_IndexBuffer,  newMesh->m_IndexBuffer );
+		swap( m_NumIndices,   newMesh->m_NumIndices );
+		swap( m_IndexFormat,  newMesh->m_IndexFormat );
+		swap( m_SubMeshes,    newMesh->m_SubMeshes );
+		swap( m_NumSubMeshes, newMesh->m_NumSubMeshes );
+		swap( m_NumLods,      newMesh->m_NumLods );
+		for (unsigned int lod = 0; lod < MaxMeshLods; ++lod)
+		{
+			m_LodErrors[lod] = newMesh->m_LodErrors[lod];
+		}
+		swap( m_Nodes,          newMesh->m_Nodes );
+		swap( m_NodeNames,      newMesh->m_NodeNames );
+		swap( m_BoundingCentre, newMesh->m_BoundingCentre );
+		swap( m_BoundingRadius, newMesh->m_BoundingRadius );
+		swap( m_PositionScale,  newMesh->m_PositionScale );
+		swap( m_PositionOffset, newMesh->m_PositionOffset );
+	}
+	newMesh->Release();
+	return compatible;
+}
+
+
+/////////////////////////////
+// Data access
+
+// Find a node by name, returns false if there is no node with that name
+bool CMesh::FindNode( const string& name, unsigned int& node )
+{
+	for (unsigned int n = 0; n < m_NodeNames.size(); ++n)
+	{
+		if (m_NodeNames[n] == name)
+		{
+			node = n;
+			return true;
+		}
+	}
+	return false;
+}
+
+
+/////////////////////////////
+// Mesh Usage
+
+// Select this mesh's vertex and index buffer and vertex layout - assuming all data will be as triangle lists
+void CMesh::SetGeometry()
+{
+	UINT offset = 0;
+	g_pd3dDevice->IASetVertexBuffers( 0, 1, &m_VertexBuffer, &m_VertexSize, &offset );
+	g_pd3dDevice->IASetInputLayout( m_VertexLayout );
+	g_pd3dDevice->IASetIndexBuffer( m_IndexBuffer, m_IndexFormat, 0 );
+	g_pd3dDevice->IASetPrimitiveTopology( D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
+}
+
+// Draw the mesh geometry at the given level of detail, assumes the geometry and technique have already been selected. May draw
+// several instances. Each sub-mesh is drawn as a separate range of the shared buffers
+void CMesh::Draw( unsigned int numInstances /*= 1*/, unsigned int lod /*= 0*/ )
+{
+	for (unsigned int i = 0; i < m_NumSubMeshes; ++i)
+	{
+		DrawSubMesh( i, numInstances, lod );
+	}
+}
+
+// Draw a single sub-mesh, assumes the geometry and technique have already been selected. May draw several instances
+void CMesh::DrawSubMesh( unsigned int subMesh, unsigned int numInstances /*= 1*/, unsigned int lod /*= 0*/ )
+{
+	const SSubMeshRange& range = GetSubMesh( subMesh, lod );
+	if (range.numIndices == 0)
+	{
+		return; // Sub-meshes can vanish entirely in the lower levels of detail
+	}
+	if (numInstances == 1)
+	{
+		g_pd3dDevice->DrawIndexed( range.numIndices, range.startIndex, range.baseVertex );
+	}
+	else
+	{
+		g_pd3dDevice->DrawIndexedInstanced( range.numIndices, numInstances, range.startIndex, range.baseVertex, 0 );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Mesh Cache
+//-----------------------------------------------------------------------------
+
+CMeshCache::TMeshMap CMeshCache::m_Meshes;
+
+// Get a mesh from the cache, loading it if necessary. The example technique is used to create the mesh's vertex layout if it
+// doesn't have one yet (see CMesh::Load), may be NULL. Returns NULL if the mesh could not be loaded
+CMesh* CMeshCache::GetMesh( const string& fileName, ID3D10EffectTechnique* exampleTechnique, bool tangents /*= false*/,
+                            bool compressed /*= false*/ )
+{
+	string key = MakeKey( fileName, tangents, compressed );
+
+	// Already loaded - share it
+	TMeshMap::iterator found = m_Meshes.find( key );
+	if (found != m_Meshes.end())
+	{
+		// The mesh may have been loaded without a layout (no example technique), create it now if this user needs one
+		if (exampleTechnique)
+		{
+			found->second->CreateVertexLayout( exampleTechnique );
+		}
+		found->second->AddRef();
+		return found->second;
+	}
+
+	// Otherwise load it and add it to the cache
+	CMesh* mesh = new CMesh;
+	if (!mesh->Load( fileName, exampleTechnique, tangents, compressed ))
+	{
+		mesh->Release();
+		return NULL;
+	}
+	m_Meshes[key] = mesh;
+	return mesh;
+}
+
+// A mesh being loaded by a job in LoadMeshes
+struct SMeshLoadJob
+{
+	CMesh*       mesh;
+	SMeshRequest request;
+	bool         success;
+
+	SMeshLoadJob( CMesh* mesh, const SMeshRequest& request ) : mesh( mesh ), request( request ), success( false ) {}
+};
+
+// Job function for LoadMeshes, runs on a worker thread
+static void LoadMeshJob( void* data )
+{
+	SMeshLoadJob* job = static_cast<SMeshLoadJob*>(data);
+	job->success = job->mesh->LoadData( job->request.fileName, job->request.tangents, job->request.compressed );
+}
+
+// Get several meshes at once. The files are read and imported in parallel as jobs on the job system, then the device objects are
+// created on this thread. Meshes already in the cache are shared as in GetMesh. The mesh for each request (NULL if it failed to load)
+// is returned holding a reference, release them once their users have their own. No vertex layouts are created, GetMesh creates
+// them for the users that give an example technique
+void CMeshCache::LoadMeshes( const vector<SMeshRequest>& requests, CJobSystem* jobSystem, vector<CMesh*>& meshes )
+{
+	// One job for each mesh not already in the cache, requests for the same mesh share the job. The cache itself is only changed on
+	// this thread. The job list is reserved so the jobs don't move while the workers are using them
+	vector<SMeshLoadJob> jobs;
+	jobs.reserve( requests.size() );
+	map<string, unsigned int> jobForKey;
+	for (unsigned int r = 0; r < requests.size(); ++r)
+	{
+		string key = MakeKey( requests[r].fileName, requests[r].tangents, requests[r].compressed );
+		if (m_Meshes.find( key ) == m_Meshes.end() && jobForKey.find( key ) == jobForKey.end())
+		{
+			jobForKey[key] = static_cast<unsigned int>(jobs.size());
+			jobs.push_back( SMeshLoadJob( new CMesh, requests[r] ) );
+		}
+	}
+
+	SJobCounter counter;
+	for (unsigned int j = 0; j < jobs.size(); ++j)
+	{
+		jobSystem->Add( LoadMeshJob, &jobs[j], &counter );
+	}
+	jobSystem->Wait( counter );
+
+	// Device objects must be created on the render thread. The loaded meshes join the cache holding the reference they were created
+	// with, which is dropped once the requests have taken theirs
+	for (unsigned int j = 0; j < jobs.size(); ++j)
+	{
+		SMeshLoadJob& job = jobs[j];
+		if (job.success && job.mesh->CreateDeviceObjects( NULL ))
+		{
+			m_Meshes[MakeKey( job.request.fileName, job.request.tangents, job.request.compressed )] = job.mesh;
+		}
+		else
+		{
+			job.mesh->Release();
+			job.mesh = NULL;
+		}
+	}
+
+	meshes.resize( requests.size() );
+	for (unsigned int r = 0; r < requests.size(); ++r)
+	{
+		TMeshMap::iterator found = m_Meshes.find( MakeKey( requests[r].fileName, requests[r].tangents, requests[r].compressed ) );
+		meshes[r] = (found != m_Meshes.end()) ? found->second : NULL;
+		if (meshes[r])
+		{
+			meshes[r]->AddRef();
+		}
+	}
+	for (unsigned int j = 0; j < jobs.size(); ++j)
+	{
+		if (jobs[j].mesh)
+		{
+			jobs[j].mesh->Release();
+		}
+	}
+}
+
+// Release a mesh obtained from GetMesh or LoadMeshes. The mesh is deleted and removed from the cache when no models use it
+void CMeshCache::ReleaseMesh( CMesh* mesh )
+{
+	if (!mesh) return;
+
+	// Find the cache entry first, the mesh may be deleted by the release
+	TMeshMap::iterator entry = m_Meshes.begin();
+	while (entry != m_Meshes.end() && entry->second != mesh)
+	{
+		++entry;
+	}
+
+	if (mesh->Release() == 0 && entry != m_Meshes.end())
+	{
+		m_Meshes.erase( entry );
+	}
+}
+
+// Reload every loaded mesh from the given file (with any flags) after the file has changed, see CMesh::Reload. The file name is
+// not case sensitive. The meshes reloaded are added to the given list, if any. Returns the number of meshes reloaded
+unsigned int CMeshCache::ReloadMeshes( const string& fileName, vector<CMesh*>* reloaded /*= NULL*/ )
+{
+	unsigned int numReloaded = 0;
+	for (TMeshMap::iterator entry = m_Meshes.begin(); entry != m_Meshes.end(); ++entry)
+	{
+		// The key is the file name followed by '|' and the flags (see MakeKey). The mesh knows whether it is compressed itself
+		const string& key = entry->first;
+		size_t length = fileName.length();
+		if (key.length() > length + 1 && key[length] == '|' && _strnicmp( key.c_str(), fileName.c_str(), length ) == 0)
+		{
+			bool tangents = (key[length + 1] == 'T');
+			if (entry->second->Reload( key.substr( 0, length ), tangents ))
+			{
+				if (reloaded) reloaded->push_back( entry->second );
+				++numReloaded;
+			}
+		}
+	}
+	return numReloaded;
+}
+
+// Cache key is the file name with a suffix for the tangent and compression flags (each gives a different vertex layout)
+string CMeshCache::MakeKey( const string& fileName, bool tangents, bool compressed )
+{
+	return fileName + (tangents ? "|T" : "|N") + (compressed ? "C" : "");
+}
@@ -0,0 +1,400 @@
+//--------------------------------------------------------------------------------------
+//	Mesh.h
+//
+//	The mesh class holds the GPU geometry loaded from a file (vertex and index buffers and
+//	vertex layout). Meshes are shared between models through the mesh cache, so a file used
+//	by several models is only imported and uploaded once
+//--------------------------------------------------------------------------------------
+
+#ifndef MESH_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define MESH_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <map>
+using namespace std;
+
+#include <d3d10.h>
+#include <d3dx10.h>
+#include "MeshData.h"
+
+namespace gen
+{
+	class CImportXFile;
+}
+class CJobSystem;
+
+
+// Most levels of detail a mesh can have, including the full detail mesh
+const unsigned int MaxMeshLods = 4;
+
+// Most nodes a skinned mesh can have. Each vertex refers to the nodes that move it by 8-bit index (see CMesh::IsSkinned)
+const unsigned int MaxSkinNodes = 256;
+
+// A range of the mesh's vertex and index buffers holding one sub-mesh (the geometry using a single material) at one level of detail
+struct SSubMeshRange
+{
+	unsigned int startIndex;   // First index of the sub-mesh in the index buffer
+	unsigned int numIndices;
+	unsigned int baseVertex;   // First vertex of the sub-mesh in the vertex buffer, the sub-mesh indices are relative to this
+	unsigned int material;     // Material number in the file the mesh was loaded from
+	unsigned int node;         // Node in the mesh hierarchy that controls the sub-mesh
+	unsigned int renderMethod; // gen::ERenderMethod of the material, selects the technique the sub-mesh is drawn with
+};
+
+// A node in the mesh's hierarchy (a frame in a .X file). The nodes are flattened depth-first, so a node's parent is always earlier in
+// the list. Node 0 is the root and is its own parent
+struct SMeshNodeInfo
+{
+	unsigned int parent;
+	D3DXMATRIX   defaultMatrix; // Matrix of the node in its parent's space when the mesh is not posed
+	D3DXMATRIX   invRootMatrix; // Inverse of the node's default matrix in model space. The vertices are stored in model space (see
+	                            // CMesh::Load), this takes them back into the node's own space so the node can move them
+};
+
+
+class CMesh
+{
+/////////////////////////////
+// Private member variables
+private:
+
+	// Number of models using this mesh - it is deleted when this reaches zero
+	unsigned int             m_RefCount;
+
+	// Vertex data for the mesh stored in a vertex buffer and the number of the vertices in the buffer
+	ID3D10Buffer*            m_VertexBuffer;
+	unsigned int             m_NumVertices;
+
+	// Description of the elements in a single vertex (position, normal, UVs etc.)
+	static const int         MAX_VERTEX_ELTS = 64;
+	D3D10_INPUT_ELEMENT_DESC m_VertexElts[MAX_VERTEX_ELTS];
+	unsigned int             m_NumVertexElts;
+	ID3D10InputLayout*       m_VertexLayout; // Layout of a vertex (derived from above)
+	unsigned int             m_VertexSize;   // Size of vertex calculated from contained elements
+
+	// Index data for the mesh stored in a index buffer and the number of indices in the buffer. Indices are 16-bit unless a sub-mesh
+	// has too many vertices for that
+	ID3D10Buffer*            m_IndexBuffer;
+	unsigned int             m_NumIndices;
+	DXGI_FORMAT              m_IndexFormat;
+
+	// The range of the buffers used by each sub-mesh. Each level of detail has a range for every sub-mesh, the full detail ranges
+	// first. The lower LODs are simplified versions of the index data using the same vertices, so only the index ranges differ
+	vector<SSubMeshRange>    m_SubMeshes;
+	unsigned int             m_NumSubMeshes; // In each level of detail
+	unsigned int             m_NumLods;
+
+	// Largest distance a vertex may have moved in each level of detail, in model space. Zero for full detail
+	float                    m_LodErrors[MaxMeshLods];
+
+	// Buffer data loaded by LoadData, waiting for CreateDeviceObjects. Built in the two vectors by an import, or a view of the
+	// memory-mapped cache file, which stays mapped until then
+	vector<unsigned char>    m_ImportVertices;
+	vector<unsigned char>    m_ImportIndices;
+	size_t                   m_ImportBytes; // Size of the data above (or the mapped file), counted in the resource registry
+	const void*              m_PendingVertices;
+	const void*              m_PendingIndices;
+	HANDLE                   m_CacheFile;
+	HANDLE                   m_CacheMapping;
+	const void*              m_CacheView;
+
+	// The node hierarchy from the file and the name of each node. Models using the mesh hold their own copy of the node matrices (see
+	// CScene), which start as the default matrices here
+	vector<SMeshNodeInfo>    m_Nodes;
+	vector<string>           m_NodeNames;
+
+	// Bounding sphere of the vertex positions, in model space. Calculated when the buffers are created
+	D3DXVECTOR3              m_BoundingCentre;
+	float                    m_BoundingRadius;
+
+	// Compressed vertices store each position as 16-bit values across the mesh's bounding box. The shaders get these as 0->1 and take
+	// them back to model space with this scale and offset (1 and 0 for uncompressed vertices)
+	bool                     m_Compressed;
+	D3DXVECTOR3              m_PositionScale;
+	D3DXVECTOR3              m_PositionOffset;
+
+	// Skinned vertices have the weights and indices of up to four nodes that move them (see IsSkinned)
+	bool                     m_Skinned;
+
+	// Flags for the components present in each vertex (position is always present). Stored in mesh cache files
+	enum EVertexComponents
+	{
+		VertexNormals  = 1,
+		VertexTangents = 2,
+		VertexUVs      = 4,
+		VertexColours  = 8,
+		VertexCompressed = 16, // Smaller formats for each component (see BuildVertexElements)
+		VertexSkinned  = 32,   // Node weights and indices, straight after the position
+	};
+
+
+/////////////////////////////
+// Public member functions
+public:
+
+	///////////////////////////////
+	// Constructors / Destructors
+
+	// Constructor - creates an empty mesh with a reference count of one
+	CMesh();
+
+	// Reference counting. Release deletes the mesh when no longer used and returns the remaining count
+	void AddRef();
+	unsigned int Release();
+
+private:
+	// Destructor is private, meshes are deleted by Release
+	~CMesh();
+
+	// Disallow use of copy constructor and assignment operator (private and not defined)
+	CMesh( const CMesh& );
+	CMesh& operator=( const CMesh& );
+
+public:
+
+	/////////////////////////////
+	// Mesh Loading
+
+	// Load the mesh geometry from a file. All the sub-meshes in the file (one for each material) are loaded into a single vertex and index
+	// buffer, with a draw range for each. May optionally request for tangents to be created for the model (for normal or parallax mapping)
+	// The loaded data is saved in a binary cache file beside the file, which is used instead of the file on later loads
+	// We need to pass an example technique that the mesh will use to help DirectX understand how to connect this data with the vertex shaders
+	// Returns true if the load was successful
+	// The example technique may be NULL, in which case no vertex layout is created (see CreateVertexLayout)
+	// Compressed vertices are less than half the size, with quantised positions, 8-bit normals and tangents and 16-bit float UVs
+	bool Load( const string& fileName, ID3D10EffectTechnique* exampleTechnique, bool tangents = false, bool compressed = false );
+
+	// Load does its work in two parts so the slow part can run on a worker thread. LoadData reads the cache file, or imports the file and
+	// builds the buffer data, and uses no device so can run on any thread. CreateDeviceObjects then creates the buffers (and the vertex
+	// layout if there is an example technique) from the data and must be called on the render thread. Both return true on success
+	bool LoadData( const string& fileName, bool tangents = false, bool compressed = false );
+	bool CreateDeviceObjects( ID3D10EffectTechnique* exampleTechnique );
+
+	// Create the vertex layout for the mesh from its element list, if not already created. Returns true on success
+	bool CreateVertexLayout( ID3D10EffectTechnique* exampleTechnique );
+
+	// Load the mesh again from its file (e.g. after it was edited), replacing the geometry in place so the models using it see the
+	// change. The vertex layout is kept, so the new geometry must have the same vertex elements, and the same number of nodes. The node
+	// hierarchy and matrices are replaced, so the models using the mesh must take a new copy of them (see CScene::SetNodes). Returns
+	// false, leaving the mesh unchanged, if the file fails to load or doesn't match. Must be on the render thread, which waits for the import
+	bool Reload( const string& fileName, bool tangents = false );
+
+
+	/////////////////////////////
+	// Data access
+
+	ID3D10InputLayout* GetVertexLayout()
+	{
+		return m_VertexLayout;
+	}
+	ID3D10Buffer* GetVertexBuffer()
+	{
+		return m_VertexBuffer;
+	}
+	unsigned int GetVertexSize()
+	{
+		return m_VertexSize;
+	}
+	// Vertex element list, used to build layouts that combine this mesh's vertices with other data (e.g. instance data)
+	const D3D10_INPUT_ELEMENT_DESC* GetVertexElts()
+	{
+		return m_VertexElts;
+	}
+	unsigned int GetNumVertexElts()
+	{
+		return m_NumVertexElts;
+	}
+	ID3D10Buffer* GetIndexBuffer()
+	{
+		return m_IndexBuffer;
+	}
+	DXGI_FORMAT GetIndexFormat()
+	{
+		return m_IndexFormat;
+	}
+
+	unsigned int GetNumSubMeshes()
+	{
+		return m_NumSubMeshes;
+	}
+	const SSubMeshRange& GetSubMesh( unsigned int subMesh, unsigned int lod = 0 )
+	{
+		return m_SubMeshes[lod * m_NumSubMeshes + subMesh];
+	}
+
+	// Levels of detail - LOD 0 is full detail, each following LOD has fewer triangles. The error is the largest distance a vertex
+	// may have moved in the LOD, in model space
+	unsigned int GetNumLods()
+	{
+		return m_NumLods;
+	}
+	float GetLodError( unsigned int lod )
+	{
+		return m_LodErrors[lod];
+	}
+
+	unsigned int GetNumNodes()
+	{
+		return static_cast<unsigned int>(m_Nodes.size());
+	}
+	const SMeshNodeInfo& GetNode( unsigned int node )
+	{
+		return m_Nodes[node];
+	}
+	const string& GetNodeName( unsigned int node )
+	{
+		return m_NodeNames[node];
+	}
+
+	// Find a node by name, returns false if there is no node with that name
+	bool FindNode( const string& name, unsigned int& node );
+
+	// Model space bounding sphere, used for culling. Covers the mesh with all nodes at their default matrices
+	const D3DXVECTOR3& GetBoundingCentre()
+	{
+		return m_BoundingCentre;
+	}
+	float GetBoundingRadius()
+	{
+		return m_BoundingRadius;
+	}
+
+	// Position decode for the vertex shaders: model space position = vertex position * scale + offset (see m_PositionScale)
+	bool IsCompressed()
+	{
+		return m_Compressed;
+	}
+	const D3DXVECTOR3& GetPositionScale()
+	{
+		return m_PositionScale;
+	}
+	const D3DXVECTOR3& GetPositionOffset()
+	{
+		return m_PositionOffset;
+	}
+
+	// A skinned mesh (one with skin weights in its file) blends each vertex between the matrices of up to four nodes, so it must be
+	// drawn with the skinned techniques and a palette of its model's node matrices (see CModel::GetNodeMeshMatrix). Vertices with no
+	// weights follow their sub-mesh's node
+	bool IsSkinned()
+	{
+		return m_Skinned;
+	}
+
+
+	/////////////////////////////
+	// Mesh Usage
+
+	// Select this mesh's vertex and index buffer and vertex layout
+	void SetGeometry();
+
+	// Draw the mesh geometry at the given level of detail, assumes the geometry and technique have already been selected. May draw
+	// several instances. Each sub-mesh is drawn as a separate range of the shared buffers
+	void Draw( unsigned int numInstances = 1, unsigned int lod = 0 );
+
+	// Draw a single sub-mesh, assumes the geometry and technique have already been selected. May draw several instances
+	void DrawSubMesh( unsigned int subMesh, unsigned int numInstances = 1, unsigned int lod = 0 );
+
+
+/////////////////////////////
+// Private member functions
+private:
+
+	// Copy the node hierarchy from the import class
+	void CreateNodes( const gen::CImportXFile& mesh );
+
+	// Build the vertex data, index data and draw ranges from the sub-meshes imported by LoadData (with the render method of each),
+	// ready for CreateDeviceObjects, then write them (and the nodes) to the given mesh cache file
+	bool BuildBuffers( const vector<gen::SSubMesh>& subMeshes, const vector<gen::ERenderMethod>& renderMethods, bool compressed,
+	                   const string& cacheFileName );
+
+	// Create the lower levels of detail by simplifying the faces of the imported sub-meshes. Adds a range for each sub-mesh in each new
+	// LOD to the sub-mesh list, with the faces for each range added to the given list. Sets the number of LODs and their errors
+	void CreateLods( const vector<gen::SSubMesh>& subMeshes, vector<gen::TMeshFaces>& lodFaces );
+
+	// Build the vertex element list for a vertex with the given components (EVertexComponents flags), sets the vertex size
+	void BuildVertexElements( unsigned int components );
+
+	// Convert uncompressed vertex data (in the layout for the given components without VertexCompressed) to the compressed layout,
+	// which must already be built. Sets the position decode from the bounding box of the vertices
+	void CompressVertices( const vector<unsigned char>& vertices, unsigned int components, vector<unsigned char>& compressedVertices );
+
+	// Get the model space position of a vertex in the given vertex data, decoding it if compressed
+	D3DXVECTOR3 GetVertexPosition( const void* vertices, unsigned int vertex );
+
+	// Create the vertex and index buffers from the given data, which must match the vertex size, counts and index format already set
+	bool CreateGPUBuffers( const void* vertices, const void* indices );
+
+	// Free the buffer data held for CreateDeviceObjects, unmapping the cache file if it was used
+	void ReleaseData();
+
+	// Calculate the bounding sphere from the given vertex data, which must match the vertex size and count already set
+	void CalculateBounds( const void* vertices );
+
+	unsigned int GetIndexSize()
+	{
+		return (m_IndexFormat == DXGI_FORMAT_R32_UINT) ? 4 : 2;
+	}
+
+	// Mesh cache files hold the finished buffer data for a mesh so later loads don't need to import the .X file (see Mesh.cpp)
+	static string CacheFileName( const string& fileName, bool tangents, bool compressed );
+	bool LoadCacheFile( const string& cacheFileName, const string& sourceFileName );
+	bool SaveCacheFile( const string& cacheFileName, unsigned int components, const void* vertices, const void* indices );
+};
+
+
+//-----------------------------------------------------------------------------
+// Mesh Cache
+//-----------------------------------------------------------------------------
+
+// A mesh for CMeshCache::LoadMeshes
+struct SMeshRequest
+{
+	string fileName;
+	bool   tangents;
+	bool   compressed;
+
+	SMeshRequest( const string& fileName, bool tangents = false, bool compressed = false )
+	: fileName( fileName ), tangents( tangents ), compressed( compressed ) {}
+};
+
+// Hands out shared meshes keyed by file name and the tangent and compression flags. The first request for a mesh loads it, later
+// requests return the same mesh with its reference count increased. All meshes must be released back to the cache
+// The cache is only used from the render thread, LoadMeshes puts the loading work on other threads itself
+class CMeshCache
+{
+public:
+	// Get a mesh from the cache, loading it if necessary. The example technique is used to create the mesh's vertex layout if it
+	// doesn't have one yet (see CMesh::Load), may be NULL. Returns NULL if the mesh could not be loaded
+	static CMesh* GetMesh( const string& fileName, ID3D10EffectTechnique* exampleTechnique, bool tangents = false, bool compressed = false );
+
+	// Get several meshes at once. The files are read and imported in parallel as jobs on the job system, then the device objects are
+	// created on this thread. Meshes already in the cache are shared as in GetMesh. The mesh for each request (NULL if it failed to load)
+	// is returned holding a reference, release them once their users have their own. No vertex layouts are created, GetMesh creates
+	// them for the users that give an example technique
+	static void LoadMeshes( const vector<SMeshRequest>& requests, CJobSystem* jobSystem, vector<CMesh*>& meshes );
+
+	// Release a mesh obtained from GetMesh or LoadMeshes. The mesh is deleted and removed from the cache when no models use it
+	static void ReleaseMesh( CMesh* mesh );
+
+	// Reload every loaded mesh from the given file (with any flags) after the file has changed, see CMesh::Reload. The file name is
+	// not case sensitive. The meshes reloaded are added to the given list, if any. Returns the number of meshes reloaded
+	static unsigned int ReloadMeshes( const string& fileName, vector<CMesh*>* reloaded = NULL );
+
+	// Number of distinct meshes currently loaded
+	static unsigned int GetNumMeshes()
+	{
+		return static_cast<unsigned int>(m_Meshes.size());
+	}
+
+private:
+	// Loaded meshes, the key is the file name with a suffix for the tangent and compression flags
+	typedef map<string, CMesh*> TMeshMap;
+	static TMeshMap m_Meshes;
+
+	static string MakeKey( const string& fileName, bool tangents, bool compressed );
+};
+
+
+#endif // End of header guard - see top of file
@@ -7,30 +7,27 @@
 
 #include "Defines.h" // General definitions shared by all source files
 #include "Model.h"   // Declaration of this class
+#include "Scene.h"   // The scene holds the model's transform
+#include "CMatrix4x4.h" // Maths library matrix, used to find the model's axes from its transform
 
-#include "CImportXFile.h"    // Class to load meshes (taken from a full graphics engine)
 
 ///////////////////////////////
 // Constructors / Destructors
 
-// Constructor - initialise all camera settings - look at the constructor declaration in the header file to see that there are defaults provided for everything
-CModel::CModel( D3DXVECTOR3 position, D3DXVECTOR3 rotation, float scale )
+// Constructor - models are created by CScene::AddModel, which holds their transform at the given index
+CModel::CModel( CScene* scene, unsigned int index )
 {
-	m_Position = position;
-	m_Rotation = rotation;
-	SetScale( scale );
-	UpdateMatrix();
+	m_Scene = scene;
+	m_Index = index;
 
 	// Good practice to ensure all private data is sensibly initialised
-	m_VertexBuffer = NULL;
-	m_NumVertices = 0;
-	m_VertexSize = 0;
-	m_VertexLayout = NULL;
-
-	m_IndexBuffer = NULL;
-	m_NumIndices = 0;
-
-	m_HasGeometry = false;
+	m_Mesh = NULL;
+	m_Lod = 0;
+	m_PaletteOffset = 0;
+	m_DiffuseMap = NULL;
+	m_Shading = ShadingMaterial;
+	m_Tint = D3DXVECTOR3( 1, 1, 1 );
+	m_Background = false;
 }
 
 // Model destructor
@@ -42,169 +39,214 @@ CModel::~CModel()
 // Release resources used by model
 void CModel::ReleaseResources()
 {
-	// Release resources
-	SAFE_RELEASE( m_IndexBuffer );  // Using a DirectX helper macro to simplify code here - look it up in Defines.h
-	SAFE_RELEASE( m_VertexBuffer );
-	SAFE_RELEASE( m_VertexLayout );
-	m_HasGeometry = false;
+	// Give the shared geometry back to the cache, it is released when no other models use it
+	CMeshCache::ReleaseMesh( m_Mesh );
+	m_Mesh = NULL;
 }
 
 
 /////////////////////////////
-// Model Loading
+// Data access
+
+D3DXVECTOR3 CModel::GetPosition()
+{
+	return m_Scene->GetPosition( m_Index );
+}
+D3DXVECTOR3 CModel::GetRotation()
+{
+	return m_Scene->GetRotation( m_Index );
+}
+D3DXVECTOR3 CModel::GetScale()
+{
+	return m_Scene->GetScale( m_Index );
+}
+D3DXMATRIX CModel::GetWorldMatrix()
+{
+	return m_Scene->GetWorldMatrix( m_Index );
+}
+D3DXVECTOR3 CModel::GetWorldPosition()
+{
+	D3DXMATRIX worldMatrix = GetWorldMatrix();
+	return D3DXVECTOR3( worldMatrix._41, worldMatrix._42, worldMatrix._43 );
+}
+float CModel::GetWorldMaxScale()
+{
+	// Rotation doesn't change the length of the matrix rows, so each row's length is the scale on that axis
+	D3DXMATRIX m = GetWorldMatrix();
+	float scaleSquared = max( m._11*m._11 + m._12*m._12 + m._13*m._13,
+	                          max( m._21*m._21 + m._22*m._22 + m._23*m._23, m._31*m._31 + m._32*m._32 + m._33*m._33 ) );
+	return sqrtf( scaleSquared );
+}
+bool CModel::UsesQuaternion()
+{
+	return m_Scene->UsesQuaternion( m_Index );
+}
+gen::CQuaternion CModel::GetOrientation()
+{
+	return m_Scene->GetOrientation( m_Index );
+}
+gen::CQuatTransform CModel::GetTransform()
+{
+	return gen::CQuatTransform( m_Scene->GetOrientation( m_Index ), *reinterpret_cast<const gen::CVector3*>(&m_Scene->GetPosition( m_Index )),
+	                            *reinterpret_cast<const gen::CVector3*>(&m_Scene->GetScale( m_Index )) );
+}
+
+void CModel::SetPosition( D3DXVECTOR3 position )
+{
+	m_Scene->SetPosition( m_Index, position );
+}
+void CModel::SetRotation( D3DXVECTOR3 rotation )
+{
+	m_Scene->SetRotation( m_Index, rotation );
+}
+void CModel::SetOrientation( const gen::CQuaternion& orientation )
+{
+	m_Scene->SetOrientation( m_Index, orientation );
+}
+void CModel::SetTransform( const gen::CQuatTransform& transform )
+{
+	m_Scene->SetPosition( m_Index, D3DXVECTOR3( transform.pos.x, transform.pos.y, transform.pos.z ) );
+	m_Scene->SetOrientation( m_Index, transform.quat );
+	m_Scene->SetScale( m_Index, D3DXVECTOR3( transform.scale.x, transform.scale.y, transform.scale.z ) );
+}
+void CModel::SetUseQuaternion( bool useQuaternion )
+{
+	m_Scene->SetUseQuaternion( m_Index, useQuaternion );
+}
+void CModel::SetNodeMatrix( unsigned int node, const D3DXMATRIX& matrix )
+{
+	m_Scene->SetNodeMatrix( m_Index, node, matrix );
+}
+void CModel::ResetNodes()
+{
+	m_Scene->ResetNodes( m_Index );
+}
+void CModel::SetScale( D3DXVECTOR3 scale )
+{
+	m_Scene->SetScale( m_Index, scale );
+}
+void CModel::SetScale( float scale )
+{
+	m_Scene->SetScale( m_Index, D3DXVECTOR3( scale, scale, scale ) );
+}
 
-// The loading and parsing of ".X" files is supported using a class taken from another application. We will not look at the process (more to do with parsing than graphics). Ultimately
-// we end up with arrays of data exactly as we have previously manually typed in
 
-// Load the model geometry from a file. This function only reads the geometry using the first material in the file, so multi-material
-// models will load but will have parts missing. May optionally request for tangents to be created for the model (for normal or parallax mapping)
+unsigned int CModel::GetNumNodes()
+{
+	return m_Scene->GetNumNodes( m_Index );
+}
+bool CModel::FindNode( const string& name, unsigned int& node )
+{
+	return m_Mesh != NULL && m_Mesh->FindNode( name, node );
+}
+D3DXMATRIX CModel::GetNodeMatrix( unsigned int node )
+{
+	return m_Scene->GetNodeMatrix( m_Index, node );
+}
+D3DXMATRIX CModel::GetNodeWorldMatrix( unsigned int node )
+{
+	return m_Scene->GetNodeWorldMatrix( m_Index, node );
+}
+D3DXMATRIX CModel::GetNodeMeshMatrix( unsigned int node )
+{
+	return m_Scene->GetNodeMeshMatrix( m_Index, node );
+}
+bool CModel::IsPosed()
+{
+	return m_Scene->IsPosed( m_Index );
+}
+
+// World matrix to draw a sub-mesh with. The model's world matrix unless the model is posed
+D3DXMATRIX CModel::GetSubMeshWorldMatrix( unsigned int subMesh )
+{
+	if (!IsPosed())
+	{
+		return GetWorldMatrix();
+	}
+	return m_Scene->GetNodeMeshMatrix( m_Index, m_Mesh->GetSubMesh( subMesh ).node );
+}
+
+
+/////////////////////////////
+// Model Loading
+
+// Load the model geometry from a file. All the sub-meshes in the file (one for each material) are loaded into a single vertex and index
+// buffer, drawn as separate ranges. May optionally request for tangents to be created for the model (for normal or parallax mapping)
 // We need to pass an example technique that the model will use to help DirectX understand how to connect this data with the vertex shaders
+// The geometry comes from the mesh cache, so loading the same file for several models only imports it once
 // Returns true if the load was successful
-bool CModel::Load( const string& fileName, ID3D10EffectTechnique* exampleTechnique, bool tangents /*= false*/ ) // The commented out bit is the default parameter (can't write it here, only in the declaration)
+bool CModel::Load( const string& fileName, ID3D10EffectTechnique* exampleTechnique, bool tangents /*= false*/, bool compressed /*= false*/ ) // The commented out bit is the default parameter (can't write it here, only in the declaration)
 {
 	// Release any existing geometry in this object
 	ReleaseResources();
 
-	// Use CImportXFile class (from another application) to load the given file. The import code is wrapped in the namespace 'gen'
-	gen::CImportXFile mesh;
-	if (mesh.ImportFile( fileName.c_str() ) != gen::kSuccess)
-	{
-		return false;
-	}
+	m_Mesh = CMeshCache::GetMesh( fileName, exampleTechnique, tangents, compressed );
+	m_Lod = 0;
+	m_Scene->SetNodes( m_Index, m_Mesh ); // The model has its own copy of the mesh's node hierarchy
+	m_Scene->SetDirty( m_Index );         // The bounds come from the geometry
+	return m_Mesh != NULL;
+}
 
-	// Get first sub-mesh from loaded file
-	gen::SSubMesh subMesh;
-	if (mesh.GetSubMesh( 0, &subMesh, tangents ) != gen::kSuccess)
-	{
-		return false;
-	}
 
+/////////////////////////////
+// Model Usage
 
-	// Create vertex element list & layout. We need a vertex layout to say what data we have per vertex in this model (e.g. position, normal, uv, etc.)
-	// In previous projects the element list was a manually typed in array as we knew what data we would provide. However, as we can load models with
-	// different vertex data this time we need flexible code. The array is built up one element at a time: ask the import class if it loaded normals, 
-	// if so then add a normal line to the array, then ask if it loaded UVS...etc
-	unsigned int numElts = 0;
-	unsigned int offset = 0;
-	// Position is always required
-	m_VertexElts[numElts].SemanticName = "POSITION";   // Semantic in HLSL (what is this data for)
-	m_VertexElts[numElts].SemanticIndex = 0;           // Index to add to semantic (a count for this kind of data, when using multiple of the same type, e.g. TEXCOORD0, TEXCOORD1)
-	m_VertexElts[numElts].Format = DXGI_FORMAT_R32G32B32_FLOAT; // Type of data - this one will be a float3 in the shader. Most data communicated as though it were colours
-	m_VertexElts[numElts].AlignedByteOffset = offset;  // Offset of element from start of vertex data (e.g. if we have position (float3), uv (float2) then normal, the normal's offset is 5 floats = 5*4 = 20)
-	m_VertexElts[numElts].InputSlot = 0;               // For when using multiple vertex buffers (e.g. instancing - an advanced topic)
-	m_VertexElts[numElts].InputSlotClass = D3D10_INPUT_PER_VERTEX_DATA; // Use this value for most cases (only changed for instancing)
-	m_VertexElts[numElts].InstanceDataStepRate = 0;                     // --"--
-	offset += 12;
-	++numElts;
-	// Repeat for each kind of vertex data
-	if (subMesh.hasNormals)
-	{
-		m_VertexElts[numElts].SemanticName = "NORMAL";
-		m_VertexElts[numElts].SemanticIndex = 0;
-		m_VertexElts[numElts].Format = DXGI_FORMAT_R32G32B32_FLOAT;
-		m_VertexElts[numElts].AlignedByteOffset = offset;
-		m_VertexElts[numElts].InputSlot = 0;
-		m_VertexElts[numElts].InputSlotClass = D3D10_INPUT_PER_VERTEX_DATA;
-		m_VertexElts[numElts].InstanceDataStepRate = 0;
-		offset += 12;
-		++numElts;
-	}
-	if (subMesh.hasTangents)
-	{
-		m_VertexElts[numElts].SemanticName = "TANGENT";
-		m_VertexElts[numElts].SemanticIndex = 0;
-		m_VertexElts[numElts].Format = DXGI_FORMAT_R32G32B32_FLOAT;
-		m_VertexElts[numElts].AlignedByteOffset = offset;
-		m_VertexElts[numElts].InputSlot = 0;
-		m_VertexElts[numElts].InputSlotClass = D3D10_INPUT_PER_VERTEX_DATA;
-		m_VertexElts[numElts].InstanceDataStepRate = 0;
-		offset += 12;
-		++numElts;
-	}
-	if (subMesh.hasTextureCoords)
-	{
-		m_VertexElts[numElts].SemanticName = "TEXCOORD";
-		m_VertexElts[numElts].SemanticIndex = 0;
-		m_VertexElts[numElts].Format = DXGI_FORMAT_R32G32_FLOAT;
-		m_VertexElts[numElts].AlignedByteOffset = offset;
-		m_VertexElts[numElts].InputSlot = 0;
-		m_VertexElts[numElts].InputSlotClass = D3D10_INPUT_PER_VERTEX_DATA;
-		m_VertexElts[numElts].InstanceDataStepRate = 0;
-		offset += 8;
-		++numElts;
-	}
-	if (subMesh.hasVertexColours)
-	{
-		m_VertexElts[numElts].SemanticName = "COLOR";
-		m_VertexElts[numElts].SemanticIndex = 0;
-		m_VertexElts[numElts].Format = DXGI_FORMAT_R8G8B8A8_UNORM; // A RGBA colour with 1 byte (0-255) per component
-		m_VertexElts[numElts].AlignedByteOffset = offset;
-		m_VertexElts[numElts].InputSlot = 0;
-		m_VertexElts[numElts].InputSlotClass = D3D10_INPUT_PER_VERTEX_DATA;
-		m_VertexElts[numElts].InstanceDataStepRate = 0;
-		offset += 4;
-		++numElts;
-	}
-	m_VertexSize = offset;
-
-	// Given the vertex element list, pass it to DirectX to create a vertex layout. We also need to pass an example of a technique that will
-	// render this model. We will only be able to render this model with techniques that have the same vertex input as the example we use here
-	D3D10_PASS_DESC PassDesc;
-	exampleTechnique->GetPassByIndex( 0 )->GetDesc( &PassDesc );
-	g_pd3dDevice->CreateInputLayout( m_VertexElts, numElts, PassDesc.pIAInputSignature, PassDesc.IAInputSignatureSize, &m_VertexLayout );
-
-
-	// Create the vertex buffer and fill it with the loaded vertex data
-	m_NumVertices = subMesh.numVertices;
-	D3D10_BUFFER_DESC bufferDesc;
-	bufferDesc.BindFlags = D3D10_BIND_VERTEX_BUFFER;
-	bufferDesc.Usage = D3D10_USAGE_DEFAULT; // Not a dynamic buffer
-	bufferDesc.ByteWidth = m_NumVertices * m_VertexSize; // Buffer size
-	bufferDesc.CPUAccessFlags = 0;   // Indicates that CPU won't access this buffer at all after creation
-	bufferDesc.MiscFlags = 0;
-	D3D10_SUBRESOURCE_DATA initData; // Initial data
-	initData.pSysMem = subMesh.vertices;   
-	if (FAILED( g_pd3dDevice->CreateBuffer( &bufferDesc, &initData, &m_VertexBuffer )))
-	{
-		return false;
-	}
+// Update the world matrix of the model from its position, rotation and scaling now. Normally the scene updates all the
+// changed models together (see CScene::UpdateMatrices)
+void CModel::UpdateMatrix()
+{
+	m_Scene->UpdateMatrix( m_Index );
+}
 
 
-	// Create the index buffer - assuming 2-byte (WORD) index data
-	m_NumIndices = static_cast<unsigned int>(subMesh.numFaces) * 3;
-	bufferDesc.BindFlags = D3D10_BIND_INDEX_BUFFER;
-	bufferDesc.Usage = D3D10_USAGE_DEFAULT;
-	bufferDesc.ByteWidth = m_NumIndices * sizeof(WORD);
-	bufferDesc.CPUAccessFlags = 0;
-	bufferDesc.MiscFlags = 0;
-	initData.pSysMem = subMesh.faces;   
-	if (FAILED( g_pd3dDevice->CreateBuffer( &bufferDesc, &initData, &m_IndexBuffer )))
+// Get the world space bounding sphere of the model, from its mesh's bounds and the current world matrix. A model with no
+// geometry has a zero radius sphere at its position
+void CModel::GetBoundingSphere( D3DXVECTOR3& centre, float& radius )
+{
+	if (!m_Mesh)
 	{
-		return false;
+		centre = GetWorldPosition();
+		radius = 0.0f;
+		return;
 	}
 
-	m_HasGeometry = true;
-	return true;
+	// Rotation doesn't change the sphere's size, but scaling does - use the largest scale in case it isn't uniform
+	D3DXMATRIX worldMatrix = GetWorldMatrix();
+	D3DXVec3TransformCoord( &centre, &m_Mesh->GetBoundingCentre(), &worldMatrix );
+	radius = m_Mesh->GetBoundingRadius() * GetWorldMaxScale();
 }
 
 
-/////////////////////////////
-// Model Usage
-
-// Update the world matrix of the model from its position, rotation and scaling
-void CModel::UpdateMatrix()
+// Choose the level of detail to draw the model with, for the given camera and a viewport of the given height in pixels. Uses the
+// lowest detail LOD whose error projects to no more than the given number of pixels at the nearest point of the model's bounds
+//**|3D|** Pass the monoscopic camera once per frame, so both eyes draw the same LOD - a different shape in each eye causes binocular
+// rivalry. Models in front of the screen with more than the given crossed disparity (pixels) are kept at full detail, the viewer
+// sees the most depth there so any simplification stands out
+void CModel::SelectLod( CCamera* camera, float viewportHeight, float maxPixelError, float maxDisparity )
 {
-	// Make a matrix for position and scaling, and one each for X, Y & Z rotations
-	D3DXMATRIX matrixXRot, matrixYRot, matrixZRot, matrixTranslation, matrixScaling;
-	D3DXMatrixRotationX( &matrixXRot, m_Rotation.x );
-	D3DXMatrixRotationY( &matrixYRot, m_Rotation.y );
-	D3DXMatrixRotationZ( &matrixZRot, m_Rotation.z );
-	D3DXMatrixTranslation( &matrixTranslation, m_Position.x, m_Position.y, m_Position.z );
-	D3DXMatrixScaling( &matrixScaling, m_Scale.x, m_Scale.y, m_Scale.z );
+	m_Lod = 0;
+	if (!m_Mesh || m_Mesh->GetNumLods() == 1)
+	{
+		return;
+	}
+
+	// Distance to the nearest point of the bounds, full detail if the camera is inside them
+	D3DXVECTOR3 centre;
+	float radius;
+	GetBoundingSphere( centre, radius );
+	D3DXVECTOR3 offset = centre - camera->GetPosition();
+	float distance = D3DXVec3Length( &offset ) - radius;
+	if (distance <= camera->GetNearClip() || -camera->GetDisparity( distance, viewportHeight ) > maxDisparity)
+	{
+		return;
+	}
 
-	// Multiply above matrices together to get the effect of them all combined - this makes the world matrix for the rendering pipeline
-	// Order of multiplication is important, get slightly different control mechanism depending on order
-	m_WorldMatrix = matrixScaling * matrixZRot * matrixXRot * matrixYRot * matrixTranslation;
+	// The LOD errors are in model space, the largest scale gives the most they can grow in the world
+	float pixelsPerUnit = GetWorldMaxScale() * camera->GetProjectionScale( viewportHeight ) / distance;
+	while (m_Lod + 1 < m_Mesh->GetNumLods() && m_Mesh->GetLodError( m_Lod + 1 ) * pixelsPerUnit <= maxPixelError)
+	{
+		++m_Lod;
+	}
 }
 
 
@@ -212,62 +254,92 @@ void CModel::UpdateMatrix()
 void CModel::Control( float frameTime, EKeyCode turnUp, EKeyCode turnDown, EKeyCode turnLeft, EKeyCode turnRight,  
                       EKeyCode turnCW, EKeyCode turnCCW, EKeyCode moveForward, EKeyCode moveBackward )
 {
+	D3DXVECTOR3 turn( 0, 0, 0 );
 	if (KeyHeld( turnDown ))
 	{
-		m_Rotation.x += RotSpeed * frameTime;
+		turn.x += RotSpeed * frameTime;
 	}
 	if (KeyHeld( turnUp ))
 	{
-		m_Rotation.x -= RotSpeed * frameTime;
+		turn.x -= RotSpeed * frameTime;
 	}
 	if (KeyHeld( turnRight ))
 	{
-		m_Rotation.y += RotSpeed * frameTime;
+		turn.y += RotSpeed * frameTime;
 	}
 	if (KeyHeld( turnLeft ))
 	{
-		m_Rotation.y -= RotSpeed * frameTime;
+		turn.y -= RotSpeed * frameTime;
 	}
 	if (KeyHeld( turnCW ))
 	{
-		m_Rotation.z += RotSpeed * frameTime;
+		turn.z += RotSpeed * frameTime;
 	}
 	if (KeyHeld( turnCCW ))
 	{
-		m_Rotation.z -= RotSpeed * frameTime;
+		turn.z -= RotSpeed * frameTime;
 	}
 
-	// Local Z movement - move in the direction of the Z axis, get axis from world matrix
+	// Local Z movement - move in the direction of the Z axis. This is the world matrix's Z axis, but is built from the transform as
+	// the world matrix may be built on another thread (see CScene::SetInterpolatedTransforms)
+	D3DXVECTOR3 position = GetPosition();
+	gen::CMatrix4x4 rotation;
+	if (UsesQuaternion())
+	{
+		rotation.MakeAffineQuaternion( GetOrientation() );
+	}
+	else
+	{
+		D3DXVECTOR3 rotationAngles = GetRotation();
+		rotation = gen::MatrixRotation( *reinterpret_cast<gen::CVector3*>(&rotationAngles), gen::kZXY );
+	}
+	const gen::CVector3& zAxis = rotation.ZAxis();
+	D3DXVECTOR3 forward = D3DXVECTOR3( zAxis.x, zAxis.y, zAxis.z ) * GetScale().z;
 	if (KeyHeld( moveForward ))
 	{
-		m_Position.x += m_WorldMatrix._31 * MoveSpeed * frameTime;
-		m_Position.y += m_WorldMatrix._32 * MoveSpeed * frameTime;
-		m_Position.z += m_WorldMatrix._33 * MoveSpeed * frameTime;
+		position += forward * MoveSpeed * frameTime;
 	}
 	if (KeyHeld( moveBackward ))
 	{
-		m_Position.x -= m_WorldMatrix._31 * MoveSpeed * frameTime;
-		m_Position.y -= m_WorldMatrix._32 * MoveSpeed * frameTime;
-		m_Position.z -= m_WorldMatrix._33 * MoveSpeed * frameTime;
+		position -= forward * MoveSpeed * frameTime;
+	}
+
+	// Only mark the transform as changed if the model actually moved
+	if (turn != D3DXVECTOR3( 0, 0, 0 ))
+	{
+		if (UsesQuaternion())
+		{
+			// Turning up/down and the rolls are around the model's own axes, so they go before the orientation. Turning left/right is
+			// around the world Y axis and goes after it (as with the Euler angles). Normalise to stop errors building up over many frames
+			gen::CQuaternion orientation = gen::QuaternionAxisAngle( gen::CVector3::kZAxis, turn.z ) *
+			                               gen::QuaternionAxisAngle( gen::CVector3::kXAxis, turn.x ) * GetOrientation() *
+			                               gen::QuaternionAxisAngle( gen::CVector3::kYAxis, turn.y );
+			orientation.Normalise();
+			SetOrientation( orientation );
+		}
+		else
+		{
+			SetRotation( GetRotation() + turn );
+		}
+	}
+	if (position != GetPosition())
+	{
+		SetPosition( position );
 	}
 }
 
 
 // Render the model with the given technique. Assumes any shader variables for the technique have already been set up (e.g. matrices and textures)
-void CModel::Render( ID3D10EffectTechnique* technique )
+// Can optionally draw several instances of the model in one call, e.g. two instances for single-pass stereo techniques (one per eye)
+void CModel::Render( ID3D10EffectTechnique* technique, unsigned int numInstances /*= 1*/ )
 {
 	// Don't render if no geometry
-	if (!m_HasGeometry)
+	if (!m_Mesh)
 	{
 		return;
 	}
 
-	// Select vertex and index buffer - assuming all data will be as triangle lists
-	UINT offset = 0;
-	g_pd3dDevice->IASetVertexBuffers( 0, 1, &m_VertexBuffer, &m_VertexSize, &offset );
-	g_pd3dDevice->IASetInputLayout( m_VertexLayout );
-	g_pd3dDevice->IASetIndexBuffer( m_IndexBuffer, DXGI_FORMAT_R16_UINT, 0 );
-	g_pd3dDevice->IASetPrimitiveTopology( D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
+	m_Mesh->SetGeometry();
 
 	// Render the model. All the data and shader variables are prepared, now select the technique to use and draw.
 	// The loop is for advanced techniques that need multiple passes - we will only use techniques with one pass
@@ -276,6 +348,6 @@ void CModel::Render( ID3D10EffectTechnique* technique )
 	for( UINT p = 0; p < techDesc.Passes; ++p )
 	{
 		technique->GetPassByIndex( p )->Apply( 0 );
-		g_pd3dDevice->DrawIndexed( m_NumIndices, 0, 0 );
+		m_Mesh->Draw( numInstances, m_Lod );
 	}
 }
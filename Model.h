@@ -14,44 +14,62 @@ using namespace std;
 #include <d3d10.h>
 #include <d3dx10.h>
 #include "Input.h"
+#include "Camera.h"
+#include "Mesh.h"
+#include "TextureManager.h"
+#include "CQuatTransform.h" // Maths library quaternion transform, an alternative to Euler angles for the model orientation
+
+
+class CScene;
+
+// How a model is shaded, used to choose its technique when it is drawn
+enum EModelShading
+{
+	ShadingMaterial,     // Each sub-mesh drawn with the technique for its material's render method (see gen::ERenderMethod)
+	ShadingAdditiveTint, // Unlit, tinted and blended additively - used for the light models
+};
 
 
 class CModel
 {
+	friend class CScene; // Models are created and deleted by the scene
+
 /////////////////////////////
 // Private member variables
 private:
 	//-----------------
 	// Postioning
 
-	// Positions, rotations and scaling for the model
-	D3DXVECTOR3   m_Position;
-	D3DXVECTOR3   m_Rotation;
-	D3DXVECTOR3   m_Scale;
-
-	// World matrix for the model - built from the above
-	D3DXMATRIXA16 m_WorldMatrix;
+	// The position, rotation, scaling and world matrix of the model are stored in the scene that owns it (see CScene), this is the
+	// model's index there
+	CScene*       m_Scene;
+	unsigned int  m_Index;
 
 	
 	//-----------------
 	// Geometry data
 
-	// Does this model have any geometry to render
-	bool                     m_HasGeometry;
+	// Geometry for the model, shared with any other models using the same file (see CMeshCache). NULL if no geometry
+	CMesh*        m_Mesh;
+
+	// Level of detail of the mesh to draw, chosen each frame by SelectLod
+	unsigned int  m_Lod;
+
+	// First of the model's node matrices in the frame's bone palette, for skinned meshes. Set each frame (see CBonePalette::AddModel)
+	unsigned int  m_PaletteOffset;
 
-	// Vertex data for the model stored in a vertex buffer and the number of the vertices in the buffer
-	ID3D10Buffer*            m_VertexBuffer;
-	unsigned int             m_NumVertices;
 
-	// Description of the elements in a single vertex (position, normal, UVs etc.)
-	static const int         MAX_VERTEX_ELTS = 64;
-	D3D10_INPUT_ELEMENT_DESC m_VertexElts[MAX_VERTEX_ELTS];
-	ID3D10InputLayout*       m_VertexLayout; // Layout of a vertex (derived from above)
-	unsigned int             m_VertexSize;   // Size of vertex calculated from contained elements
+	//-----------------
+	// Rendering
+
+	// Diffuse map from the texture manager (which owns it), how the model is shaded and a tint colour for tinted techniques
+	CTexture*     m_DiffuseMap;
+	EModelShading m_Shading;
+	D3DXVECTOR3   m_Tint;
 
-	// Index data for the model stored in a index buffer and the number of indices in the buffer
-	ID3D10Buffer*            m_IndexBuffer;
-	unsigned int             m_NumIndices;
+	// A background model surrounds the scene (e.g. the sky sphere). The distance to its centre says nothing about what it hides, so
+	// it is drawn after the other opaque models rather than sorted by depth with them
+	bool          m_Background;
 
 
 /////////////////////////////
@@ -61,80 +79,182 @@ public:
 	///////////////////////////////
 	// Constructors / Destructors
 
-	// Constructor - initialise all settings, sensible defaults provided for everything.
-	CModel( D3DXVECTOR3 position = D3DXVECTOR3(0,0,0), D3DXVECTOR3 rotation = D3DXVECTOR3(0,0,0), float scale = 1.0f );
+	// Release resources used by model
+	void ReleaseResources();
+
+private:
+	// Constructor - models are created by CScene::AddModel, which holds their transform at the given index
+	CModel( CScene* scene, unsigned int index );
 
-	// Destructor
+	// Destructor - models are deleted by the scene
 	~CModel();
 
-	// Release resources used by model
-	void ReleaseResources();
+	// Disallow use of copy constructor and assignment operator (private and not defined)
+	CModel( const CModel& );
+	CModel& operator=( const CModel& );
 
+public:
 
 	/////////////////////////////
 	// Data access
 
 	// Getters
-	D3DXVECTOR3 GetPosition()
+	D3DXVECTOR3 GetPosition();
+	D3DXVECTOR3 GetRotation();
+	D3DXVECTOR3 GetScale();
+
+	// The matrices are returned as copies: they are held in the scene's arrays, which move when models or nodes are added
+	D3DXMATRIX GetWorldMatrix();
+
+	// Position and largest scale taken from the world matrix. When the scene is updated on another thread (see CScene::GetTransforms)
+	// the render thread uses these rather than the transform, which the update thread may be changing
+	D3DXVECTOR3 GetWorldPosition();
+	float GetWorldMaxScale();
+
+	// Quaternion orientation, used in place of the rotation if UsesQuaternion is true (see SetOrientation)
+	bool UsesQuaternion();
+	gen::CQuaternion GetOrientation();
+
+	// Get the position, orientation and scale as a quaternion transform. Only valid when the model uses a quaternion
+	gen::CQuatTransform GetTransform();
+
+	// Geometry access, used by the render queue to avoid setting the same geometry state twice
+	bool HasGeometry()
 	{
-		return m_Position;
+		return m_Mesh != NULL;
 	}
-	D3DXVECTOR3 GetRotation()
+	CMesh* GetMesh()
 	{
-		return m_Rotation;
+		return m_Mesh;
 	}
-	D3DXVECTOR3 GetScale()
+	unsigned int GetLod()
 	{
-		return m_Scale;
+		return m_Lod;
+	}
+	bool IsSkinned()
+	{
+		return m_Mesh != NULL && m_Mesh->IsSkinned();
+	}
+	unsigned int GetPaletteOffset()
+	{
+		return m_PaletteOffset;
+	}
+	void SetPaletteOffset( unsigned int paletteOffset )
+	{
+		m_PaletteOffset = paletteOffset;
 	}
 
-	D3DXMATRIXA16 GetWorldMatrix()
+	// Node hierarchy of the model's mesh (frames in a .X file). Each model has its own copy of the node matrices, so models sharing a
+	// mesh can be posed differently. Nodes moved from their default matrices move their sub-meshes with them (the model is "posed")
+	unsigned int GetNumNodes();
+	bool FindNode( const string& name, unsigned int& node ); // Returns false if the mesh has no node with that name
+	D3DXMATRIX GetNodeMatrix( unsigned int node );    // In the parent node's space
+	D3DXMATRIX GetNodeWorldMatrix( unsigned int node );
+	D3DXMATRIX GetNodeMeshMatrix( unsigned int node );  // World matrix for the model space vertices the node moves
+	bool IsPosed();
+
+	// World matrix to draw a sub-mesh with. The model's world matrix unless the model is posed. Skinned meshes use the node mesh
+	// matrices instead, through the bone palette
+	D3DXMATRIX GetSubMeshWorldMatrix( unsigned int subMesh );
+
+	// Get the world space bounding sphere of the model, from its mesh's bounds and the current world matrix. A model with no
+	// geometry has a zero radius sphere at its position. Only uses the world matrix, so can be used from the render thread
+	void GetBoundingSphere( D3DXVECTOR3& centre, float& radius );
+
+	CTexture* GetDiffuseMap()
 	{
-		return m_WorldMatrix;
+		return m_DiffuseMap;
+	}
+	EModelShading GetShading()
+	{
+		return m_Shading;
+	}
+	const D3DXVECTOR3& GetTint()
+	{
+		return m_Tint;
+	}
+	bool IsBackground()
+	{
+		return m_Background;
 	}
 
 
-	// Setters
-	void SetPosition( D3DXVECTOR3 position )
+	// Setters. Changing the position, rotation or scale marks the model for its world matrix to be rebuilt (see CScene::UpdateMatrices)
+	// Setting the rotation switches the model to Euler angles, setting the orientation or transform switches it to a quaternion. The
+	// orientation must be normalised
+	void SetPosition( D3DXVECTOR3 position );
+	void SetRotation( D3DXVECTOR3 rotation );
+	void SetOrientation( const gen::CQuaternion& orientation );
+	void SetTransform( const gen::CQuatTransform& transform );
+	void SetUseQuaternion( bool useQuaternion ); // Converts the current orientation
+	void SetScale( D3DXVECTOR3 scale ); // Overloaded setter, two versions: this one sets x,y,z scale separately, the next sets all to the same value
+	void SetScale( float scale );
+
+	// Set the matrix of a node in its parent node's space. The node and its children are updated with the model's world matrix (see
+	// CScene::UpdateMatrices). The bounds used to cull the model stay those of the default pose
+	void SetNodeMatrix( unsigned int node, const D3DXMATRIX& matrix );
+	void ResetNodes(); // Put all nodes back to their default matrices
+
+	void SetDiffuseMap( CTexture* diffuseMap )
 	{
-		m_Position = position;
+		m_DiffuseMap = diffuseMap;
 	}
-	void SetRotation( D3DXVECTOR3 rotation )
+	void SetShading( EModelShading shading )
 	{
-		m_Rotation = rotation;
+		m_Shading = shading;
 	}
-	void SetScale( D3DXVECTOR3 scale ) // Overloaded setter, two versions: this one sets x,y,z scale separately, the next sets all to the same value
+	void SetTint( const D3DXVECTOR3& tint )
 	{
-		m_Scale = scale;
+		m_Tint = tint;
 	}
-	void SetScale( float scale )
+	void SetBackground( bool background )
 	{
-		m_Scale = D3DXVECTOR3( scale, scale, scale );
+		m_Background = background;
 	}
 
 
 	/////////////////////////////
 	// Model Loading
 
-	// Load the model geometry from a file. This function only reads the geometry using the first material in the file, so multi-material
-	// models will load but will have parts missing. May optionally request for tangents to be created for the model (for normal or parallax mapping)
+	// Load the model geometry from a file. All the sub-meshes in the file (one for each material) are loaded into a single vertex and index
+	// buffer, drawn as separate ranges. May optionally request for tangents to be created for the model (for normal or parallax mapping)
 	// We need to pass an example technique that the model will use to help DirectX understand how to connect this data with the vertex shaders
+	// The geometry comes from the mesh cache, so loading the same file for several models only imports it once
+	// Compressed vertices are less than half the size, which matters as every vertex is read once for each eye (see CMesh::Load)
 	// Returns true if the load was successful
-	bool Load( const string& fileName, ID3D10EffectTechnique* shaderCode, bool tangents = false );
+	bool Load( const string& fileName, ID3D10EffectTechnique* shaderCode, bool tangents = false, bool compressed = false );
 
 
 	/////////////////////////////
 	// Model Usage
 
-	// Update the world matrix of the model from its position, rotation and scaling
+	// Update the world matrix of the model from its position, rotation and scaling now. Normally the scene updates all the
+	// changed models together (see CScene::UpdateMatrices)
 	void UpdateMatrix();
+
+	// Choose the level of detail to draw the model with, for the given camera and a viewport of the given height in pixels. Uses the
+	// lowest detail LOD whose error projects to no more than the given number of pixels at the nearest point of the model's bounds
+	//**|3D|** Pass the monoscopic camera once per frame, so both eyes draw the same LOD - a different shape in each eye causes binocular
+	// rivalry. Models in front of the screen with more than the given crossed disparity (pixels) are kept at full detail, the viewer
+	// sees the most depth there so any simplification stands out
+	void SelectLod( CCamera* camera, float viewportHeight, float maxPixelError, float maxDisparity );
+
+	// Draw the full detail mesh until the next SelectLod
+	void ResetLod()
+	{
+		m_Lod = 0;
+	}
 	
 	// Control the model's position and rotation using keys provided. Amount of motion performed depends on frame time
 	void Control( float frameTime, EKeyCode turnUp, EKeyCode turnDown, EKeyCode turnLeft, EKeyCode turnRight,  
 				  EKeyCode turnCW, EKeyCode turnCCW, EKeyCode moveForward, EKeyCode moveBackward );
 
 	// Render the model with the given technique. Assumes any shader variables for the technique have already been set up (e.g. matrices and textures)
-	void Render( ID3D10EffectTechnique* technique );
+	// Can optionally draw several instances of the model in one call, e.g. two instances for single-pass stereo techniques (one per eye)
+	// The whole mesh uses the world matrix already set, so any node pose is ignored - the render queue draws posed models correctly
+	void Render( ID3D10EffectTechnique* technique, unsigned int numInstances = 1 );
+
+
 };
 
 
@@ -0,0 +1,225 @@
+//--------------------------------------------------------------------------------------
+//	OcclusionCuller.cpp
+//
+//	Hardware occlusion culling between the eye passes. After the left eye is rendered a
+//	box around each queued model is tested against its depth buffer with an occlusion
+//	predicate, and the right eye's draws of the model are predicated on the result. The
+//	GPU skips the hidden models itself, the CPU never waits for the query results
+//--------------------------------------------------------------------------------------
+
+#include <cmath>
+using namespace std;
+
+#include "Defines.h"          // General definitions shared by all source files
+#include "ShaderConstants.h"  // Per-object constants for the boxes
+#include "RenderQueue.h"      // Models to test
+#include "OcclusionCuller.h"  // Declaration of this class
+#include "ResourceRegistry.h" // Counted in the buffer memory
+
+
+///////////////////////////////
+// Constructors / Destructors
+
+COcclusionCuller::COcclusionCuller()
+{
+	m_BoxVertexBuffer = NULL;
+	m_BoxIndexBuffer = NULL;
+	m_BoxLayout = NULL;
+	m_Frame = 0;
+	m_NumQueries = 0;
+}
+
+COcclusionCuller::~COcclusionCuller()
+{
+	ReleaseResources();
+}
+
+// Create the box geometry, with the vertex layout taken from the given box technique. Returns true on success
+bool COcclusionCuller::Init( ID3D10EffectTechnique* boxTechnique )
+{
+	ReleaseResources();
+
+	// Corners of the unit box, bit 0 of the index selects x, bit 1 y and bit 2 z. Two triangles for each face, the boxes are drawn
+	// without culling so the winding doesn't matter
+	D3DXVECTOR3 corners[8];
+	for (unsigned int corner = 0; corner < 8; ++corner)
+	{
+		corners[corner] = D3DXVECTOR3( (corner & 1) ? 1.0f : -1.0f, (corner & 2) ? 1.0f : -1.0f, (corner & 4) ? 1.0f : -1.0f );
+	}
+	const USHORT indices[36] =
+	{
+		0, 2, 1,  1, 2, 3, // -z
+		4, 5, 6,  5, 7, 6, // +z
+		0, 1, 4,  1, 5, 4, // -y
+		2, 6, 3,  3, 6, 7, // +y
+		0, 4, 2,  2, 4, 6, // -x
+		1, 3, 5,  3, 7, 5, // +x
+	};
+
+	D3D10_BUFFER_DESC bufferDesc;
+	bufferDesc.BindFlags = D3D10_BIND_VERTEX_BUFFER;
+	bufferDesc.Usage = D3D10_USAGE_IMMUTABLE;
+	bufferDesc.ByteWidth = sizeof(corners);
+	bufferDesc.CPUAccessFlags = 0;
+	bufferDesc.MiscFlags = 0;
+	D3D10_SUBRESOURCE_DATA initData;
+	initData.pSysMem = corners;
+	if (FAILED( g_Resources.CreateBuffer( ResourceBuffer, &bufferDesc, &initData, &m_BoxVertexBuffer ) ))
+	{
+		return false;
+	}
+	bufferDesc.BindFlags = D3D10_BIND_INDEX_BUFFER;
+	bufferDesc.ByteWidth = sizeof(indices);
+	initData.pSysMem = indices;
+	if (FAILED( g_Resources.CreateBuffer( ResourceBuffer, &bufferDesc, &initData, &m_BoxIndexBuffer ) ))
+	{
+		return false;
+	}
+
+	D3D10_INPUT_ELEMENT_DESC vertexElts[] =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D10_INPUT_PER_VERTEX_DATA, 0 },
+	};
+	D3D10_PASS_DESC PassDesc;
+	boxTechnique->GetPassByIndex( 0 )->GetDesc( &PassDesc );
+	return SUCCEEDED( g_pd3dDevice->CreateInputLayout( vertexElts, 1, PassDesc.pIAInputSignature,
+	                                                   PassDesc.IAInputSignatureSize, &m_BoxLayout ) );
+}
+
+// Release the box geometry and all the predicates
+void COcclusionCuller::ReleaseResources()
+{
+	for (TQueryMap::iterator query = m_Queries.begin(); query != m_Queries.end(); ++query)
+	{
+		SAFE_RELEASE( query->second.predicate );
+	}
+	m_Queries.clear();
+	SAFE_RELEASE( m_BoxLayout );
+	SAFE_RELEASE( m_BoxIndexBuffer );
+	SAFE_RELEASE( m_BoxVertexBuffer );
+	m_NumQueries = 0;
+}
+
+
+/////////////////////////////
+// Occlusion tests
+
+// Test a box around each opaque model in the queue against the depth buffer of the given eye, just rendered, using the given
+// technique (depth test only, no writes) and the per-object constant buffer. The per-eye constants must still be those of that eye.
+// The results are for the other eye's draws. Pass the distance from the camera inside which occluders other than the queued models
+// (e.g. instanced models) may lie, as it limits how far the other eye can see round them (see GetMargin)
+//**|3D|** Models not entirely inside the tested eye's frustum are not tested - the other eye may see the part that was clipped
+void COcclusionCuller::IssueQueries( CRenderQueue* queue, CCamera* camera, EStereoscopic eye, float occluderDistance,
+                                     ID3D10EffectTechnique* boxTechnique, ID3D10Buffer* perObjectBuffer )
+{
+	++m_Frame; // Predicates from earlier frames are no longer used
+	m_NumQueries = 0;
+	if (!m_BoxLayout) return;
+
+	// Depth of a point in the eye's camera space (the view matrix's third column)
+	const D3DXMATRIXA16& viewMatrix = camera->GetViewMatrix( eye );
+	const CFrustum& frustum = camera->GetFrustum( eye );
+
+	// Nearest depth any occluder reaches - every opaque model in the queue is an occluder, as is anything the caller says is nearer
+	float occluderDepth = occluderDistance;
+	for (unsigned int i = 0; i < queue->GetNumItems(); ++i)
+	{
+		const SDrawItem& item = queue->GetItem( i );
+		if (!item.depthTechnique || item.model->IsBackground()) continue;
+
+		D3DXVECTOR3 centre;
+		float radius;
+		item.model->GetBoundingSphere( centre, radius );
+		float depth = centre.x * viewMatrix._13 + centre.y * viewMatrix._23 + centre.z * viewMatrix._33 + viewMatrix._43;
+		occluderDepth = min( occluderDepth, depth - radius );
+	}
+	occluderDepth = max( occluderDepth, camera->GetNearClip() );
+
+	UINT stride = sizeof(D3DXVECTOR3);
+	UINT offset = 0;
+	g_pd3dDevice->IASetInputLayout( m_BoxLayout );
+	g_pd3dDevice->IASetVertexBuffers( 0, 1, &m_BoxVertexBuffer, &stride, &offset );
+	g_pd3dDevice->IASetIndexBuffer( m_BoxIndexBuffer, DXGI_FORMAT_R16_UINT, 0 );
+	g_pd3dDevice->IASetPrimitiveTopology( D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
+	boxTechnique->GetPassByIndex( 0 )->Apply( 0 );
+
+	SPerObjectConstants perObjectConstants;
+	ZeroMemory( &perObjectConstants, sizeof(perObjectConstants) );
+	perObjectConstants.MeshPosScale = D3DXVECTOR3( 1.0f, 1.0f, 1.0f );
+
+	for (unsigned int i = 0; i < queue->GetNumItems(); ++i)
+	{
+		// Only opaque models are tested (blended draws are cheap and don't hide anything). The background is always visible. Each model
+		// is tested once however many of its sub-meshes were queued
+		const SDrawItem& item = queue->GetItem( i );
+		if (!item.depthTechnique || item.model->IsBackground()) continue;
+
+		pair<TQueryMap::iterator, bool> entry = m_Queries.insert( TQueryMap::value_type( item.model, SModelQuery() ) );
+		SModelQuery& query = entry.first->second;
+		if (entry.second)
+		{
+			query.frame = 0;
+			D3D10_QUERY_DESC queryDesc;
+			queryDesc.Query = D3D10_QUERY_OCCLUSION_PREDICATE;
+			queryDesc.MiscFlags = D3D10_QUERY_MISC_PREDICATEHINT; // Only used for predication, never read back
+			if (FAILED( g_pd3dDevice->CreatePredicate( &queryDesc, &query.predicate ) ))
+			{
+				query.predicate = NULL;
+			}
+		}
+		if (!query.predicate || query.frame == m_Frame) continue;
+
+		// A model partly outside this eye's view may be visible to the other eye in the part that was clipped, so it is drawn
+		D3DXVECTOR3 centre;
+		float radius;
+		item.model->GetBoundingSphere( centre, radius );
+		if (!frustum.IsSphereInside( centre, radius )) continue;
+
+		// A box the camera is in (or nearly, allowing for the near clip) is clipped and its result is meaningless - draw the model
+		float depth = centre.x * viewMatrix._13 + centre.y * viewMatrix._23 + centre.z * viewMatrix._33 + viewMatrix._43;
+		float halfSize = radius + GetMargin( camera, depth + radius, occluderDepth );
+		D3DXVECTOR3 toCamera = camera->GetPosition( eye ) - centre;
+		float reach = halfSize + camera->GetNearClip();
+		if (fabs( toCamera.x ) < reach && fabs( toCamera.y ) < reach && fabs( toCamera.z ) < reach) continue;
+
+		D3DXMATRIX scale, translation;
+		D3DXMatrixScaling( &scale, halfSize, halfSize, halfSize );
+		D3DXMatrixTranslation( &translation, centre.x, centre.y, centre.z );
+		perObjectConstants.WorldMatrix = scale * translation;
+		g_pd3dDevice->UpdateSubresource( perObjectBuffer, 0, NULL, &perObjectConstants, 0, 0 );
+
+		query.predicate->Begin();
+		g_pd3dDevice->DrawIndexed( 36, 0, 0 );
+		query.predicate->End();
+		query.frame = m_Frame;
+		++m_NumQueries;
+	}
+}
+
+// Get the predicate to draw a model with (drawing is skipped if no part of its box was visible), or NULL if the model wasn't tested
+// in the last IssueQueries and must be drawn
+ID3D10Predicate* COcclusionCuller::GetPredicate( CModel* model )
+{
+	TQueryMap::iterator query = m_Queries.find( model );
+	if (query == m_Queries.end() || query->second.frame != m_Frame)
+	{
+		return NULL;
+	}
+	return query->second.predicate;
+}
+
+
+/////////////////////////////
+// Private member functions
+
+//**|3D|** Distance to grow a model's box by on each side so a hidden result in one eye is also right for the other eye. Eyes an
+// interocular distance i apart see a point at depth z shifted sideways by i * (z / zo - 1) relative to an occluder at depth zo, so
+// the box must grow by that much for the nearest occluder there can be. The eyes' frustum edges also differ by i * |1 - z / s|
+// (s the screen distance) at depth z. Never less than i
+float COcclusionCuller::GetMargin( CCamera* camera, float farDepth, float occluderDepth )
+{
+	float interocular = camera->GetInterocular();
+	float scale = max( 1.0f, fabs( farDepth / camera->GetScreenDistance() - 1.0f ) );
+	scale = max( scale, farDepth / occluderDepth - 1.0f );
+	return interocular * scale;
+}
@@ -0,0 +1,104 @@
+//--------------------------------------------------------------------------------------
+//	OcclusionCuller.h
+//
+//	Hardware occlusion culling between the eye passes. After the left eye is rendered a
+//	box around each queued model is tested against its depth buffer with an occlusion
+//	predicate, and the right eye's draws of the model are predicated on the result. The
+//	GPU skips the hidden models itself, the CPU never waits for the query results
+//--------------------------------------------------------------------------------------
+
+#ifndef OCCLUSION_CULLER_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define OCCLUSION_CULLER_H_INCLUDED
+
+#include <map>
+using namespace std;
+
+#include <d3d10.h>
+#include <d3dx10.h>
+#include "Camera.h"
+#include "Model.h"
+
+class CRenderQueue;
+
+
+class COcclusionCuller
+{
+/////////////////////////////
+// Private member variables
+private:
+
+	// A unit box (-1 to 1 on each axis) drawn as the stand-in for each model, world matrix from the per-object constants
+	ID3D10Buffer*      m_BoxVertexBuffer;
+	ID3D10Buffer*      m_BoxIndexBuffer;
+	ID3D10InputLayout* m_BoxLayout;
+
+	// Each model's predicate, created the first time the model is tested and reused every frame after. The frame number says whether
+	// the predicate was issued this frame, otherwise its result is stale and the model is drawn without predication
+	struct SModelQuery
+	{
+		ID3D10Predicate* predicate;
+		unsigned int     frame;
+	};
+	typedef map<CModel*, SModelQuery> TQueryMap;
+	TQueryMap          m_Queries;
+	unsigned int       m_Frame;
+
+	// Models tested in the last IssueQueries
+	unsigned int       m_NumQueries;
+
+
+/////////////////////////////
+// Public member functions
+public:
+
+	///////////////////////////////
+	// Constructors / Destructors
+
+	COcclusionCuller();
+	~COcclusionCuller();
+
+	// Create the box geometry, with the vertex layout taken from the given box technique. Returns true on success
+	bool Init( ID3D10EffectTechnique* boxTechnique );
+
+	// Release the box geometry and all the predicates
+	void ReleaseResources();
+
+
+	/////////////////////////////
+	// Occlusion tests
+
+	// Test a box around each opaque model in the queue against the depth buffer of the given eye, just rendered, using the given
+	// technique (depth test only, no writes) and the per-object constant buffer. The per-eye constants must still be those of that eye.
+	// The results are for the other eye's draws. Pass the distance from the camera inside which occluders other than the queued models
+	// (e.g. instanced models) may lie, as it limits how far the other eye can see round them (see GetMargin)
+	//**|3D|** Models not entirely inside the tested eye's frustum are not tested - the other eye may see the part that was clipped
+	void IssueQueries( CRenderQueue* queue, CCamera* camera, EStereoscopic eye, float occluderDistance,
+	                   ID3D10EffectTechnique* boxTechnique, ID3D10Buffer* perObjectBuffer );
+
+	// Get the predicate to draw a model with (drawing is skipped if no part of its box was visible), or NULL if the model wasn't tested
+	// in the last IssueQueries and must be drawn
+	ID3D10Predicate* GetPredicate( CModel* model );
+
+	unsigned int GetNumQueries()
+	{
+		return m_NumQueries;
+	}
+
+
+/////////////////////////////
+// Private member functions
+private:
+
+	//**|3D|** Distance to grow a model's box by on each side so a hidden result in one eye is also right for the other eye. Eyes an
+	// interocular distance i apart see a point at depth z shifted sideways by i * (z / zo - 1) relative to an occluder at depth zo, so
+	// the box must grow by that much for the nearest occluder there can be. The eyes' frustum edges also differ by i * |1 - z / s|
+	// (s the screen distance) at depth z. Never less than i
+	static float GetMargin( CCamera* camera, float farDepth, float occluderDepth );
+
+	// Disallow use of copy constructor and assignment operator (private and not defined)
+	COcclusionCuller( const COcclusionCuller& );
+	COcclusionCuller& operator=( const COcclusionCuller& );
+};
+
+
+#endif // End of header guard - see top of file
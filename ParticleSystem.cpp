@@ -0,0 +1,239 @@
+//--------------------------------------------------------------------------------------
+//	ParticleSystem.cpp
+//
+//	A particle system simulated entirely on the GPU. Each frame a geometry shader ages and
+//	moves the particles and creates new ones from the emitters, streaming the result out
+//	to a second vertex buffer, which is then drawn as sprites. The two buffers swap roles
+//	every frame, so the CPU never touches the particles
+//--------------------------------------------------------------------------------------
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+#include "Defines.h"        // General definitions shared by all source files
+#include "ParticleSystem.h" // Declaration of this class
+#include "ResourceRegistry.h" // Counted in the buffer memory
+
+
+// A particle as stored in the vertex buffers. Must match PARTICLE in Stereoscopic.fx and the stream-output declaration there
+struct SParticleVertex
+{
+	D3DXVECTOR3 position; // Offset from the system position for emitters
+	D3DXVECTOR3 velocity;
+	float       age;
+	UINT        type;     // 0 for emitters, 1 for the particles they create
+};
+
+// Longest time step simulated in a frame - a pause of more than a few frames is treated as a short one
+const float CParticleSystem::MaxTimeStep = 0.1f;
+
+
+///////////////////////////////
+// Constructors / Destructors
+
+CParticleSystem::CParticleSystem()
+{
+	m_MaxParticles = 0;
+	m_SeedBuffer = NULL;
+	m_Buffers[0] = NULL;
+	m_Buffers[1] = NULL;
+	m_Current = 0;
+	m_Seeded = false;
+	m_Layout = NULL;
+	m_ConstantBuffer = NULL;
+	m_RandomSeed = 1;
+}
+
+CParticleSystem::~CParticleSystem()
+{
+	ReleaseResources();
+}
+
+// Create the buffers for a particle system with the given settings. The layout of the particles is taken from the given simulation
+// technique. Returns true on success
+bool CParticleSystem::Init( const SParticleSettings& settings, ID3D10EffectTechnique* advanceTechnique )
+{
+	ReleaseResources();
+	m_Settings = settings;
+	if (m_Settings.numEmitters == 0 || m_Settings.emitRate <= 0.0f || m_Settings.life <= 0.0f) return false;
+
+	// Each emitter has at most rate * life particles alive, plus those created in the current frame. This must not be too small:
+	// the emitters are mixed in with the particles in the buffer, so an emitter could be dropped as easily as a particle
+	unsigned int particlesPerEmitter = static_cast<unsigned int>(ceil( m_Settings.emitRate * m_Settings.life )) + MaxEmitPerFrame;
+	m_MaxParticles = m_Settings.numEmitters * (particlesPerEmitter + 1);
+
+	// Emitters spread through the sphere around the position, each part way through its emit interval so they don't all emit on the
+	// same frame
+	m_RandomSeed = 1;
+	vector<SParticleVertex> emitters( m_Settings.numEmitters );
+	for (unsigned int emitter = 0; emitter < m_Settings.numEmitters; ++emitter)
+	{
+		D3DXVECTOR3 offset;
+		do
+		{
+			offset = D3DXVECTOR3( Random(), Random(), Random() ) * 2.0f - D3DXVECTOR3( 1.0f, 1.0f, 1.0f );
+		} while (D3DXVec3LengthSq( &offset ) > 1.0f);
+		emitters[emitter].position = offset * m_Settings.emitterRadius;
+		emitters[emitter].velocity = D3DXVECTOR3( 0.0f, 0.0f, 0.0f );
+		emitters[emitter].age = Random() / m_Settings.emitRate;
+		emitters[emitter].type = 0;
+	}
+
+	D3D10_BUFFER_DESC bufferDesc;
+	bufferDesc.BindFlags = D3D10_BIND_VERTEX_BUFFER;
+	bufferDesc.Usage = D3D10_USAGE_IMMUTABLE;
+	bufferDesc.ByteWidth = m_Settings.numEmitters * sizeof(SParticleVertex);
+	bufferDesc.CPUAccessFlags = 0;
+	bufferDesc.MiscFlags = 0;
+	D3D10_SUBRESOURCE_DATA initData;
+	initData.pSysMem = &emitters[0];
+	if (FAILED( g_Resources.CreateBuffer( ResourceBuffer, &bufferDesc, &initData, &m_SeedBuffer ) ))
+	{
+		return false;
+	}
+
+	// Written only by the GPU stream output
+	bufferDesc.BindFlags = D3D10_BIND_VERTEX_BUFFER | D3D10_BIND_STREAM_OUTPUT;
+	bufferDesc.Usage = D3D10_USAGE_DEFAULT;
+	bufferDesc.ByteWidth = m_MaxParticles * sizeof(SParticleVertex);
+	for (unsigned int buffer = 0; buffer < 2; ++buffer)
+	{
+		if (FAILED( g_Resources.CreateBuffer( ResourceBuffer, &bufferDesc, NULL, &m_Buffers[buffer] ) ))
+		{
+			return false;
+		}
+	}
+
+	// Rewritten every frame, so dynamic
+	bufferDesc.BindFlags = D3D10_BIND_CONSTANT_BUFFER;
+	bufferDesc.Usage = D3D10_USAGE_DYNAMIC;
+	bufferDesc.ByteWidth = sizeof(SParticleConstants);
+	bufferDesc.CPUAccessFlags = D3D10_CPU_ACCESS_WRITE;
+	if (FAILED( g_Resources.CreateBuffer( ResourceBuffer, &bufferDesc, NULL, &m_ConstantBuffer ) ))
+	{
+		return false;
+	}
+
+	D3D10_INPUT_ELEMENT_DESC vertexElts[] =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0,  0, D3D10_INPUT_PER_VERTEX_DATA, 0 },
+		{ "VELOCITY", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D10_INPUT_PER_VERTEX_DATA, 0 },
+		{ "AGE",      0, DXGI_FORMAT_R32_FLOAT,       0, 24, D3D10_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TYPE",     0, DXGI_FORMAT_R32_UINT,        0, 28, D3D10_INPUT_PER_VERTEX_DATA, 0 },
+	};
+	D3D10_PASS_DESC PassDesc;
+	advanceTechnique->GetPassByIndex( 0 )->GetDesc( &PassDesc );
+	if (FAILED( g_pd3dDevice->CreateInputLayout( vertexElts, sizeof(vertexElts) / sizeof(vertexElts[0]), PassDesc.pIAInputSignature,
+	                                             PassDesc.IAInputSignatureSize, &m_Layout ) ))
+	{
+		return false;
+	}
+
+	Reset();
+	return true;
+}
+
+// Release the GPU buffers
+void CParticleSystem::ReleaseResources()
+{
+	SAFE_RELEASE( m_Layout );
+	SAFE_RELEASE( m_ConstantBuffer );
+	SAFE_RELEASE( m_Buffers[1] );
+	SAFE_RELEASE( m_Buffers[0] );
+	SAFE_RELEASE( m_SeedBuffer );
+	m_MaxParticles = 0;
+	m_Seeded = false;
+}
+
+
+/////////////////////////////
+// Simulation and rendering
+
+// Remove all the particles and restart the emitters from the seed buffer, e.g. so a benchmark always starts from the same state
+void CParticleSystem::Reset()
+{
+	m_Seeded = false;
+	m_Current = 0;
+	m_RandomSeed = 1;
+}
+
+// Simulate the particles for the given time using the given stream-output technique and the effect's particle constant buffer.
+// Call once per frame, before the particles are drawn for either eye
+void CParticleSystem::Advance( ID3D10EffectTechnique* advanceTechnique, ID3D10EffectConstantBuffer* constantsVar, float frameTime )
+{
+	if (!m_ConstantBuffer) return;
+
+	// Settings are copied every frame so they can change while the system runs (e.g. the position)
+	m_Constants.EmitterPos = m_Settings.position;
+	m_Constants.EmitInterval = 1.0f / m_Settings.emitRate;
+	m_Constants.EmitVelocity = m_Settings.velocity;
+	m_Constants.EmitSpread = m_Settings.spread;
+	m_Constants.ParticleAcceleration = m_Settings.acceleration;
+	m_Constants.ParticleLife = m_Settings.life;
+	m_Constants.ParticleColour = D3DXVECTOR4( m_Settings.colour.x, m_Settings.colour.y, m_Settings.colour.z, m_Settings.opacity );
+	m_Constants.ParticleStartSize = m_Settings.startSize;
+	m_Constants.ParticleEndSize = m_Settings.endSize;
+	m_Constants.ParticleTimeStep = min( frameTime, MaxTimeStep );
+	m_Constants.ParticleSeed = m_RandomSeed++ * 0x9E3779B9; // Spread consecutive frames' seeds across the range
+	void* bufferData;
+	if (SUCCEEDED( m_ConstantBuffer->Map( D3D10_MAP_WRITE_DISCARD, 0, &bufferData ) ))
+	{
+		memcpy( bufferData, &m_Constants, sizeof(SParticleConstants) );
+		m_ConstantBuffer->Unmap();
+	}
+	constantsVar->SetConstantBuffer( m_ConstantBuffer );
+
+	// The source must be bound as the input before the other buffer is bound as the output - a buffer can't be both at once
+	unsigned int target = 1 - m_Current;
+	ID3D10Buffer* source = m_Seeded ? m_Buffers[m_Current] : m_SeedBuffer;
+	UINT stride = sizeof(SParticleVertex);
+	UINT offset = 0;
+	g_pd3dDevice->IASetInputLayout( m_Layout );
+	g_pd3dDevice->IASetPrimitiveTopology( D3D10_PRIMITIVE_TOPOLOGY_POINTLIST );
+	g_pd3dDevice->IASetVertexBuffers( 0, 1, &source, &stride, &offset );
+	g_pd3dDevice->SOSetTargets( 1, &m_Buffers[target], &offset );
+
+	advanceTechnique->GetPassByIndex( 0 )->Apply( 0 );
+	if (m_Seeded)
+	{
+		g_pd3dDevice->DrawAuto(); // Draws as many particles as the last simulation streamed out, without the CPU reading the count
+	}
+	else
+	{
+		g_pd3dDevice->Draw( m_Settings.numEmitters, 0 );
+	}
+
+	// Unbind the output so the buffer can be drawn from
+	ID3D10Buffer* noBuffer = NULL;
+	g_pd3dDevice->SOSetTargets( 1, &noBuffer, &offset );
+	m_Current = target;
+	m_Seeded = true;
+}
+
+// Draw the particles with the given sprite technique, which should be of the stereo variant if the technique renders both eyes
+void CParticleSystem::Render( ID3D10EffectTechnique* technique, ID3D10EffectConstantBuffer* constantsVar )
+{
+	if (!m_Seeded) return;
+
+	constantsVar->SetConstantBuffer( m_ConstantBuffer );
+	UINT stride = sizeof(SParticleVertex);
+	UINT offset = 0;
+	g_pd3dDevice->IASetInputLayout( m_Layout );
+	g_pd3dDevice->IASetPrimitiveTopology( D3D10_PRIMITIVE_TOPOLOGY_POINTLIST );
+	g_pd3dDevice->IASetVertexBuffers( 0, 1, &m_Buffers[m_Current], &stride, &offset );
+	technique->GetPassByIndex( 0 )->Apply( 0 );
+	g_pd3dDevice->DrawAuto();
+}
+
+
+/////////////////////////////
+// Private member functions
+
+// Random number from 0 to 1, steps on the random seed (a simple linear congruential generator, repeatable unlike rand)
+float CParticleSystem::Random()
+{
+	m_RandomSeed = m_RandomSeed * 1664525 + 1013904223;
+	return (m_RandomSeed >> 8) * (1.0f / 16777216.0f);
+}
@@ -0,0 +1,145 @@
+//--------------------------------------------------------------------------------------
+//	ParticleSystem.h
+//
+//	A particle system simulated entirely on the GPU. Each frame a geometry shader ages and
+//	moves the particles and creates new ones from the emitters, streaming the result out
+//	to a second vertex buffer, which is then drawn as sprites. The two buffers swap roles
+//	every frame, so the CPU never touches the particles
+//--------------------------------------------------------------------------------------
+
+#ifndef PARTICLE_SYSTEM_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define PARTICLE_SYSTEM_H_INCLUDED
+
+#include <d3d10.h>
+#include <d3dx10.h>
+#include "ShaderConstants.h"
+
+
+// Settings of a particle system. The emitters are spread at random through a sphere around the position, each creates particles at
+// the given rate with the given velocity plus a random amount up to the spread
+struct SParticleSettings
+{
+	D3DXVECTOR3  position;
+	float        emitterRadius;
+	unsigned int numEmitters;
+	float        emitRate;     // Particles per second from each emitter
+	D3DXVECTOR3  velocity;
+	float        spread;
+	D3DXVECTOR3  acceleration; // E.g. gravity for sparks, a gentle rise for smoke
+	float        life;         // Seconds
+	float        startSize;    // Half width of the sprite when created and when it dies
+	float        endSize;
+	D3DXVECTOR3  colour;
+	float        opacity;      // 0 adds the particle's light to the scene (e.g. sparks), 1 covers the scene behind (e.g. smoke)
+};
+
+
+class CParticleSystem
+{
+/////////////////////////////
+// Public constants
+public:
+
+	// Most new particles one emitter creates in a frame - the particles to create in a slow frame are capped at this. Must match
+	// MAX_EMIT_PER_FRAME in Stereoscopic.fx, which sets the size of the simulation geometry shader's output
+	static const unsigned int MaxEmitPerFrame = 16;
+
+	// Longest time step simulated in one frame, so a pause (e.g. loading) doesn't make the particles jump
+	static const float MaxTimeStep;
+
+
+/////////////////////////////
+// Private member variables
+private:
+
+	SParticleSettings   m_Settings;
+
+	// Most particles the buffers hold, including the emitters. Sized for every emitter's particles over their whole life plus a frame's
+	// new particles, so none are lost
+	unsigned int        m_MaxParticles;
+
+	// The emitters in their starting state, copied into the simulation on the first frame (and after a reset)
+	ID3D10Buffer*       m_SeedBuffer;
+
+	// The two particle buffers, both vertex buffers and stream-output targets. Each frame the current one is simulated into the other,
+	// which becomes current. Until the first simulation the particles are in the seed buffer
+	ID3D10Buffer*       m_Buffers[2];
+	unsigned int        m_Current;
+	bool                m_Seeded;
+
+	ID3D10InputLayout*  m_Layout;
+
+	// Settings and time step for the shaders, rewritten each frame
+	SParticleConstants  m_Constants;
+	ID3D10Buffer*       m_ConstantBuffer;
+
+	// Seed for the random emitter positions, and counter for the shaders' random number seed
+	unsigned int        m_RandomSeed;
+
+
+/////////////////////////////
+// Public member functions
+public:
+
+	///////////////////////////////
+	// Constructors / Destructors
+
+	CParticleSystem();
+	~CParticleSystem();
+
+	// Create the buffers for a particle system with the given settings. The layout of the particles is taken from the given simulation
+	// technique. Returns true on success
+	bool Init( const SParticleSettings& settings, ID3D10EffectTechnique* advanceTechnique );
+
+	// Release the GPU buffers
+	void ReleaseResources();
+
+
+	/////////////////////////////
+	// Settings
+
+	const SParticleSettings& GetSettings()
+	{
+		return m_Settings;
+	}
+
+	// Move the emitters, e.g. to follow a light. Particles already created stay where they are
+	void SetPosition( const D3DXVECTOR3& position )
+	{
+		m_Settings.position = position;
+	}
+
+	unsigned int GetMaxParticles()
+	{
+		return m_MaxParticles;
+	}
+
+
+	/////////////////////////////
+	// Simulation and rendering
+
+	// Remove all the particles and restart the emitters from the seed buffer, e.g. so a benchmark always starts from the same state
+	void Reset();
+
+	// Simulate the particles for the given time using the given stream-output technique and the effect's particle constant buffer.
+	// Call once per frame, before the particles are drawn for either eye
+	void Advance( ID3D10EffectTechnique* advanceTechnique, ID3D10EffectConstantBuffer* constantsVar, float frameTime );
+
+	// Draw the particles with the given sprite technique, which should be of the stereo variant if the technique renders both eyes
+	void Render( ID3D10EffectTechnique* technique, ID3D10EffectConstantBuffer* constantsVar );
+
+
+/////////////////////////////
+// Private member functions
+private:
+
+	// Random number from 0 to 1, steps on the random seed
+	float Random();
+
+	// Disallow use of copy constructor and assignment operator (private and not defined)
+	CParticleSystem( const CParticleSystem& );
+	CParticleSystem& operator=( const CParticleSystem& );
+};
+
+
+#endif // End of header guard - see top of file
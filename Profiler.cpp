@@ -0,0 +1,328 @@
+//--------------------------------------------------------------------------------------
+//	Profiler.cpp
+//
+//	The profiler times each phase of a frame on the CPU (with CTimer) and on the GPU (with
+//	timestamp queries). The last few hundred frames are kept for statistics, which can be
+//	drawn on screen or written to a CSV file
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <fstream>
+#include <stdio.h>
+using namespace std;
+
+#include "Defines.h"  // General definitions shared by all source files
+#include "Profiler.h" // Declaration of this class
+#include "ResourceRegistry.h" // Memory use shown under the timings
+
+
+// Names of the scopes for display and CSV headings, in the order of EProfileScope
+static const char* ScopeNames[NumProfileScopes] =
+{
+	"Frame",
+	"Setup",
+	"Left eye",
+	"Right eye",
+	"Stereo eyes",
+	"Reproject",
+	"Composite",
+	"Capture",
+	"Overlay",
+	"Present",
+};
+
+
+///////////////////////////////
+// Constructors / Destructors
+
+CProfiler::CProfiler()
+{
+	ZeroMemory( m_QueryFrames, sizeof(m_QueryFrames) );
+	m_Frame = 0;
+	m_NumFrames = 0;
+	m_Font = NULL;
+	m_InFrame = false;
+	for (int scope = 0; scope < NumProfileScopes; ++scope)
+	{
+		m_CPUStart[scope] = 0.0f;
+		m_LatestGPU[scope] = -1.0f;
+	}
+}
+
+CProfiler::~CProfiler()
+{
+	ReleaseResources();
+}
+
+
+// Create the GPU queries and overlay font. Returns true on success
+bool CProfiler::Init()
+{
+	D3D10_QUERY_DESC disjointDesc = { D3D10_QUERY_TIMESTAMP_DISJOINT, 0 };
+	D3D10_QUERY_DESC timestampDesc = { D3D10_QUERY_TIMESTAMP, 0 };
+	for (unsigned int frame = 0; frame < NumQueryFrames; ++frame)
+	{
+		SQueryFrame& queryFrame = m_QueryFrames[frame];
+		if (FAILED( g_pd3dDevice->CreateQuery( &disjointDesc, &queryFrame.disjoint ) )) return false;
+		for (int scope = 0; scope < NumProfileScopes; ++scope)
+		{
+			if (FAILED( g_pd3dDevice->CreateQuery( &timestampDesc, &queryFrame.begin[scope] ) )) return false;
+			if (FAILED( g_pd3dDevice->CreateQuery( &timestampDesc, &queryFrame.end[scope] ) )) return false;
+		}
+		queryFrame.pending = false;
+	}
+
+	if (FAILED( D3DX10CreateFont( g_pd3dDevice, 14, 0, FW_NORMAL, 1, FALSE, DEFAULT_CHARSET, OUT_DEFAULT_PRECIS,
+	                              DEFAULT_QUALITY, FIXED_PITCH | FF_MODERN, L"Consolas", &m_Font ) ))
+	{
+		return false;
+	}
+
+	m_Timer.Reset();
+	m_Timer.Start();
+	return true;
+}
+
+// Release the queries and font
+void CProfiler::ReleaseResources()
+{
+	for (unsigned int frame = 0; frame < NumQueryFrames; ++frame)
+	{
+		SQueryFrame& queryFrame = m_QueryFrames[frame];
+		SAFE_RELEASE( queryFrame.disjoint );
+		for (int scope = 0; scope < NumProfileScopes; ++scope)
+		{
+			SAFE_RELEASE( queryFrame.begin[scope] );
+			SAFE_RELEASE( queryFrame.end[scope] );
+		}
+		queryFrame.pending = false;
+	}
+	SAFE_RELEASE( m_Font );
+}
+
+
+/////////////////////////////
+// Timing
+
+// Mark the start and end of a frame. All scopes must be within a frame
+void CProfiler::BeginFrame()
+{
+	// Reuse the oldest set of queries, collecting its results first if that hasn't happened yet
+	SQueryFrame& queryFrame = m_QueryFrames[m_Frame % NumQueryFrames];
+	if (queryFrame.pending)
+	{
+		CollectQueries( queryFrame );
+	}
+
+	// Clear this frame's sample
+	SFrameSample& sample = m_History[m_Frame % HistorySize];
+	for (int scope = 0; scope < NumProfileScopes; ++scope)
+	{
+		sample.cpu[scope] = -1.0f;
+		sample.gpu[scope] = -1.0f;
+		queryFrame.used[scope] = false;
+	}
+
+	queryFrame.frame = m_Frame;
+	if (queryFrame.disjoint) queryFrame.disjoint->Begin();
+	m_InFrame = true;
+}
+
+void CProfiler::EndFrame()
+{
+	if (!m_InFrame) return;
+
+	SQueryFrame& queryFrame = m_QueryFrames[m_Frame % NumQueryFrames];
+	if (queryFrame.disjoint)
+	{
+		queryFrame.disjoint->End();
+		queryFrame.pending = true;
+	}
+
+	++m_Frame;
+	if (m_NumFrames < HistorySize) ++m_NumFrames;
+	m_InFrame = false;
+}
+
+
+// Mark the start and end of a scope within the frame
+void CProfiler::Begin( EProfileScope scope )
+{
+	if (!m_InFrame) return;
+
+	m_CPUStart[scope] = m_Timer.GetTime();
+
+	// Timestamp queries only have an end, which records the time when the GPU reaches it
+	SQueryFrame& queryFrame = m_QueryFrames[m_Frame % NumQueryFrames];
+	if (scope != ProfilePresent && queryFrame.begin[scope])
+	{
+		queryFrame.begin[scope]->End();
+	}
+}
+
+void CProfiler::End( EProfileScope scope )
+{
+	if (!m_InFrame) return;
+
+	m_History[m_Frame % HistorySize].cpu[scope] = (m_Timer.GetTime() - m_CPUStart[scope]) * 1000.0f;
+
+	SQueryFrame& queryFrame = m_QueryFrames[m_Frame % NumQueryFrames];
+	if (scope != ProfilePresent && queryFrame.end[scope])
+	{
+		queryFrame.end[scope]->End();
+		queryFrame.used[scope] = true;
+	}
+}
+
+
+/////////////////////////////
+// Results
+
+// Get statistics for a scope over the frames in the history, from CPU or GPU times
+void CProfiler::GetStats( EProfileScope scope, bool gpu, SProfileStats* stats )
+{
+	// Gather the valid samples
+	static float values[HistorySize];
+	unsigned int numValues = 0;
+	float total = 0.0f;
+	for (unsigned int frame = 0; frame < m_NumFrames; ++frame)
+	{
+		float value = gpu ? m_History[frame].gpu[scope] : m_History[frame].cpu[scope];
+		if (value >= 0.0f)
+		{
+			values[numValues++] = value;
+			total += value;
+		}
+	}
+
+	stats->numSamples = numValues;
+	if (numValues == 0)
+	{
+		stats->min = stats->average = stats->max = stats->percentile95 = stats->percentile99 = 0.0f;
+		return;
+	}
+
+	sort( values, values + numValues );
+	stats->min = values[0];
+	stats->max = values[numValues - 1];
+	stats->average = total / numValues;
+	stats->percentile95 = values[(numValues - 1) * 95 / 100];
+	stats->percentile99 = values[(numValues - 1) * 99 / 100];
+}
+
+
+// Draw the statistics for each scope, then the memory use of each resource category, as text in the top-left of the current render target
+void CProfiler::RenderOverlay()
+{
+	if (!m_Font) return;
+
+	char text[2048];
+	int length = sprintf_s( text, "%-12s %27s   %27s\n%-12s %8s %8s %8s   %8s %8s %8s\n", "",
+	                        "CPU ms", "GPU ms", "Scope", "avg", "p99", "max", "avg", "p99", "max" );
+	for (int scope = 0; scope < NumProfileScopes; ++scope)
+	{
+		SProfileStats cpu, gpu;
+		GetStats( static_cast<EProfileScope>(scope), false, &cpu );
+		GetStats( static_cast<EProfileScope>(scope), true, &gpu );
+		if (cpu.numSamples == 0) continue;
+
+		length += sprintf_s( text + length, sizeof(text) - length, "%-12s %8.2f %8.2f %8.2f   %8.2f %8.2f %8.2f\n", ScopeNames[scope],
+		                     cpu.average, cpu.percentile99, cpu.max, gpu.average, gpu.percentile99, gpu.max );
+	}
+
+	// Memory use of each resource category, with its high-water mark and budget
+	length += sprintf_s( text + length, sizeof(text) - length, "\n%-12s %8s %8s %8s   %8s %8s\n", "Memory", "MB", "peak", "budget",
+	                     "objects", "views" );
+	for (int category = 0; category < NumResourceCategories; ++category)
+	{
+		SResourceStats stats;
+		g_Resources.GetStats( static_cast<EResourceCategory>(category), &stats );
+		length += sprintf_s( text + length, sizeof(text) - length, "%-12s %8.1f %8.1f %8.1f   %8u %8u%s\n",
+		                     CResourceRegistry::GetCategoryName( static_cast<EResourceCategory>(category) ),
+		                     stats.bytes / (1024.0 * 1024.0), stats.peakBytes / (1024.0 * 1024.0), stats.budget / (1024.0 * 1024.0),
+		                     stats.numObjects, stats.numViews, (stats.budget > 0 && stats.bytes > stats.budget) ? " over" : "" );
+	}
+	UINT64 gpuBytes, peakGPUBytes;
+	g_Resources.GetGPUTotals( &gpuBytes, &peakGPUBytes );
+	length += sprintf_s( text + length, sizeof(text) - length, "%-12s %8.1f %8.1f\n", "GPU total",
+	                     gpuBytes / (1024.0 * 1024.0), peakGPUBytes / (1024.0 * 1024.0) );
+
+	RECT rect = { 8, 8, 0, 0 };
+	m_Font->DrawTextA( NULL, text, -1, &rect, DT_LEFT | DT_NOCLIP, D3DXCOLOR( 1.0f, 1.0f, 0.0f, 1.0f ) );
+}
+
+
+// Write every frame in the history to a CSV file, one row per frame with CPU and GPU times for each scope. Returns true on success
+bool CProfiler::WriteCSV( const string& fileName )
+{
+	ofstream file( fileName.c_str() );
+	if (!file)
+	{
+		return false;
+	}
+
+	file << "Frame";
+	for (int scope = 0; scope < NumProfileScopes; ++scope)
+	{
+		file << "," << ScopeNames[scope] << " CPU," << ScopeNames[scope] << " GPU";
+	}
+	file << "\n";
+
+	// Oldest frame first. Unused scopes and missing GPU times are left empty
+	for (unsigned int frame = m_Frame - m_NumFrames; frame != m_Frame; ++frame)
+	{
+		const SFrameSample& sample = m_History[frame % HistorySize];
+		file << frame;
+		for (int scope = 0; scope < NumProfileScopes; ++scope)
+		{
+			file << ",";
+			if (sample.cpu[scope] >= 0.0f) file << sample.cpu[scope];
+			file << ",";
+			if (sample.gpu[scope] >= 0.0f) file << sample.gpu[scope];
+		}
+		file << "\n";
+	}
+
+	return file.good();
+}
+
+
+const char* CProfiler::GetScopeName( EProfileScope scope )
+{
+	return ScopeNames[scope];
+}
+
+
+/////////////////////////////
+// Private member functions
+
+// Collect the GPU times from a set of queries into the history, if available. If the results are not ready the GPU times for that
+// frame are dropped - waiting would stall the CPU until the GPU catches up, which would spoil the CPU timings
+void CProfiler::CollectQueries( SQueryFrame& queryFrame )
+{
+	queryFrame.pending = false;
+	UINT flags = D3D10_ASYNC_GETDATA_DONOTFLUSH;
+
+	// Frequency of the timestamps. If the GPU clock changed during the frame (disjoint) the timestamps can't be used
+	D3D10_QUERY_DATA_TIMESTAMP_DISJOINT disjointData;
+	if (queryFrame.disjoint->GetData( &disjointData, sizeof(disjointData), flags ) != S_OK ||
+	    disjointData.Disjoint || disjointData.Frequency == 0)
+	{
+		return;
+	}
+
+	SFrameSample& sample = m_History[queryFrame.frame % HistorySize];
+	for (int scope = 0; scope < NumProfileScopes; ++scope)
+	{
+		if (!queryFrame.used[scope]) continue;
+
+		// The disjoint query has completed, so the timestamps inside it have too
+		UINT64 begin, end;
+		if (queryFrame.begin[scope]->GetData( &begin, sizeof(begin), flags ) == S_OK &&
+		    queryFrame.end[scope]->GetData( &end, sizeof(end), flags ) == S_OK)
+		{
+			sample.gpu[scope] = static_cast<float>(static_cast<double>(end - begin) * 1000.0 / disjointData.Frequency);
+			m_LatestGPU[scope] = sample.gpu[scope];
+		}
+	}
+}
@@ -0,0 +1,154 @@
+//--------------------------------------------------------------------------------------
+//	Profiler.h
+//
+//	The profiler times each phase of a frame on the CPU (with CTimer) and on the GPU (with
+//	timestamp queries). The last few hundred frames are kept for statistics, which can be
+//	drawn on screen or written to a CSV file
+//--------------------------------------------------------------------------------------
+
+#ifndef PROFILER_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define PROFILER_H_INCLUDED
+
+#include <string>
+using namespace std;
+
+#include <d3d10.h>
+#include <d3dx10.h>
+#include "CTimer.h"
+
+
+// The phases of a frame that are timed. Scopes may be nested (the whole frame contains all the others)
+enum EProfileScope
+{
+	ProfileFrame,      // Whole of RenderScene
+	ProfileSetup,      // Per-frame constants and render queue building
+	ProfileLeftEye,    // Two-pass stereo, left eye
+	ProfileRightEye,   // Two-pass stereo, right eye
+	ProfileStereoEyes, // Single-pass stereo, both eyes
+	ProfileReproject,  // Reprojection of the left eye to make the right
+	ProfileComposite,  // Anaglyph full-screen pass
+	ProfileCapture,    // Copying the frame for recording, and reading back the frame from a few frames ago
+	ProfileOverlay,    // Drawing this profiler's text
+	ProfilePresent,    // SwapChain->Present - CPU only, GPU timestamps around Present are not meaningful
+	NumProfileScopes
+};
+
+// Statistics for one scope over the frames in the history (milliseconds)
+struct SProfileStats
+{
+	unsigned int numSamples; // Frames in which the scope was used (other values are 0 if none)
+	float min;
+	float average;
+	float max;
+	float percentile95;
+	float percentile99;
+};
+
+
+class CProfiler
+{
+/////////////////////////////
+// Private member variables
+private:
+
+	// GPU queries take a few frames to produce results, so a set of queries is kept for each frame in flight. If results are still not
+	// available when a set is needed again, that frame's GPU times are dropped rather than stalling
+	static const unsigned int NumQueryFrames = 4;
+	struct SQueryFrame
+	{
+		ID3D10Query*  disjoint;                    // Gives the timestamp frequency, and whether the timestamps are valid
+		ID3D10Query*  begin[NumProfileScopes];     // Timestamps at start and end of each scope
+		ID3D10Query*  end[NumProfileScopes];
+		bool          used[NumProfileScopes];
+		unsigned int  frame;                       // Frame number these queries were issued in
+		bool          pending;                     // Issued but results not yet collected
+	};
+	SQueryFrame   m_QueryFrames[NumQueryFrames];
+
+	// Ring buffer of recent frame samples. Times in ms, negative if the scope wasn't used or the GPU time wasn't available
+	static const unsigned int HistorySize = 512;
+	struct SFrameSample
+	{
+		float cpu[NumProfileScopes];
+		float gpu[NumProfileScopes];
+	};
+	SFrameSample  m_History[HistorySize];
+	float         m_LatestGPU[NumProfileScopes]; // Most recent GPU time collected for each scope, negative if none yet
+	unsigned int  m_Frame;       // Current frame number, index into history is this modulo history size
+	unsigned int  m_NumFrames;   // Number of valid frames in history
+
+	// CPU timing
+	CTimer        m_Timer;
+	float         m_CPUStart[NumProfileScopes];
+
+	// Overlay text
+	ID3DX10Font*  m_Font;
+	bool          m_InFrame;
+
+
+/////////////////////////////
+// Public member functions
+public:
+
+	///////////////////////////////
+	// Constructors / Destructors
+
+	CProfiler();
+	~CProfiler();
+
+	// Create the GPU queries and overlay font. Returns true on success
+	bool Init();
+
+	// Release the queries and font
+	void ReleaseResources();
+
+
+	/////////////////////////////
+	// Timing
+
+	// Mark the start and end of a frame. All scopes must be within a frame
+	void BeginFrame();
+	void EndFrame();
+
+	// Mark the start and end of a scope within the frame
+	void Begin( EProfileScope scope );
+	void End( EProfileScope scope );
+
+
+	/////////////////////////////
+	// Results
+
+	// Get statistics for a scope over the frames in the history, from CPU or GPU times
+	void GetStats( EProfileScope scope, bool gpu, SProfileStats* stats );
+
+	// Get the most recent GPU time collected for a scope in ms. GPU times arrive a few frames late. Negative if none available
+	float GetLatestGPUTime( EProfileScope scope )
+	{
+		return m_LatestGPU[scope];
+	}
+
+	// Draw the statistics for each scope, then the memory use of each resource category, as text in the top-left of the current
+	// render target
+	void RenderOverlay();
+
+	// Write every frame in the history to a CSV file, one row per frame with CPU and GPU times for each scope. Returns true on success
+	bool WriteCSV( const string& fileName );
+
+	static const char* GetScopeName( EProfileScope scope );
+
+
+/////////////////////////////
+// Private member functions
+private:
+
+	// Collect the GPU times from a set of queries into the history, if available. If the results are not ready the GPU times for that
+	// frame are dropped rather than waiting
+	void CollectQueries( SQueryFrame& queryFrame );
+
+	// Disallow use of copy constructor and assignment operator (private and not defined)
+	CProfiler( const CProfiler& );
+	CProfiler& operator=( const CProfiler& );
+};
+
+
+#endif // End of header guard - see top of file
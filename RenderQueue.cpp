@@ -0,0 +1,302 @@
+//--------------------------------------------------------------------------------------
+//	RenderQueue.cpp
+//
+//	A render queue collects the draws for a frame, sorts them by render state and then
+//	issues them, only changing the state that actually differs between draws
+//--------------------------------------------------------------------------------------
+
+#include <algorithm>
+using namespace std;
+
+#include "Defines.h"         // General definitions shared by all source files
+#include "RenderQueue.h"     // Declaration of this class
+#include "ShaderConstants.h" // Per-object constants uploaded for each draw
+#include "OcclusionCuller.h" // Predicates for the draws of occlusion-tested models
+
+///////////////////////////////
+// Constructors / Destructors
+
+CRenderQueue::CRenderQueue()
+{
+	m_NumStateChanges = 0;
+	m_NumDraws = 0;
+	m_FrontToBack = true;
+}
+
+
+/////////////////////////////
+// Queue usage
+
+// Register a technique with the queue. Blended techniques are drawn after all the opaque ones, and techniques of the same kind in
+// the order they were registered (techniques not registered are opaque and drawn last). Returns the technique's ID
+unsigned int CRenderQueue::RegisterTechnique( ID3D10EffectTechnique* technique, bool blended /*= false*/ )
+{
+	unsigned int index = GetTechniqueIndex( technique );
+	m_Techniques[index].blended = blended;
+	return index;
+}
+
+// Remove all submitted draws, ready for a new frame. Techniques stay registered
+void CRenderQueue::Clear()
+{
+	m_Items.clear();
+
+	// The texture and layout IDs are only compared within a frame, so they start again each frame. Otherwise the lists would keep the
+	// views and layouts released by reloads, and grow until the IDs wrap round in the sort key
+	m_Textures.clear();
+	m_Layouts.clear();
+}
+
+
+// Submit a draw to the queue. Draws the whole model unless a sub-mesh is given. Opaque draws may have a depth-only technique for
+// the depth pre-pass (see Flush)
+void CRenderQueue::Submit( CModel* model, ID3D10ShaderResourceView* diffuseMap, ID3D10EffectTechnique* technique,
+                           float depth, unsigned int numInstances /*= 1*/, const D3DXVECTOR3& tint /*= D3DXVECTOR3(1, 1, 1)*/,
+                           ID3D10EffectTechnique* depthTechnique /*= NULL*/, unsigned int subMesh /*= AllSubMeshes*/ )
+{
+	SDrawItem item;
+	item.model = model;
+	item.subMesh = subMesh;
+	item.technique = technique;
+	item.depthTechnique = depthTechnique;
+	item.diffuseMap = diffuseMap;
+	item.tint = tint;
+	item.numInstances = numInstances;
+	item.depth = depth;
+
+	// Sort key, most significant first: layer (2 bits - opaque, background, blended), then for opaque draws sorted front to back,
+	// depth (32 bits), technique (8 bits), vertex layout (8 bits), texture (14 bits). Otherwise technique, vertex layout, texture and
+	// depth last. A positive float's bits sort in the same order as the float itself, so the depth can be used directly (negative
+	// depths clamped to 0)
+	unsigned int techniqueIndex = GetTechniqueIndex( technique );
+	unsigned __int64 layer = m_Techniques[techniqueIndex].blended ? 2 : (model->IsBackground() ? 1 : 0);
+	float keyDepth = max( depth, 0.0f );
+	unsigned __int64 depthBits = *reinterpret_cast<unsigned int*>(&keyDepth);
+	unsigned __int64 state = (static_cast<unsigned __int64>(techniqueIndex & 0xff) << 22) |
+	                         (static_cast<unsigned __int64>(GetLayoutIndex( model->GetMesh() ? model->GetMesh()->GetVertexLayout() : NULL ) & 0xff) << 14) |
+	                         (static_cast<unsigned __int64>(GetTextureIndex( diffuseMap ) & 0x3fff));
+	if (m_FrontToBack && layer == 0)
+	{
+		item.sortKey = (layer << 62) | (depthBits << 30) | state;
+	}
+	else
+	{
+		item.sortKey = (layer << 62) | (state << 32) | depthBits;
+	}
+
+	m_Items.push_back( item );
+}
+
+
+// Sort predicate for draw items
+static bool DrawItemLess( const SDrawItem& item1, const SDrawItem& item2 )
+{
+	return item1.sortKey < item2.sortKey;
+}
+
+// Sort the submitted draws: opaque, then background, then blended. Opaque draws are sorted by depth (front to back) then by
+// technique, vertex layout and texture. Or with front to back sorting off, and for the other draws, by technique, vertex layout,
+// texture and then depth
+void CRenderQueue::Sort()
+{
+	stable_sort( m_Items.begin(), m_Items.end(), DrawItemLess );
+}
+
+
+// Draw the mesh of a queued model (or the item's sub-mesh) at the model's level of detail, assuming its constants are already uploaded.
+// A posed model (see CModel::SetNodeMatrix) has a different world matrix for each node, so each of its sub-meshes is drawn separately
+// with its own constants. Skinned meshes get their node matrices from the bone palette, so are drawn in one go however they are posed
+static void DrawItemMesh( const SDrawItem& item, CMesh* mesh, ID3D10Buffer* perObjectBuffer, SPerObjectConstants& perObjectConstants )
+{
+	unsigned int lod = item.model->GetLod();
+	if (!item.model->IsPosed() || mesh->IsSkinned())
+	{
+		if (item.subMesh == AllSubMeshes)
+		{
+			mesh->Draw( item.numInstances, lod );
+		}
+		else
+		{
+			mesh->DrawSubMesh( item.subMesh, item.numInstances, lod );
+		}
+		return;
+	}
+
+	unsigned int firstSubMesh = (item.subMesh == AllSubMeshes) ? 0 : item.subMesh;
+	unsigned int lastSubMesh  = (item.subMesh == AllSubMeshes) ? mesh->GetNumSubMeshes() - 1 : item.subMesh;
+	for (unsigned int subMesh = firstSubMesh; subMesh <= lastSubMesh; ++subMesh)
+	{
+		perObjectConstants.WorldMatrix = item.model->GetSubMeshWorldMatrix( subMesh );
+		g_pd3dDevice->UpdateSubresource( perObjectBuffer, 0, NULL, &perObjectConstants, 0, 0 );
+		mesh->DrawSubMesh( subMesh, item.numInstances, lod );
+	}
+}
+
+
+// Issue all the draws in their current order, only setting state that differs from the previous draw. The per-object constants
+// are uploaded to the given buffer before each draw and the diffuse map set through the given effect variable. May be called
+// several times after one sort (e.g. once per eye). For the depth pre-pass, only the draws with a depth technique are issued,
+// using that technique and no textures
+void CRenderQueue::Flush( ID3D10Buffer* perObjectBuffer, ID3D10EffectShaderResourceVariable* diffuseMapVar, bool depthPrepass /*= false*/,
+                          COcclusionCuller* occlusion /*= NULL*/ )
+{
+	m_NumStateChanges = 0;
+	m_NumDraws = 0;
+
+	// No state can be assumed at the start of a flush, other rendering may have happened since the last one
+	ID3D10EffectTechnique*    currentTechnique = NULL;
+	ID3D10ShaderResourceView* currentTexture = NULL;
+	CMesh*                    currentMesh = NULL;
+	ID3D10InputLayout*        currentLayout = NULL;
+	ID3D10Buffer*             currentVertexBuffer = NULL;
+	ID3D10Buffer*             currentIndexBuffer = NULL;
+	ID3D10Predicate*          currentPredicate = NULL;
+	bool                      applied = false;
+
+	// All models are triangle lists
+	g_pd3dDevice->IASetPrimitiveTopology( D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
+
+	SPerObjectConstants perObjectConstants;
+	for (vector<SDrawItem>::iterator item = m_Items.begin(); item != m_Items.end(); ++item)
+	{
+		CMesh* mesh = item->model->GetMesh();
+		ID3D10EffectTechnique* technique = depthPrepass ? item->depthTechnique : item->technique;
+		if (!mesh || !technique)
+		{
+			continue;
+		}
+
+		// Occlusion predicate - the GPU skips the draws if the model's box was hidden. Predication is device state outside the effect
+		if (occlusion)
+		{
+			ID3D10Predicate* predicate = occlusion->GetPredicate( item->model );
+			if (predicate != currentPredicate)
+			{
+				g_pd3dDevice->SetPredication( predicate, FALSE ); // Skip while the predicate is FALSE (no samples passed)
+				currentPredicate = predicate;
+				++m_NumStateChanges;
+			}
+		}
+
+		// Per-object constants are in our own constant buffer, which stays bound to the device. So updating its contents doesn't
+		// require the technique to be applied again
+		perObjectConstants.WorldMatrix   = item->model->GetWorldMatrix();
+		perObjectConstants.TintColour    = item->tint;
+		perObjectConstants.MeshPosScale  = mesh->GetPositionScale();
+		perObjectConstants.MeshPosOffset = mesh->GetPositionOffset();
+		perObjectConstants.BoneOffset    = item->model->GetPaletteOffset();
+		g_pd3dDevice->UpdateSubresource( perObjectBuffer, 0, NULL, &perObjectConstants, 0, 0 );
+
+		// Geometry state - each part only set if it differs from the last draw. Models sharing a mesh share all of it
+		if (mesh != currentMesh)
+		{
+			if (mesh->GetVertexLayout() != currentLayout)
+			{
+				currentLayout = mesh->GetVertexLayout();
+				g_pd3dDevice->IASetInputLayout( currentLayout );
+				++m_NumStateChanges;
+			}
+			if (mesh->GetVertexBuffer() != currentVertexBuffer)
+			{
+				currentVertexBuffer = mesh->GetVertexBuffer();
+				UINT vertexSize = mesh->GetVertexSize();
+				UINT offset = 0;
+				g_pd3dDevice->IASetVertexBuffers( 0, 1, &currentVertexBuffer, &vertexSize, &offset );
+				++m_NumStateChanges;
+			}
+			if (mesh->GetIndexBuffer() != currentIndexBuffer)
+			{
+				currentIndexBuffer = mesh->GetIndexBuffer();
+				g_pd3dDevice->IASetIndexBuffer( currentIndexBuffer, mesh->GetIndexFormat(), 0 );
+				++m_NumStateChanges;
+			}
+			currentMesh = mesh;
+		}
+
+		// Effect state - changing the technique or texture needs the technique pass applied, otherwise the previous apply stands. The
+		// depth pre-pass has no pixel shader, so its textures are left alone
+		unsigned int techniqueIndex = GetTechniqueIndex( technique );
+		UINT numPasses = m_Techniques[techniqueIndex].numPasses;
+		if (!depthPrepass && (item->diffuseMap != currentTexture || currentTechnique == NULL))
+		{
+			diffuseMapVar->SetResource( item->diffuseMap );
+			currentTexture = item->diffuseMap;
+			applied = false;
+		}
+		if (technique != currentTechnique)
+		{
+			currentTechnique = technique;
+			applied = false;
+		}
+
+		// Single pass techniques only need applying when something changed. Multi-pass techniques apply each pass for every draw
+		if (numPasses == 1)
+		{
+			if (!applied)
+			{
+				currentTechnique->GetPassByIndex( 0 )->Apply( 0 );
+				applied = true;
+				++m_NumStateChanges;
+			}
+			DrawItemMesh( *item, mesh, perObjectBuffer, perObjectConstants );
+			++m_NumDraws;
+		}
+		else
+		{
+			for (UINT p = 0; p < numPasses; ++p)
+			{
+				currentTechnique->GetPassByIndex( p )->Apply( 0 );
+				DrawItemMesh( *item, mesh, perObjectBuffer, perObjectConstants );
+				++m_NumStateChanges;
+				++m_NumDraws;
+			}
+			applied = false;
+		}
+	}
+
+	// Later rendering isn't predicated
+	if (currentPredicate)
+	{
+		g_pd3dDevice->SetPredication( NULL, FALSE );
+	}
+}
+
+
+/////////////////////////////
+// Private member functions
+
+// Find the index of a technique in the list, adding it if not found
+unsigned int CRenderQueue::GetTechniqueIndex( ID3D10EffectTechnique* technique )
+{
+	for (unsigned int i = 0; i < m_Techniques.size(); ++i)
+	{
+		if (m_Techniques[i].technique == technique) return i;
+	}
+
+	STechniqueInfo info;
+	info.technique = technique;
+	D3D10_TECHNIQUE_DESC techDesc;
+	technique->GetDesc( &techDesc );
+	info.numPasses = techDesc.Passes;
+	info.blended = false;
+	m_Techniques.push_back( info );
+	return static_cast<unsigned int>(m_Techniques.size() - 1);
+}
+
+// Find the index of a texture in the list, adding it if not found
+unsigned int CRenderQueue::GetTextureIndex( ID3D10ShaderResourceView* texture )
+{
+	vector<ID3D10ShaderResourceView*>::iterator found = find( m_Textures.begin(), m_Textures.end(), texture );
+	if (found != m_Textures.end()) return static_cast<unsigned int>(found - m_Textures.begin());
+	m_Textures.push_back( texture );
+	return static_cast<unsigned int>(m_Textures.size() - 1);
+}
+
+// Find the index of a vertex layout in the list, adding it if not found
+unsigned int CRenderQueue::GetLayoutIndex( ID3D10InputLayout* layout )
+{
+	vector<ID3D10InputLayout*>::iterator found = find( m_Layouts.begin(), m_Layouts.end(), layout );
+	if (found != m_Layouts.end()) return static_cast<unsigned int>(found - m_Layouts.begin());
+	m_Layouts.push_back( layout );
+	return static_cast<unsigned int>(m_Layouts.size() - 1);
+}
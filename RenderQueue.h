@@ -0,0 +1,163 @@
+//--------------------------------------------------------------------------------------
+//	RenderQueue.h
+//
+//	A render queue collects the draws for a frame, sorts them by render state and then
+//	issues them, only changing the state that actually differs between draws
+//--------------------------------------------------------------------------------------
+
+#ifndef RENDER_QUEUE_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define RENDER_QUEUE_H_INCLUDED
+
+#include <vector>
+using namespace std;
+
+#include <d3d10.h>
+#include <d3dx10.h>
+#include "Model.h"
+
+class COcclusionCuller;
+
+
+// Sub-mesh number for a draw of the whole model
+const unsigned int AllSubMeshes = ~0u;
+
+// A single draw submitted to the queue - a model (or one of its sub-meshes), how to render it and the data it needs
+struct SDrawItem
+{
+	CModel*                   model;
+	unsigned int              subMesh;        // Sub-mesh to draw, or AllSubMeshes
+	ID3D10EffectTechnique*    technique;
+	ID3D10EffectTechnique*    depthTechnique; // Technique for the depth pre-pass, NULL if not drawn in it (e.g. blended models)
+	ID3D10ShaderResourceView* diffuseMap;
+	D3DXVECTOR3               tint;
+	unsigned int              numInstances;
+	float                     depth;   // Distance from camera, used to sort draws front to back
+	unsigned __int64          sortKey; // Built from the values above when submitted - see CRenderQueue::Submit
+};
+
+
+class CRenderQueue
+{
+/////////////////////////////
+// Private member variables
+private:
+
+	// Draws submitted this frame
+	vector<SDrawItem> m_Items;
+
+	// Techniques known to the queue, in the order given to RegisterTechnique. This order is also the draw order among techniques of
+	// the same kind. Also caches the pass count of each technique (saves a GetDesc per draw)
+	struct STechniqueInfo
+	{
+		ID3D10EffectTechnique* technique;
+		UINT                   numPasses;
+		bool                   blended;
+	};
+	vector<STechniqueInfo> m_Techniques;
+
+	// Whether opaque draws are sorted by depth before state, see SetFrontToBack
+	bool m_FrontToBack;
+
+	// Textures and vertex layouts seen this frame, used to give each a small ID for the sort key
+	vector<ID3D10ShaderResourceView*> m_Textures;
+	vector<ID3D10InputLayout*>        m_Layouts;
+
+	// Count of state changes and draws issued by the last Flush, for checking the effect of sorting
+	unsigned int m_NumStateChanges;
+	unsigned int m_NumDraws;
+
+
+/////////////////////////////
+// Public member functions
+public:
+
+	///////////////////////////////
+	// Constructors / Destructors
+
+	CRenderQueue();
+
+
+	/////////////////////////////
+	// Queue usage
+
+	// Register a technique with the queue. Blended techniques are drawn after all the opaque ones, and techniques of the same kind in
+	// the order they were registered (techniques not registered are opaque and drawn last). Returns the technique's ID
+	unsigned int RegisterTechnique( ID3D10EffectTechnique* technique, bool blended = false );
+
+	// Forget all the registered techniques, e.g. when the effect is reloaded. Draws already submitted must be cleared before a Flush
+	void ClearTechniques()
+	{
+		m_Techniques.clear();
+	}
+
+	// Choose how opaque draws are sorted by the next Submits. Front to back (the default) draws the nearest models first so the depth
+	// test rejects the pixels they hide before shading them, at the cost of more state changes. Otherwise opaque draws are sorted by
+	// state first, like blended draws always are. Background models (see CModel::SetBackground) are drawn after the other opaque
+	// models either way
+	void SetFrontToBack( bool frontToBack )
+	{
+		m_FrontToBack = frontToBack;
+	}
+	bool GetFrontToBack()
+	{
+		return m_FrontToBack;
+	}
+
+	// Remove all submitted draws, ready for a new frame. Techniques stay registered, texture and layout IDs are reset
+	void Clear();
+
+	// Submit a draw to the queue. Draws the whole model unless a sub-mesh is given. Opaque draws may have a depth-only technique for
+	// the depth pre-pass (see Flush)
+	void Submit( CModel* model, ID3D10ShaderResourceView* diffuseMap, ID3D10EffectTechnique* technique,
+	             float depth, unsigned int numInstances = 1, const D3DXVECTOR3& tint = D3DXVECTOR3(1, 1, 1),
+	             ID3D10EffectTechnique* depthTechnique = NULL, unsigned int subMesh = AllSubMeshes );
+
+	// Sort the submitted draws: opaque, then background, then blended. Opaque draws are sorted by depth (front to back) then by
+	// technique, vertex layout and texture. Or with front to back sorting off, and for the other draws, by technique, vertex layout,
+	// texture and then depth
+	void Sort();
+
+	// Issue all the draws in their current order, only setting state that differs from the previous draw. The per-object constants
+	// are uploaded to the given buffer before each draw and the diffuse map set through the given effect variable. May be called
+	// several times after one sort (e.g. once per eye). For the depth pre-pass, only the draws with a depth technique are issued,
+	// using that technique and no textures. With an occlusion culler, draws of the models it tested are predicated on the results
+	// (see COcclusionCuller::GetPredicate)
+	void Flush( ID3D10Buffer* perObjectBuffer, ID3D10EffectShaderResourceVariable* diffuseMapVar, bool depthPrepass = false,
+	            COcclusionCuller* occlusion = NULL );
+
+	// The submitted draws, in sorted order after a Sort
+	unsigned int GetNumItems()
+	{
+		return static_cast<unsigned int>(m_Items.size());
+	}
+	const SDrawItem& GetItem( unsigned int item )
+	{
+		return m_Items[item];
+	}
+
+
+	/////////////////////////////
+	// Statistics
+
+	unsigned int GetNumStateChanges()
+	{
+		return m_NumStateChanges;
+	}
+	unsigned int GetNumDraws()
+	{
+		return m_NumDraws;
+	}
+
+
+/////////////////////////////
+// Private member functions
+private:
+
+	// Find the index of a technique / texture / layout in the lists above, adding it if not found
+	unsigned int GetTechniqueIndex( ID3D10EffectTechnique* technique );
+	unsigned int GetTextureIndex( ID3D10ShaderResourceView* texture );
+	unsigned int GetLayoutIndex( ID3D10InputLayout* layout );
+};
+
+
+#endif // End of header guard - see top of file
@@ -0,0 +1,459 @@
+//--------------------------------------------------------------------------------------
+//	ResourceRegistry.cpp
+//
+//	Keeps count of the memory used by the GPU resources and the CPU-side import data, by
+//	category, with high-water marks and optional budgets. Resources are created through
+//	the registry (or given to it afterwards) and are counted until DirectX destroys them
+//--------------------------------------------------------------------------------------
+
+#include <stdio.h>
+
+#include "Defines.h"          // General definitions shared by all source files
+#include "ResourceRegistry.h" // Declaration of this class
+
+// Names of the categories for display and benchmark headings, in the order of EResourceCategory
+static const char* CategoryNames[NumResourceCategories] =
+{
+	"Mesh",
+	"Texture",
+	"Target",
+	"Depth",
+	"Buffer",
+	"Import",
+};
+
+// Private data slot the trackers are stored in on each resource and view {8E1C52A4-3F0B-4C6D-9A72-D15B6E0F4A93}
+static const GUID TrackerGUID = { 0x8e1c52a4, 0x3f0b, 0x4c6d, { 0x9a, 0x72, 0xd1, 0x5b, 0x6e, 0x0f, 0x4a, 0x93 } };
+
+
+// A tracker is attached to each counted resource or view as private data. DirectX holds a reference to it and releases it when the
+// object is destroyed, which takes the object out of the counts. So no code that releases resources needs to know about the registry
+class CResourceTracker : public IUnknown
+{
+public:
+	CResourceTracker( CResourceRegistry* registry, EResourceCategory category, UINT64 bytes, bool view )
+		: m_RefCount( 1 ), m_Registry( registry ), m_Category( category ), m_Bytes( bytes ), m_View( view )
+	{
+		m_Registry->Add( m_Category, m_Bytes, m_View );
+	}
+
+	STDMETHODIMP QueryInterface( REFIID riid, void** object )
+	{
+		if (riid == IID_IUnknown)
+		{
+			*object = static_cast<IUnknown*>(this);
+			AddRef();
+			return S_OK;
+		}
+		*object = NULL;
+		return E_NOINTERFACE;
+	}
+
+	STDMETHODIMP_(ULONG) AddRef()
+	{
+		return InterlockedIncrement( &m_RefCount );
+	}
+
+	STDMETHODIMP_(ULONG) Release()
+	{
+		LONG refCount = InterlockedDecrement( &m_RefCount );
+		if (refCount == 0)
+		{
+			m_Registry->Remove( m_Category, m_Bytes, m_View );
+			delete this;
+		}
+		return refCount;
+	}
+
+private:
+	LONG               m_RefCount;
+	CResourceRegistry* m_Registry;
+	EResourceCategory  m_Category;
+	UINT64             m_Bytes;
+	bool               m_View;
+};
+
+
+///////////////////////////////
+// Constructors / Destructors
+
+CResourceRegistry::CResourceRegistry()
+{
+	InitializeCriticalSection( &m_Lock );
+	ZeroMemory( m_Stats, sizeof(m_Stats) );
+	ZeroMemory( m_Warned, sizeof(m_Warned) );
+	m_GPUBytes = 0;
+	m_PeakGPUBytes = 0;
+}
+
+CResourceRegistry::~CResourceRegistry()
+{
+	DeleteCriticalSection( &m_Lock );
+}
+
+
+/////////////////////////////
+// Resource creation
+
+HRESULT CResourceRegistry::CreateBuffer( EResourceCategory category, const D3D10_BUFFER_DESC* desc, const D3D10_SUBRESOURCE_DATA* initData,
+                                         ID3D10Buffer** buffer )
+{
+	HRESULT hr = g_pd3dDevice->CreateBuffer( desc, initData, buffer );
+	if (SUCCEEDED( hr ))
+	{
+		Attach( *buffer, category, desc->ByteWidth, false );
+	}
+	return hr;
+}
+
+HRESULT CResourceRegistry::CreateTexture2D( EResourceCategory category, const D3D10_TEXTURE2D_DESC* desc,
+                                            const D3D10_SUBRESOURCE_DATA* initData, ID3D10Texture2D** texture )
+{
+	HRESULT hr = g_pd3dDevice->CreateTexture2D( desc, initData, texture );
+	if (SUCCEEDED( hr ))
+	{
+		// A MipLevels of 0 in the description means a full chain, so get the size from the texture created
+		Attach( *texture, category, GetResourceSize( *texture ), false );
+	}
+	return hr;
+}
+
+HRESULT CResourceRegistry::CreateShaderResourceView( EResourceCategory category, ID3D10Resource* resource,
+                                                     const D3D10_SHADER_RESOURCE_VIEW_DESC* desc, ID3D10ShaderResourceView** view )
+{
+	HRESULT hr = g_pd3dDevice->CreateShaderResourceView( resource, desc, view );
+	if (SUCCEEDED( hr ))
+	{
+		Attach( *view, category, 0, true );
+	}
+	return hr;
+}
+
+HRESULT CResourceRegistry::CreateRenderTargetView( EResourceCategory category, ID3D10Resource* resource,
+                                                   const D3D10_RENDER_TARGET_VIEW_DESC* desc, ID3D10RenderTargetView** view )
+{
+	HRESULT hr = g_pd3dDevice->CreateRenderTargetView( resource, desc, view );
+	if (SUCCEEDED( hr ))
+	{
+		Attach( *view, category, 0, true );
+	}
+	return hr;
+}
+
+HRESULT CResourceRegistry::CreateDepthStencilView( EResourceCategory category, ID3D10Resource* resource,
+                                                   const D3D10_DEPTH_STENCIL_VIEW_DESC* desc, ID3D10DepthStencilView** view )
+{
+	HRESULT hr = g_pd3dDevice->CreateDepthStencilView( resource, desc, view );
+	if (SUCCEEDED( hr ))
+	{
+		Attach( *view, category, 0, true );
+	}
+	return hr;
+}
+
+
+// Count a resource created elsewhere (e.g. by D3DX or the swap chain) in the given category, until it is destroyed. Counting a
+// resource again replaces its previous entry, so it is safe to call more than once
+void CResourceRegistry::Track( ID3D10Resource* resource, EResourceCategory category )
+{
+	if (resource)
+	{
+		Attach( resource, category, GetResourceSize( resource ), false );
+	}
+}
+
+// Count a view created elsewhere, and the resource it views
+void CResourceRegistry::Track( ID3D10View* view, EResourceCategory category )
+{
+	if (!view) return;
+
+	ID3D10Resource* resource;
+	view->GetResource( &resource );
+	Track( resource, category );
+	resource->Release();
+	Attach( view, category, 0, true );
+}
+
+
+/////////////////////////////
+// CPU memory
+
+// Count CPU memory allocated or freed in the given category, e.g. import data
+void CResourceRegistry::AddCPU( EResourceCategory category, UINT64 bytes )
+{
+	Add( category, bytes, false );
+}
+
+void CResourceRegistry::RemoveCPU( EResourceCategory category, UINT64 bytes )
+{
+	Remove( category, bytes, false );
+}
+
+
+/////////////////////////////
+// Budgets
+
+// Set the most memory the given category should use, 0 for no budget. Going over a budget is reported once to the debugger, and
+// callers can choose smaller resources (see IsOverBudget and Fits)
+void CResourceRegistry::SetBudget( EResourceCategory category, UINT64 bytes )
+{
+	EnterCriticalSection( &m_Lock );
+	m_Stats[category].budget = bytes;
+	m_Warned[category] = false;
+	LeaveCriticalSection( &m_Lock );
+}
+
+// Whether the given category is using more than its budget
+bool CResourceRegistry::IsOverBudget( EResourceCategory category )
+{
+	EnterCriticalSection( &m_Lock );
+	const SResourceStats& stats = m_Stats[category];
+	bool overBudget = (stats.budget > 0 && stats.bytes > stats.budget);
+	LeaveCriticalSection( &m_Lock );
+	return overBudget;
+}
+
+// Whether a new resource of the given size would keep the category within its budget
+bool CResourceRegistry::Fits( EResourceCategory category, UINT64 bytes )
+{
+	EnterCriticalSection( &m_Lock );
+	const SResourceStats& stats = m_Stats[category];
+	bool fits = (stats.budget == 0 || stats.bytes + bytes <= stats.budget);
+	LeaveCriticalSection( &m_Lock );
+	return fits;
+}
+
+
+/////////////////////////////
+// Statistics
+
+void CResourceRegistry::GetStats( EResourceCategory category, SResourceStats* stats )
+{
+	EnterCriticalSection( &m_Lock );
+	*stats = m_Stats[category];
+	LeaveCriticalSection( &m_Lock );
+}
+
+// Total and peak of all the GPU categories
+void CResourceRegistry::GetGPUTotals( UINT64* bytes, UINT64* peakBytes )
+{
+	EnterCriticalSection( &m_Lock );
+	*bytes = m_GPUBytes;
+	*peakBytes = m_PeakGPUBytes;
+	LeaveCriticalSection( &m_Lock );
+}
+
+const char* CResourceRegistry::GetCategoryName( EResourceCategory category )
+{
+	return CategoryNames[category];
+}
+
+
+// Memory used by a resource, from its size, format, mip-maps, array slices and samples. Drivers pad and align resources, so the real
+// use is a little higher, but this is the part the app controls
+UINT64 CResourceRegistry::GetResourceSize( ID3D10Resource* resource )
+{
+	D3D10_RESOURCE_DIMENSION dimension;
+	resource->GetType( &dimension );
+	switch (dimension)
+	{
+		case D3D10_RESOURCE_DIMENSION_BUFFER:
+		{
+			D3D10_BUFFER_DESC desc;
+			static_cast<ID3D10Buffer*>(resource)->GetDesc( &desc );
+			return desc.ByteWidth;
+		}
+		case D3D10_RESOURCE_DIMENSION_TEXTURE2D:
+		{
+			D3D10_TEXTURE2D_DESC desc;
+			static_cast<ID3D10Texture2D*>(resource)->GetDesc( &desc );
+			return GetTextureSize( desc );
+		}
+		case D3D10_RESOURCE_DIMENSION_TEXTURE1D:
+		{
+			// Treated as a texture of height 1
+			D3D10_TEXTURE1D_DESC desc1D;
+			static_cast<ID3D10Texture1D*>(resource)->GetDesc( &desc1D );
+			D3D10_TEXTURE2D_DESC desc;
+			ZeroMemory( &desc, sizeof(desc) );
+			desc.Width = desc1D.Width;
+			desc.Height = 1;
+			desc.MipLevels = desc1D.MipLevels;
+			desc.ArraySize = desc1D.ArraySize;
+			desc.Format = desc1D.Format;
+			desc.SampleDesc.Count = 1;
+			return GetTextureSize( desc );
+		}
+		case D3D10_RESOURCE_DIMENSION_TEXTURE3D:
+		{
+			// Each mip-map of a volume has half the slices of the one before
+			D3D10_TEXTURE3D_DESC desc3D;
+			static_cast<ID3D10Texture3D*>(resource)->GetDesc( &desc3D );
+			D3D10_TEXTURE2D_DESC desc;
+			ZeroMemory( &desc, sizeof(desc) );
+			desc.Width = desc3D.Width;
+			desc.Height = desc3D.Height;
+			desc.MipLevels = 1;
+			desc.ArraySize = 1;
+			desc.Format = desc3D.Format;
+			desc.SampleDesc.Count = 1;
+			UINT64 size = 0;
+			for (UINT mip = 0; mip < desc3D.MipLevels; ++mip)
+			{
+				size += GetTextureSize( desc ) * max( desc3D.Depth >> mip, 1u );
+				desc.Width = max( desc.Width / 2, 1u );
+				desc.Height = max( desc.Height / 2, 1u );
+			}
+			return size;
+		}
+	}
+	return 0;
+}
+
+// Memory used by a texture description. MipLevels must be set (not 0)
+UINT64 CResourceRegistry::GetTextureSize( const D3D10_TEXTURE2D_DESC& desc )
+{
+	// Block-compressed formats are stored as 4x4 blocks of 8 or 16 bytes, the rest by bits per texel
+	UINT blockBytes = 0;
+	UINT bits = 32;
+	switch (desc.Format)
+	{
+		case DXGI_FORMAT_BC1_TYPELESS: case DXGI_FORMAT_BC1_UNORM: case DXGI_FORMAT_BC1_UNORM_SRGB:
+		case DXGI_FORMAT_BC4_TYPELESS: case DXGI_FORMAT_BC4_UNORM: case DXGI_FORMAT_BC4_SNORM:
+			blockBytes = 8;
+			break;
+		case DXGI_FORMAT_BC2_TYPELESS: case DXGI_FORMAT_BC2_UNORM: case DXGI_FORMAT_BC2_UNORM_SRGB:
+		case DXGI_FORMAT_BC3_TYPELESS: case DXGI_FORMAT_BC3_UNORM: case DXGI_FORMAT_BC3_UNORM_SRGB:
+		case DXGI_FORMAT_BC5_TYPELESS: case DXGI_FORMAT_BC5_UNORM: case DXGI_FORMAT_BC5_SNORM:
+			blockBytes = 16;
+			break;
+		case DXGI_FORMAT_R32G32B32A32_TYPELESS: case DXGI_FORMAT_R32G32B32A32_FLOAT:
+		case DXGI_FORMAT_R32G32B32A32_UINT: case DXGI_FORMAT_R32G32B32A32_SINT:
+			bits = 128;
+			break;
+		case DXGI_FORMAT_R32G32B32_TYPELESS: case DXGI_FORMAT_R32G32B32_FLOAT:
+		case DXGI_FORMAT_R32G32B32_UINT: case DXGI_FORMAT_R32G32B32_SINT:
+			bits = 96;
+			break;
+		case DXGI_FORMAT_R16G16B16A16_TYPELESS: case DXGI_FORMAT_R16G16B16A16_FLOAT: case DXGI_FORMAT_R16G16B16A16_UNORM:
+		case DXGI_FORMAT_R16G16B16A16_UINT: case DXGI_FORMAT_R16G16B16A16_SNORM: case DXGI_FORMAT_R16G16B16A16_SINT:
+		case DXGI_FORMAT_R32G32_TYPELESS: case DXGI_FORMAT_R32G32_FLOAT: case DXGI_FORMAT_R32G32_UINT: case DXGI_FORMAT_R32G32_SINT:
+		case DXGI_FORMAT_R32G8X24_TYPELESS: case DXGI_FORMAT_D32_FLOAT_S8X24_UINT:
+		case DXGI_FORMAT_R32_FLOAT_X8X24_TYPELESS: case DXGI_FORMAT_X32_TYPELESS_G8X24_UINT:
+			bits = 64;
+			break;
+		case DXGI_FORMAT_R16G16_TYPELESS: case DXGI_FORMAT_R16G16_FLOAT: case DXGI_FORMAT_R16G16_UNORM:
+		case DXGI_FORMAT_R16G16_UINT: case DXGI_FORMAT_R16G16_SNORM: case DXGI_FORMAT_R16G16_SINT:
+			bits = 32;
+			break;
+		case DXGI_FORMAT_R16_TYPELESS: case DXGI_FORMAT_R16_FLOAT: case DXGI_FORMAT_D16_UNORM: case DXGI_FORMAT_R16_UNORM:
+		case DXGI_FORMAT_R16_UINT: case DXGI_FORMAT_R16_SNORM: case DXGI_FORMAT_R16_SINT:
+		case DXGI_FORMAT_R8G8_TYPELESS: case DXGI_FORMAT_R8G8_UNORM: case DXGI_FORMAT_R8G8_UINT:
+		case DXGI_FORMAT_R8G8_SNORM: case DXGI_FORMAT_R8G8_SINT:
+		case DXGI_FORMAT_B5G6R5_UNORM: case DXGI_FORMAT_B5G5R5A1_UNORM:
+			bits = 16;
+			break;
+		case DXGI_FORMAT_R8_TYPELESS: case DXGI_FORMAT_R8_UNORM: case DXGI_FORMAT_R8_UINT:
+		case DXGI_FORMAT_R8_SNORM: case DXGI_FORMAT_R8_SINT: case DXGI_FORMAT_A8_UNORM:
+			bits = 8;
+			break;
+		default: // The other formats in D3D10 are 32 bits per texel (8-bit RGBA, 10-bit, depth/stencil etc.)
+			break;
+	}
+
+	UINT64 size = 0;
+	UINT width = desc.Width;
+	UINT height = desc.Height;
+	for (UINT mip = 0; mip < desc.MipLevels; ++mip)
+	{
+		if (blockBytes > 0)
+		{
+			size += static_cast<UINT64>((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+		}
+		else
+		{
+			size += static_cast<UINT64>(width) * height * bits / 8;
+		}
+		width = max( width / 2, 1u );
+		height = max( height / 2, 1u );
+	}
+	return size * desc.ArraySize * max( desc.SampleDesc.Count, 1u );
+}
+
+
+/////////////////////////////
+// Private member functions
+
+// Add or remove a counted object, called with the object's size when it is counted and again (by its tracker) when destroyed
+void CResourceRegistry::Add( EResourceCategory category, UINT64 bytes, bool view )
+{
+	EnterCriticalSection( &m_Lock );
+	SResourceStats& stats = m_Stats[category];
+	if (view)
+	{
+		++stats.numViews;
+	}
+	else
+	{
+		++stats.numObjects;
+		stats.bytes += bytes;
+		stats.peakBytes = max( stats.peakBytes, stats.bytes );
+		if (category != ResourceImport)
+		{
+			m_GPUBytes += bytes;
+			m_PeakGPUBytes = max( m_PeakGPUBytes, m_GPUBytes );
+		}
+	}
+
+	// Report going over budget once, until the category is back under it
+	bool warn = (stats.budget > 0 && stats.bytes > stats.budget && !m_Warned[category]);
+	if (warn)
+	{
+		m_Warned[category] = true;
+	}
+	UINT64 used = stats.bytes;
+	UINT64 budget = stats.budget;
+	LeaveCriticalSection( &m_Lock );
+
+	if (warn)
+	{
+		char text[256];
+		sprintf_s( text, "Over %s memory budget: %.1f MB of %.1f MB\n", CategoryNames[category],
+		           used / (1024.0 * 1024.0), budget / (1024.0 * 1024.0) );
+		OutputDebugStringA( text );
+	}
+}
+
+void CResourceRegistry::Remove( EResourceCategory category, UINT64 bytes, bool view )
+{
+	EnterCriticalSection( &m_Lock );
+	SResourceStats& stats = m_Stats[category];
+	if (view)
+	{
+		--stats.numViews;
+	}
+	else
+	{
+		--stats.numObjects;
+		stats.bytes -= bytes;
+		if (category != ResourceImport)
+		{
+			m_GPUBytes -= bytes;
+		}
+		if (stats.bytes <= stats.budget)
+		{
+			m_Warned[category] = false;
+		}
+	}
+	LeaveCriticalSection( &m_Lock );
+}
+
+
+// Attach a tracker to a resource or view so it is counted until destroyed
+void CResourceRegistry::Attach( ID3D10DeviceChild* object, EResourceCategory category, UINT64 bytes, bool view )
+{
+	// The object takes its own reference to the tracker. If that fails, releasing this one removes it from the counts again
+	CResourceTracker* tracker = new CResourceTracker( this, category, bytes, view );
+	object->SetPrivateDataInterface( TrackerGUID, tracker );
+	tracker->Release();
+}
@@ -0,0 +1,150 @@
+//--------------------------------------------------------------------------------------
+//	ResourceRegistry.h
+//
+//	Keeps count of the memory used by the GPU resources and the CPU-side import data, by
+//	category, with high-water marks and optional budgets. Resources are created through
+//	the registry (or given to it afterwards) and are counted until DirectX destroys them
+//--------------------------------------------------------------------------------------
+
+#ifndef RESOURCE_REGISTRY_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define RESOURCE_REGISTRY_H_INCLUDED
+
+#include <windows.h>
+#include <d3d10.h>
+
+
+// What a resource is used for. Budgets and statistics are kept separately for each
+enum EResourceCategory
+{
+	ResourceMesh,         // Vertex and index buffers of meshes
+	ResourceTexture,      // Textures loaded from files
+	ResourceRenderTarget, // Back buffer, eye textures and other textures rendered to
+	ResourceDepth,        // Depth buffers
+	ResourceBuffer,       // Other GPU buffers: constants, instances, lights, particles, capture staging textures
+	ResourceImport,       // CPU memory used while loading meshes - the importer's data and the buffer data waiting for the GPU
+	NumResourceCategories
+};
+
+// Memory use of one category (bytes). Views take no memory of their own but are counted to help spot leaks
+struct SResourceStats
+{
+	UINT64       bytes;
+	UINT64       peakBytes;  // Most used at any time since the start
+	UINT64       budget;     // 0 if none
+	unsigned int numObjects; // Resources (or CPU allocations)
+	unsigned int numViews;
+};
+
+
+class CResourceRegistry
+{
+/////////////////////////////
+// Private member variables
+private:
+
+	// Resources are counted from several threads: meshes load on the job threads and D3D may destroy a resource on any thread that
+	// releases it last
+	CRITICAL_SECTION m_Lock;
+	SResourceStats   m_Stats[NumResourceCategories];
+	bool             m_Warned[NumResourceCategories]; // Warning given since the category last went over its budget
+
+	// All GPU categories together
+	UINT64           m_GPUBytes;
+	UINT64           m_PeakGPUBytes;
+
+
+/////////////////////////////
+// Public member functions
+public:
+
+	///////////////////////////////
+	// Constructors / Destructors
+
+	CResourceRegistry();
+	~CResourceRegistry();
+
+
+	/////////////////////////////
+	// Resource creation
+
+	// Create a resource or view with the device and count it in the given category. Same parameters and results as the
+	// ID3D10Device functions
+	HRESULT CreateBuffer( EResourceCategory category, const D3D10_BUFFER_DESC* desc, const D3D10_SUBRESOURCE_DATA* initData,
+	                      ID3D10Buffer** buffer );
+	HRESULT CreateTexture2D( EResourceCategory category, const D3D10_TEXTURE2D_DESC* desc, const D3D10_SUBRESOURCE_DATA* initData,
+	                         ID3D10Texture2D** texture );
+	HRESULT CreateShaderResourceView( EResourceCategory category, ID3D10Resource* resource, const D3D10_SHADER_RESOURCE_VIEW_DESC* desc,
+	                                  ID3D10ShaderResourceView** view );
+	HRESULT CreateRenderTargetView( EResourceCategory category, ID3D10Resource* resource, const D3D10_RENDER_TARGET_VIEW_DESC* desc,
+	                                ID3D10RenderTargetView** view );
+	HRESULT CreateDepthStencilView( EResourceCategory category, ID3D10Resource* resource, const D3D10_DEPTH_STENCIL_VIEW_DESC* desc,
+	                                ID3D10DepthStencilView** view );
+
+	// Count a resource created elsewhere (e.g. by D3DX or the swap chain) in the given category, until it is destroyed. Counting a
+	// resource again replaces its previous entry, so it is safe to call more than once
+	void Track( ID3D10Resource* resource, EResourceCategory category );
+
+	// Count a view created elsewhere, and the resource it views
+	void Track( ID3D10View* view, EResourceCategory category );
+
+
+	/////////////////////////////
+	// CPU memory
+
+	// Count CPU memory allocated or freed in the given category, e.g. import data
+	void AddCPU( EResourceCategory category, UINT64 bytes );
+	void RemoveCPU( EResourceCategory category, UINT64 bytes );
+
+
+	/////////////////////////////
+	// Budgets
+
+	// Set the most memory the given category should use, 0 for no budget. Going over a budget is reported once to the debugger, and
+	// callers can choose smaller resources (see IsOverBudget and Fits)
+	void SetBudget( EResourceCategory category, UINT64 bytes );
+
+	// Whether the given category is using more than its budget
+	bool IsOverBudget( EResourceCategory category );
+
+	// Whether a new resource of the given size would keep the category within its budget
+	bool Fits( EResourceCategory category, UINT64 bytes );
+
+
+	/////////////////////////////
+	// Statistics
+
+	void GetStats( EResourceCategory category, SResourceStats* stats );
+
+	// Total and peak of all the GPU categories
+	void GetGPUTotals( UINT64* bytes, UINT64* peakBytes );
+
+	static const char* GetCategoryName( EResourceCategory category );
+
+	// Memory used by a resource or texture description, from its size, format, mip-maps, array slices and samples
+	static UINT64 GetResourceSize( ID3D10Resource* resource );
+	static UINT64 GetTextureSize( const D3D10_TEXTURE2D_DESC& desc );
+
+
+/////////////////////////////
+// Private member functions
+private:
+
+	// Add or remove a counted object, called with the object's size when it is counted and again (by its tracker) when destroyed
+	void Add( EResourceCategory category, UINT64 bytes, bool view );
+	void Remove( EResourceCategory category, UINT64 bytes, bool view );
+	friend class CResourceTracker;
+
+	// Attach a tracker to a resource or view so it is counted until destroyed
+	void Attach( ID3D10DeviceChild* object, EResourceCategory category, UINT64 bytes, bool view );
+
+	// Disallow use of copy constructor and assignment operator (private and not defined)
+	CResourceRegistry( const CResourceRegistry& );
+	CResourceRegistry& operator=( const CResourceRegistry& );
+};
+
+
+// The registry used by the whole app (defined in Stereoscopic.cpp)
+extern CResourceRegistry g_Resources;
+
+
+#endif // End of header guard - see top of file
@@ -0,0 +1,349 @@
+//--------------------------------------------------------------------------------------
+//	Scene.cpp
+//
+//	The scene holds all the models and their transforms. Positions, rotations, scales and
+//	world matrices are kept in separate contiguous arrays (structure of arrays) and only
+//	the transforms that have changed are rebuilt each frame
+//--------------------------------------------------------------------------------------
+
+#include "Defines.h" // General definitions shared by all source files
+#include "Scene.h"   // Declaration of this class
+#include "CMatrix4x4.h" // Maths library matrix, used to build world matrices directly from the transforms
+
+
+///////////////////////////////
+// Constructors / Destructors
+
+CScene::CScene()
+{
+	m_NodesDirty = false;
+}
+
+// Destructor - deletes all the models
+CScene::~CScene()
+{
+	for (unsigned int model = 0; model < m_Models.size(); ++model)
+	{
+		delete m_Models[model];
+	}
+}
+
+
+/////////////////////////////
+// Models
+
+// Add a new model with no geometry to the scene, load its geometry with CModel::Load. The scene owns the model
+CModel* CScene::AddModel( const D3DXVECTOR3& position /*= D3DXVECTOR3(0,0,0)*/, const D3DXVECTOR3& rotation /*= D3DXVECTOR3(0,0,0)*/,
+                          float scale /*= 1.0f*/ )
+{
+	unsigned int index = static_cast<unsigned int>(m_Models.size());
+
+	m_Positions.push_back( position );
+	m_Rotations.push_back( rotation );
+	m_Scales.push_back( D3DXVECTOR3( scale, scale, scale ) );
+	m_WorldMatrices.push_back( D3DXMATRIX() );
+	m_Orientations.push_back( gen::CQuaternion::kIdentity );
+	m_UseQuaternion.push_back( 0 );
+	m_Dirty.push_back( 1 );
+	m_BoundsX.push_back( position.x );
+	m_BoundsY.push_back( position.y );
+	m_BoundsZ.push_back( position.z );
+	m_BoundsRadius.push_back( 0.0f );
+	m_Visible.push_back( 1 );
+	m_FirstNode.push_back( 0 );
+	m_NumNodes.push_back( 0 );
+	m_Posed.push_back( 0 );
+
+	CModel* model = new CModel( this, index );
+	m_Models.push_back( model );
+
+	UpdateMatrix( index );
+	return model;
+}
+
+
+/////////////////////////////
+// Transforms
+
+// Choose whether a model's orientation is a quaternion or Euler angles, converting its current orientation
+void CScene::SetUseQuaternion( unsigned int model, bool useQuaternion )
+{
+	if (useQuaternion == (m_UseQuaternion[model] != 0))
+	{
+		return;
+	}
+
+	// Convert through a rotation matrix, the world matrix itself may be out of date
+	gen::CMatrix4x4 rotation;
+	if (useQuaternion)
+	{
+		rotation = gen::MatrixRotation( *reinterpret_cast<const gen::CVector3*>(&m_Rotations[model]), gen::kZXY );
+		m_Orientations[model] = gen::CQuaternion( rotation );
+		m_Orientations[model].Normalise();
+	}
+	else
+	{
+		rotation.MakeAffineQuaternion( m_Orientations[model] );
+		rotation.DecomposeAffineEuler( NULL, reinterpret_cast<gen::CVector3*>(&m_Rotations[model]), NULL, gen::kZXY );
+	}
+	m_UseQuaternion[model] = useQuaternion ? 1 : 0;
+	m_Dirty[model] = 1;
+}
+
+
+/////////////////////////////
+// Node hierarchy
+
+// Give a model its own copy of the node hierarchy of a mesh (may be NULL for no nodes), all nodes start at their default matrices
+void CScene::SetNodes( unsigned int model, CMesh* mesh )
+{
+	unsigned int numNodes = mesh ? mesh->GetNumNodes() : 0;
+
+	// Reuse the model's existing range if it is the right size, otherwise add a new range to the end of the list. Models rarely change
+	// mesh, so an old range is just left unused rather than closing up the gap
+	if (numNodes != m_NumNodes[model])
+	{
+		m_FirstNode[model] = static_cast<unsigned int>(m_NodeParents.size());
+		m_NumNodes[model] = numNodes;
+		unsigned int numAllNodes = m_FirstNode[model] + numNodes;
+		m_NodeParents.resize( numAllNodes );
+		m_NodeModels.resize( numAllNodes );
+		m_NodeMatrices.resize( numAllNodes );
+		m_NodeInvRootMatrices.resize( numAllNodes );
+		m_NodeWorldMatrices.resize( numAllNodes );
+		m_NodeMeshMatrices.resize( numAllNodes );
+		m_NodeDirty.resize( numAllNodes );
+	}
+
+	unsigned int firstNode = m_FirstNode[model];
+	for (unsigned int node = 0; node < numNodes; ++node)
+	{
+		const SMeshNodeInfo& meshNode = mesh->GetNode( node );
+		m_NodeParents[firstNode + node] = firstNode + meshNode.parent;
+		m_NodeModels[firstNode + node] = model;
+		m_NodeInvRootMatrices[firstNode + node] = meshNode.invRootMatrix;
+	}
+	ResetNodes( model );
+}
+
+// Put all of a model's nodes back to their default matrices
+void CScene::ResetNodes( unsigned int model )
+{
+	CMesh* mesh = m_Models[model]->GetMesh();
+	unsigned int firstNode = m_FirstNode[model];
+	for (unsigned int node = 0; node < m_NumNodes[model]; ++node)
+	{
+		m_NodeMatrices[firstNode + node] = mesh->GetNode( node ).defaultMatrix;
+	}
+
+	// Marking the root updates the whole hierarchy
+	if (m_NumNodes[model] > 0)
+	{
+		m_NodeDirty[firstNode] = 1;
+		m_NodesDirty = true;
+	}
+	m_Posed[model] = 0;
+}
+
+
+/////////////////////////////
+// Scene Usage
+
+// Rebuild the world matrix and bounds of every model whose transform has changed since the last update
+// Each run of neighbouring changed models has its matrices built in one call to the maths library
+void CScene::UpdateMatrices()
+{
+	unsigned int numModels = static_cast<unsigned int>(m_Models.size());
+	unsigned int model = 0;
+	while (model < numModels)
+	{
+		if (!m_Dirty[model])
+		{
+			++model;
+			continue;
+		}
+
+		unsigned int runStart = model;
+		while (model < numModels && m_Dirty[model])
+		{
+			++model;
+		}
+		BuildMatrices( runStart, model - runStart );
+	}
+	UpdateNodes();
+}
+
+// Rebuild the world matrix and bounds of a single model now, whether it has changed or not
+void CScene::UpdateMatrix( unsigned int model )
+{
+	BuildMatrices( model, 1 );
+	UpdateNodes();
+}
+
+
+/////////////////////////////
+// Private member functions
+
+// Build the world matrices and bounds of a range of models and clear their dirty flags
+void CScene::BuildMatrices( unsigned int firstModel, unsigned int numModels )
+{
+	// The world matrix is scaling, then Z, X and Y rotations (or the quaternion), then translation. This order gives the controls used
+	// by CModel::Control. The maths library writes the matrix elements directly rather than multiplying five separate matrices. The
+	// vector and matrix types have the same layout as the D3DX ones. Models using Euler angles and quaternions are built in separate
+	// runs, each with one call
+	unsigned int endModel = firstModel + numModels;
+	unsigned int runStart = firstModel;
+	while (runStart < endModel)
+	{
+		unsigned char useQuaternion = m_UseQuaternion[runStart];
+		unsigned int runEnd = runStart + 1;
+		while (runEnd < endModel && m_UseQuaternion[runEnd] == useQuaternion)
+		{
+			++runEnd;
+		}
+
+		if (useQuaternion)
+		{
+			gen::MatrixAffineQuaternion( reinterpret_cast<gen::CMatrix4x4*>(&m_WorldMatrices[runStart]),
+			                             reinterpret_cast<const gen::CVector3*>(&m_Positions[runStart]), &m_Orientations[runStart],
+			                             reinterpret_cast<const gen::CVector3*>(&m_Scales[runStart]), runEnd - runStart );
+		}
+		else
+		{
+			gen::MatrixAffineEulerZXY( reinterpret_cast<gen::CMatrix4x4*>(&m_WorldMatrices[runStart]),
+			                           reinterpret_cast<const gen::CVector3*>(&m_Positions[runStart]),
+			                           reinterpret_cast<const gen::CVector3*>(&m_Rotations[runStart]),
+			                           reinterpret_cast<const gen::CVector3*>(&m_Scales[runStart]), runEnd - runStart );
+		}
+		runStart = runEnd;
+	}
+
+	for (unsigned int model = firstModel; model < endModel; ++model)
+	{
+		// The bounds depend on the world matrix
+		D3DXVECTOR3 centre;
+		m_Models[model]->GetBoundingSphere( centre, m_BoundsRadius[model] );
+		m_BoundsX[model] = centre.x;
+		m_BoundsY[model] = centre.y;
+		m_BoundsZ[model] = centre.z;
+
+		// The model's nodes are positioned relative to its world matrix, marking the root updates the whole hierarchy
+		if (m_NumNodes[model] > 0)
+		{
+			m_NodeDirty[m_FirstNode[model]] = 1;
+			m_NodesDirty = true;
+		}
+
+		m_Dirty[model] = 0;
+	}
+}
+
+// Update the world matrices of all changed nodes and their children in one pass over the node list
+void CScene::UpdateNodes()
+{
+	if (!m_NodesDirty)
+	{
+		return;
+	}
+
+	// Parents are always earlier in the list, so a parent's dirty flag and world matrix are final by the time its children are reached
+	unsigned int numNodes = static_cast<unsigned int>(m_NodeParents.size());
+	for (unsigned int node = 0; node < numNodes; ++node)
+	{
+		unsigned int parent = m_NodeParents[node];
+		if (parent == node)
+		{
+			// Root node, positioned by the model's world matrix
+			if (!m_NodeDirty[node]) continue;
+			D3DXMatrixMultiply( &m_NodeWorldMatrices[node], &m_NodeMatrices[node], &m_WorldMatrices[m_NodeModels[node]] );
+		}
+		else
+		{
+			m_NodeDirty[node] |= m_NodeDirty[parent];
+			if (!m_NodeDirty[node]) continue;
+			D3DXMatrixMultiply( &m_NodeWorldMatrices[node], &m_NodeMatrices[node], &m_NodeWorldMatrices[parent] );
+		}
+
+		// The node's sub-meshes have model space vertices, so take them back to the node's space first
+		D3DXMatrixMultiply( &m_NodeMeshMatrices[node], &m_NodeInvRootMatrices[node], &m_NodeWorldMatrices[node] );
+	}
+
+	// Only cleared once the pass is complete as the children test their parent's flag
+	memset( &m_NodeDirty[0], 0, numNodes );
+	m_NodesDirty = false;
+}
+
+
+// Get the transform of every model as a quaternion transform, models using Euler angles are converted. Only reads the positions,
+// rotations and scales, so it can be used by an update thread while the render thread uses the world matrices
+void CScene::GetTransforms( vector<gen::CQuatTransform>& transforms )
+{
+	unsigned int numModels = static_cast<unsigned int>(m_Models.size());
+	transforms.resize( numModels );
+	for (unsigned int model = 0; model < numModels; ++model)
+	{
+		gen::CQuatTransform& transform = transforms[model];
+		if (m_UseQuaternion[model])
+		{
+			transform.quat = m_Orientations[model];
+		}
+		else
+		{
+			gen::CMatrix4x4 rotation = gen::MatrixRotation( *reinterpret_cast<const gen::CVector3*>(&m_Rotations[model]), gen::kZXY );
+			transform.quat = gen::CQuaternion( rotation );
+			transform.quat.Normalise();
+		}
+		transform.pos   = *reinterpret_cast<const gen::CVector3*>(&m_Positions[model]);
+		transform.scale = *reinterpret_cast<const gen::CVector3*>(&m_Scales[model]);
+	}
+}
+
+// Build the world matrix and bounds of every model from a blend of two lists of transforms from GetTransforms (t = 0 to 1), then
+// update the nodes. The transforms themselves and the dirty flags are not changed, they belong to the update thread. Models
+// missing from either list (added since) keep their current matrices
+void CScene::SetInterpolatedTransforms( const vector<gen::CQuatTransform>& transforms0, const vector<gen::CQuatTransform>& transforms1,
+                                        float t )
+{
+	unsigned int numModels = static_cast<unsigned int>(min( m_Models.size(), min( transforms0.size(), transforms1.size() ) ));
+	if (numModels == 0)
+	{
+		return;
+	}
+
+	// Blend all the transforms in one call, then build all the matrices in another. The matrix building needs separate arrays of
+	// positions, quaternions and scales, so each model is built on its own from the blended transform
+	m_InterpolatedTransforms.resize( numModels );
+	m_InterpolationTimes.assign( numModels, t );
+	gen::Slerp( &transforms0[0], &transforms1[0], &m_InterpolationTimes[0], &m_InterpolatedTransforms[0], numModels );
+	for (unsigned int model = 0; model < numModels; ++model)
+	{
+		const gen::CQuatTransform& transform = m_InterpolatedTransforms[model];
+		gen::MatrixAffineQuaternion( reinterpret_cast<gen::CMatrix4x4*>(&m_WorldMatrices[model]), &transform.pos, &transform.quat,
+		                             &transform.scale, 1 );
+
+		D3DXVECTOR3 centre;
+		m_Models[model]->GetBoundingSphere( centre, m_BoundsRadius[model] );
+		m_BoundsX[model] = centre.x;
+		m_BoundsY[model] = centre.y;
+		m_BoundsZ[model] = centre.z;
+
+		if (m_NumNodes[model] > 0)
+		{
+			m_NodeDirty[m_FirstNode[model]] = 1;
+			m_NodesDirty = true;
+		}
+	}
+	UpdateNodes();
+}
+
+
+// Test every model's bounds against the given frustum, the result is available from IsVisible. Returns the number of visible models
+unsigned int CScene::Cull( const CFrustum& frustum )
+{
+	if (m_Models.empty())
+	{
+		return 0;
+	}
+	return frustum.CullSpheres( &m_BoundsX[0], &m_BoundsY[0], &m_BoundsZ[0], &m_BoundsRadius[0],
+	                            static_cast<unsigned int>(m_Models.size()), &m_Visible[0] );
+}
@@ -0,0 +1,262 @@
+//--------------------------------------------------------------------------------------
+//	Scene.h
+//
+//	The scene holds all the models and their transforms. Positions, rotations, scales and
+//	world matrices are kept in separate contiguous arrays (structure of arrays) and only
+//	the transforms that have changed are rebuilt each frame
+//--------------------------------------------------------------------------------------
+
+#ifndef SCENE_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define SCENE_H_INCLUDED
+
+#include <vector>
+using namespace std;
+
+#include <d3d10.h>
+#include <d3dx10.h>
+#include "Model.h"
+#include "Frustum.h"
+#include "CQuaternion.h" // Maths library quaternion, an alternative to Euler angles for model orientations
+#include "CQuatTransform.h" // Maths library quaternion transform, used to pass model transforms between threads
+
+
+class CScene
+{
+/////////////////////////////
+// Private member variables
+private:
+
+	// The models in the scene, owned by the scene. A model's index in this list is also its index in all the arrays below
+	vector<CModel*>       m_Models;
+
+	// Transform for each model, the world matrix is built from the position, rotation and scale
+	vector<D3DXVECTOR3>   m_Positions;
+	vector<D3DXVECTOR3>   m_Rotations;
+	vector<D3DXVECTOR3>   m_Scales;
+	vector<D3DXMATRIX>    m_WorldMatrices;
+
+	// A model's orientation can be a quaternion instead of its Euler angles, chosen per model. 1 in m_UseQuaternion when the
+	// orientation is used and the rotation ignored
+	vector<gen::CQuaternion> m_Orientations;
+	vector<unsigned char>    m_UseQuaternion;
+
+	// Set when a model's position, rotation, scale or geometry changes, the world matrix and bounds are rebuilt by UpdateMatrices
+	vector<unsigned char> m_Dirty;
+
+	// World space bounding sphere of each model, updated with the world matrix. Kept as separate arrays for the frustum's SSE test
+	vector<float>         m_BoundsX;
+	vector<float>         m_BoundsY;
+	vector<float>         m_BoundsZ;
+	vector<float>         m_BoundsRadius;
+
+	// Result of the last Cull, 1 for each model that is at least partly inside the frustum
+	vector<unsigned char> m_Visible;
+
+	// Range of each model's nodes in the node arrays below, and whether any of the model's nodes have been moved from their default
+	// matrices. Only posed models need their sub-meshes drawn with separate world matrices
+	vector<unsigned int>  m_FirstNode;
+	vector<unsigned int>  m_NumNodes;
+	vector<unsigned char> m_Posed;
+
+	// The node hierarchies of all the models' meshes in one list. Each model's nodes are a depth-first range copied from its mesh, so
+	// a node's parent is always earlier in the list and all the world matrices are updated in a single pass with no recursion (see
+	// UpdateNodes). Parents are indexes into these arrays, a model's root node is its own parent
+	vector<unsigned int>  m_NodeParents;
+	vector<unsigned int>  m_NodeModels;          // Model owning each node
+	vector<D3DXMATRIX>    m_NodeMatrices;        // Matrix of each node in its parent's space
+	vector<D3DXMATRIX>    m_NodeInvRootMatrices; // Copied from the mesh nodes, see SMeshNodeInfo
+	vector<D3DXMATRIX>    m_NodeWorldMatrices;
+	vector<D3DXMATRIX>    m_NodeMeshMatrices;    // World matrix for the model space vertices of the node's sub-meshes
+
+	// Set when a node's matrix changes or its model moves. Changes are passed down to the children during UpdateNodes, so only the
+	// changed subtrees are recalculated
+	vector<unsigned char> m_NodeDirty;
+	bool                  m_NodesDirty;
+
+	// Working space for SetInterpolatedTransforms, kept to avoid allocating each frame
+	vector<gen::CQuatTransform> m_InterpolatedTransforms;
+	vector<float>               m_InterpolationTimes;
+
+
+/////////////////////////////
+// Public member functions
+public:
+
+	///////////////////////////////
+	// Constructors / Destructors
+
+	CScene();
+
+	// Destructor - deletes all the models
+	~CScene();
+
+private:
+	// Disallow use of copy constructor and assignment operator (private and not defined)
+	CScene( const CScene& );
+	CScene& operator=( const CScene& );
+
+public:
+
+	/////////////////////////////
+	// Models
+
+	// Add a new model with no geometry to the scene, load its geometry with CModel::Load. The scene owns the model
+	CModel* AddModel( const D3DXVECTOR3& position = D3DXVECTOR3(0,0,0), const D3DXVECTOR3& rotation = D3DXVECTOR3(0,0,0), float scale = 1.0f );
+
+	unsigned int GetNumModels()
+	{
+		return static_cast<unsigned int>(m_Models.size());
+	}
+	CModel* GetModel( unsigned int model )
+	{
+		return m_Models[model];
+	}
+
+
+	/////////////////////////////
+	// Transforms - normally used through CModel
+
+	const D3DXVECTOR3& GetPosition( unsigned int model )
+	{
+		return m_Positions[model];
+	}
+	const D3DXVECTOR3& GetRotation( unsigned int model )
+	{
+		return m_Rotations[model];
+	}
+	const D3DXVECTOR3& GetScale( unsigned int model )
+	{
+		return m_Scales[model];
+	}
+	const gen::CQuaternion& GetOrientation( unsigned int model )
+	{
+		return m_Orientations[model];
+	}
+	bool UsesQuaternion( unsigned int model )
+	{
+		return m_UseQuaternion[model] != 0;
+	}
+	const D3DXMATRIX& GetWorldMatrix( unsigned int model )
+	{
+		return m_WorldMatrices[model];
+	}
+
+	void SetPosition( unsigned int model, const D3DXVECTOR3& position )
+	{
+		m_Positions[model] = position;
+		m_Dirty[model] = 1;
+	}
+	void SetRotation( unsigned int model, const D3DXVECTOR3& rotation ) // Switches the model to Euler angles
+	{
+		m_Rotations[model] = rotation;
+		m_UseQuaternion[model] = 0;
+		m_Dirty[model] = 1;
+	}
+	void SetOrientation( unsigned int model, const gen::CQuaternion& orientation ) // Switches the model to a quaternion, must be normalised
+	{
+		m_Orientations[model] = orientation;
+		m_UseQuaternion[model] = 1;
+		m_Dirty[model] = 1;
+	}
+	void SetScale( unsigned int model, const D3DXVECTOR3& scale )
+	{
+		m_Scales[model] = scale;
+		m_Dirty[model] = 1;
+	}
+
+	// Choose whether a model's orientation is a quaternion or Euler angles, converting its current orientation
+	void SetUseQuaternion( unsigned int model, bool useQuaternion );
+
+	// Flag a model's world matrix and bounds to be rebuilt by the next UpdateMatrices, e.g. when its geometry changes
+	void SetDirty( unsigned int model )
+	{
+		m_Dirty[model] = 1;
+	}
+
+
+	/////////////////////////////
+	// Node hierarchy - normally used through CModel. Node numbers are those in the model's mesh
+
+	// Give a model its own copy of the node hierarchy of a mesh (may be NULL for no nodes), all nodes start at their default matrices
+	void SetNodes( unsigned int model, CMesh* mesh );
+
+	unsigned int GetNumNodes( unsigned int model )
+	{
+		return m_NumNodes[model];
+	}
+	bool IsPosed( unsigned int model )
+	{
+		return m_Posed[model] != 0;
+	}
+	const D3DXMATRIX& GetNodeMatrix( unsigned int model, unsigned int node )
+	{
+		return m_NodeMatrices[m_FirstNode[model] + node];
+	}
+
+	// The world matrices are updated by UpdateMatrices
+	const D3DXMATRIX& GetNodeWorldMatrix( unsigned int model, unsigned int node )
+	{
+		return m_NodeWorldMatrices[m_FirstNode[model] + node];
+	}
+	const D3DXMATRIX& GetNodeMeshMatrix( unsigned int model, unsigned int node )
+	{
+		return m_NodeMeshMatrices[m_FirstNode[model] + node];
+	}
+
+	// Set the matrix of a node in its parent's space, the node and all its children are updated by the next UpdateMatrices. The
+	// model's bounds stay those of its mesh in the default pose
+	void SetNodeMatrix( unsigned int model, unsigned int node, const D3DXMATRIX& matrix )
+	{
+		unsigned int index = m_FirstNode[model] + node;
+		m_NodeMatrices[index] = matrix;
+		m_NodeDirty[index] = 1;
+		m_NodesDirty = true;
+		m_Posed[model] = 1;
+	}
+
+	// Put all of a model's nodes back to their default matrices
+	void ResetNodes( unsigned int model );
+
+
+	/////////////////////////////
+	// Scene Usage
+
+	// Rebuild the world matrix and bounds of every model whose transform has changed since the last update, then the world matrices
+	// of every changed node
+	void UpdateMatrices();
+
+	// Rebuild the world matrix and bounds of a single model now, whether it has changed or not, then any changed nodes
+	void UpdateMatrix( unsigned int model );
+
+	// Get the transform of every model as a quaternion transform, models using Euler angles are converted. Only reads the positions,
+	// rotations and scales, so it can be used by an update thread while the render thread uses the world matrices
+	void GetTransforms( vector<gen::CQuatTransform>& transforms );
+
+	// Build the world matrix and bounds of every model from a blend of two lists of transforms from GetTransforms (t = 0 to 1), then
+	// update the nodes. The transforms themselves and the dirty flags are not changed, they belong to the update thread. Models
+	// missing from either list (added since) keep their current matrices
+	void SetInterpolatedTransforms( const vector<gen::CQuatTransform>& transforms0, const vector<gen::CQuatTransform>& transforms1, float t );
+
+	// Test every model's bounds against the given frustum, the result is available from IsVisible. Returns the number of visible models
+	unsigned int Cull( const CFrustum& frustum );
+
+	// Was the model inside the frustum given to the last Cull
+	bool IsVisible( unsigned int model )
+	{
+		return m_Visible[model] != 0;
+	}
+
+
+/////////////////////////////
+// Private member functions
+private:
+
+	// Build the world matrices and bounds of a range of models and clear their dirty flags
+	void BuildMatrices( unsigned int firstModel, unsigned int numModels );
+
+	// Update the world matrices of all changed nodes and their children in one pass over the node list
+	void UpdateNodes();
+};
+
+
+#endif // End of header guard - see top of file
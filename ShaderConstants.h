@@ -0,0 +1,75 @@
+//--------------------------------------------------------------------------------------
+//	ShaderConstants.h
+//
+//	C++ mirrors of the constant buffers declared in Stereoscopic.fx
+//--------------------------------------------------------------------------------------
+
+#ifndef SHADER_CONSTANTS_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define SHADER_CONSTANTS_H_INCLUDED
+
+#include <d3d10.h>
+#include <d3dx10.h>
+
+//-----------------------------------------------------------------------------
+// Constant buffer structures
+//-----------------------------------------------------------------------------
+// Each structure is uploaded to the GPU as raw data, so must match the layout of the cbuffer in the .fx file exactly. HLSL packs
+// constants into 16-byte registers and a float3 won't straddle two registers, hence the padding floats. Total sizes must be a
+// multiple of 16 bytes
+
+// Lighting, light tile and stereo composite data, set once per frame
+struct SPerFrameConstants
+{
+	D3DXVECTOR3 AmbientColour;
+	float       SpecularPower;
+	D3DXVECTOR2 StereoViewScale;
+	D3DXVECTOR2 StereoViewMaxUV;
+	D3DXVECTOR2 StereoViewTexelSize;
+	UINT        NumLightTiles[2];   // Across and down, see CLightGrid
+	float       LightTileScale;
+	float       ReprojectMaxX;      float Pad0[2]; // Reprojection of the left eye to the right, see ReprojectRightEye
+	D3DXVECTOR4 ReprojectParams;
+};
+
+// Camera data, set once per eye (or once for both eyes with single-pass stereo)
+struct SPerEyeConstants
+{
+	D3DXMATRIX  ViewMatrix;
+	D3DXMATRIX  ProjMatrix;
+	D3DXVECTOR3 CameraPos;      float Pad0;
+	D3DXVECTOR2 ViewportOrigin; D3DXVECTOR2 Pad1;
+
+	D3DXMATRIX  StereoViewMatrix[2]; // Index 0 = left eye, 1 = right eye
+	D3DXMATRIX  StereoProjMatrix[2];
+	D3DXVECTOR4 StereoCameraPos[2];
+	D3DXVECTOR4 StereoViewportOrigin[2];
+};
+
+// Model data, set for each model rendered
+struct SPerObjectConstants
+{
+	D3DXMATRIX  WorldMatrix;
+	D3DXVECTOR3 TintColour;    float Pad0;
+	D3DXVECTOR3 MeshPosScale;  float Pad1; // Position decode of the model's mesh (see CMesh::GetPositionScale)
+	D3DXVECTOR3 MeshPosOffset;
+	UINT        BoneOffset;    // First of the model's matrices in the bone palette (see CBonePalette)
+};
+
+// Particle system settings and simulation time step, set once per frame for each particle system (see CParticleSystem)
+struct SParticleConstants
+{
+	D3DXVECTOR3 EmitterPos;
+	float       EmitInterval;
+	D3DXVECTOR3 EmitVelocity;
+	float       EmitSpread;
+	D3DXVECTOR3 ParticleAcceleration;
+	float       ParticleLife;
+	D3DXVECTOR4 ParticleColour;
+	float       ParticleStartSize;
+	float       ParticleEndSize;
+	float       ParticleTimeStep;
+	UINT        ParticleSeed;
+};
+
+
+#endif // End of header guard - see top of file
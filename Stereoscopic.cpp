@@ -5,68 +5,342 @@
 //--------------------------------------------------------------------------------------
 
 #include <windows.h>
+#include <mmsystem.h> // timeBeginPeriod
 #include <d3d10.h>
 #include <d3dx10.h>
 #include <atlbase.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
 #include "resource.h"
 
 #include "Defines.h" // General definitions shared by all source files
 #include "Model.h"   // Model class - new, encapsulates working with vertex/index data and world matrix
+#include "InstancedModel.h" // Many copies of one model drawn in a single call
 #include "Camera.h"  // Camera class - new, encapsulates the camera's view and projection matrix
+#include "Scene.h" // All the models and their transforms
+#include "RenderQueue.h" // Collects and sorts each frame's draws to remove redundant state changes
+#include "TextureManager.h" // Shares textures between users and loads them in the background
+#include "Profiler.h" // CPU and GPU timing of each phase of the frame
+#include "MathBenchmark.h" // Compares the scalar and SSE versions of the maths library's matrix operations
+#include "ShaderConstants.h" // C++ copies of the constant buffers in the .fx file
 #include "CTimer.h"  // Timer class - not DirectX
 #include "Input.h"   // Input functions - not DirectX
+#include "UpdateThread.h" // Runs the simulation at a fixed step on its own thread
+#include "JobSystem.h" // Worker threads for jobs such as loading meshes
+#include "LightGrid.h" // Point lights binned into screen tiles for the pixel shaders
+#include "BonePalette.h" // Node matrices of the skinned models for the skinned vertex shaders
+#include "ParticleSystem.h" // GPU simulated particles
+#include "OcclusionCuller.h" // Occlusion predicates from the left eye for the right eye's draws
+#include "FileWatcher.h" // Reports changed files so the effect and assets can be reloaded while running
+#include "FrameCapture.h" // Records the frames to disk from a background thread
+#include "ResourceRegistry.h" // Memory used by the GPU resources and mesh imports, with budgets
+using namespace std;
 
 
 //--------------------------------------------------------------------------------------
 // Scene Data
 //--------------------------------------------------------------------------------------
 
-// Models and cameras encapsulated in simple classes
+// Models and cameras encapsulated in simple classes. The scene owns all the models, the ones the code moves are also kept here
+CScene* Scene;
 CModel* Cube;
-CModel* Stars;
-CModel* Crate;
-CModel* Ground;
 CCamera* MainCamera;
 
+// A row of containers drawn with hardware instancing - one draw call for all of them
+CInstancedModel* Containers;
+const unsigned int NumContainers = 8;
 
-//**|3D|** Left and Right Renders ****//
+// Worker threads shared by anything that splits its work into jobs, e.g. loading the meshes in parallel
+CJobSystem* JobSystem = NULL;
 
-// The textures for left and right images and their views as render target and shader resource
-ID3D10Texture2D*          LeftTexture = NULL;
-ID3D10Texture2D*          RightTexture = NULL;
-ID3D10RenderTargetView*   LeftRenderTarget = NULL;
-ID3D10RenderTargetView*   RightRenderTarget = NULL;
-ID3D10ShaderResourceView* LeftShaderResource = NULL;
-ID3D10ShaderResourceView* RightShaderResource = NULL;
+// All models are submitted to the render queue each frame, which sorts them by state before drawing
+CRenderQueue* RenderQueue;
+
+// Watches the working directory so the effect file, meshes and textures are reloaded when they are edited (see ReloadChangedFiles).
+// NULL if the directory couldn't be watched
+CFileWatcher* FileWatcher = NULL;
+
+// Times each phase of the frame. F2 shows the timings on screen, F3 writes the recent frames to a CSV file
+CProfiler* Profiler;
+bool ShowProfiler = false;
+
+// Recording - V starts and stops writing every frame to disk, as BMP images or with -rawvideo one raw RGBA file. With the outputs that
+// combine the eyes from the stereo texture the eyes are recorded side by side, before they are combined, unless CaptureEyes is off.
+// Otherwise (and for frame-sequential output, one eye per frame) the back buffer is recorded. Use -capture <eyes|composite> on the
+// command line to record from the start. The files are named with the time the recording started
+CFrameCapture* FrameCapture = NULL;
+bool           CaptureEyes = true;
+ECaptureFormat CaptureFormat = CaptureImages;
+bool           CaptureOnStart = false;
+
+
+//**|3D|** Left and Right Renders ****//
 
 // Interocular distance
 float Interocular = 0.65f;
 
+// The left and right images are held in the slices of a two slice texture array (slice 0 = left, 1 = right), which is read by the
+// anaglyph shader. Single-pass stereo renders each model once as two instances, one per eye. A geometry shader sends each instance to
+// one slice, which also needs a two slice depth buffer. Two-pass stereo renders each slice in turn. Toggle with F1
+bool                      SinglePassStereo = true;
+ID3D10Texture2D*          StereoTexture = NULL;
+ID3D10RenderTargetView*   StereoRenderTarget = NULL; // View of both slices
+ID3D10RenderTargetView*   LeftRenderTarget = NULL;   // View of each slice for two-pass stereo
+ID3D10RenderTargetView*   RightRenderTarget = NULL;
+ID3D10ShaderResourceView* StereoShaderResource = NULL;
+ID3D10DepthStencilView*   StereoDepthStencilView = NULL; // View of both slices of the depth buffer (see DepthStencil)
+ID3D10DepthStencilView*   RightDepthStencilView = NULL;  // View of the second slice, the first is DepthStencilView
+
+// Multisampled versions of the stereo texture and depth buffer with the same views, used by the outputs that composite the eyes
+// from the stereo texture. They are resolved into the stereo texture before the composite. Select the sample count with -msaa <samples>,
+// the highest supported count up to that is used. Cheaper anti-aliasing is available in the composite shader instead (F7 or -fxaa)
+UINT                      MSAASamples = 1;
+ID3D10Texture2D*          MSAAStereoTexture = NULL;
+ID3D10RenderTargetView*   MSAAStereoRenderTarget = NULL;
+ID3D10RenderTargetView*   MSAALeftRenderTarget = NULL;
+ID3D10RenderTargetView*   MSAARightRenderTarget = NULL;
+ID3D10Texture2D*          MSAADepthStencil = NULL;
+ID3D10DepthStencilView*   MSAAStereoDepthStencilView = NULL;
+ID3D10DepthStencilView*   MSAALeftDepthStencilView = NULL;
+ID3D10DepthStencilView*   MSAARightDepthStencilView = NULL;
+bool                      FXAA = false;
+
+// Reprojection renders only the left eye, then makes the right eye from the left eye's colour and depth in a full-screen pass (see
+// ReprojectRightEye in the .fx file). Close to the cost of a monoscopic render, with some stretching at the edges of objects. Used by the
+// outputs that composite the eyes from the stereo texture, and without MSAA as the left eye's depth must be read. The left eye is
+// rendered to its own texture, the pass writes it and the right eye into the stereo texture. Toggle with R, or -reproject on the
+// command line
+bool                      Reprojection = false;
+const float               ReprojectMaxShift = 0.1f; // Largest shift searched for, as a fraction of the eye's width
+ID3D10Texture2D*          ReprojectTexture = NULL;
+ID3D10RenderTargetView*   ReprojectRenderTarget = NULL;
+ID3D10ShaderResourceView* ReprojectShaderResource = NULL;
+ID3D10ShaderResourceView* DepthShaderResource = NULL; // View of the first slice of the depth buffer (see DepthStencil)
+
 //************************************//
 
 
-// Textures
-ID3D10ShaderResourceView* CubeDiffuseMap = NULL;
-ID3D10ShaderResourceView* StarsDiffuseMap = NULL;
-ID3D10ShaderResourceView* CrateDiffuseMap = NULL;
-ID3D10ShaderResourceView* GroundDiffuseMap = NULL;
-ID3D10ShaderResourceView* LightDiffuseMap = NULL;
+// Textures - owned by the texture manager, which loads them in the background. Use GetView each frame to pick up a texture
+// once it has finished loading
+CTextureManager* TextureManager = NULL;
+CTexture* CubeDiffuseMap = NULL;
+CTexture* StarsDiffuseMap = NULL;
+CTexture* CrateDiffuseMap = NULL;
+CTexture* GroundDiffuseMap = NULL;
+CTexture* LightDiffuseMap = NULL;
+CTexture* SmokeDiffuseMap = NULL;
 
-// Light data stored manually, a light class would be helpful - but it's an assignment task for the second years
 D3DXVECTOR4 BackgroundColour = D3DXVECTOR4( 0.2f, 0.2f, 0.3f, 1.0f );
 D3DXVECTOR3 AmbientColour    = D3DXVECTOR3( 0.4f, 0.4f, 0.5f );
 D3DXVECTOR3 Light1Colour     = D3DXVECTOR3( 0.8f, 0.8f, 1.0f ) * 8;
 D3DXVECTOR3 Light2Colour     = D3DXVECTOR3( 1.0f, 0.8f, 0.2f ) * 30;
 float SpecularPower = 256.0f;
 
-// Display models where the lights are. One of the lights will follow an orbit
+// All the point lights are held in the light grid, which bins them into screen tiles each frame so the pixel shaders only visit the
+// lights near each pixel. Both eyes share the tiles
+CLightGrid* LightGrid = NULL;
+
+// Node matrices of the skinned models queued each frame, uploaded once and shared by both eyes
+CBonePalette* BonePalette = NULL;
+
+// Display models where the two main lights are (owned by the scene), with their index in the light grid. One of the lights will follow
+// an orbit
 CModel* Light1;
 CModel* Light2;
+int Light1Index;
+int Light2Index;
 const float LightOrbitRadius = 20.0f;
 const float LightOrbitSpeed  = 0.7f;
+float LightOrbitAngle = 0.0f;
+
+// A ring of extra coloured lights around the scene, added with -lights <count> on the command line. Their flares are instances of
+// one model, drawn in a single call
+unsigned int        NumVenueLights = 0;
+const unsigned int  MaxVenueLights = 256;
+const float         VenueLightRadius = 90.0f;
+const float         VenueLightHeight = 20.0f;
+const float         VenueLightIntensity = 4.0f;
+const D3DXVECTOR3   VenueLightCentre = D3DXVECTOR3( 0, 0, 60 );
+CInstancedModel*    VenueLightFlares = NULL;
+
+// Particle systems, simulated on the GPU once per frame and drawn in both eyes: smoke rising from beside the containers and sparks
+// falling from the orbiting light. Toggle with P, or -noparticles on the command line
+CParticleSystem* SmokeParticles = NULL;
+CParticleSystem* SparkParticles = NULL;
+bool ShowParticles = true;
 
 // Note: There are move & rotation speed constants in Defines.h
 
+// The simulation (controls, movement, light orbit) runs on its own thread at a fixed step and the render thread draws a blend of the last
+// two steps, so the motion is smooth and independent of the frame rate. The update thread moves its own copy of the camera, the main
+// camera is set from the snapshots each frame. The benchmark, or -singlethread on the command line, updates and renders in turn instead
+bool            SingleThreaded = false;
+CUpdateThread*  UpdateThread = NULL;
+CCamera*        UpdateCamera = NULL;
+const float     UpdateTickTime = 1.0f / 60.0f;
+SUpdateSnapshot PreviousSnapshot; // Render thread copies of the snapshots, kept to avoid allocating each frame
+SUpdateSnapshot LatestSnapshot;
+
+// Mouse look turns the camera by the raw mouse movement (see InitRawInput). The update step turns its camera like the keys do, then the
+// main camera is turned again just before drawing by whatever movement has arrived since ("late latching"), so the view always has the
+// latest turn however far behind it the update step is. Each camera keeps the mouse totals it has turned by. Toggle with M, or
+// -mouselook on the command line
+struct SMouseLookCounts
+{
+	LONG x, y;
+};
+bool             MouseLook = false;
+const float      MouseLookSpeed = 0.003f; // Radians per mouse count
+SMouseLookCounts MainCameraMouse = { 0, 0 };
+SMouseLookCounts UpdateCameraMouse = { 0, 0 };
+
+
+
+//--------------------------------------------------------------------------------------
+// Anaglyph Modes
+//--------------------------------------------------------------------------------------
+
+//**|3D|** Ways of combining the left and right views, each is its own technique in the .fx file (same order). Cycle with F4 or select
+// on the command line with -anaglyph <name>
+enum EAnaglyphMode
+{
+	AnaglyphColour,
+	AnaglyphHalfColour,
+	AnaglyphGrey,
+	AnaglyphOptimised,
+	AnaglyphDubois,
+	AnaglyphGreenMagenta,
+	AnaglyphAmberBlue,
+	NumAnaglyphModes
+};
+const char* AnaglyphModeNames[NumAnaglyphModes] =
+{
+	"Colour", "HalfColour", "Grey", "Optimised", "Dubois", "GreenMagenta", "AmberBlue"
+};
+EAnaglyphMode AnaglyphMode = AnaglyphColour;
+
+// Each composite technique (anaglyph or interlaced) has variants for eyes rendered at reduced resolution (see RenderScale) and with
+// FXAA, selected by combining these flags. The suffixes are added to the technique names in the .fx file
+enum ECompositeVariant
+{
+	CompositeScaled = 1,
+	CompositeFXAA   = 2,
+	NumCompositeVariants = 4
+};
+const char* CompositeVariantSuffixes[NumCompositeVariants] = { "", "Scaled", "FXAA", "ScaledFXAA" };
+ID3D10EffectTechnique* AnaglyphTechniques[NumAnaglyphModes][NumCompositeVariants];
+
+//**|3D|** How the stereo image is sent to the display. Anaglyph and interlaced combine the eyes from the stereo texture, side-by-side
+// and top-bottom render each eye straight to its half of the back buffer (for 3D TVs, which stretch each half back to full size).
+// Frame-sequential shows each eye on alternate refreshes. Cycle with F5 or select on the command line with -stereo <name>
+enum EOutputMode
+{
+	OutputAnaglyph,
+	OutputSideBySide,
+	OutputTopBottom,
+	OutputInterlaced,
+	OutputFrameSequential,
+	NumOutputModes
+};
+const char* OutputModeNames[NumOutputModes] =
+{
+	"Anaglyph", "SideBySide", "TopBottom", "Interlaced", "FrameSequential"
+};
+EOutputMode OutputMode = OutputAnaglyph;
+EStereoscopic FrameSequentialEye = StereoscopicLeft; // Eye rendered last frame in frame-sequential output
+ID3D10EffectTechnique* InterlaceTechniques[NumCompositeVariants]; // Combine the eyes on alternate rows for interlaced output
+ID3D10EffectTechnique* OverdrawViewsTechnique = NULL;                 // Show the eyes side by side in the overdraw view (see ShowOverdraw)
+ID3D10EffectTechnique* ReprojectTechnique = NULL;                     // Make the stereo texture from the left eye (see Reprojection)
+
+//**|3D|** The outputs that combine the eyes from the stereo texture can render the eyes at a reduced resolution, into the top-left of
+// the stereo texture, then upscale them in the composite. Set the scale with -scale <0.5 to 1> on the command line. Dynamic resolution
+// (F6 or -dynamicres) adjusts the scale each frame to keep the GPU frame time near the target
+float RenderScale = 1.0f;
+const float MinRenderScale = 0.5f;
+bool  DynamicResolution = false;
+const float DynamicResolutionTarget = 14.0f; // GPU time in ms to aim for, leaves some headroom under 60Hz
+
+// Depth pre-pass - the opaque models are drawn to the depth buffer first, then drawn again shading only the pixels that are still
+// visible, so the lighting is only calculated once per visible pixel in each eye. Worth it when the pixel shading costs more than
+// transforming the geometry twice. Toggle with F11, or -prepass on the command line
+bool DepthPrepass = false;
+
+// Opaque models are drawn front to back so the depth test rejects hidden pixels before they are shaded, with the sky drawn last. The
+// alternative sorts by render state, for less state changes but more overdraw. Toggle with Insert
+bool FrontToBack = true;
+
+//**|3D|** Occlusion culling - with two-pass stereo a box around each opaque model is tested against the left eye's depth buffer, and the
+// GPU skips the right eye's draws of the models whose box was hidden (see COcclusionCuller). The boxes are grown by how far the right eye
+// can see round the nearest occluder at the model's depth, and models not entirely in the left eye's view are always drawn, so nothing
+// the right eye can see is skipped. Toggle with C, or -noocclusion on the command line
+bool OcclusionCulling = true;
+COcclusionCuller* OcclusionCuller = NULL;
+
+// Overdraw view - the opaque models add a step of colour for every pixel they shade, so the image shows how many times each pixel was
+// shaded (black none, red 1-4, yellow to 8, white 16 or more). Blended models are left out. Anaglyph and interlaced output show the
+// two eyes side by side instead of combining them, so each eye's counts can be read. Toggle with F12
+bool ShowOverdraw = false;
+
+// Level of detail - each model is drawn with the lowest detail LOD of its mesh whose error is at most LodPixelError pixels on screen
+// (toggle with F9, or -nolod on the command line for full detail throughout)
+//**|3D|** Models in front of the screen with more than LodMaxDisparity pixels of crossed disparity are always drawn in full detail
+bool        UseLods = true;
+const float LodPixelError = 1.0f;
+const float LodMaxDisparity = 40.0f;
+
+//**|3D|** Models are loaded with compressed vertices (less than half the size) as every vertex is read once for each eye. Use
+// -fullvertices on the command line for the full float vertex data
+bool CompressedVertices = true;
+
+
+
+//--------------------------------------------------------------------------------------
+// Benchmark Settings
+//--------------------------------------------------------------------------------------
+
+// Benchmark mode is selected on the command line: -benchmark [-frames N] [-resolutions WxH,WxH,...] [-output file]
+// It flies the camera along a fixed path at a fixed time step, for each resolution with two-pass and single-pass stereo, and
+// writes frame time statistics to the output file. No keyboard input is used, and vertical sync is off for the run (see RunBenchmark)
+struct SBenchmarkSettings
+{
+	bool           enabled;
+	unsigned int   numFrames;    // Frames measured for each configuration
+	unsigned int   warmupFrames; // Frames rendered but not measured before each configuration
+	vector<SIZE>   resolutions;  // Window client sizes to test, the current window size if empty
+	wstring        outputFile;
+};
+SBenchmarkSettings Benchmark = { false, 600, 60, vector<SIZE>(), L"Benchmark.csv" };
+
+// Times the maths library's scalar and SSE matrix operations instead of running the application (-mathbenchmark), results go to this file
+bool    MathBenchmark = false;
+wstring MathBenchmarkFile = L"MathBenchmark.csv";
+
+// Fixed time step used for updates in the benchmark, so every run sees exactly the same frames
+const float BenchmarkTimeStep = 1.0f / 60.0f;
+
+// Camera path for the benchmark - positions and rotations (degrees) at given times. Loops at the end. The keys are converted to
+// quaternion transforms the first time they are used and the camera is slerped between them (see SetBenchmarkCamera)
+struct SCameraKey
+{
+	float       time;
+	D3DXVECTOR3 position;
+	D3DXVECTOR3 rotation;
+};
+const SCameraKey BenchmarkPath[] =
+{
+	{  0.0f, D3DXVECTOR3( -15, 35, -70 ), D3DXVECTOR3( 10,  18, 0 ) },
+	{  3.0f, D3DXVECTOR3(  40, 20, -40 ), D3DXVECTOR3(  8, -30, 0 ) },
+	{  6.0f, D3DXVECTOR3(  60, 15,  60 ), D3DXVECTOR3(  5, -110, 0 ) },
+	{  9.0f, D3DXVECTOR3( -30, 25, 170 ), D3DXVECTOR3(  8, -200, 0 ) },
+	{ 12.0f, D3DXVECTOR3( -70, 40,  20 ), D3DXVECTOR3( 15, -280, 0 ) },
+	{ 15.0f, D3DXVECTOR3( -15, 35, -70 ), D3DXVECTOR3( 10, -342, 0 ) },
+};
+const unsigned int NumBenchmarkKeys = sizeof(BenchmarkPath) / sizeof(BenchmarkPath[0]);
+vector<gen::CQuatTransform> BenchmarkTransforms;
+
 
 
 //--------------------------------------------------------------------------------------
@@ -76,32 +350,63 @@ const float LightOrbitSpeed  = 0.7f;
 
 // Effects / techniques
 ID3D10Effect*          Effect = NULL;
-ID3D10EffectTechnique* VertexLitTexTechnique = NULL;
 ID3D10EffectTechnique* AdditiveTexTintTechnique = NULL;
-ID3D10EffectTechnique* AnaglyphTechnique = NULL;
-
-// Matrices
-ID3D10EffectMatrixVariable* WorldMatrixVar = NULL;
-ID3D10EffectMatrixVariable* ViewMatrixVar = NULL;
-ID3D10EffectMatrixVariable* ProjMatrixVar = NULL;
-ID3D10EffectMatrixVariable* ViewProjMatrixVar = NULL;
+ID3D10EffectTechnique* AdditiveTexTintStereoTechnique = NULL; // Single-pass stereo version
+ID3D10EffectTechnique* AdditiveTexTintInstancedTechnique = NULL;  // Instanced versions, world matrix and tint from per-instance data
+ID3D10EffectTechnique* AdditiveTexTintInstancedStereoTechnique = NULL;
+
+// Particles are simulated with stream output, then drawn as sprites one eye at a time or both eyes at once (see CParticleSystem)
+ID3D10EffectTechnique* AdvanceParticlesTechnique = NULL;
+ID3D10EffectTechnique* DrawParticlesTechnique = NULL;
+ID3D10EffectTechnique* DrawParticlesStereoTechnique = NULL;
+
+// Box drawn for each occlusion test, depth test only (see OcclusionCulling)
+ID3D10EffectTechnique* OcclusionBoxTechnique = NULL;
+
+// Each opaque technique has two versions for the depth pre-pass (see DepthPrepass): one that only writes depth, drawn first, and one
+// that then shades the pixels the depth-only pass left visible. There are also versions of the technique and the prepassed one for the
+// overdraw view (see ShowOverdraw). Each set is held for monoscopic or two-pass rendering [0] and single-pass stereo [1]. Models choose
+// between the sets from the render method of each sub-mesh's material (see GetMaterialTechniques)
+struct SOpaqueTechniques
+{
+	ID3D10EffectTechnique* technique;
+	ID3D10EffectTechnique* depthOnly;
+	ID3D10EffectTechnique* prepassed;
+	ID3D10EffectTechnique* overdraw;
+	ID3D10EffectTechnique* overdrawPrepassed;
+};
+SOpaqueTechniques PixelLitTexTechniques[2];          // Per-pixel lighting, specular strength in the diffuse map alpha
+SOpaqueTechniques PlainTexTechniques[2];             // Unlit texture
+SOpaqueTechniques PixelLitTexInstancedTechniques[2]; // Instanced version of the pixel lighting
+SOpaqueTechniques PixelLitTexSkinnedTechniques[2];   // Skinned versions of the two above, for meshes with skin weights
+SOpaqueTechniques PlainTexSkinnedTechniques[2];
+
+// Constant buffers. Shader constants are grouped by how often they change: per-frame (lights), per-eye (camera) and per-object
+// (world matrix, tint). Each group is filled in a C++ structure then uploaded in a single update to our own GPU buffer, which is
+// bound to the matching cbuffer in the effect. Changing a model's world matrix no longer re-uploads all the other constants
+SPerFrameConstants  PerFrameConstants;
+SPerEyeConstants    PerEyeConstants;
+SPerObjectConstants PerObjectConstants;
+ID3D10Buffer* PerFrameBuffer = NULL;
+ID3D10Buffer* PerEyeBuffer = NULL;
+ID3D10Buffer* PerObjectBuffer = NULL;
+ID3D10EffectConstantBuffer* PerFrameBufferVar = NULL;
+ID3D10EffectConstantBuffer* PerEyeBufferVar = NULL;
+ID3D10EffectConstantBuffer* PerObjectBufferVar = NULL;
+ID3D10EffectConstantBuffer* BonePaletteVar = NULL; // Bound to the bone palette's own buffer (see CBonePalette)
+ID3D10EffectConstantBuffer* ParticlesVar = NULL;   // Bound to each particle system's own buffer in turn (see CParticleSystem)
 
 // Textures
 ID3D10EffectShaderResourceVariable* DiffuseMapVar = NULL;
-ID3D10EffectShaderResourceVariable* LeftViewVar = NULL;
-ID3D10EffectShaderResourceVariable* RightViewVar = NULL;
+ID3D10EffectShaderResourceVariable* StereoViewsVar = NULL;
+ID3D10EffectShaderResourceVariable* ReprojectColourVar = NULL;
+ID3D10EffectShaderResourceVariable* ReprojectDepthVar = NULL;
 
-// Light Effect variables
-ID3D10EffectVectorVariable* CameraPosVar = NULL;
-ID3D10EffectVectorVariable* Light1PosVar = NULL;
-ID3D10EffectVectorVariable* Light1ColourVar = NULL;
-ID3D10EffectVectorVariable* Light2PosVar = NULL;
-ID3D10EffectVectorVariable* Light2ColourVar = NULL;
-ID3D10EffectVectorVariable* AmbientColourVar = NULL;
-ID3D10EffectScalarVariable* SpecularPowerVar = NULL;
+// Light list and tiles (buffers)
+ID3D10EffectShaderResourceVariable* LightDataVar = NULL;
+ID3D10EffectShaderResourceVariable* LightTilesVar = NULL;
+ID3D10EffectShaderResourceVariable* LightIndicesVar = NULL;
 
-// Other 
-ID3D10EffectVectorVariable* TintColourVar = NULL;
 
 
 //--------------------------------------------------------------------------------------
@@ -111,15 +416,36 @@ ID3D10EffectVectorVariable* TintColourVar = NULL;
 // The main D3D interface
 ID3D10Device* g_pd3dDevice = NULL;
 
+// Counts the memory used by each category of resource (see ResourceRegistry.h). Budgets are set with -budget <category> <MB> on the
+// command line. Going over the texture budget loads further textures without their top mip-map, over the render target or depth budget
+// leaves out the MSAA targets, and over the mesh budget loads further meshes with compressed vertices
+CResourceRegistry g_Resources;
+
 // Variables used to setup D3D
 IDXGISwapChain*         SwapChain = NULL;
-ID3D10Texture2D*        DepthStencil = NULL;
-ID3D10DepthStencilView* DepthStencilView = NULL;
+DXGI_FORMAT             DepthFormat = DXGI_FORMAT_D24_UNORM_S8_UINT; // Select with -depth 16, 24 or 32 on the command line
+
+// Frame pacing, all set on the command line. Number of swap chain buffers (-buffers 1 to 3), wait for vertical sync (-vsync, toggle
+// with F8), maximum frame rate (-maxfps <fps>, 0 for no limit) and the number of frames the CPU can queue ahead of the GPU
+// (-latency <frames>, 0 leaves the driver default). Fewer queued frames reduce the delay between input and display
+UINT         SwapChainBuffers = 1;
+bool         VSync = false;
+float        MaxFrameRate = 0.0f;
+UINT         MaxFrameLatency = 0;
+LARGE_INTEGER NextFrameTime = { 0 }; // Performance counter time the next frame may start, when limiting frame rate
+ID3D10Texture2D*        DepthStencil = NULL;     // Two slices, one for each eye. The first is also used with the back buffer
+ID3D10DepthStencilView* DepthStencilView = NULL; // View of the first slice
 ID3D10RenderTargetView* BackBufferRenderTarget = NULL;
 
 // Variables used to setup the Window
 HINSTANCE HInst = NULL;
 HWND      HWnd = NULL;
+
+// Window resizes waiting to be handled (see UpdateWindowSize)
+bool        ResizePending = false;
+bool        InSizeMove = false;        // User is dragging the window border or title bar
+DWORD       ResizeRequestTime = 0;     // Time of the last resize, from GetTickCount
+const DWORD ResizeSettleTime = 100;    // Time in ms the size must be unchanged for before resizing
 int       g_ViewportWidth;
 int       g_ViewportHeight;
 
@@ -130,12 +456,41 @@ int       g_ViewportHeight;
 //--------------------------------------------------------------------------------------
 
 bool InitDevice();
+bool CreateRenderTargets();
+bool CreateMSAATargets( D3D10_TEXTURE2D_DESC textureDesc, D3D10_TEXTURE2D_DESC depthDesc );
+void ReleaseRenderTargets();
+bool ResizeRenderTargets( int width, int height );
+void UpdateWindowSize();
+void LimitFrameRate();
 void ReleaseResources();
 bool LoadEffectFile();
+ID3D10Effect* CompileEffectFile( bool reportErrors );
+bool ReloadEffectFile();
+bool GetEffectVariables();
+bool GetOpaqueTechniques( const string& name, SOpaqueTechniques& techniques );
+bool CreateConstantBuffer( UINT size, ID3D10Buffer** buffer );
 bool InitScene();
+void RegisterTechniques();
+void ReloadChangedFiles();
+void UpdateSimulation( float frameTime, CCamera* camera, SMouseLookCounts& mouseCounts );
+void ApplyMouseLook( CCamera* camera, SMouseLookCounts& mouseCounts );
+void UpdateSettings();
 void UpdateScene( float frameTime );
-void RenderModels( CCamera* camera, EStereoscopic stereo = Monoscopic, float interocular = 0.065f );
-void RenderScene();
+bool StartUpdateThread();
+void ApplyUpdateSnapshots();
+void RenderModels( CCamera* camera, const D3D10_VIEWPORT& viewport, EStereoscopic stereo = Monoscopic, bool occlusionPredicated = false );
+void RenderModelsStereo( CCamera* camera, const D3D10_VIEWPORT eyeViewports[2] );
+void QueueModels( CCamera* camera, bool singlePassStereo, float viewportHeight, bool selectLods );
+void RenderInstancedModels( bool singlePassStereo, bool depthOnly );
+void RenderLightFlares( bool singlePassStereo );
+void RenderQueuedModels( bool singlePassStereo, COcclusionCuller* occlusion = NULL );
+void ReprojectEyes( const D3D10_VIEWPORT& viewport );
+void RenderParticles( bool singlePassStereo );
+void StartCapture();
+void CaptureFrame( bool composite, const D3D10_VIEWPORT& eyeViewport );
+void RenderScene( float frameTime );
+void ParseCommandLine( LPWSTR cmdLine );
+bool RunBenchmark();
 bool InitWindow( HINSTANCE hInstance, int nCmdShow );
 LRESULT CALLBACK WndProc( HWND, UINT, WPARAM, LPARAM );
 
@@ -163,7 +518,7 @@ bool InitDevice()
 	// Create a Direct3D device and create a swap-chain (create a back buffer to render to)
 	DXGI_SWAP_CHAIN_DESC sd;
 	ZeroMemory( &sd, sizeof( sd ) );
-	sd.BufferCount = 1;
+	sd.BufferCount = SwapChainBuffers;
 	sd.BufferDesc.Width = g_ViewportWidth;             // Target window size
 	sd.BufferDesc.Height = g_ViewportHeight;           // --"--
 	sd.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM; // Pixel format of target window
@@ -174,75 +529,352 @@ bool InitDevice()
 	sd.SampleDesc.Quality = 0;
 	sd.OutputWindow = HWnd;                            // Target window
 	sd.Windowed = TRUE;                                // Whether to render in a window (TRUE) or go fullscreen (FALSE)
-	hr = D3D10CreateDeviceAndSwapChain( NULL, D3D10_DRIVER_TYPE_HARDWARE, NULL, D3D10_CREATE_DEVICE_DEBUG, D3D10_SDK_VERSION, &sd, &SwapChain, &g_pd3dDevice );
+	// The debug layer validates every call, which is slow, so only use it in debug builds
+#ifdef _DEBUG
+	UINT deviceFlags = D3D10_CREATE_DEVICE_DEBUG;
+#else
+	UINT deviceFlags = 0;
+#endif
+	hr = D3D10CreateDeviceAndSwapChain( NULL, D3D10_DRIVER_TYPE_HARDWARE, NULL, deviceFlags, D3D10_SDK_VERSION, &sd, &SwapChain, &g_pd3dDevice );
 	if( FAILED( hr ) ) return false;
 
+	// Limit how many frames can be queued, if selected. Not an error if this isn't supported
+	if (MaxFrameLatency > 0)
+	{
+		IDXGIDevice1* dxgiDevice;
+		if (SUCCEEDED( g_pd3dDevice->QueryInterface( __uuidof(IDXGIDevice1), reinterpret_cast<void**>(&dxgiDevice) ) ))
+		{
+			dxgiDevice->SetMaximumFrameLatency( MaxFrameLatency );
+			dxgiDevice->Release();
+		}
+	}
+
+
+	// Back buffer render target, depth buffer and the eye textures - all depend on the window size so are created separately
+	return CreateRenderTargets();
+}
+
+
+// Create the render targets and depth buffers that match the window size: the back buffer view, its depth buffer and the
+// textures the eyes are rendered to
+bool CreateRenderTargets()
+{
+	HRESULT hr = S_OK;
 
 	// Indicate that the back-buffer can be "viewed" as a render target - standard behaviour
 	ID3D10Texture2D* pBackBuffer;
 	hr = SwapChain->GetBuffer( 0, __uuidof( ID3D10Texture2D ), ( LPVOID* )&pBackBuffer );
 	if( FAILED( hr ) ) return false;
-	hr = g_pd3dDevice->CreateRenderTargetView( pBackBuffer, NULL, &BackBufferRenderTarget );
+	hr = g_Resources.CreateRenderTargetView( ResourceRenderTarget, pBackBuffer, NULL, &BackBufferRenderTarget );
+	g_Resources.Track( pBackBuffer, ResourceRenderTarget ); // Only buffer 0 can be got from the swap chain, so only it is counted
 	pBackBuffer->Release();
 	if( FAILED( hr ) ) return false;
 
 
-	// Create a texture for a depth buffer
+	// Create a texture for a depth buffer. It has two slices, one for each eye, so both eyes can be rendered (and cleared) together. The
+	// first slice is also used when rendering straight to the back buffer. The texture has a typeless format so the shaders can read it
+	// too (for reprojection), through a view with the matching colour format
+	DXGI_FORMAT depthTextureFormat, depthReadFormat;
+	switch (DepthFormat)
+	{
+		case DXGI_FORMAT_D16_UNORM:
+			depthTextureFormat = DXGI_FORMAT_R16_TYPELESS;
+			depthReadFormat    = DXGI_FORMAT_R16_UNORM;
+			break;
+		case DXGI_FORMAT_D32_FLOAT:
+			depthTextureFormat = DXGI_FORMAT_R32_TYPELESS;
+			depthReadFormat    = DXGI_FORMAT_R32_FLOAT;
+			break;
+		default:
+			depthTextureFormat = DXGI_FORMAT_R24G8_TYPELESS;
+			depthReadFormat    = DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
+			break;
+	}
 	D3D10_TEXTURE2D_DESC descDepth;
 	descDepth.Width = g_ViewportWidth;
 	descDepth.Height = g_ViewportHeight;
 	descDepth.MipLevels = 1;
-	descDepth.ArraySize = 1;
-	descDepth.Format = DXGI_FORMAT_D32_FLOAT;
+	descDepth.ArraySize = 2;
+	descDepth.Format = depthTextureFormat;
 	descDepth.SampleDesc.Count = 1;
 	descDepth.SampleDesc.Quality = 0;
 	descDepth.Usage = D3D10_USAGE_DEFAULT;
-	descDepth.BindFlags = D3D10_BIND_DEPTH_STENCIL;
+	descDepth.BindFlags = D3D10_BIND_DEPTH_STENCIL | D3D10_BIND_SHADER_RESOURCE;
 	descDepth.CPUAccessFlags = 0;
 	descDepth.MiscFlags = 0;
-	hr = g_pd3dDevice->CreateTexture2D( &descDepth, NULL, &DepthStencil );
+	hr = g_Resources.CreateTexture2D( ResourceDepth, &descDepth, NULL, &DepthStencil );
 	if( FAILED( hr ) ) return false;
 
-	// Create the depth stencil view, i.e. indicate that the texture just created is to be used as a depth buffer
+	// Create the depth stencil views, i.e. indicate that the texture just created is to be used as a depth buffer. One view of both slices
+	// and one of each slice
 	D3D10_DEPTH_STENCIL_VIEW_DESC descDSV;
-	descDSV.Format = descDepth.Format;
-	descDSV.ViewDimension = D3D10_DSV_DIMENSION_TEXTURE2D;
-	descDSV.Texture2D.MipSlice = 0;
-	hr = g_pd3dDevice->CreateDepthStencilView( DepthStencil, &descDSV, &DepthStencilView );
-	if( FAILED( hr ) ) return false;
+	descDSV.Format = DepthFormat;
+	descDSV.ViewDimension = D3D10_DSV_DIMENSION_TEXTURE2DARRAY;
+	descDSV.Texture2DArray.MipSlice = 0;
+	descDSV.Texture2DArray.FirstArraySlice = 0;
+	descDSV.Texture2DArray.ArraySize = 2;
+	if (FAILED( g_Resources.CreateDepthStencilView( ResourceDepth, DepthStencil, &descDSV, &StereoDepthStencilView ) )) return false;
+	descDSV.Texture2DArray.ArraySize = 1;
+	if (FAILED( g_Resources.CreateDepthStencilView( ResourceDepth, DepthStencil, &descDSV, &DepthStencilView ) )) return false;
+	descDSV.Texture2DArray.FirstArraySlice = 1;
+	if (FAILED( g_Resources.CreateDepthStencilView( ResourceDepth, DepthStencil, &descDSV, &RightDepthStencilView ) )) return false;
+
+	// Shader view of the first slice
+	D3D10_SHADER_RESOURCE_VIEW_DESC depthSRDesc;
+	depthSRDesc.Format = depthReadFormat;
+	depthSRDesc.ViewDimension = D3D10_SRV_DIMENSION_TEXTURE2DARRAY;
+	depthSRDesc.Texture2DArray.MostDetailedMip = 0;
+	depthSRDesc.Texture2DArray.MipLevels = 1;
+	depthSRDesc.Texture2DArray.FirstArraySlice = 0;
+	depthSRDesc.Texture2DArray.ArraySize = 1;
+	if (FAILED( g_Resources.CreateShaderResourceView( ResourceDepth, DepthStencil, &depthSRDesc, &DepthShaderResource ) )) return false;
+
+
+	//**|3D|** Left and Right Render Target Textures ****//
+
+	// Create a texture array with a slice for each eye (0 = left, 1 = right). The anaglyph is created from this whichever way the eyes are rendered
+	D3D10_TEXTURE2D_DESC textureDesc;
+	textureDesc.Width  = g_ViewportWidth;  // Match views to viewport size
+	textureDesc.Height = g_ViewportHeight;
+	textureDesc.MipLevels = 1; // No mip-maps when rendering to textures (or we will have to render every level)
+	textureDesc.ArraySize = 2;
+	textureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM; // RGBA texture (8-bits each)
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.SampleDesc.Quality = 0;
+	textureDesc.Usage = D3D10_USAGE_DEFAULT;
+	textureDesc.BindFlags = D3D10_BIND_RENDER_TARGET | D3D10_BIND_SHADER_RESOURCE; // Indicate we will use texture as render target, and pass it to shaders
+	textureDesc.CPUAccessFlags = 0;
+	textureDesc.MiscFlags = 0;
+	if (FAILED( g_Resources.CreateTexture2D( ResourceRenderTarget, &textureDesc, NULL, &StereoTexture ) )) return false;
+
+	// Now get "views" of the texture as render targets - giving us an interface for rendering to the texture. Single-pass stereo renders
+	// both slices together, two-pass stereo renders each slice in turn
+	D3D10_RENDER_TARGET_VIEW_DESC rtDesc;
+	rtDesc.Format = textureDesc.Format;
+	rtDesc.ViewDimension = D3D10_RTV_DIMENSION_TEXTURE2DARRAY;
+	rtDesc.Texture2DArray.MipSlice = 0;
+	rtDesc.Texture2DArray.FirstArraySlice = 0;
+	rtDesc.Texture2DArray.ArraySize = 2;
+	if (FAILED( g_Resources.CreateRenderTargetView( ResourceRenderTarget, StereoTexture, &rtDesc, &StereoRenderTarget ) )) return false;
+	rtDesc.Texture2DArray.ArraySize = 1;
+	if (FAILED( g_Resources.CreateRenderTargetView( ResourceRenderTarget, StereoTexture, &rtDesc, &LeftRenderTarget ) )) return false;
+	rtDesc.Texture2DArray.FirstArraySlice = 1;
+	if (FAILED( g_Resources.CreateRenderTargetView( ResourceRenderTarget, StereoTexture, &rtDesc, &RightRenderTarget ) )) return false;
+
+	// And shader-resource "view" - giving us an interface for passing texture to shaders
+	D3D10_SHADER_RESOURCE_VIEW_DESC srDesc;
+	srDesc.Format = textureDesc.Format;
+	srDesc.ViewDimension = D3D10_SRV_DIMENSION_TEXTURE2DARRAY;
+	srDesc.Texture2DArray.MostDetailedMip = 0;
+	srDesc.Texture2DArray.MipLevels = 1;
+	srDesc.Texture2DArray.FirstArraySlice = 0;
+	srDesc.Texture2DArray.ArraySize = 2;
+	if (FAILED( g_Resources.CreateShaderResourceView( ResourceRenderTarget, StereoTexture, &srDesc, &StereoShaderResource ) )) return false;
+
+	// Single texture the left eye is rendered to for reprojection, with views to render to it and read it
+	textureDesc.ArraySize = 1;
+	if (FAILED( g_Resources.CreateTexture2D( ResourceRenderTarget, &textureDesc, NULL, &ReprojectTexture ) )) return false;
+	if (FAILED( g_Resources.CreateRenderTargetView( ResourceRenderTarget, ReprojectTexture, NULL, &ReprojectRenderTarget ) )) return false;
+	if (FAILED( g_Resources.CreateShaderResourceView( ResourceRenderTarget, ReprojectTexture, NULL, &ReprojectShaderResource ) )) return false;
+	textureDesc.ArraySize = 2;
+
+	// Multisampled versions if MSAA is selected. The multisampled depth buffer is only used for depth, so it has the depth format
+	descDepth.Format = DepthFormat;
+	descDepth.BindFlags = D3D10_BIND_DEPTH_STENCIL;
+	if (MSAASamples > 1 && !CreateMSAATargets( textureDesc, descDepth )) return false;
+
+	//***************************************************//
+
+	return true;
+}
+
+
+//**|3D|** Create the multisampled stereo texture and depth buffer, matching the descriptions of the single-sampled ones. Uses the
+// highest sample count supported for both formats up to the one selected, doesn't create anything if none are supported
+bool CreateMSAATargets( D3D10_TEXTURE2D_DESC textureDesc, D3D10_TEXTURE2D_DESC depthDesc )
+{
+	UINT samples = MSAASamples;
+	UINT colourQuality = 0, depthQuality = 0;
+	while (samples > 1)
+	{
+		g_pd3dDevice->CheckMultisampleQualityLevels( textureDesc.Format, samples, &colourQuality );
+		g_pd3dDevice->CheckMultisampleQualityLevels( depthDesc.Format, samples, &depthQuality );
+		if (colourQuality > 0 && depthQuality > 0) break;
+		samples /= 2;
+	}
+	if (samples <= 1) return true;
+
+	// Leave out MSAA rather than go over the render target or depth budgets, the eyes are drawn without it (see RenderScene)
+	textureDesc.SampleDesc.Count = samples;
+	depthDesc.SampleDesc.Count = samples;
+	if (!g_Resources.Fits( ResourceRenderTarget, CResourceRegistry::GetTextureSize( textureDesc ) ) ||
+	    !g_Resources.Fits( ResourceDepth, CResourceRegistry::GetTextureSize( depthDesc ) ))
+	{
+		OutputDebugStringA( "MSAA targets left out to stay within the memory budget\n" );
+		return true;
+	}
+
+	// Multisampled textures can't be read by shaders, they are resolved into the stereo texture instead
+	textureDesc.SampleDesc.Quality = 0;
+	textureDesc.BindFlags = D3D10_BIND_RENDER_TARGET;
+	if (FAILED( g_Resources.CreateTexture2D( ResourceRenderTarget, &textureDesc, NULL, &MSAAStereoTexture ) )) return false;
+
+	D3D10_RENDER_TARGET_VIEW_DESC rtDesc;
+	rtDesc.Format = textureDesc.Format;
+	rtDesc.ViewDimension = D3D10_RTV_DIMENSION_TEXTURE2DMSARRAY;
+	rtDesc.Texture2DMSArray.FirstArraySlice = 0;
+	rtDesc.Texture2DMSArray.ArraySize = 2;
+	if (FAILED( g_Resources.CreateRenderTargetView( ResourceRenderTarget, MSAAStereoTexture, &rtDesc, &MSAAStereoRenderTarget ) )) return false;
+	rtDesc.Texture2DMSArray.ArraySize = 1;
+	if (FAILED( g_Resources.CreateRenderTargetView( ResourceRenderTarget, MSAAStereoTexture, &rtDesc, &MSAALeftRenderTarget ) )) return false;
+	rtDesc.Texture2DMSArray.FirstArraySlice = 1;
+	if (FAILED( g_Resources.CreateRenderTargetView( ResourceRenderTarget, MSAAStereoTexture, &rtDesc, &MSAARightRenderTarget ) )) return false;
+
+	depthDesc.SampleDesc.Quality = 0;
+	if (FAILED( g_Resources.CreateTexture2D( ResourceDepth, &depthDesc, NULL, &MSAADepthStencil ) )) return false;
+
+	D3D10_DEPTH_STENCIL_VIEW_DESC dsDesc;
+	dsDesc.Format = depthDesc.Format;
+	dsDesc.ViewDimension = D3D10_DSV_DIMENSION_TEXTURE2DMSARRAY;
+	dsDesc.Texture2DMSArray.FirstArraySlice = 0;
+	dsDesc.Texture2DMSArray.ArraySize = 2;
+	if (FAILED( g_Resources.CreateDepthStencilView( ResourceDepth, MSAADepthStencil, &dsDesc, &MSAAStereoDepthStencilView ) )) return false;
+	dsDesc.Texture2DMSArray.ArraySize = 1;
+	if (FAILED( g_Resources.CreateDepthStencilView( ResourceDepth, MSAADepthStencil, &dsDesc, &MSAALeftDepthStencilView ) )) return false;
+	dsDesc.Texture2DMSArray.FirstArraySlice = 1;
+	if (FAILED( g_Resources.CreateDepthStencilView( ResourceDepth, MSAADepthStencil, &dsDesc, &MSAARightDepthStencilView ) )) return false;
 
 	return true;
 }
 
 
+// Release the objects created in CreateRenderTargets
+void ReleaseRenderTargets()
+{
+	SAFE_RELEASE( MSAARightDepthStencilView );
+	SAFE_RELEASE( MSAALeftDepthStencilView );
+	SAFE_RELEASE( MSAAStereoDepthStencilView );
+	SAFE_RELEASE( MSAADepthStencil );
+	SAFE_RELEASE( MSAARightRenderTarget );
+	SAFE_RELEASE( MSAALeftRenderTarget );
+	SAFE_RELEASE( MSAAStereoRenderTarget );
+	SAFE_RELEASE( MSAAStereoTexture );
+	SAFE_RELEASE( ReprojectShaderResource );
+	SAFE_RELEASE( ReprojectRenderTarget );
+	SAFE_RELEASE( ReprojectTexture );
+	SAFE_RELEASE( StereoShaderResource );
+	SAFE_RELEASE( StereoRenderTarget );
+	SAFE_RELEASE( RightRenderTarget );
+	SAFE_RELEASE( LeftRenderTarget );
+	SAFE_RELEASE( StereoTexture );
+	SAFE_RELEASE( DepthShaderResource );
+	SAFE_RELEASE( RightDepthStencilView );
+	SAFE_RELEASE( DepthStencilView );
+	SAFE_RELEASE( StereoDepthStencilView );
+	SAFE_RELEASE( DepthStencil );
+	SAFE_RELEASE( BackBufferRenderTarget );
+}
+
+
+// Change the size of the back buffer and all the render targets that match it
+bool ResizeRenderTargets( int width, int height )
+{
+	// All views of the swap chain buffers must be released before it can be resized
+	g_pd3dDevice->ClearState();
+	ReleaseRenderTargets();
+
+	// Keep the existing buffer count and format
+	if (FAILED( SwapChain->ResizeBuffers( 0, width, height, DXGI_FORMAT_UNKNOWN, 0 ) )) return false;
+	g_ViewportWidth = width;
+	g_ViewportHeight = height;
+
+	// Projection must match the new shape of the viewport
+	if (MainCamera)
+	{
+		MainCamera->SetAspect( static_cast<float>(width) / height );
+	}
+
+	return CreateRenderTargets();
+}
+
+
+// Resize the render targets if the window has changed size. Window resizes are only recorded as they happen (see WndProc), then
+// handled here once per frame, once the user has stopped dragging the window border and the size has settled for a moment. Changes
+// that leave the size the same (e.g. moving the window to another monitor) cost nothing
+void UpdateWindowSize()
+{
+	if (!ResizePending || InSizeMove || GetTickCount() - ResizeRequestTime < ResizeSettleTime) return;
+	ResizePending = false;
+
+	RECT rc;
+	GetClientRect( HWnd, &rc );
+	int width  = rc.right - rc.left;
+	int height = rc.bottom - rc.top;
+	if (width <= 0 || height <= 0 || (width == g_ViewportWidth && height == g_ViewportHeight)) return;
+
+	if (!ResizeRenderTargets( width, height ))
+	{
+		// Can't continue without render targets
+		DestroyWindow( HWnd );
+	}
+}
+
+
+// Wait until it is time for the next frame if the frame rate is limited. Sleep is only accurate to about a millisecond (with
+// timeBeginPeriod(1), see wWinMain), so sleep for most of the wait then give up the rest of the time slice until the time is reached
+void LimitFrameRate()
+{
+	if (MaxFrameRate <= 0.0f) return;
+
+	LARGE_INTEGER frequency, now;
+	QueryPerformanceFrequency( &frequency );
+	QueryPerformanceCounter( &now );
+	LONGLONG frameLength = static_cast<LONGLONG>(frequency.QuadPart / MaxFrameRate);
+	LONGLONG sleepMargin = frequency.QuadPart / 500; // 2ms
+
+	while (now.QuadPart < NextFrameTime.QuadPart)
+	{
+		Sleep( NextFrameTime.QuadPart - now.QuadPart > sleepMargin ? 1 : 0 );
+		QueryPerformanceCounter( &now );
+	}
+
+	// Schedule the next frame a fixed time after this one so the rate doesn't drift, unless we have fallen behind
+	NextFrameTime.QuadPart += frameLength;
+	if (NextFrameTime.QuadPart < now.QuadPart)
+	{
+		NextFrameTime.QuadPart = now.QuadPart + frameLength;
+	}
+}
+
+
 // Release the memory held by all objects created
 void ReleaseResources()
 {
 	if( g_pd3dDevice ) g_pd3dDevice->ClearState();
 
-	delete Light2;
-	delete Light1;
-	delete Ground;
-	delete Crate;
-	delete Stars;
-	delete Cube;
+	delete UpdateThread; // Stops the thread, which uses the scene
+	delete FrameCapture; // Writes the frames still being recorded
+	delete FileWatcher;
+	delete UpdateCamera;
+	delete Profiler;
+	delete RenderQueue;
+	delete Containers;
+	delete VenueLightFlares;
+	delete LightGrid;
+	delete BonePalette;
+	delete OcclusionCuller;
+	delete SparkParticles;
+	delete SmokeParticles;
+	delete Scene; // Deletes all the models
 	delete MainCamera;
+	delete JobSystem;
 
-	if (RightShaderResource)    RightShaderResource->Release();
-	if (LeftShaderResource)     LeftShaderResource->Release();
-	if (RightRenderTarget)      RightRenderTarget->Release();
-	if (LeftRenderTarget)       LeftRenderTarget->Release();
-	if (RightTexture)           RightTexture->Release();
-	if (LeftTexture)            LeftTexture->Release();
-    if (GroundDiffuseMap)       GroundDiffuseMap->Release();
-    if (LightDiffuseMap)        LightDiffuseMap->Release();
-    if (CrateDiffuseMap)        CrateDiffuseMap->Release();
-    if (StarsDiffuseMap)        StarsDiffuseMap->Release();
-    if (CubeDiffuseMap)         CubeDiffuseMap->Release();
+	ReleaseRenderTargets();
+	delete TextureManager;      // Releases all textures
+	if (PerObjectBuffer)        PerObjectBuffer->Release();
+	if (PerEyeBuffer)           PerEyeBuffer->Release();
+	if (PerFrameBuffer)         PerFrameBuffer->Release();
 	if (Effect)                 Effect->Release();
-	if (DepthStencilView)       DepthStencilView->Release();
-	if (BackBufferRenderTarget) BackBufferRenderTarget->Release();
-	if (DepthStencil)           DepthStencil->Release();
 	if (SwapChain)              SwapChain->Release();
 	if (g_pd3dDevice)           g_pd3dDevice->Release();
 }
@@ -256,47 +888,188 @@ void ReleaseResources()
 // All techniques in one file in this lab
 bool LoadEffectFile()
 {
-	ID3D10Blob* pErrors; // This strangely typed variable collects any errors when compiling the effect file
-	DWORD dwShaderFlags = D3D10_SHADER_ENABLE_STRICTNESS; // These "flags" are used to set the compiler options
+	// Release builds use the effect compiled when the project was built (Stereoscopic.fxo, see the post-build step in the project),
+	// which saves compiling all the shaders every time the app starts. Falls back to compiling the .fx file if it isn't there
+#ifndef _DEBUG
+	ifstream compiledFile( "Stereoscopic.fxo", ios::binary );
+	if (compiledFile)
+	{
+		vector<char> compiledEffect( (istreambuf_iterator<char>( compiledFile )), istreambuf_iterator<char>() );
+		if (!compiledEffect.empty() &&
+		    SUCCEEDED( D3D10CreateEffectFromMemory( &compiledEffect[0], compiledEffect.size(), 0, g_pd3dDevice, NULL, &Effect ) ))
+		{
+			return GetEffectVariables();
+		}
+	}
+#endif
+
+	Effect = CompileEffectFile( true );
+	if (!Effect) return false;
+	return GetEffectVariables();
+}
+
+
+// Compile the effect file, returns NULL on failure. The errors are shown in a message box, or if reportErrors is false (e.g. when the
+// app is already running) sent to the debugger output
+ID3D10Effect* CompileEffectFile( bool reportErrors )
+{
+	ID3D10Blob* pErrors = NULL; // This strangely typed variable collects any errors when compiling the effect file
+#ifdef _DEBUG
+	DWORD dwShaderFlags = D3D10_SHADER_ENABLE_STRICTNESS | D3D10_SHADER_DEBUG; // These "flags" are used to set the compiler options
+#else
+	DWORD dwShaderFlags = D3D10_SHADER_ENABLE_STRICTNESS | D3D10_SHADER_OPTIMIZATION_LEVEL3;
+#endif
 
 	// Load and compile the effect file
-	HRESULT hr = D3DX10CreateEffectFromFile( L"Stereoscopic.fx", NULL, NULL, "fx_4_0", dwShaderFlags, 0, g_pd3dDevice, NULL, NULL, &Effect, &pErrors, NULL );
+	ID3D10Effect* effect = NULL;
+	HRESULT hr = D3DX10CreateEffectFromFile( L"Stereoscopic.fx", NULL, NULL, "fx_4_0", dwShaderFlags, 0, g_pd3dDevice, NULL, NULL, &effect, &pErrors, NULL );
 	if( FAILED( hr ) )
 	{
-		if (pErrors != 0)  MessageBox( NULL, CA2CT(reinterpret_cast<char*>(pErrors->GetBufferPointer())), L"Error", MB_OK ); // Compiler error: display error message
-		else               MessageBox( NULL, L"Error loading FX file. Ensure your FX file is in the same folder as this executable.", L"Error", MB_OK );  // No error message - probably file not found
+		if (!reportErrors)
+		{
+			OutputDebugString( L"Error compiling Stereoscopic.fx, keeping the current effect\n" );
+			if (pErrors != 0)  OutputDebugStringA( reinterpret_cast<char*>(pErrors->GetBufferPointer()) );
+		}
+		else if (pErrors != 0)  MessageBox( NULL, CA2CT(reinterpret_cast<char*>(pErrors->GetBufferPointer())), L"Error", MB_OK ); // Compiler error: display error message
+		else                    MessageBox( NULL, L"Error loading FX file. Ensure your FX file is in the same folder as this executable.", L"Error", MB_OK );  // No error message - probably file not found
+		if (pErrors != 0)  pErrors->Release();
+		return NULL;
+	}
+	if (pErrors != 0)  pErrors->Release(); // Warnings
+	return effect;
+}
+
+// Compile the effect file again after it has changed, and swap it in place of the current effect. Called between frames, so nothing
+// is using the old effect's techniques and variables - they are all fetched again from the new effect, and the render queue's
+// techniques registered again. Always compiles the .fx file, even in release builds. The meshes' vertex layouts are kept, so changing
+// a vertex shader's inputs still needs a restart. Returns false, keeping the current effect, if the file doesn't compile or lacks
+// something the app uses
+bool ReloadEffectFile()
+{
+	ID3D10Effect* newEffect = CompileEffectFile( false );
+	if (!newEffect) return false;
+
+	ID3D10Effect* oldEffect = Effect;
+	Effect = newEffect;
+	if (!GetEffectVariables())
+	{
+		OutputDebugString( L"Stereoscopic.fx is missing techniques or variables, keeping the current effect\n" );
+		Effect = oldEffect;
+		GetEffectVariables();
+		newEffect->Release();
 		return false;
 	}
+	oldEffect->Release();
+	RegisterTechniques();
+	return true;
+}
 
-	// Select techniques from the compiled effect file
-	VertexLitTexTechnique    = Effect->GetTechniqueByName( "VertexLitTex" );
-	AdditiveTexTintTechnique = Effect->GetTechniqueByName( "AdditiveTexTint" );
-	AnaglyphTechnique        = Effect->GetTechniqueByName( "CreateAnaglyph" );
 
-	// Create variables to access global variables in the shaders from C++
-	WorldMatrixVar    = Effect->GetVariableByName( "WorldMatrix"    )->AsMatrix();
-	ViewMatrixVar     = Effect->GetVariableByName( "ViewMatrix"     )->AsMatrix();
-	ProjMatrixVar     = Effect->GetVariableByName( "ProjMatrix"     )->AsMatrix();
-	ViewProjMatrixVar = Effect->GetVariableByName( "ViewProjMatrix" )->AsMatrix();
+// Get the techniques and variables used from the loaded effect, and bind our constant buffers to it. Returns true on success, false if
+// any technique or variable is missing (an effect reloaded after an edit is only used if everything is there, see ReloadEffectFile)
+bool GetEffectVariables()
+{
+	// Select techniques from the compiled effect file. Missing names give invalid (not NULL) techniques and variables, so every one
+	// is checked below
+	bool valid = true;
+	if (!GetOpaqueTechniques( "PixelLitTex",                PixelLitTexTechniques[0] ))          valid = false;
+	if (!GetOpaqueTechniques( "PixelLitTexStereo",          PixelLitTexTechniques[1] ))          valid = false;
+	if (!GetOpaqueTechniques( "PlainTex",                   PlainTexTechniques[0] ))             valid = false;
+	if (!GetOpaqueTechniques( "PlainTexStereo",             PlainTexTechniques[1] ))             valid = false;
+	if (!GetOpaqueTechniques( "PixelLitTexInstanced",       PixelLitTexInstancedTechniques[0] )) valid = false;
+	if (!GetOpaqueTechniques( "PixelLitTexInstancedStereo", PixelLitTexInstancedTechniques[1] )) valid = false;
+	if (!GetOpaqueTechniques( "PixelLitTexSkinned",         PixelLitTexSkinnedTechniques[0] ))   valid = false;
+	if (!GetOpaqueTechniques( "PixelLitTexSkinnedStereo",   PixelLitTexSkinnedTechniques[1] ))   valid = false;
+	if (!GetOpaqueTechniques( "PlainTexSkinned",            PlainTexSkinnedTechniques[0] ))      valid = false;
+	if (!GetOpaqueTechniques( "PlainTexSkinnedStereo",      PlainTexSkinnedTechniques[1] ))      valid = false;
+	AdditiveTexTintTechnique = Effect->GetTechniqueByName( "AdditiveTexTint" );
+	AdditiveTexTintStereoTechnique = Effect->GetTechniqueByName( "AdditiveTexTintStereo" );
+	AdditiveTexTintInstancedTechnique       = Effect->GetTechniqueByName( "AdditiveTexTintInstanced" );
+	AdditiveTexTintInstancedStereoTechnique = Effect->GetTechniqueByName( "AdditiveTexTintInstancedStereo" );
+	for (int variant = 0; variant < NumCompositeVariants; ++variant)
+	{
+		for (int mode = 0; mode < NumAnaglyphModes; ++mode)
+		{
+			string name = string("Anaglyph") + AnaglyphModeNames[mode] + CompositeVariantSuffixes[variant];
+			AnaglyphTechniques[mode][variant] = Effect->GetTechniqueByName( name.c_str() );
+			if (!AnaglyphTechniques[mode][variant]->IsValid()) valid = false;
+		}
+		InterlaceTechniques[variant] = Effect->GetTechniqueByName( (string("CreateInterlaced") + CompositeVariantSuffixes[variant]).c_str() );
+		if (!InterlaceTechniques[variant]->IsValid()) valid = false;
+	}
+	OverdrawViewsTechnique = Effect->GetTechniqueByName( "ShowOverdrawViews" );
+	ReprojectTechnique = Effect->GetTechniqueByName( "Reproject" );
+	AdvanceParticlesTechnique     = Effect->GetTechniqueByName( "AdvanceParticles" );
+	DrawParticlesTechnique        = Effect->GetTechniqueByName( "DrawParticles" );
+	DrawParticlesStereoTechnique  = Effect->GetTechniqueByName( "DrawParticlesStereo" );
+	OcclusionBoxTechnique         = Effect->GetTechniqueByName( "OcclusionBox" );
+
+	// Create our own GPU buffers for each constant buffer in the shaders (once, they are kept if the effect is reloaded), and bind them
+	// in place of the effect's own buffers
+	if (!PerFrameBuffer &&
+	    (!CreateConstantBuffer( sizeof(SPerFrameConstants),  &PerFrameBuffer ) ||
+	     !CreateConstantBuffer( sizeof(SPerEyeConstants),    &PerEyeBuffer ) ||
+	     !CreateConstantBuffer( sizeof(SPerObjectConstants), &PerObjectBuffer )))
+	{
+		return false;
+	}
+	PerFrameBufferVar  = Effect->GetConstantBufferByName( "PerFrame" );
+	PerEyeBufferVar    = Effect->GetConstantBufferByName( "PerEye" );
+	PerObjectBufferVar = Effect->GetConstantBufferByName( "PerObject" );
+	PerFrameBufferVar-> SetConstantBuffer( PerFrameBuffer );
+	PerEyeBufferVar->   SetConstantBuffer( PerEyeBuffer );
+	PerObjectBufferVar->SetConstantBuffer( PerObjectBuffer );
+	BonePaletteVar     = Effect->GetConstantBufferByName( "BonePalette" );
+	ParticlesVar       = Effect->GetConstantBufferByName( "Particles" );
 
 	// Textures in shader (shader resources)
 	DiffuseMapVar = Effect->GetVariableByName( "DiffuseMap" )->AsShaderResource();
-	LeftViewVar   = Effect->GetVariableByName( "LeftView"   )->AsShaderResource();
-	RightViewVar  = Effect->GetVariableByName( "RightView"  )->AsShaderResource();
+	StereoViewsVar = Effect->GetVariableByName( "StereoViews" )->AsShaderResource();
+	ReprojectColourVar = Effect->GetVariableByName( "ReprojectColour" )->AsShaderResource();
+	ReprojectDepthVar  = Effect->GetVariableByName( "ReprojectDepth" )->AsShaderResource();
+	LightDataVar    = Effect->GetVariableByName( "LightData" )->AsShaderResource();
+	LightTilesVar   = Effect->GetVariableByName( "LightTiles" )->AsShaderResource();
+	LightIndicesVar = Effect->GetVariableByName( "LightIndices" )->AsShaderResource();
+
+	// The opaque, anaglyph and interlace techniques were checked as they were fetched, check the rest
+	return valid &&
+	       AdditiveTexTintTechnique->IsValid() && AdditiveTexTintStereoTechnique->IsValid() &&
+	       AdditiveTexTintInstancedTechnique->IsValid() && AdditiveTexTintInstancedStereoTechnique->IsValid() &&
+	       OverdrawViewsTechnique->IsValid() && ReprojectTechnique->IsValid() &&
+	       AdvanceParticlesTechnique->IsValid() && DrawParticlesTechnique->IsValid() && DrawParticlesStereoTechnique->IsValid() &&
+	       OcclusionBoxTechnique->IsValid() &&
+	       PerFrameBufferVar->IsValid() && PerEyeBufferVar->IsValid() && PerObjectBufferVar->IsValid() && BonePaletteVar->IsValid() &&
+	       ParticlesVar->IsValid() &&
+	       DiffuseMapVar->IsValid() && StereoViewsVar->IsValid() && ReprojectColourVar->IsValid() && ReprojectDepthVar->IsValid() &&
+	       LightDataVar->IsValid() && LightTilesVar->IsValid() && LightIndicesVar->IsValid();
+}
 
-	// Also access shader variables needed for lighting
-	CameraPosVar     = Effect->GetVariableByName( "CameraPos"     )->AsVector();
-	Light1PosVar     = Effect->GetVariableByName( "Light1Pos"     )->AsVector();
-	Light1ColourVar  = Effect->GetVariableByName( "Light1Colour"  )->AsVector();
-	Light2PosVar     = Effect->GetVariableByName( "Light2Pos"     )->AsVector();
-	Light2ColourVar  = Effect->GetVariableByName( "Light2Colour"  )->AsVector();
-	AmbientColourVar = Effect->GetVariableByName( "AmbientColour" )->AsVector();
-	SpecularPowerVar = Effect->GetVariableByName( "SpecularPower" )->AsScalar();
 
-	// Other shader variables
-	TintColourVar = Effect->GetVariableByName( "TintColour"  )->AsVector();
+// Get an opaque technique and its depth pre-pass and overdraw versions, which have the same name with "DepthOnly", "Prepassed",
+// "Overdraw" and "OverdrawPrepassed" added. Returns false if any of them is missing
+bool GetOpaqueTechniques( const string& name, SOpaqueTechniques& techniques )
+{
+	techniques.technique = Effect->GetTechniqueByName( name.c_str() );
+	techniques.depthOnly = Effect->GetTechniqueByName( (name + "DepthOnly").c_str() );
+	techniques.prepassed = Effect->GetTechniqueByName( (name + "Prepassed").c_str() );
+	techniques.overdraw  = Effect->GetTechniqueByName( (name + "Overdraw").c_str() );
+	techniques.overdrawPrepassed = Effect->GetTechniqueByName( (name + "OverdrawPrepassed").c_str() );
+	return techniques.technique->IsValid() && techniques.depthOnly->IsValid() && techniques.prepassed->IsValid() &&
+	       techniques.overdraw->IsValid() && techniques.overdrawPrepassed->IsValid();
+}
 
-	return true;
+
+// Create a GPU constant buffer of the given size (must be a multiple of 16 bytes). Filled with UpdateSubresource from the
+// C++ structures in ShaderConstants.h
+bool CreateConstantBuffer( UINT size, ID3D10Buffer** buffer )
+{
+	D3D10_BUFFER_DESC bufferDesc;
+	bufferDesc.BindFlags = D3D10_BIND_CONSTANT_BUFFER;
+	bufferDesc.Usage = D3D10_USAGE_DEFAULT;
+	bufferDesc.ByteWidth = size;
+	bufferDesc.CPUAccessFlags = 0;
+	bufferDesc.MiscFlags = 0;
+	return SUCCEEDED( g_Resources.CreateBuffer( ResourceBuffer, &bufferDesc, NULL, buffer ) );
 }
 
 
@@ -320,235 +1093,1475 @@ bool InitScene()
 	///////////////////////
 	// Load/Create models
 
-	Cube   = new CModel;
-	Stars = new CModel;
-	Crate  = new CModel;
-	Ground = new CModel;
-	Light1 = new CModel;
-	Light2 = new CModel;
+	// Add the models to the scene with their initial positions
+	Scene = new CScene;
+	Cube           = Scene->AddModel( D3DXVECTOR3(0, 15, 0) );
+	CModel* crate  = Scene->AddModel( D3DXVECTOR3(-10, 0, 90), D3DXVECTOR3(0.0f, ToRadians(40.0f), 0.0f), 6.0f );
+	CModel* ground = Scene->AddModel();
+	CModel* stars  = Scene->AddModel( D3DXVECTOR3(0, 0, 0), D3DXVECTOR3(0, 0, 0), 10000.0f );
+	Light1         = Scene->AddModel( D3DXVECTOR3(30, 10, 0), D3DXVECTOR3(0, 0, 0), 4.0f );
+	Light2         = Scene->AddModel( D3DXVECTOR3(-20, 30, 50), D3DXVECTOR3(0, 0, 0), 8.0f );
+
+	// Load all the meshes at once, the files are read and imported as jobs on the worker threads. The models below then share them
+	// through the mesh cache, these references are released once the models have their own
+	JobSystem = new CJobSystem;
+	if (!JobSystem->Init()) return false;
+	const char* meshFiles[] = { "Cube.x", "Stars.x", "CargoContainer.x", "Hills.x", "Light.x" };
+	vector<SMeshRequest> meshRequests;
+	for (unsigned int i = 0; i < sizeof(meshFiles) / sizeof(meshFiles[0]); ++i)
+	{
+		meshRequests.push_back( SMeshRequest( meshFiles[i], false, CompressedVertices ) );
+	}
+	vector<CMesh*> loadedMeshes;
+	CMeshCache::LoadMeshes( meshRequests, JobSystem, loadedMeshes );
 
 	// Load .X files for each model
-	if (!Cube->  Load( "Cube.x",  VertexLitTexTechnique )) return false;
-	if (!Stars->Load( "Stars.x", VertexLitTexTechnique )) return false;
-	if (!Crate-> Load( "CargoContainer.x", VertexLitTexTechnique )) return false;
-	if (!Ground->Load( "Hills.x", VertexLitTexTechnique )) return false;
-	if (!Light1->Load( "Light.x", AdditiveTexTintTechnique )) return false;
-	if (!Light2->Load( "Light.x", AdditiveTexTintTechnique )) return false;
-
-	// Initial positions
-	Cube->  SetPosition( D3DXVECTOR3(0, 15, 0) );
-	Crate-> SetPosition( D3DXVECTOR3(-10, 0, 90) );
-	Crate-> SetScale( 6.0f );
-	Crate-> SetRotation( D3DXVECTOR3(0.0f, ToRadians(40.0f), 0.0f) );
-	Stars-> SetScale( 10000.0f );
-	Light1->SetPosition( D3DXVECTOR3(30, 10, 0) );
-	Light1->SetScale( 4.0f );
-	Light2->SetPosition( D3DXVECTOR3(-20, 30, 50) );
-	Light2->SetScale( 8.0f );
+	if (!Cube->  Load( "Cube.x",  PixelLitTexTechniques[0].technique, false, CompressedVertices )) return false;
+	if (!stars-> Load( "Stars.x", PixelLitTexTechniques[0].technique, false, CompressedVertices )) return false;
+	if (!crate-> Load( "CargoContainer.x", PixelLitTexTechniques[0].technique, false, CompressedVertices )) return false;
+	if (!ground->Load( "Hills.x", PixelLitTexTechniques[0].technique, false, CompressedVertices )) return false;
+	if (!Light1->Load( "Light.x", AdditiveTexTintTechnique, false, CompressedVertices )) return false;
+	if (!Light2->Load( "Light.x", AdditiveTexTintTechnique, false, CompressedVertices )) return false;
+
+	// The light models use a special shader that tints them to match the light colour
+	Light1->SetShading( ShadingAdditiveTint );
+	Light1->SetTint( Light1Colour );
+	Light2->SetShading( ShadingAdditiveTint );
+	Light2->SetTint( Light2Colour );
+
+	// Instanced containers, placed in a row behind the crate. Shares its geometry with the crate through the mesh cache
+	Containers = new CInstancedModel;
+	if (!Containers->Load( "CargoContainer.x", PixelLitTexInstancedTechniques[0].technique, PixelLitTexInstancedTechniques[1].technique,
+	                       NumContainers, false, CompressedVertices )) return false;
+	for (unsigned int i = 0; i < NumContainers; ++i)
+	{
+		Containers->AddInstance( D3DXVECTOR3(-80.0f + i * 25.0f, 0, 140), D3DXVECTOR3(0.0f, ToRadians(90.0f + i * 7.0f), 0.0f), 4.0f );
+	}
 
+	// Lights - the two main lights follow their models, the venue lights are fixed in a ring with colours around the colour wheel
+	LightGrid = new CLightGrid;
+	if (!LightGrid->Init( 2 + NumVenueLights )) return false;
+	BonePalette = new CBonePalette;
+	if (!BonePalette->Init()) return false;
+	OcclusionCuller = new COcclusionCuller;
+	if (!OcclusionCuller->Init( OcclusionBoxTechnique )) return false;
+	Light1Index = LightGrid->AddLight( Light1->GetPosition(), Light1Colour );
+	Light2Index = LightGrid->AddLight( Light2->GetPosition(), Light2Colour );
+	if (NumVenueLights > 0)
+	{
+		VenueLightFlares = new CInstancedModel;
+		if (!VenueLightFlares->Load( "Light.x", AdditiveTexTintInstancedTechnique, AdditiveTexTintInstancedStereoTechnique, NumVenueLights,
+		                             false, CompressedVertices )) return false;
+		for (unsigned int i = 0; i < NumVenueLights; ++i)
+		{
+			float angle = 2.0f * static_cast<float>(D3DX_PI) * i / NumVenueLights;
+			D3DXVECTOR3 position = VenueLightCentre + D3DXVECTOR3( cosf(angle) * VenueLightRadius, VenueLightHeight, sinf(angle) * VenueLightRadius );
+			D3DXVECTOR3 colour( 0.5f + 0.5f * cosf(angle), 0.5f + 0.5f * cosf(angle - 2.094f), 0.5f + 0.5f * cosf(angle + 2.094f) );
+			colour *= VenueLightIntensity;
+			LightGrid->AddLight( position, colour );
+			VenueLightFlares->AddInstance( position, D3DXVECTOR3(0, 0, 0), 3.0f, colour );
+		}
+	}
 
-	//////////////////
-	// Load textures
+	for (unsigned int i = 0; i < loadedMeshes.size(); ++i)
+	{
+		CMeshCache::ReleaseMesh( loadedMeshes[i] );
+	}
 
-	if (FAILED( D3DX10CreateShaderResourceViewFromFile( g_pd3dDevice, L"StoneDiffuseSpecular.dds", NULL, NULL, &CubeDiffuseMap,  NULL ) )) return false;
-	if (FAILED( D3DX10CreateShaderResourceViewFromFile( g_pd3dDevice, L"CargoA.dds",               NULL, NULL, &CrateDiffuseMap, NULL ) )) return false;
-	if (FAILED( D3DX10CreateShaderResourceViewFromFile( g_pd3dDevice, L"StarsHi.jpg",              NULL, NULL, &StarsDiffuseMap, NULL ) )) return false;
-	if (FAILED( D3DX10CreateShaderResourceViewFromFile( g_pd3dDevice, L"tiles1.jpg",               NULL, NULL, &GroundDiffuseMap, NULL ) )) return false;
-	if (FAILED( D3DX10CreateShaderResourceViewFromFile( g_pd3dDevice, L"flare.jpg",                NULL, NULL, &LightDiffuseMap, NULL ) )) return false;
+	// Render queue
+	RenderQueue = new CRenderQueue;
+	RegisterTechniques();
 
 
-	//**|3D|** Left and Right Render Target Textures ****//
+	//////////////////
+	// Load textures
 
-	// Create the textures for left and right views
-	D3D10_TEXTURE2D_DESC textureDesc;
-	textureDesc.Width  = g_ViewportWidth;  // Match views to viewport size
-	textureDesc.Height = g_ViewportHeight;
-	textureDesc.MipLevels = 1; // No mip-maps when rendering to textures (or we will have to render every level)
-	textureDesc.ArraySize = 1;
-	textureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM; // RGBA texture (8-bits each)
-	textureDesc.SampleDesc.Count = 1;
-	textureDesc.SampleDesc.Quality = 0;
-	textureDesc.Usage = D3D10_USAGE_DEFAULT;
-	textureDesc.BindFlags = D3D10_BIND_RENDER_TARGET | D3D10_BIND_SHADER_RESOURCE; // Indicate we will use texture as render target, and pass it to shaders
-	textureDesc.CPUAccessFlags = 0;
-	textureDesc.MiscFlags = 0;
-	if (FAILED( g_pd3dDevice->CreateTexture2D( &textureDesc, NULL, &LeftTexture ) )) return false;
-	if (FAILED( g_pd3dDevice->CreateTexture2D( &textureDesc, NULL, &RightTexture ) )) return false;
+	// Textures are requested here but load on worker threads - models are drawn with a placeholder texture until their own
+	// texture is ready. Requesting the same file twice returns the same texture
+	TextureManager = new CTextureManager;
+	if (!TextureManager->Init()) return false;
+	CubeDiffuseMap   = TextureManager->GetTexture( L"StoneDiffuseSpecular.dds" );
+	CrateDiffuseMap  = TextureManager->GetTexture( L"CargoA.dds" );
+	StarsDiffuseMap  = TextureManager->GetTexture( L"StarsHi.jpg" );
+	GroundDiffuseMap = TextureManager->GetTexture( L"tiles1.jpg" );
+	LightDiffuseMap  = TextureManager->GetTexture( L"flare.jpg" );
+
+	Cube->  SetDiffuseMap( CubeDiffuseMap );
+	crate-> SetDiffuseMap( CrateDiffuseMap );
+	ground->SetDiffuseMap( GroundDiffuseMap );
+	stars-> SetDiffuseMap( StarsDiffuseMap );
+	stars-> SetBackground( true );
+	Light1->SetDiffuseMap( LightDiffuseMap );
+	Light2->SetDiffuseMap( LightDiffuseMap );
+	SmokeDiffuseMap  = TextureManager->GetTexture( L"Smoke.png" );
 
-	// Now get "views" of the textures as render targets - giving us an interface for rendering to the texture
-	if (FAILED( g_pd3dDevice->CreateRenderTargetView( LeftTexture, NULL, &LeftRenderTarget ) )) return false;
-	if (FAILED( g_pd3dDevice->CreateRenderTargetView( RightTexture, NULL, &RightRenderTarget ) )) return false;
 
-	// And shader-resource "view" - giving us an interface for passing texture to shaders
-	D3D10_SHADER_RESOURCE_VIEW_DESC srDesc;
-	srDesc.Format = textureDesc.Format;
-	srDesc.ViewDimension = D3D10_SRV_DIMENSION_TEXTURE2D;
-	srDesc.Texture2D.MostDetailedMip = 0;
-	srDesc.Texture2D.MipLevels = 1;
-	if (FAILED( g_pd3dDevice->CreateShaderResourceView( LeftTexture, &srDesc, &LeftShaderResource ) )) return false;
-	if (FAILED( g_pd3dDevice->CreateShaderResourceView( RightTexture, &srDesc, &RightShaderResource ) )) return false;
+	//////////////////
+	// Particles
+
+	// Smoke drifts up and spreads from a patch of ground beside the containers, covering the scene behind it
+	SParticleSettings smoke;
+	smoke.position      = D3DXVECTOR3( -110, 0, 140 );
+	smoke.emitterRadius = 6.0f;
+	smoke.numEmitters   = 32;
+	smoke.emitRate      = 4.0f;
+	smoke.velocity      = D3DXVECTOR3( 0, 6, 0 );
+	smoke.spread        = 2.0f;
+	smoke.acceleration  = D3DXVECTOR3( 0.5f, 0.5f, 0 ); // A little wind
+	smoke.life          = 6.0f;
+	smoke.startSize     = 3.0f;
+	smoke.endSize       = 12.0f;
+	smoke.colour        = D3DXVECTOR3( 0.6f, 0.6f, 0.65f );
+	smoke.opacity       = 0.6f;
+	SmokeParticles = new CParticleSystem;
+	if (!SmokeParticles->Init( smoke, AdvanceParticlesTechnique )) return false;
+
+	// Sparks burst from the orbiting light and fall under gravity, adding the light's colour
+	SParticleSettings sparks;
+	sparks.position      = Light1->GetPosition();
+	sparks.emitterRadius = 1.0f;
+	sparks.numEmitters   = 64;
+	sparks.emitRate      = 30.0f;
+	sparks.velocity      = D3DXVECTOR3( 0, 4, 0 );
+	sparks.spread        = 12.0f;
+	sparks.acceleration  = D3DXVECTOR3( 0, -30, 0 );
+	sparks.life          = 1.5f;
+	sparks.startSize     = 0.6f;
+	sparks.endSize       = 0.1f;
+	sparks.colour        = Light1Colour * 0.5f;
+	sparks.opacity       = 0.0f;
+	SparkParticles = new CParticleSystem;
+	if (!SparkParticles->Init( sparks, AdvanceParticlesTechnique )) return false;
 
-	//***************************************************//
 
-	return true;
-}
+	//////////////////
+	// Profiling
 
+	Profiler = new CProfiler;
+	if (!Profiler->Init()) return false;
 
-// Update the scene - move/rotate each model and the camera, then update their matrices
-void UpdateScene( float frameTime )
-{
-	// Control camera position and update its matrices (monoscopic version)
-	MainCamera->Control( frameTime, Key_Up, Key_Down, Key_Left, Key_Right, Key_W, Key_S, Key_A, Key_D );
-	MainCamera->UpdateMatrices();
-	
-	// Control cube position and update its world matrix each frame
-	Cube->Control( frameTime, Key_I, Key_K, Key_J, Key_L, Key_U, Key_O, Key_Period, Key_Comma );
-	Cube->UpdateMatrix();
-
-	// Update the orbiting light - a bit of a cheat with the static variable
-	static float Rotate = 0.0f;
-	Light1->SetPosition( Cube->GetPosition() + D3DXVECTOR3(cos(Rotate)*LightOrbitRadius, 0, sin(Rotate)*LightOrbitRadius) );
-	Rotate -= LightOrbitSpeed * frameTime;
-	Light1->UpdateMatrix();
-
-	// Objects that don't move still need a world matrix - could do this in SceneSetup function (which occurs once at the start of the app)
-	Stars->UpdateMatrix();
-	Crate->UpdateMatrix();
-	Ground->UpdateMatrix();
-	Light2->UpdateMatrix();
 
-	// Change the interocular distance on Page-up and Page-down
-	if (KeyHeld(Key_Next))
-	{
-		Interocular += 0.6f * frameTime;
-	}
-	if (KeyHeld(Key_Prior))
+	//////////////////
+	// Recording
+
+	FrameCapture = new CFrameCapture;
+	if (CaptureOnStart)
 	{
-		Interocular -= 0.6f * frameTime;
+		StartCapture();
 	}
-}
 
 
-//--------------------------------------------------------------------------------------
-// Scene Rendering
-//--------------------------------------------------------------------------------------
+	//////////////////
+	// Hot reload
 
-// Render all the models from the point of view of the given camera
-void RenderModels( CCamera* camera, EStereoscopic stereo /*= Monoscopic*/, float interocular /*=0.65*/ )
-{
-	// Pass the camera's matrices to the vertex shader and position to the vertex shader
-	ViewMatrixVar->SetMatrix( (float*)&camera->GetViewMatrix( stereo, interocular ) );
-	ProjMatrixVar->SetMatrix( (float*)&camera->GetProjectionMatrix( stereo, interocular ) );
-	CameraPosVar->SetRawValue( camera->GetPosition( stereo, interocular ), 0, 12 );
+	// Watch the working directory, which the effect file and assets are loaded from. Not being able to watch it isn't an error, the
+	// files just won't be reloaded
+	FileWatcher = new CFileWatcher;
+	if (!FileWatcher->Init( L"." ))
+	{
+		delete FileWatcher;
+		FileWatcher = NULL;
+	}
 
+	return true;
+}
 
-	// Render cube
-	WorldMatrixVar->SetMatrix( (float*)Cube->GetWorldMatrix() );  // Send the cube's world matrix to the shader
-    DiffuseMapVar->SetResource( CubeDiffuseMap );                 // Send the cube's diffuse/specular map to the shader
-	Cube->Render( VertexLitTexTechnique );                        // Pass rendering technique to the model class
 
-	// Same for the other models in the scene
-	WorldMatrixVar->SetMatrix( (float*)Crate->GetWorldMatrix() );
-    DiffuseMapVar->SetResource( CrateDiffuseMap );
-	Crate->Render( VertexLitTexTechnique );
+// Register the techniques with the render queue, again whenever the effect is reloaded. Techniques are drawn in the order registered,
+// with blended techniques after all the opaque ones
+void RegisterTechniques()
+{
+	RenderQueue->ClearTechniques();
+	SOpaqueTechniques* opaqueTechniques[] = { PixelLitTexTechniques, PlainTexTechniques, PixelLitTexSkinnedTechniques, PlainTexSkinnedTechniques };
+	for (unsigned int set = 0; set < sizeof(opaqueTechniques) / sizeof(opaqueTechniques[0]); ++set)
+	{
+		for (int stereo = 0; stereo < 2; ++stereo)
+		{
+			RenderQueue->RegisterTechnique( opaqueTechniques[set][stereo].technique );
+			RenderQueue->RegisterTechnique( opaqueTechniques[set][stereo].prepassed );
+			RenderQueue->RegisterTechnique( opaqueTechniques[set][stereo].depthOnly );
+			RenderQueue->RegisterTechnique( opaqueTechniques[set][stereo].overdraw );
+			RenderQueue->RegisterTechnique( opaqueTechniques[set][stereo].overdrawPrepassed );
+		}
+	}
+	RenderQueue->RegisterTechnique( AdditiveTexTintTechnique, true );
+	RenderQueue->RegisterTechnique( AdditiveTexTintStereoTechnique, true );
+}
 
-	WorldMatrixVar->SetMatrix( (float*)Ground->GetWorldMatrix() );
-    DiffuseMapVar->SetResource( GroundDiffuseMap );
-	Ground->Render( VertexLitTexTechnique );
 
-	WorldMatrixVar->SetMatrix( (float*)Stars->GetWorldMatrix() );
-    DiffuseMapVar->SetResource( StarsDiffuseMap );
-	Stars->Render( VertexLitTexTechnique );
+// Reload the files the file watcher has seen change: the effect file, meshes (.x files) and textures. Called between frames on the
+// render thread, so the new effect and geometry are in place before any draws use them. Textures load in the background as usual and
+// replace the old ones when ready. Files that fail to load leave the old version in use
+// A mesh reload changes the size of the scene's node arrays, which the update thread reads and writes each step, so the update thread
+// is paused from the first mesh reload until the models' nodes have been refreshed
+void ReloadChangedFiles()
+{
+	if (!FileWatcher) return;
 
-	WorldMatrixVar->SetMatrix( (float*)Light1->GetWorldMatrix() );
-    DiffuseMapVar->SetResource( LightDiffuseMap );
-	TintColourVar->SetRawValue( Light1Colour, 0, 12 ); // Using special shader that tints the light model to match the light colour
-	Light1->Render( AdditiveTexTintTechnique );
+	vector<wstring> changedFiles;
+	FileWatcher->GetChangedFiles( changedFiles );
+	vector<CMesh*> reloadedMeshes;
+	bool paused = false;
+	for (unsigned int i = 0; i < changedFiles.size(); ++i)
+	{
+		const wstring& fileName = changedFiles[i];
+		if (_wcsicmp( fileName.c_str(), L"Stereoscopic.fx" ) == 0)
+		{
+			ReloadEffectFile();
+		}
+		else if (fileName.length() > 2 && _wcsicmp( fileName.c_str() + fileName.length() - 2, L".x" ) == 0)
+		{
+			if (UpdateThread && !paused)
+			{
+				UpdateThread->Pause();
+				paused = true;
+			}
+			CMeshCache::ReloadMeshes( string( CW2A( fileName.c_str() ) ), &reloadedMeshes );
+		}
+		else
+		{
+			TextureManager->ReloadTexture( fileName ); // Ignores files that aren't loaded textures
+		}
+	}
 
-	WorldMatrixVar->SetMatrix( (float*)Light2->GetWorldMatrix() );
-    DiffuseMapVar->SetResource( LightDiffuseMap );
-	TintColourVar->SetRawValue( Light2Colour, 0, 12 );
-	Light2->Render( AdditiveTexTintTechnique );
+	// Models keep their level of detail between frames, and a reloaded mesh may have fewer. The models using a reloaded mesh take a
+	// new copy of its node hierarchy, as the parents, default matrices and inverse root matrices may all have changed (posed models
+	// go back to the default pose until posed again), and their bounds are rebuilt
+	if (!reloadedMeshes.empty())
+	{
+		for (unsigned int i = 0; i < Scene->GetNumModels(); ++i)
+		{
+			CModel* model = Scene->GetModel( i );
+			model->ResetLod();
+			if (find( reloadedMeshes.begin(), reloadedMeshes.end(), model->GetMesh() ) != reloadedMeshes.end())
+			{
+				Scene->SetNodes( i, model->GetMesh() );
+				Scene->SetDirty( i );
+			}
+		}
+	}
+	if (paused)
+	{
+		UpdateThread->Resume();
+	}
 }
 
 
-// Render everything in the scene
-void RenderScene()
+//**|3D|** Adjust the render scale towards the scale that should give the target GPU frame time. GPU time is roughly proportional to the
+// number of pixels, i.e. the square of the scale. Only moves part of the way each frame as the GPU times are a few frames old
+void UpdateRenderScale()
 {
-	//---------------------------
-	// Common rendering settings
+	float gpuTime = Profiler->GetLatestGPUTime( ProfileFrame );
+	if (gpuTime <= 0.0f) return;
 
-	// There are some common features all models that we will be rendering, set these once only
-	//**|3D|** Camera settings are different per-eye so not set as here (as they might be in the monoscopic case) ****//
+	float targetScale = RenderScale * sqrtf( DynamicResolutionTarget / gpuTime );
+	RenderScale += (targetScale - RenderScale) * 0.1f;
+	RenderScale = max( MinRenderScale, min( RenderScale, 1.0f ) );
+}
 
-	// Pass light information to the vertex shader - lights are the same for each model *** and every render target ***
-	Light1PosVar->    SetRawValue( Light1->GetPosition(), 0, 12 );  // Send 3 floats (12 bytes) from C++ LightPos variable (x,y,z) to shader counterpart (middle parameter is unused) 
-	Light1ColourVar-> SetRawValue( Light1Colour, 0, 12 );
-	Light2PosVar->    SetRawValue( Light2->GetPosition(), 0, 12 );
-	Light2ColourVar-> SetRawValue( Light2Colour, 0, 12 );
-	AmbientColourVar->SetRawValue( AmbientColour, 0, 12 );
-	SpecularPowerVar->SetFloat( SpecularPower );
-
-	// Setup the viewport - defines which part of the back-buffer we will render to (usually all of it)
-	D3D10_VIEWPORT vp;
-	vp.Width  = g_ViewportWidth;
-	vp.Height = g_ViewportHeight;
-	vp.MinDepth = 0.0f;
-	vp.MaxDepth = 1.0f;
-	vp.TopLeftX = 0;
-	vp.TopLeftY = 0;
-	g_pd3dDevice->RSSetViewports( 1, &vp );
+
+// Move/rotate each model and the given camera, doesn't update any matrices. The mouse counts are the mouse look totals the camera has
+// turned by. Runs on the update thread unless single threaded
+void UpdateSimulation( float frameTime, CCamera* camera, SMouseLookCounts& mouseCounts )
+{
+	// Control camera position. The benchmark moves the camera itself
+	if (!Benchmark.enabled)
+	{
+		ApplyMouseLook( camera, mouseCounts );
+		camera->Control( frameTime, Key_Up, Key_Down, Key_Left, Key_Right, Key_W, Key_S, Key_A, Key_D );
+	}
+
+	// Change the interocular distance on Page-up and Page-down
+	if (KeyHeld(Key_Next))
+	{
+		Interocular += 0.6f * frameTime;
+	}
+	if (KeyHeld(Key_Prior))
+	{
+		Interocular -= 0.6f * frameTime;
+	}
+	camera->SetInterocular( Interocular );
+	
+	// Control cube position
+	if (!Benchmark.enabled)
+	{
+		Cube->Control( frameTime, Key_I, Key_K, Key_J, Key_L, Key_U, Key_O, Key_Period, Key_Comma );
+	}
+
+	// Update the orbiting light
+	Light1->SetPosition( Cube->GetPosition() + D3DXVECTOR3(cos(LightOrbitAngle)*LightOrbitRadius, 0, sin(LightOrbitAngle)*LightOrbitRadius) );
+	LightOrbitAngle -= LightOrbitSpeed * frameTime;
+}
+
+// Update the scene on the main thread - move/rotate each model and the camera, then update their matrices and check the settings keys
+void UpdateScene( float frameTime )
+{
+	UpdateSimulation( frameTime, MainCamera, MainCameraMouse );
+
+	// Update the camera matrices (monoscopic and both eyes)
+	MainCamera->UpdateMatrices();
+
+	// Rebuild the world matrices of the models that moved, the others keep their matrices from earlier frames
+	Scene->UpdateMatrices();
+
+	UpdateSettings();
+}
+
+// Turn the camera by the mouse movement since the given totals, which are then brought up to date. The totals are kept up to date
+// with mouse look off too, so switching it on doesn't jump. Doesn't update the camera matrices
+void ApplyMouseLook( CCamera* camera, SMouseLookCounts& mouseCounts )
+{
+	LONG totalX, totalY;
+	GetMouseTotal( totalX, totalY );
+	if (MouseLook)
+	{
+		camera->Turn( (totalY - mouseCounts.y) * MouseLookSpeed, (totalX - mouseCounts.x) * MouseLookSpeed );
+	}
+	mouseCounts.x = totalX;
+	mouseCounts.y = totalY;
+}
+
+// Keys that change the rendering settings, always checked on the render thread
+void UpdateSettings()
+{
+	// Mouse look
+	if (KeyHit(Key_M))
+	{
+		MouseLook = !MouseLook;
+	}
+
+	// Switch between single-pass and two-pass stereo rendering
+	if (KeyHit(Key_F1))
+	{
+		SinglePassStereo = !SinglePassStereo;
+	}
+
+	// Profiler overlay and output
+	if (KeyHit(Key_F2))
+	{
+		ShowProfiler = !ShowProfiler;
+	}
+	if (KeyHit(Key_F3))
+	{
+		Profiler->WriteCSV( "Profile.csv" );
+	}
+
+	// Start or stop recording
+	if (KeyHit(Key_V))
+	{
+		if (FrameCapture->IsRecording())
+		{
+			FrameCapture->Stop();
+		}
+		else
+		{
+			StartCapture();
+		}
+	}
+
+	// Cycle through the anaglyph modes and output modes
+	if (KeyHit(Key_F4))
+	{
+		AnaglyphMode = static_cast<EAnaglyphMode>((AnaglyphMode + 1) % NumAnaglyphModes);
+	}
+	if (KeyHit(Key_F5))
+	{
+		OutputMode = static_cast<EOutputMode>((OutputMode + 1) % NumOutputModes);
+	}
+
+	// Anti-aliasing in the composite
+	if (KeyHit(Key_F7))
+	{
+		FXAA = !FXAA;
+	}
+
+	// Vertical sync
+	if (KeyHit(Key_F8))
+	{
+		VSync = !VSync;
+	}
+
+	// Reprojection of the left eye instead of rendering the right
+	if (KeyHit(Key_R))
+	{
+		Reprojection = !Reprojection;
+	}
+
+	// Depth pre-pass
+	if (KeyHit(Key_F11))
+	{
+		DepthPrepass = !DepthPrepass;
+	}
+
+	// Opaque draw order and the overdraw view
+	if (KeyHit(Key_Insert))
+	{
+		FrontToBack = !FrontToBack;
+	}
+	if (KeyHit(Key_F12))
+	{
+		ShowOverdraw = !ShowOverdraw;
+	}
+
+	// Particles
+	if (KeyHit(Key_P))
+	{
+		ShowParticles = !ShowParticles;
+	}
+
+	// Occlusion culling of the right eye
+	if (KeyHit(Key_C))
+	{
+		OcclusionCulling = !OcclusionCulling;
+	}
+
+	// Level of detail
+	if (KeyHit(Key_F9))
+	{
+		UseLods = !UseLods;
+	}
+
+	// Dynamic resolution - return to full resolution when switched off
+	if (KeyHit(Key_F6))
+	{
+		DynamicResolution = !DynamicResolution;
+		if (!DynamicResolution) RenderScale = 1.0f;
+	}
+	if (DynamicResolution)
+	{
+		UpdateRenderScale();
+	}
+}
+
+
+// One step of the update thread, moves everything on by the tick time and takes a snapshot of the transforms for the render thread
+void UpdateStep( float tickTime, SUpdateSnapshot& snapshot )
+{
+	UpdateSimulation( tickTime, UpdateCamera, UpdateCameraMouse );
+
+	// The camera's controls move along its axes, which come from its matrices
+	UpdateCamera->UpdateMatrices();
+
+	Scene->GetTransforms( snapshot.modelTransforms );
+	snapshot.cameraTransform = UpdateCamera->GetTransform();
+	snapshot.interocular = UpdateCamera->GetInterocular();
+	snapshot.mouseX = UpdateCameraMouse.x;
+	snapshot.mouseY = UpdateCameraMouse.y;
+}
+
+// Start the simulation on the update thread, from the current state of the scene and camera. The update thread uses a quaternion
+// camera so its transform can be slerped
+bool StartUpdateThread()
+{
+	MainCamera->SetUseQuaternion( true );
+	MainCamera->UpdateMatrices();
+	UpdateCamera = new CCamera( *MainCamera );
+	UpdateCameraMouse = MainCameraMouse;
+
+	UpdateThread = new CUpdateThread;
+	return UpdateThread->Start( UpdateStep, UpdateTickTime );
+}
+
+// Set the model world matrices and the main camera for this frame from the update thread's snapshots. Drawing one tick behind the
+// simulation means the time drawn is almost always between the last two snapshots, so their transforms can be blended rather than
+// extrapolated. Keeps the previous frame's state until the thread has published two snapshots
+void ApplyUpdateSnapshots()
+{
+	if (!UpdateThread->GetSnapshots( PreviousSnapshot, LatestSnapshot )) return;
+
+	float renderTime = UpdateThread->GetTime() - UpdateThread->GetTickTime();
+	float t = (renderTime - PreviousSnapshot.time) / (LatestSnapshot.time - PreviousSnapshot.time);
+	t = max( 0.0f, min( t, 1.0f ) );
+
+	Scene->SetInterpolatedTransforms( PreviousSnapshot.modelTransforms, LatestSnapshot.modelTransforms, t );
+
+	gen::CQuatTransform cameraTransform;
+	gen::Slerp( PreviousSnapshot.cameraTransform, LatestSnapshot.cameraTransform, t, cameraTransform );
+	MainCamera->SetTransform( cameraTransform );
+	MainCamera->SetInterocular( PreviousSnapshot.interocular + (LatestSnapshot.interocular - PreviousSnapshot.interocular) * t );
+	MainCamera->UpdateMatrices();
+
+	// The mouse totals the blended camera has turned by, for the late latch in RenderScene
+	MainCameraMouse.x = PreviousSnapshot.mouseX + static_cast<LONG>((LatestSnapshot.mouseX - PreviousSnapshot.mouseX) * t);
+	MainCameraMouse.y = PreviousSnapshot.mouseY + static_cast<LONG>((LatestSnapshot.mouseY - PreviousSnapshot.mouseY) * t);
+}
+
+
+
+//--------------------------------------------------------------------------------------
+// Scene Rendering
+//--------------------------------------------------------------------------------------
+
+// Distance of a model from the camera, used to sort draws
+float CameraDistance( CModel* model, const D3DXVECTOR3& cameraPos )
+{
+	D3DXVECTOR3 offset = model->GetWorldPosition() - cameraPos;
+	return D3DXVec3Length( &offset );
+}
+
+// Techniques for a sub-mesh with the given render method (gen::ERenderMethod). Plain materials are unlit, the others are lit per pixel.
+// There are no vertex-lit or untextured lit shaders, those methods use the pixel-lit technique (the models all have a diffuse map).
+// Skinned meshes use the skinned versions
+const SOpaqueTechniques& GetMaterialTechniques( unsigned int renderMethod, bool singlePassStereo, bool skinned )
+{
+	int stereo = singlePassStereo ? 1 : 0;
+	if (renderMethod == gen::PlainTexture || renderMethod == gen::PlainColour)
+	{
+		return skinned ? PlainTexSkinnedTechniques[stereo] : PlainTexTechniques[stereo];
+	}
+	return skinned ? PixelLitTexSkinnedTechniques[stereo] : PixelLitTexTechniques[stereo];
+}
+
+// Select the technique from a set for the main (not depth-only) draw of an opaque model, for the pre-pass and overdraw settings
+ID3D10EffectTechnique* GetMainTechnique( const SOpaqueTechniques& techniques )
+{
+	if (ShowOverdraw)
+	{
+		return DepthPrepass ? techniques.overdrawPrepassed : techniques.overdraw;
+	}
+	return DepthPrepass ? techniques.prepassed : techniques.technique;
+}
+
+// Submit an opaque draw of a model (or one of its sub-meshes) to the render queue. With the depth pre-pass the draw also has the
+// depth-only technique for the pre-pass
+void SubmitOpaque( CModel* model, ID3D10ShaderResourceView* diffuseMap, const SOpaqueTechniques& techniques, float depth,
+                   unsigned int numInstances, unsigned int subMesh )
+{
+	RenderQueue->Submit( model, diffuseMap, GetMainTechnique( techniques ), depth, numInstances, model->GetTint(),
+	                     DepthPrepass ? techniques.depthOnly : NULL, subMesh );
+}
+
+// Submit all the models to the render queue and sort them. Done once per frame, the queue is then drawn for each eye. Single-pass stereo
+// uses the stereo techniques, drawing two instances of each model. If selectLods is set, the visible models choose their level of
+// detail for an eye viewport of the given height, otherwise they keep the LOD they had
+//**|3D|** Models outside the frustum enclosing both eyes are not submitted, so each model is culled once for the frame rather than per eye.
+// The LOD is also chosen once for both eyes, from the monoscopic camera, and the skinned models' node matrices are uploaded once into the
+// bone palette
+void QueueModels( CCamera* camera, bool singlePassStereo, float viewportHeight, bool selectLods )
+{
+	ID3D10EffectTechnique* additiveTechnique = singlePassStereo ? AdditiveTexTintStereoTechnique : AdditiveTexTintTechnique;
+	unsigned int numInstances = singlePassStereo ? 2 : 1;
+
+	Scene->Cull( camera->GetStereoFrustum() );
+
+	// Depth for sorting is the distance of each model from the (monoscopic) camera - the eyes are close enough to share the order
+	D3DXVECTOR3 cameraPos = camera->GetPosition();
+
+	RenderQueue->Clear();
+	RenderQueue->SetFrontToBack( FrontToBack );
+	BonePalette->Clear();
+	for (unsigned int i = 0; i < Scene->GetNumModels(); ++i)
+	{
+		if (!Scene->IsVisible( i ))
+		{
+			continue;
+		}
+
+		CModel* model = Scene->GetModel( i );
+		if (!UseLods)
+		{
+			model->ResetLod();
+		}
+		else if (selectLods)
+		{
+			model->SelectLod( camera, viewportHeight, LodPixelError, LodMaxDisparity );
+		}
+		ID3D10ShaderResourceView* diffuseMap = model->GetDiffuseMap() ? model->GetDiffuseMap()->GetView() : NULL;
+		float depth = CameraDistance( model, cameraPos );
+		if (model->GetShading() == ShadingAdditiveTint)
+		{
+			if (ShowOverdraw) continue;
+			RenderQueue->Submit( model, diffuseMap, additiveTechnique, depth, numInstances, model->GetTint() );
+			continue;
+		}
+		CMesh* mesh = model->GetMesh();
+		if (!mesh || mesh->GetNumSubMeshes() == 0)
+		{
+			continue;
+		}
+
+		// A skinned model needs all its node matrices in the palette, one that doesn't fit is not drawn this frame
+		bool skinned = mesh->IsSkinned();
+		if (skinned && !BonePalette->AddModel( model ))
+		{
+			continue;
+		}
+
+		// One draw for the whole model if its sub-meshes share a render method (the usual case), otherwise a draw for each sub-mesh
+		unsigned int numSubMeshes = mesh->GetNumSubMeshes();
+		unsigned int renderMethod = mesh->GetSubMesh( 0 ).renderMethod;
+		bool oneMethod = true;
+		for (unsigned int subMesh = 1; subMesh < numSubMeshes && oneMethod; ++subMesh)
+		{
+			oneMethod = (mesh->GetSubMesh( subMesh ).renderMethod == renderMethod);
+		}
+		if (oneMethod)
+		{
+			SubmitOpaque( model, diffuseMap, GetMaterialTechniques( renderMethod, singlePassStereo, skinned ), depth, numInstances,
+			              AllSubMeshes );
+		}
+		else
+		{
+			for (unsigned int subMesh = 0; subMesh < numSubMeshes; ++subMesh)
+			{
+				SubmitOpaque( model, diffuseMap, GetMaterialTechniques( mesh->GetSubMesh( subMesh ).renderMethod, singlePassStereo, skinned ),
+				              depth, numInstances, subMesh );
+			}
+		}
+	}
+	RenderQueue->Sort();
+	BonePalette->Upload();
+	BonePaletteVar->SetConstantBuffer( BonePalette->GetBuffer() );
+}
+
+
+// Render the instanced models, each with a single draw call. These are opaque so are drawn before the render queue (which ends
+// with the blended models). Pass depthOnly for the depth pre-pass. Camera constants must already be set
+void RenderInstancedModels( bool singlePassStereo, bool depthOnly )
+{
+	// The world matrices come from the instance data, but the shaders still decode the mesh positions with the per-object constants
+	PerObjectConstants.MeshPosScale  = Containers->GetMesh()->GetPositionScale();
+	PerObjectConstants.MeshPosOffset = Containers->GetMesh()->GetPositionOffset();
+	g_pd3dDevice->UpdateSubresource( PerObjectBuffer, 0, NULL, &PerObjectConstants, 0, 0 );
+
+	const SOpaqueTechniques& techniques = PixelLitTexInstancedTechniques[singlePassStereo ? 1 : 0];
+	if (depthOnly)
+	{
+		Containers->Render( techniques.depthOnly, singlePassStereo );
+		return;
+	}
+	DiffuseMapVar->SetResource( CrateDiffuseMap->GetView() );
+	Containers->Render( GetMainTechnique( techniques ), singlePassStereo );
+}
+
+
+// Render the flares of the venue lights, if there are any. They are additive blended so are drawn after the render queue (their order
+// doesn't matter). Camera constants must already be set
+void RenderLightFlares( bool singlePassStereo )
+{
+	if (!VenueLightFlares) return;
+
+	PerObjectConstants.MeshPosScale  = VenueLightFlares->GetMesh()->GetPositionScale();
+	PerObjectConstants.MeshPosOffset = VenueLightFlares->GetMesh()->GetPositionOffset();
+	g_pd3dDevice->UpdateSubresource( PerObjectBuffer, 0, NULL, &PerObjectConstants, 0, 0 );
+
+	DiffuseMapVar->SetResource( LightDiffuseMap->GetView() );
+	if (singlePassStereo)
+	{
+		VenueLightFlares->Render( AdditiveTexTintInstancedStereoTechnique, true );
+	}
+	else
+	{
+		VenueLightFlares->Render( AdditiveTexTintInstancedTechnique );
+	}
+}
+
+
+// Draw the instanced models, the models queued for this frame and the light flares. With the depth pre-pass the opaque models are
+// drawn to the depth buffer first, so the main draws only shade visible pixels. Camera constants must already be set. The queued draws
+// are predicated on the given occlusion culler's tests, if any
+void RenderQueuedModels( bool singlePassStereo, COcclusionCuller* occlusion /*= NULL*/ )
+{
+	if (DepthPrepass)
+	{
+		RenderInstancedModels( singlePassStereo, true );
+		RenderQueue->Flush( PerObjectBuffer, DiffuseMapVar, true, occlusion );
+	}
+	RenderInstancedModels( singlePassStereo, false );
+	RenderQueue->Flush( PerObjectBuffer, DiffuseMapVar, false, occlusion );
+	if (!ShowOverdraw)
+	{
+		RenderLightFlares( singlePassStereo );
+		RenderParticles( singlePassStereo );
+	}
+}
+
+
+// Draw the particle systems as simulated this frame. Blended, so drawn after the opaque models. The particles aren't sorted - the glowing
+// sparks add up in any order, and the smoke is soft enough that the order is hard to see
+void RenderParticles( bool singlePassStereo )
+{
+	if (!ShowParticles) return;
+
+	ID3D10EffectTechnique* technique = singlePassStereo ? DrawParticlesStereoTechnique : DrawParticlesTechnique;
+	DiffuseMapVar->SetResource( SmokeDiffuseMap->GetView() );
+	SmokeParticles->Render( technique, ParticlesVar );
+	DiffuseMapVar->SetResource( LightDiffuseMap->GetView() );
+	SparkParticles->Render( technique, ParticlesVar );
+}
+
+
+// Render all the models from the point of view of the given camera, into the given viewport (which must already be set). Occlusion
+// predicated rendering skips the models the occlusion culler's last tests found hidden
+void RenderModels( CCamera* camera, const D3D10_VIEWPORT& viewport, EStereoscopic stereo /*= Monoscopic*/,
+                   bool occlusionPredicated /*= false*/ )
+{
+	// Pass the camera's matrices to the vertex shader and position to the vertex shader - one update for all the camera data. The pixel
+	// shaders find their light tile relative to the viewport
+	PerEyeConstants.ViewMatrix = camera->GetViewMatrix( stereo );
+	PerEyeConstants.ProjMatrix = camera->GetProjectionMatrix( stereo );
+	PerEyeConstants.CameraPos  = camera->GetPosition( stereo );
+	PerEyeConstants.ViewportOrigin = D3DXVECTOR2( static_cast<float>(viewport.TopLeftX), static_cast<float>(viewport.TopLeftY) );
+	g_pd3dDevice->UpdateSubresource( PerEyeBuffer, 0, NULL, &PerEyeConstants, 0, 0 );
+
+	// Draw the instanced models then the models queued for this frame
+	RenderQueuedModels( false, occlusionPredicated ? OcclusionCuller : NULL );
+}
+
+
+//**|3D|** Render all the models for both eyes in a single pass. Each model is drawn once with two instances, the shaders select the eye
+// matrices from the instance ID and send each instance to its own slice of the stereo render target array
+void RenderModelsStereo( CCamera* camera, const D3D10_VIEWPORT eyeViewports[2] )
+{
+	// Pass both eye's matrices, positions and viewports to the shaders in one go
+	for (int eye = 0; eye < 2; ++eye)
+	{
+		EStereoscopic stereo = (eye == 0) ? StereoscopicLeft : StereoscopicRight;
+		PerEyeConstants.StereoViewMatrix[eye] = camera->GetViewMatrix( stereo );
+		PerEyeConstants.StereoProjMatrix[eye] = camera->GetProjectionMatrix( stereo );
+		PerEyeConstants.StereoCameraPos[eye]  = D3DXVECTOR4( camera->GetPosition( stereo ), 1.0f );
+		PerEyeConstants.StereoViewportOrigin[eye] = D3DXVECTOR4( static_cast<float>(eyeViewports[eye].TopLeftX),
+		                                                         static_cast<float>(eyeViewports[eye].TopLeftY), 0.0f, 0.0f );
+	}
+	g_pd3dDevice->UpdateSubresource( PerEyeBuffer, 0, NULL, &PerEyeConstants, 0, 0 );
+
+	// Draw the instanced models then the models queued for this frame - queued with the stereo techniques and two instances each
+	RenderQueuedModels( true );
+}
+
+
+//**|3D|** Get the viewport for each eye for the current output mode and render scale, given the viewport covering the whole back buffer
+void GetEyeViewports( const D3D10_VIEWPORT& fullViewport, D3D10_VIEWPORT eyeViewports[2] )
+{
+	eyeViewports[0] = eyeViewports[1] = fullViewport;
+	if (OutputMode == OutputSideBySide)
+	{
+		eyeViewports[0].Width = fullViewport.Width / 2;
+		eyeViewports[1].Width = fullViewport.Width - eyeViewports[0].Width;
+		eyeViewports[1].TopLeftX = eyeViewports[0].Width;
+	}
+	else if (OutputMode == OutputTopBottom)
+	{
+		eyeViewports[0].Height = fullViewport.Height / 2;
+		eyeViewports[1].Height = fullViewport.Height - eyeViewports[0].Height;
+		eyeViewports[1].TopLeftY = eyeViewports[0].Height;
+	}
+	else if (OutputMode == OutputInterlaced)
+	{
+		// Each eye only needs half the rows, rendered to the top of its slice of the stereo texture
+		eyeViewports[0].Height = eyeViewports[1].Height = (fullViewport.Height + 1) / 2;
+	}
+
+	// The eyes are rendered to the top-left of the stereo texture at reduced resolution
+	if (OutputMode == OutputAnaglyph || OutputMode == OutputInterlaced)
+	{
+		for (int eye = 0; eye < 2; ++eye)
+		{
+			eyeViewports[eye].Width  = max( 1, static_cast<int>(eyeViewports[eye].Width  * RenderScale) );
+			eyeViewports[eye].Height = max( 1, static_cast<int>(eyeViewports[eye].Height * RenderScale) );
+		}
+	}
+}
+
+
+//**|3D|** Write both slices of the stereo texture from the left eye's render: slice 0 is a copy and slice 1 is the left eye shifted to
+// the right eye's view using its depth (see ReprojectRightEye in the .fx file). The eyes share the given viewport
+void ReprojectEyes( const D3D10_VIEWPORT& viewport )
+{
+	// The depth buffer is read by the shader so it can't be bound for output. The slices are written as two render targets
+	ID3D10RenderTargetView* targets[2] = { LeftRenderTarget, RightRenderTarget };
+	g_pd3dDevice->OMSetRenderTargets( 2, targets, NULL );
+	g_pd3dDevice->RSSetViewports( 1, &viewport );
+	ReprojectColourVar->SetResource( ReprojectShaderResource );
+	ReprojectDepthVar->SetResource( DepthShaderResource );
+
+	// Full-screen triangle, no vertex data needed (see FullScreenTriangle in the .fx file)
+	g_pd3dDevice->IASetInputLayout( NULL );
+	g_pd3dDevice->IASetPrimitiveTopology( D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
+	ReprojectTechnique->GetPassByIndex(0)->Apply(0);
+	g_pd3dDevice->Draw( 3, 0 );
+
+	// Unbind the textures so they can be rendered to again next frame
+	ReprojectColourVar->SetResource( NULL );
+	ReprojectDepthVar->SetResource( NULL );
+	ReprojectTechnique->GetPassByIndex(0)->Apply(0);
+}
+
+
+// Start recording to files named with the current time (see FrameCapture)
+void StartCapture()
+{
+	SYSTEMTIME time;
+	GetLocalTime( &time );
+	wchar_t baseName[64];
+	swprintf_s( baseName, L"Capture_%04d%02d%02d_%02d%02d%02d", time.wYear, time.wMonth, time.wDay, time.wHour, time.wMinute, time.wSecond );
+	FrameCapture->Start( CaptureFormat, baseName );
+}
+
+// Pass this frame to the recording: both eyes from the stereo texture if they were composited from it, otherwise the back buffer
+void CaptureFrame( bool composite, const D3D10_VIEWPORT& eyeViewport )
+{
+	if (composite && CaptureEyes)
+	{
+		// Only the top-left of each slice is used when the eyes are rendered at a reduced scale
+		FrameCapture->CaptureFrame( StereoTexture, static_cast<UINT>(eyeViewport.Width), static_cast<UINT>(eyeViewport.Height) );
+	}
+	else
+	{
+		ID3D10Texture2D* backBuffer;
+		if (SUCCEEDED( SwapChain->GetBuffer( 0, __uuidof( ID3D10Texture2D ), ( LPVOID* )&backBuffer ) ))
+		{
+			FrameCapture->CaptureFrame( backBuffer, g_ViewportWidth, g_ViewportHeight );
+			backBuffer->Release();
+		}
+	}
+}
+
+
+// Render everything in the scene, the given time after the last frame (used to move the particles)
+void RenderScene( float frameTime )
+{
+	Profiler->BeginFrame();
+	Profiler->Begin( ProfileFrame );
+	Profiler->Begin( ProfileSetup );
+
+	// Finish creating any textures the loading threads have completed, they will be used from this frame on
+	TextureManager->Update();
+
+	// Late latch - turn the camera by the mouse movement since it was updated, as close as possible to the matrices being used
+	if (MouseLook && !Benchmark.enabled)
+	{
+		ApplyMouseLook( MainCamera, MainCameraMouse );
+		MainCamera->UpdateMatrices();
+	}
+
+	//---------------------------
+	// Common rendering settings
+
+	// There are some common features all models that we will be rendering, set these once only
+	//**|3D|** Camera settings are different per-eye so not set as here (as they might be in the monoscopic case) ****//
+
+	// Setup the viewports - defines which part of the render target we will render to. Each eye has its own viewport, which depends on the
+	// output mode (see GetEyeViewports). The full viewport is used for the composite
+	D3D10_VIEWPORT fullViewport;
+	fullViewport.Width  = g_ViewportWidth;
+	fullViewport.Height = g_ViewportHeight;
+	fullViewport.MinDepth = 0.0f;
+	fullViewport.MaxDepth = 1.0f;
+	fullViewport.TopLeftX = 0;
+	fullViewport.TopLeftY = 0;
+	D3D10_VIEWPORT eyeViewports[2];
+	GetEyeViewports( fullViewport, eyeViewports );
+
+	// Pass light information to the shaders - lights are the same for each model *** and every render target *** so upload them once per frame
+	LightGrid->SetLightPosition( Light1Index, Light1->GetWorldPosition() );
+	LightGrid->SetLightPosition( Light2Index, Light2->GetWorldPosition() );
+	// The lights are binned into the tiles of the eye viewports, one set of tiles covers both eyes. If the grid's buffers can't be created
+	// the views are NULL and the shaders see no lights, it tries again next frame
+	LightGrid->Build( MainCamera, eyeViewports );
+	LightDataVar->   SetResource( LightGrid->GetLightView() );
+	LightTilesVar->  SetResource( LightGrid->GetTileView() );
+	LightIndicesVar->SetResource( LightGrid->GetIndexView() );
+
+	// Simulate the particles once for both eyes. The sparks follow the light as it is drawn this frame
+	if (ShowParticles)
+	{
+		SparkParticles->SetPosition( Light1->GetWorldPosition() );
+		SmokeParticles->Advance( AdvanceParticlesTechnique, ParticlesVar, frameTime );
+		SparkParticles->Advance( AdvanceParticlesTechnique, ParticlesVar, frameTime );
+	}
+	PerFrameConstants.NumLightTiles[0] = LightGrid->GetTilesX();
+	PerFrameConstants.NumLightTiles[1] = LightGrid->GetTilesY();
+	PerFrameConstants.LightTileScale   = 1.0f / CLightGrid::TileSize;
+	PerFrameConstants.AmbientColour = AmbientColour;
+	PerFrameConstants.SpecularPower = SpecularPower;
+
+	//**|3D|** Part of the stereo texture used by the eyes, for upscaling in the composite. Stop half a texel short of the edge so the
+	// bilinear filter doesn't pick up pixels outside it
+	PerFrameConstants.StereoViewScale = D3DXVECTOR2( static_cast<float>(eyeViewports[0].Width) / g_ViewportWidth,
+	                                                 static_cast<float>(eyeViewports[0].Height) / g_ViewportHeight );
+	PerFrameConstants.StereoViewMaxUV = D3DXVECTOR2( (eyeViewports[0].Width - 0.5f) / g_ViewportWidth,
+	                                                 (eyeViewports[0].Height - 0.5f) / g_ViewportHeight );
+	PerFrameConstants.StereoViewTexelSize = D3DXVECTOR2( 1.0f / g_ViewportWidth, 1.0f / g_ViewportHeight );
+
+	//**|3D|** Reprojection - a point at view depth z is i*p*(1/z - 1/s) pixels further right in the right eye than in the left (i is the
+	// interocular distance, s the screen distance, p the horizontal projection scale of the eye's view; see GetDisparity). The depth
+	// buffer holds d = (f/z)(z - n)/(f - n), which makes the shift A - B*d with A = i*p*(1/n - 1/s) and B = i*p*(f - n)/(n*f). Search
+	// the shifts from the far clip to the near, limited to a fraction of the eye's width
+	float nearClip = MainCamera->GetNearClip();
+	float farClip  = MainCamera->GetFarClip();
+	float eyeWidth = static_cast<float>(eyeViewports[0].Width);
+	float shiftScale = MainCamera->GetInterocular() * MainCamera->GetProjectionScale( eyeWidth / MainCamera->GetAspect() );
+	float nearShift = shiftScale * (1.0f / nearClip - 1.0f / MainCamera->GetScreenDistance());
+	float farShift  = shiftScale * (1.0f / farClip  - 1.0f / MainCamera->GetScreenDistance());
+	float maxShift  = ReprojectMaxShift * eyeWidth;
+	PerFrameConstants.ReprojectParams = D3DXVECTOR4( nearShift, shiftScale * (farClip - nearClip) / (nearClip * farClip),
+	                                                 max( min( nearShift, farShift ), -maxShift ), min( max( nearShift, farShift ), maxShift ) );
+	PerFrameConstants.ReprojectMaxX = eyeWidth - 1.0f;
+	g_pd3dDevice->UpdateSubresource( PerFrameBuffer, 0, NULL, &PerFrameConstants, 0, 0 );
 
 
 	//**|3D|****************************************//
 	// Render left and right images of scene
 
-	// Select the texture to use for rendering to, will share the depth/stencil buffer with the backbuffer though
-	g_pd3dDevice->OMSetRenderTargets( 1, &LeftRenderTarget, DepthStencilView );
+	// Anaglyph and interlaced output render the eyes into the slices of the stereo texture then combine them onto the back buffer.
+	// The other outputs render the eyes straight to the back buffer
+	bool composite = (OutputMode == OutputAnaglyph || OutputMode == OutputInterlaced);
 
-	// Clear the texture and the depth buffer
-	g_pd3dDevice->ClearRenderTargetView( LeftRenderTarget, &BackgroundColour[0] );
-	g_pd3dDevice->ClearDepthStencilView( DepthStencilView, D3D10_CLEAR_DEPTH, 1.0f, 0 );
+	// Reprojection only renders the left eye, which isn't multisampled (see Reprojection)
+	bool reproject = Reprojection && composite;
+
+	// Views to render the eyes to when they are composited - the multisampled versions if MSAA is available
+	bool msaa = composite && !reproject && MSAAStereoTexture != NULL;
+	ID3D10RenderTargetView* stereoTarget = msaa ? MSAAStereoRenderTarget : StereoRenderTarget;
+	ID3D10RenderTargetView* leftTarget   = msaa ? MSAALeftRenderTarget   : LeftRenderTarget;
+	ID3D10RenderTargetView* rightTarget  = msaa ? MSAARightRenderTarget  : RightRenderTarget;
+	ID3D10DepthStencilView* stereoDepth  = msaa ? MSAAStereoDepthStencilView : StereoDepthStencilView;
+	ID3D10DepthStencilView* leftDepth    = msaa ? MSAALeftDepthStencilView   : DepthStencilView;
+	ID3D10DepthStencilView* rightDepth   = msaa ? MSAARightDepthStencilView  : RightDepthStencilView;
+
+	// Frame-sequential output and reprojection render only one eye, so there is nothing to gain from single-pass stereo
+	bool singlePassStereo = SinglePassStereo && OutputMode != OutputFrameSequential && !reproject;
+
+	// Queue and sort the models once, the queue is drawn for each eye. Frame-sequential output draws the eyes in alternate frames, so
+	// the LODs are only chosen before the left eye to keep the same LOD for the pair
+	bool selectLods = (OutputMode != OutputFrameSequential || FrameSequentialEye == StereoscopicRight);
+	QueueModels( MainCamera, singlePassStereo, static_cast<float>(eyeViewports[0].Height), selectLods );
+	Profiler->End( ProfileSetup );
+
+	// The overdraw view adds up from black
+	const D3DXVECTOR4 overdrawBackground( 0.0f, 0.0f, 0.0f, 1.0f );
+	const float* clearColour = ShowOverdraw ? &overdrawBackground[0] : &BackgroundColour[0];
+
+	// Only the 24-bit depth format has a stencil channel to clear
+	UINT depthClearFlags = D3D10_CLEAR_DEPTH | (DepthFormat == DXGI_FORMAT_D24_UNORM_S8_UINT ? D3D10_CLEAR_STENCIL : 0);
+
+	if (OutputMode == OutputFrameSequential)
+	{
+		// Alternate eyes each frame, the display (or glasses) must be synchronised to the refresh to show each eye to the right viewer
+		FrameSequentialEye = (FrameSequentialEye == StereoscopicLeft) ? StereoscopicRight : StereoscopicLeft;
+		EProfileScope scope = (FrameSequentialEye == StereoscopicLeft) ? ProfileLeftEye : ProfileRightEye;
+		Profiler->Begin( scope );
+		g_pd3dDevice->OMSetRenderTargets( 1, &BackBufferRenderTarget, DepthStencilView );
+		g_pd3dDevice->ClearRenderTargetView( BackBufferRenderTarget, clearColour );
+		g_pd3dDevice->ClearDepthStencilView( DepthStencilView, depthClearFlags, 1.0f, 0 );
+		g_pd3dDevice->RSSetViewports( 1, &fullViewport );
+		RenderModels( MainCamera, fullViewport, FrameSequentialEye );
+		Profiler->End( scope );
+	}
+	else if (reproject)
+	{
+		// Render the left eye to its own texture with the first slice of the depth buffer, then make both slices of the stereo texture
+		// from them
+		Profiler->Begin( ProfileLeftEye );
+		g_pd3dDevice->OMSetRenderTargets( 1, &ReprojectRenderTarget, DepthStencilView );
+		g_pd3dDevice->ClearRenderTargetView( ReprojectRenderTarget, clearColour );
+		g_pd3dDevice->ClearDepthStencilView( DepthStencilView, depthClearFlags, 1.0f, 0 );
+		g_pd3dDevice->RSSetViewports( 1, &eyeViewports[0] );
+		RenderModels( MainCamera, eyeViewports[0], StereoscopicLeft );
+		Profiler->End( ProfileLeftEye );
+
+		Profiler->Begin( ProfileReproject );
+		ReprojectEyes( eyeViewports[0] );
+		Profiler->End( ProfileReproject );
+	}
+	else if (singlePassStereo)
+	{
+		// Both eyes rendered together, so only one clear of each target. The geometry shader sends each eye to its own slice (stereo
+		// texture) or its own viewport (back buffer)
+		Profiler->Begin( ProfileStereoEyes );
+		ID3D10RenderTargetView* renderTarget = composite ? stereoTarget : BackBufferRenderTarget;
+		ID3D10DepthStencilView* depthStencil = composite ? stereoDepth  : DepthStencilView;
+		g_pd3dDevice->OMSetRenderTargets( 1, &renderTarget, depthStencil );
+		g_pd3dDevice->ClearRenderTargetView( renderTarget, clearColour );
+		g_pd3dDevice->ClearDepthStencilView( depthStencil, depthClearFlags, 1.0f, 0 );
+		g_pd3dDevice->RSSetViewports( 2, eyeViewports );
+		RenderModelsStereo( MainCamera, eyeViewports );
+		Profiler->End( ProfileStereoEyes );
+	}
+	else
+	{
+		// Each eye rendered in turn, to its slice of the stereo texture or its part of the back buffer. Each eye has its own slice of the
+		// depth buffer, so both slices are cleared together. When rendering to the back buffer the eyes don't overlap so they share
+		// the first slice and it is only cleared once
+		if (!composite)
+		{
+			leftTarget = rightTarget = BackBufferRenderTarget;
+			leftDepth = rightDepth = DepthStencilView;
+		}
+		g_pd3dDevice->ClearDepthStencilView( composite ? stereoDepth : DepthStencilView, depthClearFlags, 1.0f, 0 );
 
-	// Render everything from the left camera's point of view
-	RenderModels( MainCamera, StereoscopicLeft, Interocular );
+		// Select the target to use for rendering to and clear it
+		Profiler->Begin( ProfileLeftEye );
+		g_pd3dDevice->OMSetRenderTargets( 1, &leftTarget, leftDepth );
+		g_pd3dDevice->ClearRenderTargetView( leftTarget, clearColour );
 
+		// Render everything from the left camera's point of view
+		g_pd3dDevice->RSSetViewports( 1, &eyeViewports[0] );
+		RenderModels( MainCamera, eyeViewports[0], StereoscopicLeft );
 
-	vp.TopLeftX = 0;
-	g_pd3dDevice->RSSetViewports( 1, &vp );
+		// Test the opaque models against the left eye's depth while its camera constants are still set. The GPU has the results by the
+		// time the right eye's draws need them, so there is no wait. The instanced models are occluders outside the queue, so find how
+		// near they come
+		if (OcclusionCulling)
+		{
+			const D3DXMATRIXA16& leftView = MainCamera->GetViewMatrix( StereoscopicLeft );
+			float occluderDistance = MainCamera->GetFarClip();
+			for (unsigned int i = 0; i < Containers->GetNumInstances(); ++i)
+			{
+				D3DXVECTOR3 centre;
+				float radius;
+				Containers->GetInstanceBoundingSphere( i, centre, radius );
+				float depth = centre.x * leftView._13 + centre.y * leftView._23 + centre.z * leftView._33 + leftView._43;
+				occluderDistance = min( occluderDistance, depth - radius );
+			}
+			OcclusionCuller->IssueQueries( RenderQueue, MainCamera, StereoscopicLeft, occluderDistance, OcclusionBoxTechnique,
+			                               PerObjectBuffer );
+		}
+		Profiler->End( ProfileLeftEye );
 
-	// Same again for right view
-	g_pd3dDevice->OMSetRenderTargets( 1, &RightRenderTarget, DepthStencilView );
-	g_pd3dDevice->ClearRenderTargetView( RightRenderTarget, &BackgroundColour[0] );
-	g_pd3dDevice->ClearDepthStencilView( DepthStencilView, D3D10_CLEAR_DEPTH, 1.0f, 0 );
-	RenderModels( MainCamera, StereoscopicRight, Interocular );
+		// Same again for right view
+		Profiler->Begin( ProfileRightEye );
+		g_pd3dDevice->OMSetRenderTargets( 1, &rightTarget, rightDepth );
+		if (composite)
+		{
+			g_pd3dDevice->ClearRenderTargetView( rightTarget, clearColour );
+		}
+		g_pd3dDevice->RSSetViewports( 1, &eyeViewports[1] );
+		RenderModels( MainCamera, eyeViewports[1], StereoscopicRight, OcclusionCulling );
+		Profiler->End( ProfileRightEye );
+	}
 
 	
 	//***********************************//
-	// Create Anaglyph on Back Buffer
+	// Combine Eyes on Back Buffer
 
-	// Render full-screen quad over back-buffer using analglyph pixel shader to combine left and right views
+	if (composite)
+	{
+		// Render full-screen triangle over back-buffer using analglyph or interlacing pixel shader to combine left and right views
 
-	// Select the back buffer to use for rendering (ignore depth-buffer for full-screen quad) and select left and right views for use in shader
-	g_pd3dDevice->OMSetRenderTargets( 1, &BackBufferRenderTarget, DepthStencilView );
-	LeftViewVar->SetResource( LeftShaderResource );
-	RightViewVar->SetResource( RightShaderResource );
+		// Select the back buffer to use for rendering (no depth-buffer for full-screen triangle) and select left and right views for use in shader
+		Profiler->Begin( ProfileComposite );
 
-	// Using special vertex shader than creates its own data (see .fx file). No need to set vertex/index buffer, just draw 4 vertices of quad
-	g_pd3dDevice->IASetInputLayout( NULL );
-	g_pd3dDevice->IASetPrimitiveTopology( D3D10_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP );
-	ID3D10EffectTechnique * pTech = NULL;
-	AnaglyphTechnique->GetPassByIndex(0)->Apply(0);
-	g_pd3dDevice->Draw( 4, 0 );
+		// Resolve multisampled eyes into the stereo texture so the shader can read them
+		if (msaa)
+		{
+			for (UINT slice = 0; slice < 2; ++slice)
+			{
+				UINT subresource = D3D10CalcSubresource( 0, slice, 1 );
+				g_pd3dDevice->ResolveSubresource( StereoTexture, subresource, MSAAStereoTexture, subresource, DXGI_FORMAT_R8G8B8A8_UNORM );
+			}
+		}
+
+		g_pd3dDevice->OMSetRenderTargets( 1, &BackBufferRenderTarget, NULL );
+		g_pd3dDevice->RSSetViewports( 1, &fullViewport );
+		StereoViewsVar->SetResource( StereoShaderResource );
+
+		// Using special vertex shader than creates its own data (see .fx file). No need to set vertex/index buffer, just draw 3 vertices of triangle
+		g_pd3dDevice->IASetInputLayout( NULL );
+		g_pd3dDevice->IASetPrimitiveTopology( D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
+		int variant = (RenderScale < 1.0f ? CompositeScaled : 0) | (FXAA ? CompositeFXAA : 0);
+		ID3D10EffectTechnique* compositeTechnique = (OutputMode == OutputInterlaced) ? InterlaceTechniques[variant] : AnaglyphTechniques[AnaglyphMode][variant];
+		if (ShowOverdraw)
+		{
+			// The eyes' overdraw counts are shown side by side, unmixed by the anaglyph matrices or interlacing
+			compositeTechnique = OverdrawViewsTechnique;
+		}
+		compositeTechnique->GetPassByIndex(0)->Apply(0);
+		g_pd3dDevice->Draw( 3, 0 );
+
+		// Unbind the eye textures from the shader so they can be used as render targets again next frame
+		StereoViewsVar->SetResource( NULL );
+		compositeTechnique->GetPassByIndex(0)->Apply(0);
+		Profiler->End( ProfileComposite );
+	}
+	else
+	{
+		// Anything drawn after this (e.g. the profiler overlay) covers the whole back buffer
+		g_pd3dDevice->RSSetViewports( 1, &fullViewport );
+	}
+
+	// Record the frame without the profiler overlay
+	if (FrameCapture->IsRecording())
+	{
+		Profiler->Begin( ProfileCapture );
+		CaptureFrame( composite, eyeViewports[0] );
+		Profiler->End( ProfileCapture );
+	}
 
 	//***********************************//
 
 
+	// Profiler timings over the top of the anaglyph
+	if (ShowProfiler)
+	{
+		Profiler->Begin( ProfileOverlay );
+		Profiler->RenderOverlay();
+		Profiler->End( ProfileOverlay );
+	}
+
+
 	//---------------------------
 	// Display the Scene
 
 	// After we've finished drawing to the off-screen back buffer, we "present" it to the front buffer (the screen)
-	SwapChain->Present( 0, 0 );
+	Profiler->Begin( ProfilePresent );
+	SwapChain->Present( (VSync || OutputMode == OutputFrameSequential) ? 1 : 0, 0 ); // Frame-sequential output must present each eye on its own refresh
+	Profiler->End( ProfilePresent );
+
+	Profiler->End( ProfileFrame );
+	Profiler->EndFrame();
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////////////
+// Benchmark
+////////////////////////////////////////////////////////////////////////////////////////
+
+// Read the settings from the command line: the anaglyph and output modes (see EAnaglyphMode, EOutputMode), depth buffer format,
+// render scale, anti-aliasing, depth pre-pass, reprojection, occlusion culling, mouse look, extra lights, particles, recording, frame
+// pacing, memory budgets and benchmark settings (see SBenchmarkSettings)
+void ParseCommandLine( LPWSTR cmdLine )
+{
+	// Tokenise a copy of the command line at spaces
+	vector<wchar_t> line( cmdLine, cmdLine + wcslen( cmdLine ) + 1 );
+	wchar_t* context = NULL;
+	wchar_t* token = wcstok_s( &line[0], L" ", &context );
+	while (token)
+	{
+		if (_wcsicmp( token, L"-benchmark" ) == 0)
+		{
+			Benchmark.enabled = true;
+		}
+		else if (_wcsicmp( token, L"-mathbenchmark" ) == 0)
+		{
+			MathBenchmark = true;
+		}
+		else if (_wcsicmp( token, L"-frames" ) == 0 && (token = wcstok_s( NULL, L" ", &context )) != NULL)
+		{
+			Benchmark.numFrames = max( _wtoi( token ), 1 );
+		}
+		else if (_wcsicmp( token, L"-resolutions" ) == 0 && (token = wcstok_s( NULL, L" ", &context )) != NULL)
+		{
+			// Comma separated list of WxH
+			wchar_t* sizeContext = NULL;
+			wchar_t* sizeToken = wcstok_s( token, L",", &sizeContext );
+			while (sizeToken)
+			{
+				SIZE size;
+				if (swscanf_s( sizeToken, L"%ldx%ld", &size.cx, &size.cy ) == 2 && size.cx > 0 && size.cy > 0)
+				{
+					Benchmark.resolutions.push_back( size );
+				}
+				sizeToken = wcstok_s( NULL, L",", &sizeContext );
+			}
+		}
+		else if (_wcsicmp( token, L"-anaglyph" ) == 0 && (token = wcstok_s( NULL, L" ", &context )) != NULL)
+		{
+			for (int mode = 0; mode < NumAnaglyphModes; ++mode)
+			{
+				wstring name( AnaglyphModeNames[mode], AnaglyphModeNames[mode] + strlen( AnaglyphModeNames[mode] ) );
+				if (_wcsicmp( token, name.c_str() ) == 0)
+				{
+					AnaglyphMode = static_cast<EAnaglyphMode>(mode);
+				}
+			}
+		}
+		else if (_wcsicmp( token, L"-stereo" ) == 0 && (token = wcstok_s( NULL, L" ", &context )) != NULL)
+		{
+			for (int mode = 0; mode < NumOutputModes; ++mode)
+			{
+				wstring name( OutputModeNames[mode], OutputModeNames[mode] + strlen( OutputModeNames[mode] ) );
+				if (_wcsicmp( token, name.c_str() ) == 0)
+				{
+					OutputMode = static_cast<EOutputMode>(mode);
+				}
+			}
+		}
+		else if (_wcsicmp( token, L"-depth" ) == 0 && (token = wcstok_s( NULL, L" ", &context )) != NULL)
+		{
+			int depthBits = _wtoi( token );
+			if      (depthBits == 16) DepthFormat = DXGI_FORMAT_D16_UNORM;
+			else if (depthBits == 32) DepthFormat = DXGI_FORMAT_D32_FLOAT;
+			else                      DepthFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
+		}
+		else if (_wcsicmp( token, L"-scale" ) == 0 && (token = wcstok_s( NULL, L" ", &context )) != NULL)
+		{
+			RenderScale = max( MinRenderScale, min( static_cast<float>(_wtof( token )), 1.0f ) );
+		}
+		else if (_wcsicmp( token, L"-dynamicres" ) == 0)
+		{
+			DynamicResolution = true;
+		}
+		else if (_wcsicmp( token, L"-msaa" ) == 0 && (token = wcstok_s( NULL, L" ", &context )) != NULL)
+		{
+			MSAASamples = max( _wtoi( token ), 1 );
+		}
+		else if (_wcsicmp( token, L"-fxaa" ) == 0)
+		{
+			FXAA = true;
+		}
+		else if (_wcsicmp( token, L"-prepass" ) == 0)
+		{
+			DepthPrepass = true;
+		}
+		else if (_wcsicmp( token, L"-reproject" ) == 0)
+		{
+			Reprojection = true;
+		}
+		else if (_wcsicmp( token, L"-noocclusion" ) == 0)
+		{
+			OcclusionCulling = false;
+		}
+		else if (_wcsicmp( token, L"-mouselook" ) == 0)
+		{
+			MouseLook = true;
+		}
+		else if (_wcsicmp( token, L"-nolod" ) == 0)
+		{
+			UseLods = false;
+		}
+		else if (_wcsicmp( token, L"-fullvertices" ) == 0)
+		{
+			CompressedVertices = false;
+		}
+		else if (_wcsicmp( token, L"-lights" ) == 0 && (token = wcstok_s( NULL, L" ", &context )) != NULL)
+		{
+			NumVenueLights = min( static_cast<unsigned int>(max( _wtoi( token ), 0 )), MaxVenueLights );
+		}
+		else if (_wcsicmp( token, L"-capture" ) == 0 && (token = wcstok_s( NULL, L" ", &context )) != NULL)
+		{
+			CaptureOnStart = true;
+			CaptureEyes = (_wcsicmp( token, L"composite" ) != 0);
+		}
+		else if (_wcsicmp( token, L"-rawvideo" ) == 0)
+		{
+			CaptureFormat = CaptureRawVideo;
+		}
+		else if (_wcsicmp( token, L"-noparticles" ) == 0)
+		{
+			ShowParticles = false;
+		}
+		else if (_wcsicmp( token, L"-singlethread" ) == 0)
+		{
+			SingleThreaded = true;
+		}
+		else if (_wcsicmp( token, L"-buffers" ) == 0 && (token = wcstok_s( NULL, L" ", &context )) != NULL)
+		{
+			SwapChainBuffers = max( 1, min( _wtoi( token ), 3 ) );
+		}
+		else if (_wcsicmp( token, L"-vsync" ) == 0)
+		{
+			VSync = true;
+		}
+		else if (_wcsicmp( token, L"-maxfps" ) == 0 && (token = wcstok_s( NULL, L" ", &context )) != NULL)
+		{
+			MaxFrameRate = max( static_cast<float>(_wtof( token )), 0.0f );
+		}
+		else if (_wcsicmp( token, L"-latency" ) == 0 && (token = wcstok_s( NULL, L" ", &context )) != NULL)
+		{
+			MaxFrameLatency = max( _wtoi( token ), 0 );
+		}
+		else if (_wcsicmp( token, L"-output" ) == 0 && (token = wcstok_s( NULL, L" ", &context )) != NULL)
+		{
+			Benchmark.outputFile = token;
+		}
+		else if (_wcsicmp( token, L"-budget" ) == 0 && (token = wcstok_s( NULL, L" ", &context )) != NULL)
+		{
+			// Category by its name in the overlay (mesh, texture, target, depth, buffer or import), then the budget in MB. A missing
+			// size skips this switch only - if the next argument is another switch it is read as normal
+			wchar_t* categoryToken = token;
+			if (categoryToken[0] == L'-')
+			{
+				OutputDebugString( L"-budget needs a category and a size in MB, ignored\n" );
+				continue; // Parse the next switch without reading another token
+			}
+			token = wcstok_s( NULL, L" ", &context );
+			wchar_t* sizeEnd = NULL;
+			long megabytes = token ? wcstol( token, &sizeEnd, 10 ) : 0;
+			if (!token || sizeEnd == token || *sizeEnd != 0 || megabytes < 0)
+			{
+				OutputDebugString( (wstring( L"-budget " ) + categoryToken + L" needs a size in MB, ignored\n").c_str() );
+				if (token && token[0] == L'-') continue; // Parse the next switch without reading another token
+			}
+			else
+			{
+				int category = 0;
+				while (category < NumResourceCategories)
+				{
+					const char* categoryName = CResourceRegistry::GetCategoryName( static_cast<EResourceCategory>(category) );
+					wstring name( categoryName, categoryName + strlen( categoryName ) );
+					if (_wcsicmp( categoryToken, name.c_str() ) == 0) break;
+					++category;
+				}
+				if (category < NumResourceCategories)
+				{
+					g_Resources.SetBudget( static_cast<EResourceCategory>(category), static_cast<UINT64>(megabytes) * 1024 * 1024 );
+				}
+				else
+				{
+					OutputDebugString( (wstring( L"Unknown -budget category: " ) + categoryToken + L", ignored\n").c_str() );
+				}
+			}
+		}
+		token = wcstok_s( NULL, L" ", &context );
+	}
+}
+
+
+// Set the camera to its position on the benchmark path at the given time
+void SetBenchmarkCamera( float time )
+{
+	float pathLength = BenchmarkPath[NumBenchmarkKeys - 1].time;
+	time = fmod( time, pathLength );
+
+	unsigned int key = 0;
+	while (key < NumBenchmarkKeys - 2 && time > BenchmarkPath[key + 1].time)
+	{
+		++key;
+	}
+	const SCameraKey& key0 = BenchmarkPath[key];
+	const SCameraKey& key1 = BenchmarkPath[key + 1];
+	float t = (time - key0.time) / (key1.time - key0.time);
+
+	// Convert the keys once, the rotations use the same Z, X then Y order as the camera's Euler angles
+	if (BenchmarkTransforms.empty())
+	{
+		for (unsigned int k = 0; k < NumBenchmarkKeys; ++k)
+		{
+			const D3DXVECTOR3& rotation = BenchmarkPath[k].rotation;
+			gen::CVector3 angles( ToRadians(rotation.x), ToRadians(rotation.y), ToRadians(rotation.z) );
+			gen::CQuaternion orientation( gen::MatrixRotation( angles, gen::kZXY ) );
+			orientation.Normalise();
+			BenchmarkTransforms.push_back( gen::CQuatTransform( orientation, *reinterpret_cast<const gen::CVector3*>(&BenchmarkPath[k].position),
+			                                                    gen::CVector3::kOne ) );
+		}
+	}
+
+	// Slerp the orientation rather than interpolating the Euler angles, the camera then builds its matrix straight from the quaternion
+	gen::CQuatTransform transform;
+	gen::Slerp( &BenchmarkTransforms[key], &BenchmarkTransforms[key + 1], &t, &transform, 1 );
+	MainCamera->SetTransform( transform );
+}
+
+
+// Render the benchmark frames for the current settings, returns the time for each measured frame in ms. Returns false if the
+// window was closed
+bool BenchmarkFrames( vector<float>& frameTimes )
+{
+	// Same starting state every time
+	LightOrbitAngle = 0.0f;
+	SmokeParticles->Reset();
+	SparkParticles->Reset();
+	frameTimes.clear();
+
+	CTimer timer;
+	timer.Start();
+	for (unsigned int frame = 0; frame < Benchmark.warmupFrames + Benchmark.numFrames; ++frame)
+	{
+		// Keep the window responsive
+		MSG msg;
+		while (PeekMessage( &msg, NULL, 0, 0, PM_REMOVE ))
+		{
+			if (msg.message == WM_QUIT) return false;
+			TranslateMessage( &msg );
+			DispatchMessage( &msg );
+		}
+
+		SetBenchmarkCamera( frame * BenchmarkTimeStep );
+		UpdateScene( BenchmarkTimeStep );
+		RenderScene( BenchmarkTimeStep );
+
+		float frameTime = timer.GetLapTime() * 1000.0f;
+		if (frame >= Benchmark.warmupFrames)
+		{
+			frameTimes.push_back( frameTime );
+		}
+	}
+	return true;
+}
+
+
+// Run the benchmark for each resolution and stereo method, writing the statistics to the output file. Returns false on failure
+// Frames are presented without waiting for vertical sync whatever the -vsync setting, so the times aren't capped at the refresh rate.
+// Frame-sequential output is the exception, it must present each eye on its own refresh, so its times are capped. The output mode and
+// whether frames were synced are recorded on each line
+bool RunBenchmark()
+{
+	ofstream file( Benchmark.outputFile.c_str() );
+	if (!file)
+	{
+		return false;
+	}
+	bool savedVSync = VSync;
+	VSync = false;
+	bool synced = (OutputMode == OutputFrameSequential); // See Present in RenderScene
+
+	// The memory columns are the use of each category at the end of the run, and the most the GPU categories used at once
+	file << "Width,Height,Output,VSync,Stereo,Frames,Average ms,Min ms,Max ms,95th percentile ms,99th percentile ms,Average FPS";
+	for (int category = 0; category < NumResourceCategories; ++category)
+	{
+		file << "," << CResourceRegistry::GetCategoryName( static_cast<EResourceCategory>(category) ) << " MB";
+	}
+	file << ",GPU MB,Peak GPU MB\n";
+
+	vector<SIZE> resolutions = Benchmark.resolutions;
+	if (resolutions.empty())
+	{
+		SIZE size = { g_ViewportWidth, g_ViewportHeight };
+		resolutions.push_back( size );
+	}
+
+	vector<float> frameTimes;
+	for (unsigned int res = 0; res < resolutions.size(); ++res)
+	{
+		// Size the window so its client area is the requested resolution, and the back buffer to match
+		RECT rc = { 0, 0, resolutions[res].cx, resolutions[res].cy };
+		AdjustWindowRect( &rc, WS_OVERLAPPEDWINDOW, FALSE );
+		SetWindowPos( HWnd, NULL, 0, 0, rc.right - rc.left, rc.bottom - rc.top, SWP_NOMOVE | SWP_NOZORDER );
+		if (!ResizeRenderTargets( resolutions[res].cx, resolutions[res].cy ))
+		{
+			VSync = savedVSync;
+			return false;
+		}
+
+		for (int method = 0; method < 2; ++method)
+		{
+			SinglePassStereo = (method == 1);
+			if (!BenchmarkFrames( frameTimes ))
+			{
+				VSync = savedVSync;
+				return false;
+			}
+
+			vector<float> sorted = frameTimes;
+			sort( sorted.begin(), sorted.end() );
+			float total = 0.0f;
+			for (unsigned int i = 0; i < sorted.size(); ++i)
+			{
+				total += sorted[i];
+			}
+			float average = total / sorted.size();
+			file << resolutions[res].cx << "," << resolutions[res].cy << "," << OutputModeNames[OutputMode]
+			     << "," << (synced ? "Yes (frame-sequential needs it)" : "No") << "," << (SinglePassStereo ? "Single-pass" : "Two-pass")
+			     << "," << sorted.size() << "," << average << "," << sorted.front() << "," << sorted.back()
+			     << "," << sorted[(sorted.size() - 1) * 95 / 100] << "," << sorted[(sorted.size() - 1) * 99 / 100]
+			     << "," << 1000.0f / average;
+			for (int category = 0; category < NumResourceCategories; ++category)
+			{
+				SResourceStats stats;
+				g_Resources.GetStats( static_cast<EResourceCategory>(category), &stats );
+				file << "," << stats.bytes / (1024.0 * 1024.0);
+			}
+			UINT64 gpuBytes, peakGPUBytes;
+			g_Resources.GetGPUTotals( &gpuBytes, &peakGPUBytes );
+			file << "," << gpuBytes / (1024.0 * 1024.0) << "," << peakGPUBytes / (1024.0 * 1024.0) << "\n";
+		}
+	}
+
+	VSync = savedVSync;
+	return file.good();
 }
 
 
@@ -563,6 +2576,15 @@ void RenderScene()
 //--------------------------------------------------------------------------------------
 int WINAPI wWinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLine, int nCmdShow )
 {
+	// Check for benchmark mode and other settings
+	ParseCommandLine( lpCmdLine );
+
+	// The maths benchmark needs no window or device
+	if (MathBenchmark)
+	{
+		return RunMathBenchmark( MathBenchmarkFile ) ? 0 : 1;
+	}
+
 	// Initialise everything in turn
 	if( !InitWindow( hInstance, nCmdShow) )
 	{
@@ -574,13 +2596,35 @@ int WINAPI wWinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdL
 		return 0;
 	}
 
-	// Initialise simple input functions (in Input.h/.cpp, not part of DirectX)
+	// Initialise simple input functions (in Input.h/.cpp, not part of DirectX). Raw input if possible, otherwise the key messages
 	InitInput();
+	InitRawInput( HWnd );
+
+	// Benchmark mode runs a fixed sequence of frames then exits
+	if (Benchmark.enabled)
+	{
+		bool success = RunBenchmark();
+		ReleaseResources();
+		return success ? 0 : 1;
+	}
+
+	// Run the simulation on its own thread unless asked not to, carry on single threaded if the thread can't be started
+	if (!SingleThreaded && !StartUpdateThread())
+	{
+		delete UpdateThread;
+		UpdateThread = NULL;
+	}
 
 	// Initialise a timer class (in CTimer.h/.cpp, not part of DirectX). It's like a stopwatch - start it counting now
 	CTimer Timer;
 	Timer.Start();
 
+	// Accurate sleeps for the frame rate limit
+	if (MaxFrameRate > 0.0f)
+	{
+		timeBeginPeriod( 1 );
+	}
+
 	// Main message loop. The window will stay in this loop until it is closed
 	MSG msg = {0};
 	while( WM_QUIT != msg.message )
@@ -593,13 +2637,41 @@ int WINAPI wWinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdL
 			TranslateMessage( &msg );
 			DispatchMessage( &msg );
 		}
+		else if (IsIconic( HWnd ))
+		{
+			// Nothing to see when minimised, don't use the CPU or GPU
+			Sleep( 50 );
+			Timer.GetLapTime(); // Don't include the time minimised in the next frame
+		}
 		else // Otherwise render & update
 		{
-			RenderScene();
+			// Resize render targets to match the window if needed
+			UpdateWindowSize();
+
+			// Pick up the latest state from the update thread if there is one
+			if (UpdateThread)
+			{
+				ApplyUpdateSnapshots();
+			}
+
+			// Swap in any shaders and assets edited since the last frame
+			ReloadChangedFiles();
 
 			// Get the time passed since the last frame (since the last time this line was reached) - used to synchronise update to realtime rather than machine speed
+			// The update thread keeps its own time, only the settings are updated here. Updating before rendering means the frame
+			// shows the input read by the update, rather than waiting for the next frame
 			float frameTime = Timer.GetLapTime();
-			UpdateScene( frameTime );
+			if (UpdateThread)
+			{
+				UpdateSettings();
+			}
+			else
+			{
+				UpdateScene( frameTime );
+			}
+
+			RenderScene( frameTime );
+			LimitFrameRate();
 
 			// Allow user to quit with escape key
 			if (KeyHit( Key_Escape )) 
@@ -610,6 +2682,11 @@ int WINAPI wWinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdL
 		}
 	}
 
+	if (MaxFrameRate > 0.0f)
+	{
+		timeEndPeriod( 1 );
+	}
+
 	// Release all the resources we've created before leaving
 	ReleaseResources();
 
@@ -671,15 +2748,38 @@ LRESULT CALLBACK WndProc( HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam
 			PostQuitMessage( 0 );
 			break;
 
+		// Record window resizes, the render targets are resized later (see UpdateWindowSize). Minimising gives a zero size, which is ignored
+		case WM_SIZE:
+			if (wParam != SIZE_MINIMIZED)
+			{
+				ResizePending = true;
+				ResizeRequestTime = GetTickCount();
+			}
+			break;
+
+		case WM_ENTERSIZEMOVE:
+			InSizeMove = true;
+			break;
+
+		case WM_EXITSIZEMOVE:
+			InSizeMove = false;
+			break;
+
 		// These windows messages (WM_KEYXXXX) can be used to get keyboard input to the window
 		// This application has added some simple functions (not DirectX) to process these messages (all in Input.cpp/h)
+		// With raw input the keys come from WM_INPUT instead, the key messages still arrive but are ignored
 		case WM_KEYDOWN:
-			KeyDownEvent( static_cast<EKeyState>(wParam) );
+			if (!UsingRawInput()) KeyDownEvent( static_cast<EKeyState>(wParam) );
 			break;
 
 		case WM_KEYUP:
-			KeyUpEvent( static_cast<EKeyState>(wParam) );
+			if (!UsingRawInput()) KeyUpEvent( static_cast<EKeyState>(wParam) );
 			break;
+
+		// Raw keyboard and mouse input, the default handling must still be called to clean up
+		case WM_INPUT:
+			RawInputEvent( lParam );
+			return DefWindowProc( hWnd, message, wParam, lParam );
 		
 		default:
 			return DefWindowProc( hWnd, message, wParam, lParam );
@@ -45,33 +45,268 @@ struct VS_BASIC_OUTPUT
 };
 
 
+//**|3D|********************************************//
+//**** Single-Pass Stereo Structures ****//
+
+// Single-pass stereo vertex shaders also take the instance ID - each model is drawn as two instances, instance 0 is the left eye, 1 the right eye
+struct VS_STEREO_INPUT
+{
+    float3 Pos    : POSITION;
+    float3 Normal : NORMAL;
+	float2 UV     : TEXCOORD0;
+	uint   Eye    : SV_InstanceID;
+};
+
+// Stereo versions of the vertex shader outputs above, they carry the eye index on to the geometry shader
+struct VS_LIGHTING_STEREO_OUTPUT
+{
+    float4 ProjPos       : SV_POSITION;
+	float3 WorldPos      : POSITION;
+	float3 WorldNormal   : NORMAL;
+    float2 UV            : TEXCOORD0;
+	nointerpolation uint Eye : EYE;
+};
+
+struct VS_BASIC_STEREO_OUTPUT
+{
+    float4 ProjPos       : SV_POSITION;
+    float2 UV            : TEXCOORD0;
+	nointerpolation uint Eye : EYE;
+};
+
+// The geometry shader sends each triangle to the render target array slice for its eye. Only a geometry shader can select the slice in DX10
+struct GS_LIGHTING_STEREO_OUTPUT
+{
+    float4 ProjPos       : SV_POSITION;
+	float3 WorldPos      : POSITION;
+	float3 WorldNormal   : NORMAL;
+    float2 UV            : TEXCOORD0;
+	nointerpolation uint Eye : EYE;
+	uint   Slice         : SV_RenderTargetArrayIndex;
+	uint   Viewport      : SV_ViewportArrayIndex;
+};
+
+struct GS_BASIC_STEREO_OUTPUT
+{
+    float4 ProjPos       : SV_POSITION;
+    float2 UV            : TEXCOORD0;
+	uint   Slice         : SV_RenderTargetArrayIndex;
+	uint   Viewport      : SV_ViewportArrayIndex;
+};
+
+//**************************************************//
+
+
+//**** Instancing Structures ****//
+
+// Instanced models have a second vertex buffer holding data for each instance - its world matrix (as four rows) and a tint colour.
+// The instance ID is only used by the single-pass stereo versions, where each instance is drawn twice (once per eye)
+struct VS_INSTANCED_INPUT
+{
+    float3 Pos    : POSITION;
+    float3 Normal : NORMAL;
+	float2 UV     : TEXCOORD0;
+	float4 World0 : INSTANCE_WORLD0;
+	float4 World1 : INSTANCE_WORLD1;
+	float4 World2 : INSTANCE_WORLD2;
+	float4 World3 : INSTANCE_WORLD3;
+	float3 Tint   : INSTANCE_TINT;
+	uint   Instance : SV_InstanceID;
+};
+
+// The tint comes from the instance data rather than the per-object constants, so the tinted techniques pass it on to the pixel shader
+struct VS_TINT_OUTPUT
+{
+    float4 ProjPos       : SV_POSITION;
+    float2 UV            : TEXCOORD0;
+	nointerpolation float3 Tint : COLOR0;
+};
+
+struct VS_TINT_STEREO_OUTPUT
+{
+    float4 ProjPos       : SV_POSITION;
+    float2 UV            : TEXCOORD0;
+	nointerpolation float3 Tint : COLOR0;
+	nointerpolation uint Eye : EYE;
+};
+
+struct GS_TINT_STEREO_OUTPUT
+{
+    float4 ProjPos       : SV_POSITION;
+    float2 UV            : TEXCOORD0;
+	nointerpolation float3 Tint : COLOR0;
+	uint   Slice         : SV_RenderTargetArrayIndex;
+	uint   Viewport      : SV_ViewportArrayIndex;
+};
+
+//**************************************************//
+
+
+//**** Skinning Structures ****//
+
+// Skinned vertices carry the weights and palette indices of up to four nodes that move them (see BonePalette). The instance ID is only
+// used by the single-pass stereo versions, instance 0 is the left eye, 1 the right eye
+struct VS_SKINNED_INPUT
+{
+    float3 Pos     : POSITION;
+	float4 Weights : BLENDWEIGHT;
+	uint4  Bones   : BLENDINDICES;
+    float3 Normal  : NORMAL;
+	float2 UV      : TEXCOORD0;
+	uint   Eye     : SV_InstanceID;
+};
+
+//**************************************************//
+
+
+//**** Particle Structures ****//
+
+// A particle as stored in the particle vertex buffers, which the simulation streams out to and the drawing reads (see CParticleSystem).
+// Emitters are particles too - they stay in the buffer and create the other particles
+struct PARTICLE
+{
+	float3 Pos      : POSITION; // World space, or offset from EmitterPos for emitters
+	float3 Velocity : VELOCITY;
+	float  Age      : AGE;      // Seconds since created, or since last emitting for emitters
+	uint   Type     : TYPE;     // PARTICLE_EMITTER or PARTICLE_SPRITE
+};
+
+// Particles are drawn as camera-facing quads built by the geometry shader
+struct GS_PARTICLE_OUTPUT
+{
+    float4 ProjPos       : SV_POSITION;
+    float2 UV            : TEXCOORD0;
+	float4 Colour        : COLOR0;       // Tint and fade
+};
+
+struct GS_PARTICLE_STEREO_OUTPUT
+{
+    float4 ProjPos       : SV_POSITION;
+    float2 UV            : TEXCOORD0;
+	float4 Colour        : COLOR0;
+	uint   Slice         : SV_RenderTargetArrayIndex;
+	uint   Viewport      : SV_ViewportArrayIndex;
+};
+
+//**************************************************//
+
+
+//**|3D|** Reprojection writes both slices of the stereo texture at once, as two render targets
+struct PS_REPROJECT_OUTPUT
+{
+    float4 Left          : SV_Target0;
+    float4 Right         : SV_Target1;
+};
+
+
 //--------------------------------------------------------------------------------------
 // Global Variables
 //--------------------------------------------------------------------------------------
 
-// The matrices (4x4 matrix of floats) for transforming from 3D model to 2D projection (used in vertex shader)
-float4x4 WorldMatrix;
-float4x4 ViewMatrix;
-float4x4 ProjMatrix;
+// Shader constants are grouped into constant buffers by how often they change, so updating one group doesn't re-upload the others.
+// The C++ side keeps a matching structure for each buffer (see ShaderConstants.h) and uploads it in one go - keep the two in step.
+// Matrices are declared row_major to match the DirectX matrix layout, as they are uploaded as raw data rather than with SetMatrix
+
+// Information used for lighting (in the vertex or pixel shader) - the same for every model, every eye, every frame
+cbuffer PerFrame
+{
+	float3 AmbientColour;
+	float  SpecularPower;
+
+	//**|3D|** Part of the stereo texture the eyes were rendered to (UV scale), and the largest UV to sample to stay inside it
+	float2 StereoViewScale;
+	float2 StereoViewMaxUV;
+	float2 StereoViewTexelSize; // 1 / size of the stereo texture
+
+	// Light tiles across and down each eye's viewport, and 1 / tile size in pixels (see LightTiles)
+	uint2  NumLightTiles;
+	float  LightTileScale;
+
+	//**|3D|** Reprojection of the left eye to the right (see ReprojectRightEye). The last pixel column of the eye's view. The shift in pixels
+	// of a left eye pixel with depth buffer value d is x - y * d, and zw is the range of shifts searched
+	float  ReprojectMaxX;
+	float4 ReprojectParams;
+};
+
+// Camera data, changes for each eye
+cbuffer PerEye
+{
+	// The matrices (4x4 matrix of floats) for transforming from world space to 2D projection (used in vertex shader)
+	row_major float4x4 ViewMatrix;
+	row_major float4x4 ProjMatrix;
+	float3   CameraPos;
+	float2   ViewportOrigin; // Top-left of the viewport in the render target, pixel positions are relative to this in the light tiles
+
+	//**|3D|** Matrices, camera positions and viewport origins for both eyes, used when rendering both eyes in a single pass (index 0 = left,
+	// 1 = right)
+	row_major float4x4 StereoViewMatrix[2];
+	row_major float4x4 StereoProjMatrix[2];
+	float4   StereoCameraPos[2];      // Only xyz used, float4 so array elements don't share registers with anything else
+	float4   StereoViewportOrigin[2]; // Only xy used
+};
+
+// Data that changes for each model rendered
+cbuffer PerObject
+{
+	// Matrix for transforming from 3D model space to world space
+	row_major float4x4 WorldMatrix;
+
+	// Variable used to tint each light model to show the colour that it emits
+	float3 TintColour;
 
-// Information used for lighting (in the vertex or pixel shader)
-float3 Light1Pos;
-float3 Light2Pos;
-float3 Light1Colour;
-float3 Light2Colour;
-float3 AmbientColour;
-float  SpecularPower;
-float3 CameraPos;
+	// Compressed meshes store positions as 16-bit values across the mesh's bounding box, which arrive in the vertex shader as 0->1.
+	// This scale and offset take them back to model space (1 and 0 for uncompressed meshes). The other compressed vertex data needs
+	// no decoding, the GPU expands it to float values as the vertices are read
+	float3 MeshPosScale;
+	float3 MeshPosOffset;
+
+	// First of the model's matrices in the bone palette, for skinned models
+	uint   BoneOffset;
+};
+
+// The largest number of matrices in the bone palette - 64KB, the largest a constant buffer can be. Must match CBonePalette::MaxMatrices
+#define MAX_BONE_MATRICES 1024
+
+// World matrices of the nodes of every skinned model drawn this frame, uploaded once per frame and used by both eyes (see CBonePalette).
+// A skinned vertex's bone indices are nodes of its model, so they are offset by the model's BoneOffset
+cbuffer BonePalette
+{
+	row_major float4x4 BoneMatrices[MAX_BONE_MATRICES];
+};
+
+// Settings of a particle system and the time step of its simulation, one buffer per particle system (see CParticleSystem). Updated once
+// per frame when the particles are simulated, both eyes draw with the same values
+cbuffer Particles
+{
+	float3 EmitterPos;
+	float  EmitInterval;     // Seconds between particles from each emitter
+	float3 EmitVelocity;
+	float  EmitSpread;       // Largest random speed added to EmitVelocity
+	float3 ParticleAcceleration;
+	float  ParticleLife;     // Seconds
+	float4 ParticleColour;   // rgb tint, a is the opacity - 0 adds the particle's light to the scene, 1 covers the scene like smoke
+	float  ParticleStartSize;
+	float  ParticleEndSize;
+	float  ParticleTimeStep; // Seconds simulated this frame
+	uint   ParticleSeed;     // Changes every frame for new random numbers
+};
 
-// Variable used to tint each light model to show the colour that it emits
-float3 TintColour;
+// The point lights, binned into screen tiles once per frame on the CPU (see CLightGrid). Both eyes share the tiles, which cover the
+// parts of the viewport a light reaches in either eye. A tile's lights are LightIndices[offset] to LightIndices[offset + count - 1]
+Buffer<float4> LightData;    // Two entries per light: position and range, then colour
+Buffer<uint2>  LightTiles;   // For each tile, row by row: offset of its first light in LightIndices, number of lights
+Buffer<uint>   LightIndices;
 
 // Diffuse texture map
 Texture2D DiffuseMap;
 
-// Left and right images for anaglyph
-Texture2D LeftView;
-Texture2D RightView;
+//**|3D|** Left and right images for anaglyph, in a two slice array (slice 0 = left, 1 = right). Both the single-pass and two-pass stereo
+// rendering write to this
+Texture2DArray StereoViews;
+
+//**|3D|** Left eye colour and depth for reprojection. The depth is the first slice of the depth buffer
+Texture2D      ReprojectColour;
+Texture2DArray ReprojectDepth;
 
 // Samplers to use with the above textures
 SamplerState TrilinearWrap
@@ -88,11 +323,24 @@ SamplerState PointSample
     AddressV = Clamp;
 };
 
+SamplerState BilinearClamp
+{
+    Filter = MIN_MAG_LINEAR_MIP_POINT;
+    AddressU = Clamp;
+    AddressV = Clamp;
+};
+
 
 //--------------------------------------------------------------------------------------
 // Vertex Shaders
 //--------------------------------------------------------------------------------------
 
+// Get the model space position of an input vertex, all vertex shaders read positions through this (see MeshPosScale)
+float3 DecodePosition( float3 pos )
+{
+	return pos * MeshPosScale + MeshPosOffset;
+}
+
 // The vertex shader will process each of the vertices in the model, typically transforming/projecting them into 2D at a minimum.
 // This vertex shader passes on the vertex position and normal to the pixel shader for per-pixel lighting
 //
@@ -101,7 +349,7 @@ VS_LIGHTING_OUTPUT VertexLightingTex( VS_INPUT vIn )
 	VS_LIGHTING_OUTPUT vOut;
 
 	// Use world matrix passed from C++ to transform the input model vertex position into world space
-	float4 modelPos = float4(vIn.Pos, 1.0f); // Promote to 1x4 so we can multiply by 4x4 matrix, put 1.0 in 4th element for a point (0.0 for a vector)
+	float4 modelPos = float4(DecodePosition( vIn.Pos ), 1.0f); // Promote to 1x4 so we can multiply by 4x4 matrix, put 1.0 in 4th element for a point (0.0 for a vector)
 	float4 worldPos = mul( modelPos, WorldMatrix );
 	vOut.WorldPos = worldPos.xyz;
 
@@ -128,7 +376,7 @@ VS_BASIC_OUTPUT BasicTransform( VS_INPUT vIn )
 	VS_BASIC_OUTPUT vOut;
 	
 	// Use world matrix passed from C++ to transform the input model vertex position into world space
-	float4 modelPos = float4(vIn.Pos, 1.0f); // Promote to 1x4 so we can multiply by 4x4 matrix, put 1.0 in 4th element for a point (0.0 for a vector)
+	float4 modelPos = float4(DecodePosition( vIn.Pos ), 1.0f); // Promote to 1x4 so we can multiply by 4x4 matrix, put 1.0 in 4th element for a point (0.0 for a vector)
 	float4 worldPos = mul( modelPos, WorldMatrix );
 	float4 viewPos  = mul( worldPos, ViewMatrix );
 	vOut.ProjPos    = mul( viewPos,  ProjMatrix );
@@ -140,174 +388,832 @@ VS_BASIC_OUTPUT BasicTransform( VS_INPUT vIn )
 }
 
 
+// Transform the corners of an occlusion test box (see COcclusionCuller), which has full float positions and only the world matrix
+//
+float4 OcclusionBoxTransform( float3 pos : POSITION ) : SV_POSITION
+{
+	float4 worldPos = mul( float4(pos, 1.0f), WorldMatrix );
+	float4 viewPos  = mul( worldPos, ViewMatrix );
+	return mul( viewPos, ProjMatrix );
+}
+
+
 //**|3D|********************************************//
-//**** DirectX 10 Post Processing Vertex Shader ****//
+//**** Single-Pass Stereo Shaders ****//
 
-// This rather unusual shader generates its own vertices - the input data is merely the vertex ID - an automatically generated increasing index.
-// There is no vertex buffer, the vertices are generated in this shader. Probably not so efficient, but fine for a full-screen quad.
-VS_BASIC_OUTPUT FullScreenQuad(VS_POSTPROCESS_INPUT vIn)
+// Stereo version of VertexLightingTex, the instance ID selects which eye's camera matrices to use
+//
+VS_LIGHTING_STEREO_OUTPUT VertexLightingTexStereo( VS_STEREO_INPUT vIn )
 {
-    VS_BASIC_OUTPUT vOut;
+	VS_LIGHTING_STEREO_OUTPUT vOut;
+
+	float4 worldPos = mul( float4(DecodePosition( vIn.Pos ), 1.0f), WorldMatrix );
+	vOut.WorldPos = worldPos.xyz;
+
+	float4 viewPos  = mul( worldPos, StereoViewMatrix[vIn.Eye] );
+	vOut.ProjPos    = mul( viewPos,  StereoProjMatrix[vIn.Eye] );
+
+	vOut.WorldNormal = mul( float4(vIn.Normal, 0.0f), WorldMatrix ).xyz;
+	vOut.UV = vIn.UV;
+	vOut.Eye = vIn.Eye;
+
+	return vOut;
+}
+
+// Stereo version of BasicTransform
+//
+VS_BASIC_STEREO_OUTPUT BasicTransformStereo( VS_STEREO_INPUT vIn )
+{
+	VS_BASIC_STEREO_OUTPUT vOut;
 	
-    if (vIn.vertexId == 0)
-	{
-        vOut.ProjPos = float4(-1.0, 1.0, 0.0, 1.0);
-		vOut.UV = float2(0.0, 0.0);
-	}
-    else if (vIn.vertexId == 1)
+	float4 worldPos = mul( float4(DecodePosition( vIn.Pos ), 1.0f), WorldMatrix );
+	float4 viewPos  = mul( worldPos, StereoViewMatrix[vIn.Eye] );
+	vOut.ProjPos    = mul( viewPos,  StereoProjMatrix[vIn.Eye] );
+	vOut.UV = vIn.UV;
+	vOut.Eye = vIn.Eye;
+
+	return vOut;
+}
+
+
+// Pass-through geometry shaders that route each triangle to the render target array slice and the viewport of its eye. Only one of
+// these has an effect depending on the output: the anaglyph and interlaced outputs render each eye to its own slice (with matching
+// viewports), side-by-side and top-bottom render directly to the back buffer (not an array) with a viewport for each eye
+//
+[maxvertexcount(3)]
+void StereoSliceLighting( triangle VS_LIGHTING_STEREO_OUTPUT gIn[3], inout TriangleStream<GS_LIGHTING_STEREO_OUTPUT> triStream )
+{
+	GS_LIGHTING_STEREO_OUTPUT gOut;
+	for (int v = 0; v < 3; ++v)
 	{
-        vOut.ProjPos = float4(-1.0,-1.0, 0.0, 1.0);
-		vOut.UV = float2(0.0, 1.0);
+		gOut.ProjPos     = gIn[v].ProjPos;
+		gOut.WorldPos    = gIn[v].WorldPos;
+		gOut.WorldNormal = gIn[v].WorldNormal;
+		gOut.UV          = gIn[v].UV;
+		gOut.Eye         = gIn[v].Eye;
+		gOut.Slice       = gIn[v].Eye;
+		gOut.Viewport    = gIn[v].Eye;
+		triStream.Append( gOut );
 	}
-    else if (vIn.vertexId == 2)
+}
+
+[maxvertexcount(3)]
+void StereoSliceBasic( triangle VS_BASIC_STEREO_OUTPUT gIn[3], inout TriangleStream<GS_BASIC_STEREO_OUTPUT> triStream )
+{
+	GS_BASIC_STEREO_OUTPUT gOut;
+	for (int v = 0; v < 3; ++v)
 	{
-        vOut.ProjPos = float4( 1.0, 1.0, 0.0, 1.0);
-		vOut.UV = float2(1.0, 0.0);
+		gOut.ProjPos = gIn[v].ProjPos;
+		gOut.UV      = gIn[v].UV;
+		gOut.Slice   = gIn[v].Eye;
+		gOut.Viewport = gIn[v].Eye;
+		triStream.Append( gOut );
 	}
-	else
+}
+
+[maxvertexcount(3)]
+void StereoSliceTint( triangle VS_TINT_STEREO_OUTPUT gIn[3], inout TriangleStream<GS_TINT_STEREO_OUTPUT> triStream )
+{
+	GS_TINT_STEREO_OUTPUT gOut;
+	for (int v = 0; v < 3; ++v)
 	{
-        vOut.ProjPos = float4( 1.0,-1.0, 0.0, 1.0);
-		vOut.UV = float2(1.0, 1.0);
+		gOut.ProjPos = gIn[v].ProjPos;
+		gOut.UV      = gIn[v].UV;
+		gOut.Tint    = gIn[v].Tint;
+		gOut.Slice   = gIn[v].Eye;
+		gOut.Viewport = gIn[v].Eye;
+		triStream.Append( gOut );
 	}
-	
-    return vOut;
 }
 
 //**************************************************//
 
 
-//--------------------------------------------------------------------------------------
-// Pixel Shaders
-//--------------------------------------------------------------------------------------
+//**** Instanced Vertex Shaders ****//
 
-// The pixel shader determines colour for each pixel in the rendered polygons, given the data passed on from the vertex shader
-// This shader expects vertex position, normal and UVs from the vertex shader. It calculates per-pixel lighting and combines with diffuse and specular map
+// Versions of the shaders above that take the world matrix and tint from the per-instance vertex data, so many copies of a model can
+// be drawn in one call. The stereo versions draw each instance twice: even instance IDs are the left eye, odd the right. The C++ side
+// steps the instance data once every two instances in that case, so both eyes see the same instance data
 //
-float4 VertexLitDiffuseMap( VS_LIGHTING_OUTPUT vOut ) : SV_Target  // The ": SV_Target" bit just indicates that the returned float4 colour goes to the render target (i.e. it's a colour to render)
+VS_LIGHTING_OUTPUT VertexLightingTexInstanced( VS_INSTANCED_INPUT vIn )
 {
-	// Can't guarantee the normals are length 1 now (because the world matrix may contain scaling), so renormalise
-	// If lighting in the pixel shader, this is also because the interpolation from vertex shader to pixel shader will also rescale normals
-	float3 worldNormal = normalize(vOut.WorldNormal); 
+	VS_LIGHTING_OUTPUT vOut;
 
+	float4x4 worldMatrix = float4x4( vIn.World0, vIn.World1, vIn.World2, vIn.World3 );
+	float4 worldPos = mul( float4(DecodePosition( vIn.Pos ), 1.0f), worldMatrix );
+	vOut.WorldPos = worldPos.xyz;
 
-	///////////////////////
-	// Calculate lighting
+	float4 viewPos  = mul( worldPos, ViewMatrix );
+	vOut.ProjPos    = mul( viewPos,  ProjMatrix );
 
-	// Calculate direction of camera
-	float3 CameraDir = normalize(CameraPos - vOut.WorldPos.xyz); // Position of camera - position of current vertex (or pixel) (in world space)
-	
-	//// LIGHT 1
-	float3 Light1Dir = normalize(Light1Pos - vOut.WorldPos.xyz);   // Direction for each light is different
-	float3 Light1Dist = length(Light1Pos - vOut.WorldPos.xyz); 
-	float3 DiffuseLight1 = Light1Colour * max( dot(worldNormal.xyz, Light1Dir), 0 ) / Light1Dist;
-	float3 halfway = normalize(Light1Dir + CameraDir);
-	float3 SpecularLight1 = DiffuseLight1 * pow( max( dot(worldNormal.xyz, halfway), 0 ), SpecularPower );
+	vOut.WorldNormal = mul( float4(vIn.Normal, 0.0f), worldMatrix ).xyz;
+	vOut.UV = vIn.UV;
 
-	//// LIGHT 2
-	float3 Light2Dir = normalize(Light2Pos - vOut.WorldPos.xyz);
-	float3 Light2Dist = length(Light2Pos - vOut.WorldPos.xyz);
-	float3 DiffuseLight2 = Light2Colour * max( dot(worldNormal.xyz, Light2Dir), 0 ) / Light2Dist;
-	halfway = normalize(Light2Dir + CameraDir);
-	float3 SpecularLight2 = DiffuseLight2 * pow( max( dot(worldNormal.xyz, halfway), 0 ), SpecularPower );
+	return vOut;
+}
 
-	// Sum the effect of the two lights - add the ambient at this stage rather than for each light (or we will get twice the ambient level)
-	float3 DiffuseLight = AmbientColour + DiffuseLight1 + DiffuseLight2;
-	float3 SpecularLight = SpecularLight1 + SpecularLight2;
+VS_TINT_OUTPUT BasicTransformInstanced( VS_INSTANCED_INPUT vIn )
+{
+	VS_TINT_OUTPUT vOut;
 
+	float4x4 worldMatrix = float4x4( vIn.World0, vIn.World1, vIn.World2, vIn.World3 );
+	float4 worldPos = mul( float4(DecodePosition( vIn.Pos ), 1.0f), worldMatrix );
+	float4 viewPos  = mul( worldPos, ViewMatrix );
+	vOut.ProjPos    = mul( viewPos,  ProjMatrix );
+	vOut.UV   = vIn.UV;
+	vOut.Tint = vIn.Tint;
 
-	////////////////////
-	// Sample texture
+	return vOut;
+}
 
-	// Extract diffuse material colour for this pixel from a texture
-	float4 DiffuseMaterial = DiffuseMap.Sample( TrilinearWrap, vOut.UV );
-	
-	// Assume specular material colour is white (i.e. highlights are a full, untinted reflection of light)
-	float3 SpecularMaterial = DiffuseMaterial.a;
+//**|3D|** Single-pass stereo instanced versions
+VS_LIGHTING_STEREO_OUTPUT VertexLightingTexInstancedStereo( VS_INSTANCED_INPUT vIn )
+{
+	VS_LIGHTING_STEREO_OUTPUT vOut;
 
-	
-	////////////////////
-	// Combine colours 
-	
-	// Combine maps and lighting for final pixel colour
-	float4 combinedColour;
-	combinedColour.rgb = DiffuseMaterial.rgb * DiffuseLight + SpecularMaterial * SpecularLight;
-	combinedColour.a = 1.0f; // No alpha processing in this shader, so just set it to 1
+	uint eye = vIn.Instance % 2;
+	float4x4 worldMatrix = float4x4( vIn.World0, vIn.World1, vIn.World2, vIn.World3 );
+	float4 worldPos = mul( float4(DecodePosition( vIn.Pos ), 1.0f), worldMatrix );
+	vOut.WorldPos = worldPos.xyz;
 
-	return combinedColour;
+	float4 viewPos  = mul( worldPos, StereoViewMatrix[eye] );
+	vOut.ProjPos    = mul( viewPos,  StereoProjMatrix[eye] );
+
+	vOut.WorldNormal = mul( float4(vIn.Normal, 0.0f), worldMatrix ).xyz;
+	vOut.UV = vIn.UV;
+	vOut.Eye = eye;
+
+	return vOut;
 }
 
+VS_TINT_STEREO_OUTPUT BasicTransformInstancedStereo( VS_INSTANCED_INPUT vIn )
+{
+	VS_TINT_STEREO_OUTPUT vOut;
 
-// A pixel shader that just tints a (diffuse) texture with a fixed colour
+	uint eye = vIn.Instance % 2;
+	float4x4 worldMatrix = float4x4( vIn.World0, vIn.World1, vIn.World2, vIn.World3 );
+	float4 worldPos = mul( float4(DecodePosition( vIn.Pos ), 1.0f), worldMatrix );
+	float4 viewPos  = mul( worldPos, StereoViewMatrix[eye] );
+	vOut.ProjPos    = mul( viewPos,  StereoProjMatrix[eye] );
+	vOut.UV   = vIn.UV;
+	vOut.Tint = vIn.Tint;
+	vOut.Eye  = eye;
+
+	return vOut;
+}
+
+//**************************************************//
+
+
+//**** Skinned Vertex Shaders ****//
+
+// Blend of the palette matrices that move a skinned vertex. The palette holds world matrices, so this replaces the world matrix. The
+// weights add up to 1 (the importer normalises them), vertices that no node moves follow their sub-mesh's node with a weight of 1
+float4x4 SkinMatrix( VS_SKINNED_INPUT vIn )
+{
+	uint4 bones = vIn.Bones + BoneOffset;
+	return vIn.Weights.x * BoneMatrices[bones.x] + vIn.Weights.y * BoneMatrices[bones.y] +
+	       vIn.Weights.z * BoneMatrices[bones.z] + vIn.Weights.w * BoneMatrices[bones.w];
+}
+
+// Skinned versions of VertexLightingTex and BasicTransform. Blending the matrices first then transforming once is cheaper than
+// transforming the vertex by each matrix and blending the results, and gives the same answer
 //
-float4 TintDiffuseMap( VS_BASIC_OUTPUT vOut ) : SV_Target
+VS_LIGHTING_OUTPUT VertexLightingTexSkinned( VS_SKINNED_INPUT vIn )
 {
-	// Extract diffuse material colour for this pixel from a texture
-	float4 diffuseMapColour = DiffuseMap.Sample( TrilinearWrap, vOut.UV );
+	VS_LIGHTING_OUTPUT vOut;
 
-	// Tint by global colour (set from C++)
-	diffuseMapColour.rgb *= TintColour / 10;
+	float4x4 skinMatrix = SkinMatrix( vIn );
+	float4 worldPos = mul( float4(DecodePosition( vIn.Pos ), 1.0f), skinMatrix );
+	vOut.WorldPos = worldPos.xyz;
 
-	return diffuseMapColour;
+	float4 viewPos  = mul( worldPos, ViewMatrix );
+	vOut.ProjPos    = mul( viewPos,  ProjMatrix );
+
+	// A blend of matrices may not be a rotation, so the normal is renormalised
+	vOut.WorldNormal = normalize( mul( float4(vIn.Normal, 0.0f), skinMatrix ).xyz );
+	vOut.UV = vIn.UV;
+
+	return vOut;
 }
 
+VS_BASIC_OUTPUT BasicTransformSkinned( VS_SKINNED_INPUT vIn )
+{
+	VS_BASIC_OUTPUT vOut;
 
-//**|3D|*************************//
-//**** Anaglyph Pixel Shader ****//
+	float4 worldPos = mul( float4(DecodePosition( vIn.Pos ), 1.0f), SkinMatrix( vIn ) );
+	float4 viewPos  = mul( worldPos, ViewMatrix );
+	vOut.ProjPos    = mul( viewPos,  ProjMatrix );
+	vOut.UV = vIn.UV;
 
-float4 ColourAnaglyph( VS_BASIC_OUTPUT vOut ) : SV_Target
+	return vOut;
+}
+
+//**|3D|** Single-pass stereo skinned versions, both eyes share the palette
+VS_LIGHTING_STEREO_OUTPUT VertexLightingTexSkinnedStereo( VS_SKINNED_INPUT vIn )
 {
-	// Extract left and right pixel values
-	float3 leftColour  = LeftView.Sample( PointSample, vOut.UV ).rgb;
-	float3 rightColour = RightView.Sample( PointSample, vOut.UV ).rgb;
+	VS_LIGHTING_STEREO_OUTPUT vOut;
 
-	// Combine into anaglyph
-	const float3 grey = float3( 0.299f, 0.587f, 0.114f );
-	const float3 opti = float3( 0.0f,   0.7f,   0.3f );
+	float4x4 skinMatrix = SkinMatrix( vIn );
+	float4 worldPos = mul( float4(DecodePosition( vIn.Pos ), 1.0f), skinMatrix );
+	vOut.WorldPos = worldPos.xyz;
 
-	//*** MISSING - well todo really ****//
-	// Change this line to support other anaglyph modes (e.g. greyscale, half-colour or optimised) - two convenient float3 vectors are set-up above
-	
-	//regular
-	float4 anaglyph = float4( leftColour.r, rightColour.g, rightColour.b, 1.0f ); // Simple anaglyph
-	
-	//grey
-	//float4 anaglyph;
-	//anaglyph.r = dot(grey, leftColour);
-	//anaglyph.g = dot( grey, rightColour);
-	//anaglyph.b = dot( grey, rightColour );
-	//anaglyph.a = 1.0f;
-	
-	//opti
-	//float4 anaglyph;
-	//anaglyph.r = pow(dot( opti, leftColour), 57);
+	float4 viewPos  = mul( worldPos, StereoViewMatrix[vIn.Eye] );
+	vOut.ProjPos    = mul( viewPos,  StereoProjMatrix[vIn.Eye] );
 
-	//anaglyph.g = dot( float3(0,1,0), rightColour);
-	//anaglyph.b = dot( float3(0, 0, 1), rightColour );
-	//anaglyph.a = 1.0f;
+	vOut.WorldNormal = normalize( mul( float4(vIn.Normal, 0.0f), skinMatrix ).xyz );
+	vOut.UV = vIn.UV;
+	vOut.Eye = vIn.Eye;
 
-	return anaglyph;
+	return vOut;
 }
 
-//*******************************//
+VS_BASIC_STEREO_OUTPUT BasicTransformSkinnedStereo( VS_SKINNED_INPUT vIn )
+{
+	VS_BASIC_STEREO_OUTPUT vOut;
 
+	float4 worldPos = mul( float4(DecodePosition( vIn.Pos ), 1.0f), SkinMatrix( vIn ) );
+	float4 viewPos  = mul( worldPos, StereoViewMatrix[vIn.Eye] );
+	vOut.ProjPos    = mul( viewPos,  StereoProjMatrix[vIn.Eye] );
+	vOut.UV = vIn.UV;
+	vOut.Eye = vIn.Eye;
 
-//--------------------------------------------------------------------------------------
-// States
-//--------------------------------------------------------------------------------------
+	return vOut;
+}
 
-// States are needed to switch between additive blending for the lights and no blending for other models
+//**************************************************//
 
-RasterizerState CullNone  // Cull none of the polygons, i.e. show both sides
-{
-	CullMode = None;
-};
-RasterizerState CullBack  // Cull back side of polygon - normal behaviour, only show front of polygons
-{
-	CullMode = Back;
-};
 
+//**** Particle Shaders ****//
 
-DepthStencilState DepthWritesOff // Don't write to the depth buffer - polygons rendered will not obscure other polygons
+// Particle types, see PARTICLE
+#define PARTICLE_EMITTER 0
+#define PARTICLE_SPRITE  1
+
+// Most particles one emitter can create in a frame (slow frames create fewer). Must match CParticleSystem::MaxEmitPerFrame
+#define MAX_EMIT_PER_FRAME 16
+
+// Both the simulation and the drawing read the particles straight from the vertex buffer, the geometry shaders do the work
+PARTICLE ParticlePassThrough( PARTICLE p )
+{
+	return p;
+}
+
+// Hash an integer to a well-mixed value, used to make random numbers on the GPU
+uint ParticleHash( uint value )
+{
+	value = (value ^ 61) ^ (value >> 16);
+	value *= 9;
+	value = value ^ (value >> 4);
+	value *= 0x27d4eb2d;
+	value = value ^ (value >> 15);
+	return value;
+}
+
+// Random number from 0 to 1, steps the seed on to the next number
+float ParticleRandom( inout uint seed )
+{
+	seed = ParticleHash( seed );
+	return seed * (1.0f / 4294967295.0f);
+}
+
+// Random vector inside the unit sphere (slightly biased towards the corners' directions, which doesn't show in a particle spray)
+float3 ParticleRandomVector( inout uint seed )
+{
+	float3 v = float3( ParticleRandom( seed ), ParticleRandom( seed ), ParticleRandom( seed ) ) * 2.0f - 1.0f;
+	float length2 = dot( v, v );
+	return length2 > 1.0f ? v * rsqrt( length2 ) : v;
+}
+
+// Simulate one particle for a frame, streaming out the particles that continue to the other buffer. Emitters stay and create a new
+// particle every EmitInterval seconds, other particles move and are dropped when they reach the end of their life. Each emitter is
+// written just before its new particles, so after the first frame the emitters are spread through the buffer and one could be lost
+// if it filled. The buffer is sized so that it never does (see CParticleSystem::Init)
+[maxvertexcount(MAX_EMIT_PER_FRAME + 1)]
+void AdvanceParticles( point PARTICLE gIn[1], uint primitive : SV_PrimitiveID, inout PointStream<PARTICLE> stream )
+{
+	PARTICLE p = gIn[0];
+	p.Age += ParticleTimeStep;
+	if (p.Type == PARTICLE_EMITTER)
+	{
+		uint numNew = min( (uint)(p.Age / EmitInterval), MAX_EMIT_PER_FRAME );
+		p.Age = min( p.Age - numNew * EmitInterval, EmitInterval ); // Drop any backlog rather than emit a burst next frame
+		stream.Append( p );
+
+		// Each new particle starts part way through the frame, so a steady stream doesn't come out in clumps at low frame rates
+		uint seed = ParticleHash( primitive ^ ParticleSeed );
+		for (uint i = 0; i < numNew; ++i)
+		{
+			PARTICLE newParticle;
+			newParticle.Velocity = EmitVelocity + ParticleRandomVector( seed ) * EmitSpread;
+			newParticle.Age      = ParticleRandom( seed ) * ParticleTimeStep;
+			newParticle.Pos      = EmitterPos + p.Pos + newParticle.Velocity * newParticle.Age;
+			newParticle.Type     = PARTICLE_SPRITE;
+			stream.Append( newParticle );
+		}
+	}
+	else if (p.Age < ParticleLife)
+	{
+		p.Velocity += ParticleAcceleration * ParticleTimeStep;
+		p.Pos      += p.Velocity * ParticleTimeStep;
+		stream.Append( p );
+	}
+}
+
+// Get the corners of a particle's camera-facing quad in projection space and its colour, for the given camera. The corners are offset
+// in view space, so the quad faces the camera whatever its direction
+//**|3D|** The eye cameras have parallel axes, so each eye's quad lies in the same plane and the particle has a consistent depth
+void ParticleQuad( PARTICLE p, float4x4 viewMatrix, float4x4 projMatrix, out float4 corners[4], out float4 colour )
+{
+	float t = saturate( p.Age / ParticleLife );
+	float size = lerp( ParticleStartSize, ParticleEndSize, t );
+	float4 viewPos = mul( float4(p.Pos, 1.0f), viewMatrix );
+	corners[0] = mul( viewPos + float4(-size,  size, 0, 0), projMatrix );
+	corners[1] = mul( viewPos + float4( size,  size, 0, 0), projMatrix );
+	corners[2] = mul( viewPos + float4(-size, -size, 0, 0), projMatrix );
+	corners[3] = mul( viewPos + float4( size, -size, 0, 0), projMatrix );
+
+	// Fade in quickly and out over the particle's life. Emitters are invisible
+	float fade = (p.Type == PARTICLE_EMITTER) ? 0.0f : saturate( t * 10.0f ) * (1.0f - t);
+	colour = float4( ParticleColour.rgb, fade );
+}
+
+// UVs of the quad corners, in triangle strip order
+static const float2 ParticleUVs[4] = { float2(0, 0), float2(1, 0), float2(0, 1), float2(1, 1) };
+
+// Expand a particle into a quad for the current eye. Emitters are skipped
+[maxvertexcount(4)]
+void DrawParticle( point PARTICLE gIn[1], inout TriangleStream<GS_PARTICLE_OUTPUT> triStream )
+{
+	if (gIn[0].Type == PARTICLE_EMITTER) return;
+
+	float4 corners[4];
+	GS_PARTICLE_OUTPUT gOut;
+	ParticleQuad( gIn[0], ViewMatrix, ProjMatrix, corners, gOut.Colour );
+	for (int v = 0; v < 4; ++v)
+	{
+		gOut.ProjPos = corners[v];
+		gOut.UV      = ParticleUVs[v];
+		triStream.Append( gOut );
+	}
+}
+
+//**|3D|** Single-pass stereo version, expands each particle into a quad for each eye. The particles are drawn with DrawAuto, which can't
+// draw instances, so the geometry shader makes both eyes' quads rather than the usual instance for each eye
+[maxvertexcount(8)]
+void DrawParticleStereo( point PARTICLE gIn[1], inout TriangleStream<GS_PARTICLE_STEREO_OUTPUT> triStream )
+{
+	if (gIn[0].Type == PARTICLE_EMITTER) return;
+
+	for (uint eye = 0; eye < 2; ++eye)
+	{
+		float4 corners[4];
+		GS_PARTICLE_STEREO_OUTPUT gOut;
+		ParticleQuad( gIn[0], StereoViewMatrix[eye], StereoProjMatrix[eye], corners, gOut.Colour );
+		gOut.Slice    = eye;
+		gOut.Viewport = eye;
+		for (int v = 0; v < 4; ++v)
+		{
+			gOut.ProjPos = corners[v];
+			gOut.UV      = ParticleUVs[v];
+			triStream.Append( gOut );
+		}
+		triStream.RestartStrip();
+	}
+}
+
+//**************************************************//
+
+
+//**|3D|********************************************//
+//**** DirectX 10 Post Processing Vertex Shader ****//
+
+// This rather unusual shader generates its own vertices - the input data is merely the vertex ID - an automatically generated increasing index.
+// There is no vertex buffer, the vertices are generated in this shader. A single triangle twice the size of the screen is used rather than
+// a quad - the part off-screen is clipped away, and there is no diagonal seam across the screen where pixels are shaded twice
+VS_BASIC_OUTPUT FullScreenTriangle(VS_POSTPROCESS_INPUT vIn)
+{
+    VS_BASIC_OUTPUT vOut;
+
+	// Vertices 0,1,2 give UVs (0,0), (2,0), (0,2) and positions (-1,1), (3,1), (-1,-3)
+	vOut.UV = float2( (vIn.vertexId << 1) & 2, vIn.vertexId & 2 );
+	vOut.ProjPos = float4( vOut.UV.x * 2.0f - 1.0f, 1.0f - vOut.UV.y * 2.0f, 0.0f, 1.0f );
+
+    return vOut;
+}
+
+//**************************************************//
+
+
+//--------------------------------------------------------------------------------------
+// Pixel Shaders
+//--------------------------------------------------------------------------------------
+
+// The pixel shader determines colour for each pixel in the rendered polygons, given the data passed on from the vertex shader
+// This shader expects vertex position, normal and UVs from the vertex shader. It calculates per-pixel lighting and combines with diffuse and specular map
+// The lighting calculation is shared between the monoscopic and single-pass stereo pixel shaders below, only the camera position and
+// the viewport the pixel is in differ. The pixel position selects the light tile, so only the lights that reach the tile are visited
+//
+float4 LitDiffuseMap( float3 worldPos, float3 worldNormal, float2 uv, float3 cameraPos, float2 viewportPos )
+{
+	// Can't guarantee the normals are length 1 now (because the world matrix may contain scaling), so renormalise
+	// If lighting in the pixel shader, this is also because the interpolation from vertex shader to pixel shader will also rescale normals
+	worldNormal = normalize(worldNormal); 
+
+
+	///////////////////////
+	// Calculate lighting
+
+	// Calculate direction of camera
+	float3 CameraDir = normalize(cameraPos - worldPos); // Position of camera - position of current vertex (or pixel) (in world space)
+
+	// Find this pixel's tile and sum the effect of its lights. Add the ambient once rather than for each light
+	uint2 tile = min( uint2(viewportPos * LightTileScale), NumLightTiles - 1 );
+	uint2 tileLights = LightTiles.Load( tile.y * NumLightTiles.x + tile.x );
+
+	float3 DiffuseLight = AmbientColour;
+	float3 SpecularLight = 0;
+	[loop] for (uint i = 0; i < tileLights.y; ++i)
+	{
+		uint light = LightIndices.Load( tileLights.x + i );
+		float4 lightPosRange = LightData.Load( light * 2 );
+		float3 lightColour   = LightData.Load( light * 2 + 1 ).rgb;
+
+		// Lights fall off with 1 / distance, faded to zero at the light's range so it has no effect outside the tiles it was binned to
+		float3 lightDir = lightPosRange.xyz - worldPos;
+		float  lightDist = length(lightDir);
+		lightDir /= lightDist;
+		float  rangeFraction = lightDist / lightPosRange.w;
+		rangeFraction *= rangeFraction;
+		float  fade = saturate( 1.0f - rangeFraction * rangeFraction );
+		float3 diffuse = lightColour * max( dot(worldNormal.xyz, lightDir), 0 ) * fade * fade / lightDist;
+		float3 halfway = normalize(lightDir + CameraDir);
+		DiffuseLight  += diffuse;
+		SpecularLight += diffuse * pow( max( dot(worldNormal.xyz, halfway), 0 ), SpecularPower );
+	}
+
+
+	////////////////////
+	// Sample texture
+
+	// Extract diffuse material colour for this pixel from a texture
+	float4 DiffuseMaterial = DiffuseMap.Sample( TrilinearWrap, uv );
+	
+	// Assume specular material colour is white (i.e. highlights are a full, untinted reflection of light)
+	float3 SpecularMaterial = DiffuseMaterial.a;
+
+	
+	////////////////////
+	// Combine colours 
+	
+	// Combine maps and lighting for final pixel colour
+	float4 combinedColour;
+	combinedColour.rgb = DiffuseMaterial.rgb * DiffuseLight + SpecularMaterial * SpecularLight;
+	combinedColour.a = 1.0f; // No alpha processing in this shader, so just set it to 1
+
+	return combinedColour;
+}
+
+float4 PixelLitDiffuseMap( VS_LIGHTING_OUTPUT vOut ) : SV_Target  // The ": SV_Target" bit just indicates that the returned float4 colour goes to the render target (i.e. it's a colour to render)
+{
+	return LitDiffuseMap( vOut.WorldPos, vOut.WorldNormal, vOut.UV, CameraPos, vOut.ProjPos.xy - ViewportOrigin );
+}
+
+//**|3D|** Single-pass stereo version - camera position depends on the eye this pixel is being rendered for
+float4 PixelLitDiffuseMapStereo( GS_LIGHTING_STEREO_OUTPUT vOut ) : SV_Target
+{
+	return LitDiffuseMap( vOut.WorldPos, vOut.WorldNormal, vOut.UV, StereoCameraPos[vOut.Eye].xyz,
+	                      vOut.ProjPos.xy - StereoViewportOrigin[vOut.Eye].xy );
+}
+
+
+// Unlit opaque texture, for materials with the plain texture render method (see gen::ERenderMethod)
+//
+float4 PlainDiffuseMap( VS_BASIC_OUTPUT vOut ) : SV_Target
+{
+	return float4( DiffuseMap.Sample( TrilinearWrap, vOut.UV ).rgb, 1.0f );
+}
+
+//**|3D|** Single-pass stereo version
+float4 PlainDiffuseMapStereo( GS_BASIC_STEREO_OUTPUT vOut ) : SV_Target
+{
+	return float4( DiffuseMap.Sample( TrilinearWrap, vOut.UV ).rgb, 1.0f );
+}
+
+
+// A pixel shader that just tints a (diffuse) texture with a fixed colour
+//
+float4 TintDiffuseMap( VS_BASIC_OUTPUT vOut ) : SV_Target
+{
+	// Extract diffuse material colour for this pixel from a texture
+	float4 diffuseMapColour = DiffuseMap.Sample( TrilinearWrap, vOut.UV );
+
+	// Tint by global colour (set from C++)
+	diffuseMapColour.rgb *= TintColour / 10;
+
+	return diffuseMapColour;
+}
+
+//**|3D|** Single-pass stereo version, identical but takes the geometry shader output
+float4 TintDiffuseMapStereo( GS_BASIC_STEREO_OUTPUT vOut ) : SV_Target
+{
+	float4 diffuseMapColour = DiffuseMap.Sample( TrilinearWrap, vOut.UV );
+	diffuseMapColour.rgb *= TintColour / 10;
+	return diffuseMapColour;
+}
+
+
+// Instanced versions of the tint shader, the tint colour comes from the instance data
+float4 InstanceTintDiffuseMap( VS_TINT_OUTPUT vOut ) : SV_Target
+{
+	float4 diffuseMapColour = DiffuseMap.Sample( TrilinearWrap, vOut.UV );
+	diffuseMapColour.rgb *= vOut.Tint / 10;
+	return diffuseMapColour;
+}
+
+float4 InstanceTintDiffuseMapStereo( GS_TINT_STEREO_OUTPUT vOut ) : SV_Target
+{
+	float4 diffuseMapColour = DiffuseMap.Sample( TrilinearWrap, vOut.UV );
+	diffuseMapColour.rgb *= vOut.Tint / 10;
+	return diffuseMapColour;
+}
+
+
+// Particle sprites give premultiplied alpha colours, so one blend state (see ParticleBlending) covers both glowing and smoky particles: the
+// colour is always added and the alpha, the particle's opacity, sets how much of the scene it covers
+float4 ParticleDiffuseMap( float4 colour, float2 uv )
+{
+	float4 diffuseMapColour = DiffuseMap.Sample( TrilinearWrap, uv );
+	float alpha = diffuseMapColour.a * colour.a;
+	return float4( diffuseMapColour.rgb * colour.rgb * alpha, alpha * ParticleColour.a );
+}
+
+float4 ParticleSprite( GS_PARTICLE_OUTPUT vOut ) : SV_Target
+{
+	return ParticleDiffuseMap( vOut.Colour, vOut.UV );
+}
+
+//**|3D|** Single-pass stereo version
+float4 ParticleSpriteStereo( GS_PARTICLE_STEREO_OUTPUT vOut ) : SV_Target
+{
+	return ParticleDiffuseMap( vOut.Colour, vOut.UV );
+}
+
+
+// Overdraw visualisation - each pixel shaded adds a step to the colour, which is blended additively. Red is full after 4 layers,
+// green after 8 and blue after 16, so the view goes from black through red and yellow to white as the overdraw increases. Only reads
+// the position, which comes first in every vertex / geometry shader output, so the same shader suits all the techniques
+float4 Overdraw( float4 ProjPos : SV_POSITION ) : SV_Target
+{
+	return float4( 0.25f, 0.125f, 0.0625f, 1.0f );
+}
+
+
+//**|3D|*************************//
+//**** Anaglyph Pixel Shader ****//
+
+// Sample one eye's view, clamped to the part of the stereo texture the eye was rendered to. Without the clamp, filter taps near the
+// edge of a reduced scale (or half height interlaced) view would read the unused part of the texture
+float3 SampleStereoView( float2 uv, uint eye )
+{
+	return StereoViews.SampleLevel( BilinearClamp, float3(min( uv, StereoViewMaxUV ), eye), 0 ).rgb;
+}
+
+// FXAA-style anti-aliasing of one eye's view: finds the direction of any edge through this pixel from the brightness of the
+// surrounding pixels and blurs along it. Much cheaper than MSAA, but softens the image a little
+float3 FXAAStereoView( float2 uv, uint eye )
+{
+	const float3 luma = float3( 0.299f, 0.587f, 0.114f );
+	float2 texel = StereoViewTexelSize;
+
+	// Brightness of this pixel and the four diagonal corners (each a bilinear average of a 2x2 block)
+	float3 colourM  = SampleStereoView( uv, eye );
+	float  lumaM  = dot( colourM, luma );
+	float  lumaNW = dot( SampleStereoView( uv + float2(-0.5f,-0.5f) * texel, eye ), luma );
+	float  lumaNE = dot( SampleStereoView( uv + float2( 0.5f,-0.5f) * texel, eye ), luma );
+	float  lumaSW = dot( SampleStereoView( uv + float2(-0.5f, 0.5f) * texel, eye ), luma );
+	float  lumaSE = dot( SampleStereoView( uv + float2( 0.5f, 0.5f) * texel, eye ), luma );
+	float  lumaMin = min( lumaM, min( min( lumaNW, lumaNE ), min( lumaSW, lumaSE ) ) );
+	float  lumaMax = max( lumaM, max( max( lumaNW, lumaNE ), max( lumaSW, lumaSE ) ) );
+
+	// Direction along the edge, scaled so the shortest component is one texel, limited to 8 texels
+	float2 dir = float2( (lumaSW + lumaSE) - (lumaNW + lumaNE), (lumaNW + lumaSW) - (lumaNE + lumaSE) );
+	float  dirReduce = max( (lumaNW + lumaNE + lumaSW + lumaSE) * (0.25f / 8.0f), 1.0f / 128.0f );
+	float  rcpDirMin = 1.0f / (min( abs(dir.x), abs(dir.y) ) + dirReduce);
+	dir = clamp( dir * rcpDirMin, -8.0f, 8.0f ) * texel;
+
+	// Blend samples along the edge, use the narrower blend if the wider one goes outside the local brightness range (crossed the edge)
+	float3 colourA = 0.5f  * (SampleStereoView( uv - dir * (1.0f/6.0f), eye ) +
+	                          SampleStereoView( uv + dir * (1.0f/6.0f), eye ));
+	float3 colourB = 0.5f  * colourA +
+	                 0.25f * (SampleStereoView( uv - dir * 0.5f, eye ) +
+	                          SampleStereoView( uv + dir * 0.5f, eye ));
+	float lumaB = dot( colourB, luma );
+	return (lumaB < lumaMin || lumaB > lumaMax) ? colourA : colourB;
+}
+
+// Get the colour of one eye's view for this pixel (pixel is in the eye's view). At full resolution the views are the same size as the
+// back buffer so each pixel is read directly. With a reduced render scale the eyes only cover the top-left of the stereo texture, so
+// the view is upscaled with bilinear filtering. The uniform parameters select the version when the shader is compiled
+float3 ReadStereoView( VS_BASIC_OUTPUT vOut, int2 pixel, uint eye, uniform bool scaled, uniform bool fxaa )
+{
+	float2 uv = scaled ? vOut.UV * StereoViewScale : (pixel + 0.5f) * StereoViewTexelSize;
+	if (fxaa)
+	{
+		return FXAAStereoView( uv, eye );
+	}
+	if (scaled)
+	{
+		return SampleStereoView( uv, eye );
+	}
+	return StereoViews.Load( int4(pixel, eye, 0) ).rgb;
+}
+
+// Interlaced output: even rows from the left eye, odd rows from the right. Each eye was rendered at half height to the top of its slice
+float4 InterlaceViews( VS_BASIC_OUTPUT vOut, uniform bool scaled, uniform bool fxaa ) : SV_Target
+{
+	int2 pixel = int2( vOut.ProjPos.xy );
+	return float4( ReadStereoView( vOut, int2(pixel.x, pixel.y >> 1), pixel.y & 1, scaled, fxaa ), 1.0f );
+}
+
+// Each anaglyph mode is a pair of 3x3 matrices, one per eye, that convert the eye's RGB colour into its contribution to the output
+// RGB. The matrices are passed as uniform parameters when the pixel shader is compiled, so each mode's technique is specialised to its
+// own constants with no branching
+
+// Luminance weights for the greyscale modes
+#define GREY 0.299f, 0.587f, 0.114f
+
+// Red/cyan: left eye's red channel, right eye's green and blue
+static const float3x3 ColourLeft      = { 1, 0, 0,   0, 0, 0,   0, 0, 0 };
+static const float3x3 ColourRight     = { 0, 0, 0,   0, 1, 0,   0, 0, 1 };
+
+// Half-colour: left eye in grey to reduce retinal rivalry in strong reds, right eye in colour
+static const float3x3 HalfColourLeft  = { GREY,      0, 0, 0,   0, 0, 0 };
+
+// Grey: both eyes in grey
+static const float3x3 GreyLeft        = { GREY,      0, 0, 0,   0, 0, 0 };
+static const float3x3 GreyRight       = { 0, 0, 0,   GREY,      GREY    };
+
+// Optimised: left eye's red made from green and blue, which removes most ghosting of reds at the cost of red reproduction
+static const float3x3 OptimisedLeft   = { 0, 0.7f, 0.3f,   0, 0, 0,   0, 0, 0 };
+
+// Dubois least-squares projection for red/cyan glasses
+static const float3x3 DuboisLeft      = {  0.437f,  0.449f,  0.164f,
+                                          -0.062f, -0.062f, -0.024f,
+                                          -0.048f, -0.050f, -0.017f };
+static const float3x3 DuboisRight     = { -0.011f, -0.032f, -0.007f,
+                                           0.377f,  0.761f,  0.009f,
+                                          -0.026f, -0.093f,  1.234f };
+
+// Green/magenta: left eye's green channel, right eye's red and blue
+static const float3x3 GreenMagentaLeft  = { 0, 0, 0,   0, 1, 0,   0, 0, 0 };
+static const float3x3 GreenMagentaRight = { 1, 0, 0,   0, 0, 0,   0, 0, 1 };
+
+// Amber/blue: left eye's red and green channels, right eye as a blue weighted grey
+static const float3x3 AmberBlueLeft   = { 1, 0, 0,   0, 1, 0,   0, 0, 0 };
+static const float3x3 AmberBlueRight  = { 0, 0, 0,   0, 0, 0,   0.15f, 0.15f, 0.7f };
+
+// Combine the left and right views into an anaglyph
+float4 ColourAnaglyph( VS_BASIC_OUTPUT vOut, uniform float3x3 leftMatrix, uniform float3x3 rightMatrix, uniform bool scaled,
+                       uniform bool fxaa ) : SV_Target
+{
+	// Extract left and right pixel values
+	int2 pixel = int2( vOut.ProjPos.xy );
+	float3 leftColour  = ReadStereoView( vOut, pixel, 0, scaled, fxaa );
+	float3 rightColour = ReadStereoView( vOut, pixel, 1, scaled, fxaa );
+
+	// Combine into anaglyph
+	return float4( saturate( mul( leftMatrix, leftColour ) + mul( rightMatrix, rightColour ) ), 1.0f );
+}
+
+// Overdraw view of the eyes: left eye on the left half of the screen, right eye on the right, each squashed to half width. The
+// colours are shown as they were rendered - going through the anaglyph or interlacing would mix the two eyes' counts together
+float4 OverdrawViews( VS_BASIC_OUTPUT vOut ) : SV_Target
+{
+	uint eye = (vOut.UV.x >= 0.5f) ? 1 : 0;
+	float2 uv = float2( frac( vOut.UV.x * 2.0f ), vOut.UV.y ) * StereoViewScale;
+	return float4( SampleStereoView( uv, eye ), 1.0f );
+}
+
+//*******************************//
+
+
+//**|3D|*****************************//
+//**** Reprojection Pixel Shader ****//
+
+// Reprojection makes the right eye from the left eye's colour and depth instead of rendering it. The eyes only differ by a horizontal
+// offset, so a left eye pixel appears in the right eye on the same row, shifted by an amount that depends on its depth. Each right eye
+// pixel steps along its row of the left eye through the range of possible shifts, looking for where the landing position of the left
+// eye pixels passes it. The nearest surface found is refined to the exact pixel. Where nothing lands (background hidden from the left
+// eye by something in front) the background beside the edge is stretched across the gap. Surfaces narrower than a step can be missed
+static const int ReprojectSteps = 16;
+
+// Shift in pixels from a left eye pixel to where it lands in the right eye, given its depth buffer value
+float ReprojectShift( float depth )
+{
+	return ReprojectParams.x - ReprojectParams.y * depth;
+}
+
+// Depth buffer value of a left eye pixel in the given row, clamped to the eye's view
+float ReprojectDepthAt( float x, int y )
+{
+	return ReprojectDepth.Load( int4(clamp( x + 0.5f, 0.0f, ReprojectMaxX ), y, 0, 0) ).r;
+}
+
+PS_REPROJECT_OUTPUT ReprojectRightEye( VS_BASIC_OUTPUT vOut )
+{
+	int2 pixel = int2( vOut.ProjPos.xy );
+
+	PS_REPROJECT_OUTPUT pOut;
+	pOut.Left = ReprojectColour.Load( int3(pixel, 0) );
+
+	// Step from the largest shift to the smallest, i.e. left to right along the row. landing is how far right of this pixel each left
+	// eye pixel lands, it goes from <= 0 to > 0 where the landing positions pass this pixel. If the shift hardly changes across the step
+	// then a continuous surface lands here, otherwise it is an edge with a gap behind it
+	float step = (ReprojectParams.w - ReprojectParams.z) / ReprojectSteps;
+	float prevX = pixel.x - ReprojectParams.w;
+	float prevDepth = ReprojectDepthAt( prevX, pixel.y );
+	float prevLanding = prevX + ReprojectShift( prevDepth ) - pixel.x;
+
+	float  surfaceDepth = 2.0f; // Nearest continuous surface: its depth and the positions and landings either side
+	float4 surface = 0.0f;
+	float  gapDepth = 2.0f;     // Nearest edge with a gap behind it: the depth in front and the shift of the background
+	float  gapShift = 0.0f;
+	[unroll]
+	for (int i = 0; i < ReprojectSteps; ++i)
+	{
+		float x = prevX + step;
+		float depth = ReprojectDepthAt( x, pixel.y );
+		float landing = x + ReprojectShift( depth ) - pixel.x;
+		if (prevLanding <= 0.0f && landing > 0.0f)
+		{
+			float nearDepth = min( depth, prevDepth );
+			if (abs( ReprojectShift( depth ) - ReprojectShift( prevDepth ) ) < step)
+			{
+				if (nearDepth < surfaceDepth)
+				{
+					surfaceDepth = nearDepth;
+					surface = float4( prevX, prevLanding, x, landing );
+				}
+			}
+			else if (nearDepth < gapDepth)
+			{
+				gapDepth = nearDepth;
+				gapShift = ReprojectShift( max( depth, prevDepth ) );
+			}
+		}
+		prevX = x;
+		prevDepth = depth;
+		prevLanding = landing;
+	}
+
+	float sourceX;
+	if (surfaceDepth <= 1.0f)
+	{
+		// Narrow down to the pixel that lands here, replacing whichever side of the step has the same sign
+		[unroll]
+		for (int j = 0; j < 2; ++j)
+		{
+			float x = surface.x - surface.y * (surface.z - surface.x) / (surface.w - surface.y);
+			float landing = x + ReprojectShift( ReprojectDepthAt( x, pixel.y ) ) - pixel.x;
+			if (landing <= 0.0f) surface.xy = float2( x, landing );
+			else                 surface.zw = float2( x, landing );
+		}
+		sourceX = (-surface.y < surface.w) ? surface.x : surface.z;
+	}
+	else if (gapDepth <= 1.0f)
+	{
+		sourceX = pixel.x - gapShift;
+	}
+	else
+	{
+		// Nothing passes this pixel within the search, e.g. near the edges of the view. Use the shift of the pixel in the same place
+		sourceX = pixel.x - ReprojectShift( ReprojectDepthAt( pixel.x, pixel.y ) );
+	}
+	pOut.Right = ReprojectColour.Load( int3(clamp( sourceX + 0.5f, 0.0f, ReprojectMaxX ), pixel.y, 0) );
+	return pOut;
+}
+
+//***********************************//
+
+
+//--------------------------------------------------------------------------------------
+// States
+//--------------------------------------------------------------------------------------
+
+// States are needed to switch between additive blending for the lights and no blending for other models
+
+RasterizerState CullNone  // Cull none of the polygons, i.e. show both sides
+{
+	CullMode = None;
+};
+RasterizerState CullBack  // Cull back side of polygon - normal behaviour, only show front of polygons
+{
+	CullMode = Back;
+};
+
+
+DepthStencilState DepthWritesOff // Don't write to the depth buffer - polygons rendered will not obscure other polygons
 {
 	DepthFunc      = LESS;
 	DepthWriteMask = ZERO;
@@ -317,6 +1223,11 @@ DepthStencilState DepthWritesOn  // Write to the depth buffer - normal behaviour
 	DepthFunc      = LESS;
 	DepthWriteMask = ALL;
 };
+DepthStencilState DepthPrepassed // Depth already written by the depth pre-pass - only the nearest surface's pixels pass, so each is shaded once
+{
+	DepthFunc      = LESS_EQUAL;
+	DepthWriteMask = ZERO;
+};
 DepthStencilState DisableDepth   // Disable depth buffer entirely
 {
 	DepthFunc      = ALWAYS;
@@ -335,6 +1246,13 @@ BlendState AdditiveBlending // Additive blending is used for lighting effects
     DestBlend = ONE;
     BlendOp = ADD;
 };
+BlendState ParticleBlending // Premultiplied alpha - the colour is added and the alpha says how much of the scene behind is covered
+{
+    BlendEnable[0] = TRUE;
+    SrcBlend = ONE;
+    DestBlend = INV_SRC_ALPHA;
+    BlendOp = ADD;
+};
 
 
 //--------------------------------------------------------------------------------------
@@ -343,14 +1261,14 @@ BlendState AdditiveBlending // Additive blending is used for lighting effects
 
 // Techniques are used to render models in our scene. They select a combination of vertex, geometry and pixel shader from those provided above. Can also set states.
 
-// Vertex lighting with diffuse map
-technique10 VertexLitTex
+// Per-pixel lighting with diffuse map, specular strength in the map's alpha
+technique10 PixelLitTex
 {
     pass P0
     {
         SetVertexShader( CompileShader( vs_4_0, VertexLightingTex() ) );
         SetGeometryShader( NULL );                                   
-        SetPixelShader( CompileShader( ps_4_0, VertexLitDiffuseMap() ) );
+        SetPixelShader( CompileShader( ps_4_0, PixelLitDiffuseMap() ) );
 
 		// Switch off blending states
 		SetBlendState( NoBlending, float4( 0.0f, 0.0f, 0.0f, 0.0f ), 0xFFFFFFFF );
@@ -360,6 +1278,22 @@ technique10 VertexLitTex
 }
 
 
+// Unlit opaque texture
+technique10 PlainTex
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_4_0, BasicTransform() ) );
+        SetGeometryShader( NULL );                                   
+        SetPixelShader( CompileShader( ps_4_0, PlainDiffuseMap() ) );
+
+		SetBlendState( NoBlending, float4( 0.0f, 0.0f, 0.0f, 0.0f ), 0xFFFFFFFF );
+		SetRasterizerState( CullBack ); 
+		SetDepthStencilState( DepthWritesOn, 0 );
+	}
+}
+
+
 // Additive blended texture. No lighting, but uses a global colour tint. Used for light models
 technique10 AdditiveTexTint
 {
@@ -377,23 +1311,415 @@ technique10 AdditiveTexTint
 
 
 //**|3D|******************************//
-// Anaglyph Post-Processing Technique
+// Single-Pass Stereo Techniques
+
+// Same as the techniques above, but draw two instances of each model, one into each slice of a two slice render target array
+technique10 PixelLitTexStereo
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_4_0, VertexLightingTexStereo() ) );
+        SetGeometryShader( CompileShader( gs_4_0, StereoSliceLighting() ) );
+        SetPixelShader( CompileShader( ps_4_0, PixelLitDiffuseMapStereo() ) );
+
+		SetBlendState( NoBlending, float4( 0.0f, 0.0f, 0.0f, 0.0f ), 0xFFFFFFFF );
+		SetRasterizerState( CullBack ); 
+		SetDepthStencilState( DepthWritesOn, 0 );
+	}
+}
+
+technique10 PlainTexStereo
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_4_0, BasicTransformStereo() ) );
+        SetGeometryShader( CompileShader( gs_4_0, StereoSliceBasic() ) );
+        SetPixelShader( CompileShader( ps_4_0, PlainDiffuseMapStereo() ) );
+
+		SetBlendState( NoBlending, float4( 0.0f, 0.0f, 0.0f, 0.0f ), 0xFFFFFFFF );
+		SetRasterizerState( CullBack ); 
+		SetDepthStencilState( DepthWritesOn, 0 );
+	}
+}
+
+technique10 AdditiveTexTintStereo
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_4_0, BasicTransformStereo() ) );
+        SetGeometryShader( CompileShader( gs_4_0, StereoSliceBasic() ) );
+        SetPixelShader( CompileShader( ps_4_0, TintDiffuseMapStereo() ) );
+
+		SetBlendState( AdditiveBlending, float4( 0.0f, 0.0f, 0.0f, 0.0f ), 0xFFFFFFFF );
+		SetRasterizerState( CullNone ); 
+		SetDepthStencilState( DepthWritesOff, 0 );
+     }
+}
 
-// Draw full screen quad combining left and right views into an anaglyph output. 
-// Doesn't require any vertex or index data (see FullScreenQuad vertex shader)
-technique10 CreateAnaglyph
+//************************************//
+
+
+//************************************//
+// Instanced Techniques
+
+// Same as PixelLitTex and AdditiveTexTint, but the world matrix and tint come from per-instance vertex data (see CInstancedModel)
+technique10 PixelLitTexInstanced
 {
     pass P0
     {
-        SetVertexShader( CompileShader( vs_4_0, FullScreenQuad() ) );
+        SetVertexShader( CompileShader( vs_4_0, VertexLightingTexInstanced() ) );
         SetGeometryShader( NULL );                                   
-        SetPixelShader( CompileShader( ps_4_0, ColourAnaglyph() ) );
+        SetPixelShader( CompileShader( ps_4_0, PixelLitDiffuseMap() ) );
 
 		SetBlendState( NoBlending, float4( 0.0f, 0.0f, 0.0f, 0.0f ), 0xFFFFFFFF );
+		SetRasterizerState( CullBack ); 
+		SetDepthStencilState( DepthWritesOn, 0 );
+	}
+}
+
+technique10 AdditiveTexTintInstanced
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_4_0, BasicTransformInstanced() ) );
+        SetGeometryShader( NULL );                                   
+        SetPixelShader( CompileShader( ps_4_0, InstanceTintDiffuseMap() ) );
+
+		SetBlendState( AdditiveBlending, float4( 0.0f, 0.0f, 0.0f, 0.0f ), 0xFFFFFFFF );
 		SetRasterizerState( CullNone ); 
-		SetDepthStencilState( DisableDepth, 0 );
+		SetDepthStencilState( DepthWritesOff, 0 );
+     }
+}
+
+//**|3D|** Single-pass stereo instanced techniques, two instances drawn for each instance in the buffer
+technique10 PixelLitTexInstancedStereo
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_4_0, VertexLightingTexInstancedStereo() ) );
+        SetGeometryShader( CompileShader( gs_4_0, StereoSliceLighting() ) );
+        SetPixelShader( CompileShader( ps_4_0, PixelLitDiffuseMapStereo() ) );
+
+		SetBlendState( NoBlending, float4( 0.0f, 0.0f, 0.0f, 0.0f ), 0xFFFFFFFF );
+		SetRasterizerState( CullBack ); 
+		SetDepthStencilState( DepthWritesOn, 0 );
+	}
+}
+
+technique10 AdditiveTexTintInstancedStereo
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_4_0, BasicTransformInstancedStereo() ) );
+        SetGeometryShader( CompileShader( gs_4_0, StereoSliceTint() ) );
+        SetPixelShader( CompileShader( ps_4_0, InstanceTintDiffuseMapStereo() ) );
+
+		SetBlendState( AdditiveBlending, float4( 0.0f, 0.0f, 0.0f, 0.0f ), 0xFFFFFFFF );
+		SetRasterizerState( CullNone ); 
+		SetDepthStencilState( DepthWritesOff, 0 );
      }
 }
 
 //************************************//
 
+
+//************************************//
+// Skinned Techniques
+
+// Same as PixelLitTex and PlainTex, but each vertex is moved by a blend of its model's node matrices (see BonePalette)
+technique10 PixelLitTexSkinned
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_4_0, VertexLightingTexSkinned() ) );
+        SetGeometryShader( NULL );                                   
+        SetPixelShader( CompileShader( ps_4_0, PixelLitDiffuseMap() ) );
+
+		SetBlendState( NoBlending, float4( 0.0f, 0.0f, 0.0f, 0.0f ), 0xFFFFFFFF );
+		SetRasterizerState( CullBack ); 
+		SetDepthStencilState( DepthWritesOn, 0 );
+	}
+}
+
+technique10 PlainTexSkinned
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_4_0, BasicTransformSkinned() ) );
+        SetGeometryShader( NULL );                                   
+        SetPixelShader( CompileShader( ps_4_0, PlainDiffuseMap() ) );
+
+		SetBlendState( NoBlending, float4( 0.0f, 0.0f, 0.0f, 0.0f ), 0xFFFFFFFF );
+		SetRasterizerState( CullBack ); 
+		SetDepthStencilState( DepthWritesOn, 0 );
+	}
+}
+
+//**|3D|** Single-pass stereo skinned techniques
+technique10 PixelLitTexSkinnedStereo
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_4_0, VertexLightingTexSkinnedStereo() ) );
+        SetGeometryShader( CompileShader( gs_4_0, StereoSliceLighting() ) );
+        SetPixelShader( CompileShader( ps_4_0, PixelLitDiffuseMapStereo() ) );
+
+		SetBlendState( NoBlending, float4( 0.0f, 0.0f, 0.0f, 0.0f ), 0xFFFFFFFF );
+		SetRasterizerState( CullBack ); 
+		SetDepthStencilState( DepthWritesOn, 0 );
+	}
+}
+
+technique10 PlainTexSkinnedStereo
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_4_0, BasicTransformSkinnedStereo() ) );
+        SetGeometryShader( CompileShader( gs_4_0, StereoSliceBasic() ) );
+        SetPixelShader( CompileShader( ps_4_0, PlainDiffuseMapStereo() ) );
+
+		SetBlendState( NoBlending, float4( 0.0f, 0.0f, 0.0f, 0.0f ), 0xFFFFFFFF );
+		SetRasterizerState( CullBack ); 
+		SetDepthStencilState( DepthWritesOn, 0 );
+	}
+}
+
+//************************************//
+
+
+//************************************//
+// Particle Techniques
+
+// Simulate the particles for a frame, streaming the particles out to the other particle buffer. Nothing is drawn - there is no pixel
+// shader and no depth test (see CParticleSystem::Advance)
+GeometryShader AdvanceParticlesGS = ConstructGSWithSO( CompileShader( gs_4_0, AdvanceParticles() ), "POSITION.xyz; VELOCITY.xyz; AGE.x; TYPE.x" );
+technique10 AdvanceParticles
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_4_0, ParticlePassThrough() ) );
+        SetGeometryShader( AdvanceParticlesGS );
+        SetPixelShader( NULL );
+
+		SetDepthStencilState( DisableDepth, 0 );
+	}
+}
+
+// Draw the particles as camera-facing sprites. They are depth tested against the scene but don't write depth, and are not sorted
+technique10 DrawParticles
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_4_0, ParticlePassThrough() ) );
+        SetGeometryShader( CompileShader( gs_4_0, DrawParticle() ) );
+        SetPixelShader( CompileShader( ps_4_0, ParticleSprite() ) );
+
+		SetBlendState( ParticleBlending, float4( 0.0f, 0.0f, 0.0f, 0.0f ), 0xFFFFFFFF );
+		SetRasterizerState( CullNone ); 
+		SetDepthStencilState( DepthWritesOff, 0 );
+	}
+}
+
+//**|3D|** Single-pass stereo version, both eyes' sprites from one draw
+technique10 DrawParticlesStereo
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_4_0, ParticlePassThrough() ) );
+        SetGeometryShader( CompileShader( gs_4_0, DrawParticleStereo() ) );
+        SetPixelShader( CompileShader( ps_4_0, ParticleSpriteStereo() ) );
+
+		SetBlendState( ParticleBlending, float4( 0.0f, 0.0f, 0.0f, 0.0f ), 0xFFFFFFFF );
+		SetRasterizerState( CullNone ); 
+		SetDepthStencilState( DepthWritesOff, 0 );
+	}
+}
+
+//************************************//
+
+
+//************************************//
+// Occlusion Test Techniques
+
+// Test a box against the depth buffer for an occlusion predicate (see COcclusionCuller). Nothing is written, both faces of the box are
+// drawn so it still counts if the camera is close to it
+technique10 OcclusionBox
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_4_0, OcclusionBoxTransform() ) );
+        SetGeometryShader( NULL );
+        SetPixelShader( NULL );
+
+		SetRasterizerState( CullNone ); 
+		SetDepthStencilState( DepthWritesOff, 0 );
+	}
+}
+
+//************************************//
+
+
+//************************************//
+// Depth Pre-Pass Techniques
+
+// Each opaque technique above has two versions for the depth pre-pass. The "DepthOnly" version is drawn first and only writes depth,
+// it has no pixel shader. The "Prepassed" version is then drawn over it and shades only the pixels whose depth matches, so the pixel
+// shader runs once for each visible pixel however the models overlap. Both use the same vertex shader as the original, so the depths
+// come out identical
+#define DEPTH_PREPASS_TECHNIQUES( name, vertexShader, geometryShader, pixelShader ) \
+technique10 name##DepthOnly \
+{ \
+    pass P0 \
+    { \
+        SetVertexShader( CompileShader( vs_4_0, vertexShader ) ); \
+        SetGeometryShader( geometryShader ); \
+        SetPixelShader( NULL ); \
+\
+		SetBlendState( NoBlending, float4( 0.0f, 0.0f, 0.0f, 0.0f ), 0xFFFFFFFF ); \
+		SetRasterizerState( CullBack ); \
+		SetDepthStencilState( DepthWritesOn, 0 ); \
+	} \
+} \
+technique10 name##Prepassed \
+{ \
+    pass P0 \
+    { \
+        SetVertexShader( CompileShader( vs_4_0, vertexShader ) ); \
+        SetGeometryShader( geometryShader ); \
+        SetPixelShader( CompileShader( ps_4_0, pixelShader ) ); \
+\
+		SetBlendState( NoBlending, float4( 0.0f, 0.0f, 0.0f, 0.0f ), 0xFFFFFFFF ); \
+		SetRasterizerState( CullBack ); \
+		SetDepthStencilState( DepthPrepassed, 0 ); \
+	} \
+}
+
+DEPTH_PREPASS_TECHNIQUES( PixelLitTex, VertexLightingTex(), NULL, PixelLitDiffuseMap() )
+DEPTH_PREPASS_TECHNIQUES( PlainTex,    BasicTransform(),    NULL, PlainDiffuseMap() )
+DEPTH_PREPASS_TECHNIQUES( PixelLitTexInstanced, VertexLightingTexInstanced(), NULL, PixelLitDiffuseMap() )
+DEPTH_PREPASS_TECHNIQUES( PixelLitTexSkinned, VertexLightingTexSkinned(), NULL, PixelLitDiffuseMap() )
+DEPTH_PREPASS_TECHNIQUES( PlainTexSkinned,    BasicTransformSkinned(),    NULL, PlainDiffuseMap() )
+
+//**|3D|** Single-pass stereo versions
+DEPTH_PREPASS_TECHNIQUES( PixelLitTexStereo, VertexLightingTexStereo(), CompileShader( gs_4_0, StereoSliceLighting() ), PixelLitDiffuseMapStereo() )
+DEPTH_PREPASS_TECHNIQUES( PlainTexStereo,    BasicTransformStereo(),    CompileShader( gs_4_0, StereoSliceBasic() ),    PlainDiffuseMapStereo() )
+DEPTH_PREPASS_TECHNIQUES( PixelLitTexInstancedStereo, VertexLightingTexInstancedStereo(), CompileShader( gs_4_0, StereoSliceLighting() ),
+                          PixelLitDiffuseMapStereo() )
+DEPTH_PREPASS_TECHNIQUES( PixelLitTexSkinnedStereo, VertexLightingTexSkinnedStereo(), CompileShader( gs_4_0, StereoSliceLighting() ),
+                          PixelLitDiffuseMapStereo() )
+DEPTH_PREPASS_TECHNIQUES( PlainTexSkinnedStereo,    BasicTransformSkinnedStereo(),    CompileShader( gs_4_0, StereoSliceBasic() ),
+                          PlainDiffuseMapStereo() )
+
+//************************************//
+
+
+//************************************//
+// Overdraw Techniques
+
+// Versions of the opaque techniques for the overdraw view (see the Overdraw pixel shader). The "Overdraw" version replaces the
+// original technique and the "OverdrawPrepassed" version replaces the "Prepassed" one, so the view shows the pixels each draw order
+// and pre-pass setting actually shades. The depth tests are unchanged - the colour is blended but depth is still written as usual
+#define OVERDRAW_TECHNIQUES( name, vertexShader, geometryShader ) \
+technique10 name##Overdraw \
+{ \
+    pass P0 \
+    { \
+        SetVertexShader( CompileShader( vs_4_0, vertexShader ) ); \
+        SetGeometryShader( geometryShader ); \
+        SetPixelShader( CompileShader( ps_4_0, Overdraw() ) ); \
+\
+		SetBlendState( AdditiveBlending, float4( 0.0f, 0.0f, 0.0f, 0.0f ), 0xFFFFFFFF ); \
+		SetRasterizerState( CullBack ); \
+		SetDepthStencilState( DepthWritesOn, 0 ); \
+	} \
+} \
+technique10 name##OverdrawPrepassed \
+{ \
+    pass P0 \
+    { \
+        SetVertexShader( CompileShader( vs_4_0, vertexShader ) ); \
+        SetGeometryShader( geometryShader ); \
+        SetPixelShader( CompileShader( ps_4_0, Overdraw() ) ); \
+\
+		SetBlendState( AdditiveBlending, float4( 0.0f, 0.0f, 0.0f, 0.0f ), 0xFFFFFFFF ); \
+		SetRasterizerState( CullBack ); \
+		SetDepthStencilState( DepthPrepassed, 0 ); \
+	} \
+}
+
+OVERDRAW_TECHNIQUES( PixelLitTex, VertexLightingTex(), NULL )
+OVERDRAW_TECHNIQUES( PlainTex,    BasicTransform(),    NULL )
+OVERDRAW_TECHNIQUES( PixelLitTexInstanced, VertexLightingTexInstanced(), NULL )
+OVERDRAW_TECHNIQUES( PixelLitTexSkinned, VertexLightingTexSkinned(), NULL )
+OVERDRAW_TECHNIQUES( PlainTexSkinned,    BasicTransformSkinned(),    NULL )
+
+//**|3D|** Single-pass stereo versions
+OVERDRAW_TECHNIQUES( PixelLitTexStereo, VertexLightingTexStereo(), CompileShader( gs_4_0, StereoSliceLighting() ) )
+OVERDRAW_TECHNIQUES( PlainTexStereo,    BasicTransformStereo(),    CompileShader( gs_4_0, StereoSliceBasic() ) )
+OVERDRAW_TECHNIQUES( PixelLitTexInstancedStereo, VertexLightingTexInstancedStereo(), CompileShader( gs_4_0, StereoSliceLighting() ) )
+OVERDRAW_TECHNIQUES( PixelLitTexSkinnedStereo, VertexLightingTexSkinnedStereo(), CompileShader( gs_4_0, StereoSliceLighting() ) )
+OVERDRAW_TECHNIQUES( PlainTexSkinnedStereo,    BasicTransformSkinnedStereo(),    CompileShader( gs_4_0, StereoSliceBasic() ) )
+
+//************************************//
+
+
+//**|3D|******************************//
+// Anaglyph Post-Processing Technique
+
+// Draw full screen triangle combining left and right views into an anaglyph output. 
+// Doesn't require any vertex or index data (see FullScreenTriangle vertex shader)
+// Each technique has "Scaled" versions used when the eyes are rendered at reduced resolution and "FXAA" versions with anti-aliasing
+#define COMPOSITE_TECHNIQUE( name, pixelShader ) \
+technique10 name \
+{ \
+    pass P0 \
+    { \
+        SetVertexShader( CompileShader( vs_4_0, FullScreenTriangle() ) ); \
+        SetGeometryShader( NULL ); \
+        SetPixelShader( CompileShader( ps_4_0, pixelShader ) ); \
+\
+		SetBlendState( NoBlending, float4( 0.0f, 0.0f, 0.0f, 0.0f ), 0xFFFFFFFF ); \
+		SetRasterizerState( CullNone ); \
+		SetDepthStencilState( DisableDepth, 0 ); \
+     } \
+}
+#define ANAGLYPH_TECHNIQUE( name, leftMatrix, rightMatrix ) \
+COMPOSITE_TECHNIQUE( name,             ColourAnaglyph( leftMatrix, rightMatrix, false, false ) ) \
+COMPOSITE_TECHNIQUE( name##Scaled,     ColourAnaglyph( leftMatrix, rightMatrix, true,  false ) ) \
+COMPOSITE_TECHNIQUE( name##FXAA,       ColourAnaglyph( leftMatrix, rightMatrix, false, true ) ) \
+COMPOSITE_TECHNIQUE( name##ScaledFXAA, ColourAnaglyph( leftMatrix, rightMatrix, true,  true ) )
+
+// One technique for each anaglyph mode, which must match the order of EAnaglyphMode in the C++ code
+ANAGLYPH_TECHNIQUE( AnaglyphColour,       ColourLeft,       ColourRight )
+ANAGLYPH_TECHNIQUE( AnaglyphHalfColour,   HalfColourLeft,   ColourRight )
+ANAGLYPH_TECHNIQUE( AnaglyphGrey,         GreyLeft,         GreyRight )
+ANAGLYPH_TECHNIQUE( AnaglyphOptimised,    OptimisedLeft,    ColourRight )
+ANAGLYPH_TECHNIQUE( AnaglyphDubois,       DuboisLeft,       DuboisRight )
+ANAGLYPH_TECHNIQUE( AnaglyphGreenMagenta, GreenMagentaLeft, GreenMagentaRight )
+ANAGLYPH_TECHNIQUE( AnaglyphAmberBlue,    AmberBlueLeft,    AmberBlueRight )
+
+// Combine the left and right views on alternate rows for interlaced (passive polarised) displays
+COMPOSITE_TECHNIQUE( CreateInterlaced,           InterlaceViews( false, false ) )
+COMPOSITE_TECHNIQUE( CreateInterlacedScaled,     InterlaceViews( true,  false ) )
+COMPOSITE_TECHNIQUE( CreateInterlacedFXAA,       InterlaceViews( false, true ) )
+COMPOSITE_TECHNIQUE( CreateInterlacedScaledFXAA, InterlaceViews( true,  true ) )
+
+// Show the overdraw of the two eyes side by side, in place of the anaglyph or interlacing (see ShowOverdraw)
+COMPOSITE_TECHNIQUE( ShowOverdrawViews, OverdrawViews() )
+
+// Make the stereo texture from the left eye and its depth, instead of rendering the right eye (see ReprojectRightEye)
+technique10 Reproject
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_4_0, FullScreenTriangle() ) );
+        SetGeometryShader( NULL );
+        SetPixelShader( CompileShader( ps_4_0, ReprojectRightEye() ) );
+
+		SetBlendState( NoBlending, float4( 0.0f, 0.0f, 0.0f, 0.0f ), 0xFFFFFFFF );
+		SetRasterizerState( CullNone );
+		SetDepthStencilState( DisableDepth, 0 );
+     }
+}
+
+//************************************//
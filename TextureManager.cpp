@@ -0,0 +1,352 @@
+//--------------------------------------------------------------------------------------
+//	TextureManager.cpp
+//
+//	The texture manager loads each texture file once, shares it between users and decodes
+//	files on worker threads. A placeholder is used until a texture has finished loading.
+//	Image files are converted to block-compressed DDS files with mip-maps the first time
+//	they are loaded, later loads use the DDS while it is up to date
+//--------------------------------------------------------------------------------------
+
+#include "Defines.h"        // General definitions shared by all source files
+#include "TextureManager.h" // Declaration of this class
+#include "ResourceRegistry.h" // Counted in the texture memory, with a budget
+
+// Maximum number of device work items completed per frame in Update - limits how long a frame can be held up creating textures
+const UINT MaxDeviceWorkItemsPerFrame = 4;
+
+
+///////////////////////////////
+// Constructors / Destructors
+
+CTextureManager::CTextureManager()
+{
+	m_ThreadPump = NULL;
+	m_PlaceholderTexture = NULL;
+	m_Placeholder = NULL;
+	m_NumPending = 0;
+}
+
+CTextureManager::~CTextureManager()
+{
+	ReleaseResources();
+}
+
+
+// Create the thread pump and placeholder texture. Number of worker threads defaults (0) to the number of processors
+bool CTextureManager::Init( unsigned int numThreads /*= 0*/ )
+{
+	// One IO thread is enough to read files, the decoding is done on the processing threads
+	if (FAILED( D3DX10CreateThreadPump( 1, numThreads, &m_ThreadPump ) )) return false;
+
+	// Placeholder texture - single texel, immutable
+	D3D10_TEXTURE2D_DESC textureDesc;
+	textureDesc.Width  = 1;
+	textureDesc.Height = 1;
+	textureDesc.MipLevels = 1;
+	textureDesc.ArraySize = 1;
+	textureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.SampleDesc.Quality = 0;
+	textureDesc.Usage = D3D10_USAGE_IMMUTABLE;
+	textureDesc.BindFlags = D3D10_BIND_SHADER_RESOURCE;
+	textureDesc.CPUAccessFlags = 0;
+	textureDesc.MiscFlags = 0;
+	const UINT placeholderTexel = 0x00808080; // ABGR: mid-grey, alpha (specular) 0
+	D3D10_SUBRESOURCE_DATA initData;
+	initData.pSysMem = &placeholderTexel;
+	initData.SysMemPitch = sizeof(placeholderTexel);
+	initData.SysMemSlicePitch = 0;
+	if (FAILED( g_Resources.CreateTexture2D( ResourceTexture, &textureDesc, &initData, &m_PlaceholderTexture ) )) return false;
+	if (FAILED( g_Resources.CreateShaderResourceView( ResourceTexture, m_PlaceholderTexture, NULL, &m_Placeholder ) )) return false;
+
+	return true;
+}
+
+
+// Release all textures. Waits for any outstanding loads first
+void CTextureManager::ReleaseResources()
+{
+	// The thread pump writes into the texture objects, so it must be finished with them before they are deleted
+	if (m_ThreadPump)
+	{
+		m_ThreadPump->PurgeAllItems();
+	}
+
+	for (TTextureMap::iterator texture = m_Textures.begin(); texture != m_Textures.end(); ++texture)
+	{
+		SAFE_RELEASE( texture->second->m_View );
+		SAFE_RELEASE( texture->second->m_ReloadView );
+		SAFE_RELEASE( texture->second->m_ConvertResource );
+		delete texture->second;
+	}
+	m_Textures.clear();
+	m_NumPending = 0;
+
+	SAFE_RELEASE( m_Placeholder );
+	SAFE_RELEASE( m_PlaceholderTexture );
+	SAFE_RELEASE( m_ThreadPump );
+}
+
+
+/////////////////////////////
+// Texture Usage
+
+// Get a texture, starting it loading on a worker thread if it hasn't been requested before. Returns NULL only if the manager
+// has not been initialised. Check IsLoaded / GetView on the result
+CTexture* CTextureManager::GetTexture( const wstring& fileName )
+{
+	if (!m_ThreadPump) return NULL;
+
+	// Already requested - share it
+	TTextureMap::iterator found = m_Textures.find( fileName );
+	if (found != m_Textures.end())
+	{
+		return found->second;
+	}
+
+	// New texture, uses the placeholder until the thread pump has loaded it
+	CTexture* texture = new CTexture;
+	texture->m_FileName = fileName;
+	texture->m_Placeholder = m_Placeholder;
+	m_Textures[fileName] = texture;
+
+	if (StartLoad( texture, false ))
+	{
+		++m_NumPending;
+	}
+	else
+	{
+		texture->m_Loaded = true;
+	}
+
+	return texture;
+}
+
+
+// Call once per frame on the render thread - completes loads that the worker threads have finished decoding
+void CTextureManager::Update()
+{
+	if (!m_ThreadPump || m_NumPending == 0) return;
+
+	m_ThreadPump->ProcessDeviceWorkItems( MaxDeviceWorkItemsPerFrame );
+	CheckCompleted();
+}
+
+
+// Block until all requested textures have loaded
+void CTextureManager::WaitForAll()
+{
+	if (!m_ThreadPump || m_NumPending == 0) return;
+
+	m_ThreadPump->WaitForAllItems();
+	CheckCompleted();
+}
+
+
+// Load a texture again after its file has changed. The file name is not case sensitive. The texture keeps its current view until
+// the new one has loaded, and keeps it if the new load fails. Returns false if the texture has not been requested
+bool CTextureManager::ReloadTexture( const wstring& fileName )
+{
+	if (!m_ThreadPump) return false;
+
+	for (TTextureMap::iterator entry = m_Textures.begin(); entry != m_Textures.end(); ++entry)
+	{
+		CTexture* texture = entry->second;
+		if (_wcsicmp( entry->first.c_str(), fileName.c_str() ) != 0) continue;
+
+		// A load in progress may have read the file before it changed, so start again once it has completed
+		if (!texture->m_Loaded || texture->m_Reloading)
+		{
+			texture->m_ReloadAgain = true;
+		}
+		else
+		{
+			StartReload( texture );
+		}
+		return true;
+	}
+	return false;
+}
+
+
+/////////////////////////////
+// Private member functions
+
+// Mark textures whose loads have been completed by the thread pump, and swap in completed reloads
+void CTextureManager::CheckCompleted()
+{
+	for (TTextureMap::iterator entry = m_Textures.begin(); entry != m_Textures.end(); ++entry)
+	{
+		CTexture* texture = entry->second;
+		if (texture->m_Converting && texture->m_ConvertResult != E_PENDING)
+		{
+			CompleteConversion( texture );
+		}
+
+		if (!texture->m_Loaded && texture->m_LoadResult != E_PENDING)
+		{
+			texture->m_Loaded = true;
+			--m_NumPending;
+			if (FAILED( texture->m_LoadResult ))
+			{
+				// Keep using the placeholder, but report the problem
+				OutputDebugString( (L"Failed to load texture: " + texture->m_FileName + L"\n").c_str() );
+				SAFE_RELEASE( texture->m_View );
+			}
+			else
+			{
+				g_Resources.Track( texture->m_View, ResourceTexture );
+			}
+		}
+
+		// Swap in completed reloads, the old view is kept if the reload failed
+		if (texture->m_Reloading && texture->m_ReloadResult != E_PENDING)
+		{
+			texture->m_Reloading = false;
+			--m_NumPending;
+			if (SUCCEEDED( texture->m_ReloadResult ) && texture->m_ReloadView)
+			{
+				SAFE_RELEASE( texture->m_View );
+				texture->m_View = texture->m_ReloadView;
+				texture->m_ReloadView = NULL;
+				g_Resources.Track( texture->m_View, ResourceTexture );
+			}
+			else
+			{
+				OutputDebugString( (L"Failed to reload texture: " + texture->m_FileName + L"\n").c_str() );
+				SAFE_RELEASE( texture->m_ReloadView );
+			}
+		}
+		if (texture->m_ReloadAgain && texture->m_Loaded && !texture->m_Reloading)
+		{
+			StartReload( texture );
+		}
+	}
+}
+
+// Start loading a texture's file on the thread pump, into its view or its reload view. DDS files are loaded as they are. Other
+// image files load the compressed file instead (see CompressedFileName) if it is newer than the image, otherwise the image is
+// converted and the compressed file written when the load completes (see CompleteConversion). Returns false if the load could not
+// be started
+bool CTextureManager::StartLoad( CTexture* texture, bool reload )
+{
+	// Passing the thread pump makes these calls return immediately. The view (or resource) and result are written when the load completes
+	ID3D10ShaderResourceView** view = reload ? &texture->m_ReloadView : &texture->m_View;
+	HRESULT* result = reload ? &texture->m_ReloadResult : &texture->m_LoadResult;
+	*result = E_PENDING;
+
+	// Over the texture budget, further loads leave out the top mip-map, which is three quarters of a texture's memory. Conversions
+	// still build the full chain so the compressed file is complete
+	bool overBudget = g_Resources.IsOverBudget( ResourceTexture );
+	D3DX10_IMAGE_LOAD_INFO reducedInfo;
+	reducedInfo.FirstMipLevel = 1;
+
+	DXGI_FORMAT format;
+	wstring compressedFileName = CompressedFileName( texture->m_FileName, &format );
+	if (!compressedFileName.empty())
+	{
+		// Use the compressed file if it is newer than the image (or the image is missing)
+		WIN32_FILE_ATTRIBUTE_DATA compressedAttributes, imageAttributes;
+		if (GetFileAttributesExW( compressedFileName.c_str(), GetFileExInfoStandard, &compressedAttributes ) &&
+		    (!GetFileAttributesExW( texture->m_FileName.c_str(), GetFileExInfoStandard, &imageAttributes ) ||
+		     CompareFileTime( &compressedAttributes.ftLastWriteTime, &imageAttributes.ftLastWriteTime ) >= 0))
+		{
+			HRESULT hr = D3DX10CreateShaderResourceViewFromFile( g_pd3dDevice, compressedFileName.c_str(), overBudget ? &reducedInfo : NULL,
+			                                                     m_ThreadPump, view, result );
+			if (SUCCEEDED( hr )) return true;
+		}
+
+		// Otherwise convert the image - the worker threads decode it, build the mip-maps and compress them. D3DX's defaults give the
+		// full mip chain
+		D3DX10_IMAGE_LOAD_INFO loadInfo;
+		loadInfo.Format = format;
+		loadInfo.BindFlags = D3D10_BIND_SHADER_RESOURCE;
+		texture->m_ConvertResult = E_PENDING;
+		HRESULT hr = D3DX10CreateTextureFromFile( g_pd3dDevice, texture->m_FileName.c_str(), &loadInfo, m_ThreadPump,
+		                                          &texture->m_ConvertResource, &texture->m_ConvertResult );
+		if (SUCCEEDED( hr ))
+		{
+			texture->m_Converting = true;
+			return true;
+		}
+	}
+
+	// DDS files, and images that couldn't be converted, load as they are. Only files with mip-maps can leave out the top level, reading
+	// the header is quick
+	D3DX10_IMAGE_INFO imageInfo;
+	if (overBudget && (FAILED( D3DX10GetImageInfoFromFile( texture->m_FileName.c_str(), NULL, &imageInfo, NULL ) ) || imageInfo.MipLevels <= 1))
+	{
+		overBudget = false;
+	}
+	HRESULT hr = D3DX10CreateShaderResourceViewFromFile( g_pd3dDevice, texture->m_FileName.c_str(), overBudget ? &reducedInfo : NULL,
+	                                                     m_ThreadPump, view, result );
+	if (FAILED( hr ))
+	{
+		*result = hr;
+		return false;
+	}
+	return true;
+}
+
+// Save a texture converted by StartLoad as its compressed file and create the texture's view (or reload view) of it. If the
+// conversion failed the image file is loaded as it is instead
+void CTextureManager::CompleteConversion( CTexture* texture )
+{
+	// Conversions are only started for loads and reloads, and a reload only starts after the load has completed
+	texture->m_Converting = false;
+	bool reload = texture->m_Reloading;
+	ID3D10ShaderResourceView** view = reload ? &texture->m_ReloadView : &texture->m_View;
+	HRESULT* result = reload ? &texture->m_ReloadResult : &texture->m_LoadResult;
+
+	if (SUCCEEDED( texture->m_ConvertResult ) && texture->m_ConvertResource)
+	{
+		// Saving reads the texture back through the device so must be done here on the render thread. It only happens once for each
+		// image, the next run loads the compressed file. Failing to save just means converting again next time
+		wstring compressedFileName = CompressedFileName( texture->m_FileName );
+		if (FAILED( D3DX10SaveTextureToFileW( texture->m_ConvertResource, D3DX10_IFF_DDS, compressedFileName.c_str() ) ))
+		{
+			OutputDebugString( (L"Failed to save compressed texture: " + compressedFileName + L"\n").c_str() );
+		}
+		*result = g_pd3dDevice->CreateShaderResourceView( texture->m_ConvertResource, NULL, view );
+		SAFE_RELEASE( texture->m_ConvertResource );
+		return;
+	}
+
+	// E.g. image sizes that can't be block-compressed (the top level must be a multiple of 4 texels)
+	OutputDebugString( (L"Failed to compress texture: " + texture->m_FileName + L"\n").c_str() );
+	SAFE_RELEASE( texture->m_ConvertResource );
+	HRESULT hr = D3DX10CreateShaderResourceViewFromFile( g_pd3dDevice, texture->m_FileName.c_str(), NULL, m_ThreadPump, view, result );
+	if (FAILED( hr ))
+	{
+		*result = hr;
+	}
+}
+
+// Start loading a texture's file again into its reload view
+void CTextureManager::StartReload( CTexture* texture )
+{
+	texture->m_ReloadAgain = false;
+	if (StartLoad( texture, true ))
+	{
+		texture->m_Reloading = true;
+		++m_NumPending;
+	}
+}
+
+// Name of the compressed file for an image file, or an empty string for files that are already DDS. Images that can't hold alpha
+// (JPEG, BMP) are compressed to BC1, the rest to BC3 so they keep their alpha
+wstring CTextureManager::CompressedFileName( const wstring& fileName, DXGI_FORMAT* format /*= NULL*/ )
+{
+	wstring::size_type dot = fileName.find_last_of( L'.' );
+	const wchar_t* extension = (dot == wstring::npos) ? L"" : fileName.c_str() + dot;
+	if (_wcsicmp( extension, L".dds" ) == 0)
+	{
+		return wstring();
+	}
+	if (format)
+	{
+		bool noAlpha = _wcsicmp( extension, L".jpg" ) == 0 || _wcsicmp( extension, L".jpeg" ) == 0 || _wcsicmp( extension, L".bmp" ) == 0;
+		*format = noAlpha ? DXGI_FORMAT_BC1_UNORM : DXGI_FORMAT_BC3_UNORM;
+	}
+	return fileName + L".bc.dds";
+}
@@ -0,0 +1,175 @@
+//--------------------------------------------------------------------------------------
+//	TextureManager.h
+//
+//	The texture manager loads each texture file once, shares it between users and decodes
+//	files on worker threads. A placeholder is used until a texture has finished loading.
+//	Image files are converted to block-compressed DDS files with mip-maps the first time
+//	they are loaded, later loads use the DDS while it is up to date
+//--------------------------------------------------------------------------------------
+
+#ifndef TEXTURE_MANAGER_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define TEXTURE_MANAGER_H_INCLUDED
+
+#include <string>
+#include <map>
+using namespace std;
+
+#include <d3d10.h>
+#include <d3dx10.h>
+
+
+// A texture handed out by the texture manager. The view may change when loading finishes, so users should fetch the view when
+// they need it rather than storing it
+class CTexture
+{
+	friend class CTextureManager;
+
+public:
+	// Get the texture's shader resource view, or the manager's placeholder if it hasn't loaded (or failed to load)
+	ID3D10ShaderResourceView* GetView()
+	{
+		return m_View ? m_View : m_Placeholder;
+	}
+
+	// Has the texture finished loading (successfully or not)
+	bool IsLoaded()
+	{
+		return m_Loaded;
+	}
+
+	const wstring& GetFileName()
+	{
+		return m_FileName;
+	}
+
+private:
+	CTexture()
+	{
+		m_View = NULL;
+		m_Placeholder = NULL;
+		m_LoadResult = S_OK;
+		m_Loaded = false;
+		m_ReloadView = NULL;
+		m_ReloadResult = S_OK;
+		m_Reloading = false;
+		m_ReloadAgain = false;
+		m_ConvertResource = NULL;
+		m_ConvertResult = S_OK;
+		m_Converting = false;
+	}
+
+	wstring                   m_FileName;
+	ID3D10ShaderResourceView* m_View;        // Filled in by the D3DX thread pump when loading completes
+	ID3D10ShaderResourceView* m_Placeholder; // Used until then
+	HRESULT                   m_LoadResult;  // --"--
+	bool                      m_Loaded;
+
+	// A reload (see CTextureManager::ReloadTexture) loads into its own view, which replaces the current view once it completes. A
+	// reload asked for while a load is in progress is started when that load completes
+	ID3D10ShaderResourceView* m_ReloadView;
+	HRESULT                   m_ReloadResult;
+	bool                      m_Reloading;
+	bool                      m_ReloadAgain;
+
+	// A load (or reload) without an up to date compressed file first loads the image into a compressed texture with mip-maps, which
+	// is saved as the compressed file on the render thread then used as the view (see CTextureManager::StartLoad)
+	ID3D10Resource*           m_ConvertResource;
+	HRESULT                   m_ConvertResult;
+	bool                      m_Converting;
+};
+
+
+class CTextureManager
+{
+/////////////////////////////
+// Private member variables
+private:
+
+	// D3DX thread pump - decodes texture files on worker threads. The final device work (creating the texture from the decoded
+	// data) happens on the render thread in Update
+	ID3DX10ThreadPump*        m_ThreadPump;
+
+	// View used in place of textures still loading: a single mid-grey texel with no specular (alpha 0)
+	ID3D10Texture2D*          m_PlaceholderTexture;
+	ID3D10ShaderResourceView* m_Placeholder;
+
+	// All textures requested so far, keyed by file name
+	typedef map<wstring, CTexture*> TTextureMap;
+	TTextureMap               m_Textures;
+
+	// Number of textures still loading
+	unsigned int              m_NumPending;
+
+
+/////////////////////////////
+// Public member functions
+public:
+
+	///////////////////////////////
+	// Constructors / Destructors
+
+	CTextureManager();
+	~CTextureManager();
+
+	// Create the thread pump and placeholder texture. Number of worker threads defaults (0) to the number of processors
+	bool Init( unsigned int numThreads = 0 );
+
+	// Release all textures. Waits for any outstanding loads first
+	void ReleaseResources();
+
+
+	/////////////////////////////
+	// Texture Usage
+
+	// Get a texture, starting it loading on a worker thread if it hasn't been requested before. Returns NULL only if the manager
+	// has not been initialised. Check IsLoaded / GetView on the result
+	CTexture* GetTexture( const wstring& fileName );
+
+	// Call once per frame on the render thread - completes loads that the worker threads have finished decoding
+	void Update();
+
+	// Block until all requested textures have loaded
+	void WaitForAll();
+
+	// Load a texture again after its file has changed. The file name is not case sensitive. The texture keeps its current view until
+	// the new one has loaded, and keeps it if the new load fails. Returns false if the texture has not been requested
+	bool ReloadTexture( const wstring& fileName );
+
+	// Number of textures still loading
+	unsigned int GetNumPending()
+	{
+		return m_NumPending;
+	}
+
+
+/////////////////////////////
+// Private member functions
+private:
+
+	// Mark textures whose loads have been completed by the thread pump, and swap in completed reloads
+	void CheckCompleted();
+
+	// Start loading a texture's file on the thread pump, into its view or its reload view. DDS files are loaded as they are. Other
+	// image files load the compressed file instead (see CompressedFileName) if it is newer than the image, otherwise the image is
+	// converted and the compressed file written when the load completes (see CompleteConversion). Returns false if the load could not
+	// be started
+	bool StartLoad( CTexture* texture, bool reload );
+
+	// Save a texture converted by StartLoad as its compressed file and create the texture's view (or reload view) of it. If the
+	// conversion failed the image file is loaded as it is instead
+	void CompleteConversion( CTexture* texture );
+
+	// Start loading a texture's file again into its reload view
+	void StartReload( CTexture* texture );
+
+	// Name of the compressed file for an image file, or an empty string for files that are already DDS. Images that can't hold alpha
+	// (JPEG, BMP) are compressed to BC1, the rest to BC3 so they keep their alpha
+	static wstring CompressedFileName( const wstring& fileName, DXGI_FORMAT* format = NULL );
+
+	// Disallow use of copy constructor and assignment operator (private and not defined)
+	CTextureManager( const CTextureManager& );
+	CTextureManager& operator=( const CTextureManager& );
+};
+
+
+#endif // End of header guard - see top of file
@@ -0,0 +1,171 @@
+//--------------------------------------------------------------------------------------
+//	UpdateThread.cpp
+//
+//	Runs the simulation (controls, movement, animation) on its own thread at a fixed time
+//	step. Each step publishes a snapshot of the scene's transforms, the render thread
+//	blends the last two snapshots for the time it is drawing
+//--------------------------------------------------------------------------------------
+
+#include <mmsystem.h> // timeBeginPeriod
+
+#include "Defines.h"      // General definitions shared by all source files
+#include "UpdateThread.h" // Declaration of this class
+
+
+///////////////////////////////
+// Constructors / Destructors
+
+CUpdateThread::CUpdateThread()
+{
+	m_Thread = NULL;
+	m_StopEvent = NULL;
+	m_Update = NULL;
+	m_TickTime = 0.0f;
+	m_StartCount.QuadPart = 0;
+	QueryPerformanceFrequency( &m_Frequency );
+	m_NumPublished = 0;
+	InitializeCriticalSection( &m_Lock );
+	InitializeCriticalSection( &m_StepLock );
+}
+
+// Destructor - stops the thread if it is running
+CUpdateThread::~CUpdateThread()
+{
+	Stop();
+	DeleteCriticalSection( &m_StepLock );
+	DeleteCriticalSection( &m_Lock );
+}
+
+
+/////////////////////////////
+// Thread control
+
+// Start calling the update function every tickTime seconds on a new thread. The first step happens straight away
+bool CUpdateThread::Start( TUpdateFunction update, float tickTime )
+{
+	if (m_Thread || !update || tickTime <= 0.0f) return false;
+
+	m_Update = update;
+	m_TickTime = tickTime;
+	m_NumPublished = 0;
+	QueryPerformanceCounter( &m_StartCount );
+
+	// Manual reset so the thread sees the signal however many times it waits
+	m_StopEvent = CreateEvent( NULL, TRUE, FALSE, NULL );
+	if (!m_StopEvent) return false;
+
+	// The thread waits between steps, which is only accurate to about a millisecond with timeBeginPeriod(1)
+	timeBeginPeriod( 1 );
+	m_Thread = CreateThread( NULL, 0, ThreadProc, this, 0, NULL );
+	if (!m_Thread)
+	{
+		timeEndPeriod( 1 );
+		CloseHandle( m_StopEvent );
+		m_StopEvent = NULL;
+		return false;
+	}
+	return true;
+}
+
+// Stop the thread, waits for the current step to finish
+void CUpdateThread::Stop()
+{
+	if (!m_Thread) return;
+
+	SetEvent( m_StopEvent );
+	WaitForSingleObject( m_Thread, INFINITE );
+	CloseHandle( m_Thread );
+	CloseHandle( m_StopEvent );
+	m_Thread = NULL;
+	m_StopEvent = NULL;
+	timeEndPeriod( 1 );
+}
+
+
+// Hold the thread between steps, e.g. while the render thread changes the scene's structure. Waits for the current step to
+// finish. The steps missed are skipped when resumed, as if the thread had fallen behind. Calls must be paired with Resume
+void CUpdateThread::Pause()
+{
+	EnterCriticalSection( &m_StepLock );
+}
+void CUpdateThread::Resume()
+{
+	LeaveCriticalSection( &m_StepLock );
+}
+
+
+/////////////////////////////
+// Snapshots
+
+// Seconds since the thread was started, on the same clock as the snapshot times
+float CUpdateThread::GetTime()
+{
+	LARGE_INTEGER now;
+	QueryPerformanceCounter( &now );
+	return static_cast<float>(static_cast<double>(now.QuadPart - m_StartCount.QuadPart) / m_Frequency.QuadPart);
+}
+
+// Copy the last two published snapshots. Returns false until two steps have been published
+bool CUpdateThread::GetSnapshots( SUpdateSnapshot& previous, SUpdateSnapshot& latest )
+{
+	EnterCriticalSection( &m_Lock );
+	bool available = m_NumPublished >= 2;
+	if (available)
+	{
+		previous = m_Snapshots[0];
+		latest = m_Snapshots[1];
+	}
+	LeaveCriticalSection( &m_Lock );
+	return available;
+}
+
+
+/////////////////////////////
+// Private member functions
+
+// Run the fixed steps until the stop event is signalled
+void CUpdateThread::Run()
+{
+	// Steps are scheduled at exact multiples of the tick time so the simulation doesn't drift from real time. If the thread falls
+	// behind (e.g. the process was suspended) it skips ahead rather than running many steps to catch up
+	unsigned int step = 0;
+	for (;;)
+	{
+		float stepTime = step * m_TickTime;
+		float wait = stepTime - GetTime();
+		if (wait > 0.0f)
+		{
+			if (WaitForSingleObject( m_StopEvent, static_cast<DWORD>(wait * 1000.0f) ) == WAIT_OBJECT_0) return;
+		}
+		else if (WaitForSingleObject( m_StopEvent, 0 ) == WAIT_OBJECT_0)
+		{
+			return;
+		}
+		else if (-wait > 4 * m_TickTime)
+		{
+			step = static_cast<unsigned int>(GetTime() / m_TickTime);
+			stepTime = step * m_TickTime;
+		}
+
+		// Build the snapshot outside the lock, the render thread only waits for the copy. A pause may have held the step up, in
+		// which case it is late but still runs (the next wait catches up)
+		EnterCriticalSection( &m_StepLock );
+		m_Update( m_TickTime, m_Pending );
+		LeaveCriticalSection( &m_StepLock );
+		m_Pending.time = stepTime;
+
+		EnterCriticalSection( &m_Lock );
+		m_Snapshots[0] = m_Snapshots[1];
+		m_Snapshots[1] = m_Pending;
+		++m_NumPublished;
+		LeaveCriticalSection( &m_Lock );
+
+		++step;
+	}
+}
+
+DWORD WINAPI CUpdateThread::ThreadProc( LPVOID param )
+{
+	static_cast<CUpdateThread*>(param)->Run();
+	return 0;
+}
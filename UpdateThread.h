@@ -0,0 +1,126 @@
+//--------------------------------------------------------------------------------------
+//	UpdateThread.h
+//
+//	Runs the simulation (controls, movement, animation) on its own thread at a fixed time
+//	step. Each step publishes a snapshot of the scene's transforms, the render thread
+//	blends the last two snapshots for the time it is drawing
+//--------------------------------------------------------------------------------------
+
+#ifndef UPDATE_THREAD_H_INCLUDED // Header guard - prevents file being included more than once (would cause errors)
+#define UPDATE_THREAD_H_INCLUDED
+
+#include <vector>
+using namespace std;
+
+#include <windows.h>
+#include "CQuatTransform.h" // Maths library quaternion transform, the snapshot transforms are blended with its slerp
+
+
+// Everything the render thread needs from one simulation step, copied so the update thread can carry on with the next step
+struct SUpdateSnapshot
+{
+	float                       time;            // Simulation time of the step in seconds, on the update thread's clock (see GetTime)
+	vector<gen::CQuatTransform> modelTransforms; // From CScene::GetTransforms
+	gen::CQuatTransform         cameraTransform;
+	float                       interocular;     //**|3D|**
+	LONG                        mouseX;          // Raw mouse totals the camera has turned by (see GetMouseTotal in Input.h)
+	LONG                        mouseY;
+};
+
+// Function called for each simulation step. Given the step length in seconds, it should move everything on by that time then fill
+// in the snapshot (other than the time)
+typedef void (*TUpdateFunction)( float tickTime, SUpdateSnapshot& snapshot );
+
+
+class CUpdateThread
+{
+/////////////////////////////
+// Private member variables
+private:
+
+	HANDLE           m_Thread;
+	HANDLE           m_StopEvent; // Signalled to end the thread, also used as its timer so it can be stopped mid-wait
+
+	TUpdateFunction  m_Update;
+	float            m_TickTime;
+
+	// Performance counter value at the start, and counts per second. Both threads read the time from here
+	LARGE_INTEGER    m_StartCount;
+	LARGE_INTEGER    m_Frequency;
+
+	// The last two published snapshots, previous then latest, and the number published so far. Guarded by the lock, the update
+	// thread builds each snapshot in m_Pending first so the lock is only held for the copy
+	CRITICAL_SECTION m_Lock;
+	SUpdateSnapshot  m_Snapshots[2];
+	unsigned int     m_NumPublished;
+	SUpdateSnapshot  m_Pending;
+
+	// Held by the update thread for each step, and by the render thread while it has the thread paused (see Pause)
+	CRITICAL_SECTION m_StepLock;
+
+
+/////////////////////////////
+// Public member functions
+public:
+
+	///////////////////////////////
+	// Constructors / Destructors
+
+	CUpdateThread();
+
+	// Destructor - stops the thread if it is running
+	~CUpdateThread();
+
+private:
+	// Disallow use of copy constructor and assignment operator (private and not defined)
+	CUpdateThread( const CUpdateThread& );
+	CUpdateThread& operator=( const CUpdateThread& );
+
+public:
+
+	/////////////////////////////
+	// Thread control
+
+	// Start calling the update function every tickTime seconds on a new thread. The first step happens straight away
+	bool Start( TUpdateFunction update, float tickTime );
+
+	// Stop the thread, waits for the current step to finish
+	void Stop();
+
+	bool IsRunning()
+	{
+		return m_Thread != NULL;
+	}
+
+	// Hold the thread between steps, e.g. while the render thread changes the scene's structure. Waits for the current step to
+	// finish. The steps missed are skipped when resumed, as if the thread had fallen behind. Calls must be paired with Resume
+	void Pause();
+	void Resume();
+
+
+	/////////////////////////////
+	// Snapshots
+
+	// Seconds since the thread was started, on the same clock as the snapshot times
+	float GetTime();
+
+	float GetTickTime()
+	{
+		return m_TickTime;
+	}
+
+	// Copy the last two published snapshots. Returns false until two steps have been published
+	bool GetSnapshots( SUpdateSnapshot& previous, SUpdateSnapshot& latest );
+
+
+/////////////////////////////
+// Private member functions
+private:
+
+	// Run the fixed steps until the stop event is signalled
+	void Run();
+	static DWORD WINAPI ThreadProc( LPVOID param );
+};
+
+
+#endif // End of header guard - see top of file